@@ -0,0 +1,63 @@
+/*
+ * arena.c
+ *
+ *  Double-ended bump allocator.
+ */
+
+#include "arena.h"
+
+#include <stddef.h>
+
+#define ALIGN_UP(n)     (((n) + ARENA_ALIGN - 1) & ~(uint32_t)(ARENA_ALIGN - 1))
+
+static void note_use(Arena *arena) {
+    if (arena->bottom + arena->top > arena->high_water) {
+        arena->high_water = arena->bottom + arena->top;
+    }
+}
+
+// Arena Init
+void arena_init(Arena *arena, void *mem, uint32_t size) {
+    arena->base = (uint8_t *)mem;
+    arena->size = size & ~(uint32_t)(ARENA_ALIGN - 1);
+    arena->bottom = 0;
+    arena->top = 0;
+    arena->high_water = 0;
+    arena->failures = 0;
+}
+
+// Arena Alloc
+void *arena_alloc(Arena *arena, uint32_t bytes) {
+    uint32_t need = ALIGN_UP(bytes);
+    void *p;
+    if (need > arena_free_bytes(arena)) {
+        arena->failures++;
+        return NULL;
+    }
+    p = arena->base + arena->bottom;
+    arena->bottom += need;
+    note_use(arena);
+    return p;
+}
+
+// Arena Alloc Top
+void *arena_alloc_top(Arena *arena, uint32_t bytes) {
+    uint32_t need = ALIGN_UP(bytes);
+    if (need > arena_free_bytes(arena)) {
+        arena->failures++;
+        return NULL;
+    }
+    arena->top += need;
+    note_use(arena);
+    return arena->base + arena->size - arena->top;
+}
+
+// Arena Reset
+void arena_reset(Arena *arena) {
+    arena->bottom = 0;
+}
+
+// Arena Free
+uint32_t arena_free_bytes(const Arena *arena) {
+    return arena->size - arena->bottom - arena->top;
+}
@@ -0,0 +1,40 @@
+/*
+ * arena.h
+ *
+ *  Double-ended bump allocator over a fixed block of memory. Short-lived
+ *  data (the platforms of the current map) is taken from the bottom and
+ *  released all at once by arena_reset(); long-lived buffers are taken from
+ *  the top and stay until arena_init(). Allocation never blocks or
+ *  fragments, a request that doesn't fit simply returns NULL.
+ */
+
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <stdint.h>
+
+#define ARENA_ALIGN     8
+
+typedef struct {
+    uint8_t *base;
+    uint32_t size;
+    uint32_t bottom;        /* Bytes in use from the start */
+    uint32_t top;           /* Bytes in use from the end */
+    uint32_t high_water;    /* Most bytes in use at once since arena_init */
+    uint32_t failures;      /* Requests that didn't fit */
+} Arena;
+
+// Manage size bytes at mem, which must be ARENA_ALIGN aligned
+void arena_init(Arena *arena, void *mem, uint32_t size);
+
+// Allocate from the bottom or the top, NULL if there isn't room
+void *arena_alloc(Arena *arena, uint32_t bytes);
+void *arena_alloc_top(Arena *arena, uint32_t bytes);
+
+// Free every bottom allocation, O(1)
+void arena_reset(Arena *arena);
+
+// Bytes still free between the two ends
+uint32_t arena_free_bytes(const Arena *arena);
+
+#endif /* ARENA_H_ */
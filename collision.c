@@ -0,0 +1,103 @@
+/*
+ * collision.c
+ *
+ *  Swept collision against the level bitboard.
+ */
+
+#include "collision.h"
+#include "dist_field.h"
+
+// Count leading zeros of a non-zero word
+static int clz64(uint64_t v) {
+    int n = 0;
+    if (!(v & 0xFFFFFFFF00000000)) { n += 32; v <<= 32; }
+    if (!(v & 0xFFFF000000000000)) { n += 16; v <<= 16; }
+    if (!(v & 0xFF00000000000000)) { n += 8;  v <<= 8;  }
+    if (!(v & 0xF000000000000000)) { n += 4;  v <<= 4;  }
+    if (!(v & 0xC000000000000000)) { n += 2;  v <<= 2;  }
+    if (!(v & 0x8000000000000000)) { n += 1; }
+    return n;
+}
+
+// Count trailing zeros of a non-zero word
+static int ctz64(uint64_t v) {
+    int n = 0;
+    if (!(v & 0x00000000FFFFFFFF)) { n += 32; v >>= 32; }
+    if (!(v & 0x000000000000FFFF)) { n += 16; v >>= 16; }
+    if (!(v & 0x00000000000000FF)) { n += 8;  v >>= 8;  }
+    if (!(v & 0x000000000000000F)) { n += 4;  v >>= 4;  }
+    if (!(v & 0x0000000000000003)) { n += 2;  v >>= 2;  }
+    if (!(v & 0x0000000000000001)) { n += 1; }
+    return n;
+}
+
+// Solid bits of one map word restricted to columns x_first..x_last
+static uint64_t span_bits(const uint64_t *map, int row, int word, int x_first, int x_last) {
+    int a = x_first - word * 64, b = x_last - word * 64;
+    if (a < 0) a = 0;
+    if (b > 63) b = 63;
+    if (a > b) return 0;
+    return map[row * 2 + word] & (0xFFFFFFFFFFFFFFFF >> a) & (0xFFFFFFFFFFFFFFFF << (63 - b));
+}
+
+// First Solid Column in Span
+int span_first_solid(const uint64_t *map, int row, int x_first, int x_last) {
+    int word;
+    if (row < 0 || row > 127) return -1;
+    for (word = 0; word < 2; word++) {
+        uint64_t bits = span_bits(map, row, word, x_first, x_last);
+        if (bits) return word * 64 + clz64(bits);
+    }
+    return -1;
+}
+
+// Last Solid Column in Span
+int span_last_solid(const uint64_t *map, int row, int x_first, int x_last) {
+    int word;
+    if (row < 0 || row > 127) return -1;
+    for (word = 1; word >= 0; word--) {
+        uint64_t bits = span_bits(map, row, word, x_first, x_last);
+        if (bits) return word * 64 + 63 - ctz64(bits);
+    }
+    return -1;
+}
+
+// Sweep Down
+int sweep_down(const uint64_t *map, int x_first, int x_last, int y0, int y1, int radius) {
+    int top = (y0 < y1) ? y0 : y1;
+    int bottom = ((y0 < y1) ? y1 : y0) + radius;
+    if (top < 0) top = 0;
+    if (bottom > 127) bottom = 127;
+    if (top > bottom) return -1;
+#if DIST_FIELD_ENABLE
+    (void)map;
+    uint8_t d = dist_field_min_below(top, x_first, x_last);
+    if (d != DIST_NONE && top + d <= bottom) return top + d;
+#else
+    int row;
+    for (row = top; row <= bottom; row++) {
+        if (span_first_solid(map, row, x_first, x_last) >= 0) return row;
+    }
+#endif
+    return -1;
+}
+
+// Sweep Up
+int sweep_up(const uint64_t *map, int x_first, int x_last, int y0, int y1, int radius) {
+    int bottom = (y0 < y1) ? y1 : y0;
+    int top = ((y0 < y1) ? y0 : y1) - radius;
+    if (top < 1) top = 1;
+    if (bottom > 127) bottom = 127;
+    if (top > bottom) return -1;
+#if DIST_FIELD_ENABLE
+    (void)map;
+    uint8_t d = dist_field_min_above(bottom, x_first, x_last);
+    if (d != DIST_NONE && bottom - d >= top) return bottom - d;
+#else
+    int row;
+    for (row = bottom; row >= top; row--) {
+        if (span_first_solid(map, row, x_first, x_last) >= 0) return row;
+    }
+#endif
+    return -1;
+}
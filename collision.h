@@ -0,0 +1,31 @@
+/*
+ * collision.h
+ *
+ *  Swept collision against the 128x128 level bitboard. Movement is resolved
+ *  one axis at a time by testing every pixel the character passes over
+ *  during the tick, so fast movement can't skip over thin platforms.
+ *
+ *  Cost per tick is bounded by the board, not the speed: a horizontal sweep
+ *  is at most two masked word tests, a vertical sweep is one masked test per
+ *  row crossed (at most 128), or a min over the character's columns when the
+ *  distance fields are enabled.
+ */
+
+#ifndef COLLISION_H_
+#define COLLISION_H_
+
+#include <stdint.h>
+
+// First/last solid column in x_first..x_last of a map row, -1 if none
+int span_first_solid(const uint64_t *map, int row, int x_first, int x_last);
+int span_last_solid(const uint64_t *map, int row, int x_first, int x_last);
+
+// Character of the given radius falling from center row y0 to y1 over
+// columns x_first..x_last. Returns the first solid row hit, -1 if none.
+int sweep_down(const uint64_t *map, int x_first, int x_last, int y0, int y1, int radius);
+
+// Character rising from center row y0 to y1. Returns the first solid row
+// hit (row 0 is never reported, matching the old ceiling scan), -1 if none.
+int sweep_up(const uint64_t *map, int x_first, int x_last, int y0, int y1, int radius);
+
+#endif /* COLLISION_H_ */
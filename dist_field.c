@@ -0,0 +1,111 @@
+/*
+ * dist_field.c
+ *
+ *  Per-column distance tables for ground and ceiling queries.
+ */
+
+#include "dist_field.h"
+
+#if DIST_FIELD_ENABLE
+
+uint8_t dist_below[DIST_FIELD_ROWS][DIST_FIELD_COLS];
+uint8_t dist_above[DIST_FIELD_ROWS][DIST_FIELD_COLS];
+
+// Map pixel test, same layout as the rest of the game (2 words per row)
+static inline int pixel_set(const uint64_t *map, int x, int y) {
+    return ((map[y * 2 + (x / 64)] << (x % 64)) & 0x8000000000000000) != 0;
+}
+
+// Rebuild a single column of both tables
+static void build_col(const uint64_t *map, int x) {
+    int y;
+    uint8_t d = DIST_NONE;
+
+    for (y = DIST_FIELD_ROWS - 1; y >= 0; y--) {
+        if (pixel_set(map, x, y)) {
+            d = 0;
+        } else if (d != DIST_NONE) {
+            d++;
+        }
+        dist_below[y][x] = d;
+    }
+
+    d = DIST_NONE;
+    for (y = 0; y < DIST_FIELD_ROWS; y++) {
+        if (pixel_set(map, x, y)) {
+            d = 0;
+        } else if (d != DIST_NONE) {
+            d++;
+        }
+        dist_above[y][x] = d;
+    }
+}
+
+// Build Distance Fields
+void dist_field_build(const uint64_t *map) {
+    int x;
+    for (x = 0; x < DIST_FIELD_COLS; x++) {
+        build_col(map, x);
+    }
+}
+
+// Update Distance Field Columns
+void dist_field_update_mask(const uint64_t *map, const uint64_t *changed) {
+    int x;
+    for (x = 0; x < DIST_FIELD_COLS; x++) {
+        if ((changed[x / 64] << (x % 64)) & 0x8000000000000000) {
+            build_col(map, x);
+        }
+    }
+}
+
+// Nearest Ground Below Row
+uint8_t dist_field_min_below(int row, int x_first, int x_last) {
+    int x;
+    uint8_t d = DIST_NONE;
+    for (x = x_first; x <= x_last; x++) {
+        if (dist_below[row][x] < d) d = dist_below[row][x];
+    }
+    return d;
+}
+
+// Nearest Ceiling Above Row
+uint8_t dist_field_min_above(int row, int x_first, int x_last) {
+    int x;
+    uint8_t d = DIST_NONE;
+    for (x = x_first; x <= x_last; x++) {
+        if (dist_above[row][x] < d) d = dist_above[row][x];
+    }
+    return d;
+}
+
+// Verify Distance Fields
+int dist_field_verify(const uint64_t *map) {
+    int x, y, r, mismatches = 0;
+    for (x = 0; x < DIST_FIELD_COLS; x++) {
+        for (y = 0; y < DIST_FIELD_ROWS; y++) {
+            uint8_t below = DIST_NONE, above = DIST_NONE;
+            for (r = y; r < DIST_FIELD_ROWS; r++) {
+                if (pixel_set(map, x, r)) {
+                    below = r - y;
+                    break;
+                }
+            }
+            for (r = y; r >= 0; r--) {
+                if (pixel_set(map, x, r)) {
+                    above = y - r;
+                    break;
+                }
+            }
+            if (dist_below[y][x] != below) mismatches++;
+            if (dist_above[y][x] != above) mismatches++;
+        }
+    }
+    return mismatches;
+}
+
+unsigned int dist_field_bytes(void) {
+    return sizeof(dist_below) + sizeof(dist_above);
+}
+
+#endif
@@ -0,0 +1,47 @@
+/*
+ * dist_field.h
+ *
+ *  Per-column distance tables for the 128x128 level bitboard. For every
+ *  pixel the tables hold the number of rows to the nearest solid pixel at
+ *  or below (dist_below) and at or above (dist_above) it in the same column,
+ *  so ground snapping and ceiling bumps become lookups instead of scans.
+ */
+
+#ifndef DIST_FIELD_H_
+#define DIST_FIELD_H_
+
+#include <stdint.h>
+
+// Set to 1 to trade 32 KB of SRAM for the tables, else the map is scanned
+#ifndef DIST_FIELD_ENABLE
+#define DIST_FIELD_ENABLE   0
+#endif
+
+#define DIST_FIELD_ROWS     128
+#define DIST_FIELD_COLS     128
+#define DIST_NONE           0xFF    /* No solid pixel in that direction */
+
+#if DIST_FIELD_ENABLE
+
+extern uint8_t dist_below[DIST_FIELD_ROWS][DIST_FIELD_COLS];
+extern uint8_t dist_above[DIST_FIELD_ROWS][DIST_FIELD_COLS];
+
+// Rebuild both tables from a level map (static and moving platforms only)
+void dist_field_build(const uint64_t *map);
+
+// Recompute the columns whose bits are set in a row mask (2 words, map layout)
+void dist_field_update_mask(const uint64_t *map, const uint64_t *changed);
+
+// Smallest dist_below/dist_above over columns x_first..x_last of a row
+uint8_t dist_field_min_below(int row, int x_first, int x_last);
+uint8_t dist_field_min_above(int row, int x_first, int x_last);
+
+// Compare every entry against a brute-force scan, returns mismatch count
+int dist_field_verify(const uint64_t *map);
+
+// Bytes of SRAM used by the tables
+unsigned int dist_field_bytes(void);
+
+#endif
+
+#endif /* DIST_FIELD_H_ */
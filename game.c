@@ -0,0 +1,426 @@
+/*
+ * game.c
+ *
+ *  Headless game core: level loading, physics and platform updates.
+ */
+
+#include "game.h"
+
+#include <string.h>
+#include <math.h>
+
+#include "oled_test.h"
+#include "dist_field.h"
+#include "collision.h"
+#include "plat_index.h"
+#include "procgen.h"
+
+uint64_t (*game_clock)(void) = 0;
+uint64_t game_phase_time[PHASE_COUNT];
+
+// Charge the time since *mark to a phase when timing is enabled
+static inline void phase_end(GamePhase phase, uint64_t *mark) {
+    if (game_clock) {
+        uint64_t now = game_clock();
+        game_phase_time[phase] += now - *mark;
+        *mark = now;
+    }
+}
+
+// Create Static Platform
+Platform create_static_platform(uint8_t x, uint8_t y, uint8_t length, uint8_t thickness) {
+    Platform plat = {length, thickness, x, y};
+    return plat;
+}
+
+// Create Movable Platform
+MovablePlatform create_mov_platform(uint8_t x, uint8_t y, uint8_t length, uint8_t thickness, uint8_t x_min, uint8_t x_max) {
+    MovablePlatform mov_plat = {{length, thickness, x, y}, x_min, x_max};
+    return mov_plat;
+}
+
+// Load Level
+void load_level(uint64_t *map, uint64_t *prev_map, const Platform *st_plats, uint8_t num_st_plats, MovablePlatform *mov_plats, uint8_t num_mov_plats, const uint64_t *raster, PlatIndex *index) {
+    uint8_t i, j, k;
+    int map_idx;
+    // Pre-rasterized levels start from their static rows, the rest draw them
+    uint8_t num_drawn = raster ? 0 : num_st_plats;
+    for (map_idx = 0; map_idx < 256; map_idx++) {
+        map[map_idx] = raster ? raster[map_idx] : 0;
+        if (raster) {
+            prev_map[map_idx] &= ~raster[map_idx];
+        }
+    }
+    for (i = 0; i < num_drawn; i++) {
+        for (k = 0; k < st_plats[i].thickness; k++) {
+            for (j = 0; j < st_plats[i].length; j++) {
+                uint8_t y = st_plats[i].y + k;
+                uint8_t x = st_plats[i].x + j;
+                uint64_t mask = 0x8000000000000000 >> (x % 64);
+                map[(y) * 2 + ((x) / 64)] |= mask;
+                uint64_t delete_mask = ~(0x8000000000000000 >> ((x) % 64));
+                prev_map[(y) * 2 + ((x) / 64)] &= delete_mask;
+            }
+        }
+    }
+    for (i = 0; i < num_mov_plats; i++) {
+        for (k = 0; k < mov_plats[i].plat.thickness; k++) {
+            for (j = 0; j < mov_plats[i].plat.length; j++) {
+                uint8_t y = mov_plats[i].plat.y + k;
+                uint8_t x = mov_plats[i].plat.x + j;
+                uint64_t mask = 0x8000000000000000 >> (x % 64);
+                map[(y) * 2 + ((x) / 64)] |= mask;
+                uint64_t delete_mask = ~(0x8000000000000000 >> ((x) % 64));
+                prev_map[(y) * 2 + ((x) / 64)] &= delete_mask;
+            }
+        }
+    }
+#if DIST_FIELD_ENABLE
+    dist_field_build(map);
+#endif
+    if (index) {
+        plat_index_clear(index);
+        for (i = 0; i < num_st_plats; i++) {
+            plat_index_add(index, i, st_plats[i].x, st_plats[i].y, st_plats[i].length, st_plats[i].thickness);
+        }
+        for (i = 0; i < num_mov_plats; i++) {
+            plat_index_add(index, PLAT_MOVING | i, mov_plats[i].plat.x, mov_plats[i].plat.y, mov_plats[i].plat.length, mov_plats[i].plat.thickness);
+        }
+    }
+}
+
+// Update Platforms
+void update_platforms(MovablePlatform *mov_plats, uint8_t num_plats, int tilt, uint64_t *map, PlatIndex *index) {
+    int i, y, x;
+    if (tilt != 0) {
+        for (i = 0; i < num_plats; i++) {
+            int old_x = mov_plats[i].plat.x;
+            // Clamp before storing so a big tilt can't wrap the uint8_t past x_min
+            int new_x = old_x + tilt;
+            if (new_x > mov_plats[i].x_max) {
+                new_x = mov_plats[i].x_max;
+            } else if (new_x < mov_plats[i].x_min) {
+                new_x = mov_plats[i].x_min;
+            }
+            mov_plats[i].plat.x = new_x;
+#if DIST_FIELD_ENABLE
+            // Pixels the redraw changes, usually just the platform's two edges,
+            // but anything else on its rows within its range is cleared too
+            uint64_t changed[2] = {0, 0};
+#endif
+            for (y = mov_plats[i].plat.y; y < mov_plats[i].plat.y + mov_plats[i].plat.thickness; y++) {
+#if DIST_FIELD_ENABLE
+                uint64_t before[2] = {map[y * 2], map[y * 2 + 1]};
+#endif
+                for (x = mov_plats[i].x_min; x < mov_plats[i].x_max + mov_plats[i].plat.length; x++) {
+                    if (x < mov_plats[i].plat.x || x >= mov_plats[i].plat.x + mov_plats[i].plat.length) {
+                        uint64_t delete_mask = ~(0x8000000000000000 >> ((x) % 64));
+                        map[(y) * 2 + ((x) / 64)] &= delete_mask;
+                    } else {
+                        map[(y) * 2 + ((x) / 64)] |= 0x8000000000000000 >> (x % 64);
+                    }
+                }
+#if DIST_FIELD_ENABLE
+                changed[0] |= before[0] ^ map[y * 2];
+                changed[1] |= before[1] ^ map[y * 2 + 1];
+#endif
+            }
+#if DIST_FIELD_ENABLE
+            dist_field_update_mask(map, changed);
+#endif
+            if (index) {
+                plat_index_move(index, PLAT_MOVING | i, old_x, new_x, mov_plats[i].plat.y, mov_plats[i].plat.length, mov_plats[i].plat.thickness);
+            }
+        }
+    }
+}
+
+// Game Init
+void game_init(GameState *game) {
+    memset(game, 0, sizeof(*game));
+    game->gravity = 1;
+    game->x_speed = 5;
+    game->jump_speed = 8;
+    game->term_vel = 5;
+    game->character_radius = 5;
+    game->ride_platforms = RIDE_PLATFORMS;
+    game->on_ground = 1;
+    game->color = WHITE;
+    game->x_pos = 64;
+    game->y_pos = 127 - game->character_radius;
+
+    // The diff lives for the whole session, levels come and go below it
+    arena_init(&game->arena, game->arena_mem, sizeof(game->arena_mem));
+    game->diff = arena_alloc_top(&game->arena, sizeof(RenderDiff));
+}
+
+// Reset Levels
+void game_reset_levels(GameState *game) {
+    arena_reset(&game->arena);
+    memset(game->num_st_platforms, 0, sizeof(game->num_st_platforms));
+    memset(game->num_mov_platforms, 0, sizeof(game->num_mov_platforms));
+    memset(game->static_plats, 0, sizeof(game->static_plats));
+    memset(game->mov_plats, 0, sizeof(game->mov_plats));
+    memset(game->raster, 0, sizeof(game->raster));
+}
+
+// Alloc Static
+Platform *game_alloc_static(GameState *game, uint8_t level, uint8_t count) {
+    Platform *plats = arena_alloc(&game->arena, count * sizeof(Platform));
+    game->static_plats[level] = plats;
+    game->num_st_platforms[level] = plats ? count : 0;
+    return plats;
+}
+
+// Alloc Moving
+MovablePlatform *game_alloc_moving(GameState *game, uint8_t level, uint8_t count) {
+    MovablePlatform *plats = arena_alloc(&game->arena, count * sizeof(MovablePlatform));
+    game->mov_plats[level] = plats;
+    game->num_mov_platforms[level] = plats ? count : 0;
+    return plats;
+}
+
+// Set Level
+int game_set_level(GameState *game, uint8_t level, const LevelTable *table) {
+    MovablePlatform *mov = game_alloc_moving(game, level, table->num_mov);
+    if (!mov) {
+        game->num_st_platforms[level] = 0;
+        game->raster[level] = 0;
+        return -1;
+    }
+    if (table->num_mov) {
+        memcpy(mov, table->mov_plats, table->num_mov * sizeof(MovablePlatform));
+    }
+    game->static_plats[level] = table->st_plats;
+    game->num_st_platforms[level] = table->num_st;
+    game->raster[level] = table->raster;
+    return 0;
+}
+
+// Game Start
+void game_start(GameState *game) {
+    game->level = 0;
+    game->ticks = 0;
+    load_level(game->map, game->prev_map, game->static_plats[0], game->num_st_platforms[0], game->mov_plats[0], game->num_mov_platforms[0], game->raster[0], &game->plat_index);
+}
+
+// Advance to the next level, returns GAME_EVENT_* flags
+static uint8_t next_level(GameState *game) {
+    static const unsigned int endless_colors[4] = {WHITE, CYAN, RED, MAGENTA};
+    uint8_t events = GAME_EVENT_LEVEL;
+    if (game->endless) {
+        // Endless mode makes every level in slot 0 as it is reached
+        game->depth++;
+        game->color = endless_colors[game->depth % 4];
+        game_reset_levels(game);
+        // Clamped here, the depth would wrap the uint8_t difficulty past level 255
+        procgen_level(game, 0, game_endless_seed(game),
+                      (game->depth > PROCGEN_MAX_DIFFICULTY) ? PROCGEN_MAX_DIFFICULTY : game->depth);
+    } else {
+        game->level++;
+        if (game->level == 1) {
+            game->color = CYAN;
+        } else if (game->level == 2) {
+            game->color = RED;
+        }
+        if (game->level == game->num_levels - 1) {
+            game->color = MAGENTA;
+            events |= GAME_EVENT_WIN;
+        } else if (game->level >= game->num_levels) {
+            return GAME_EVENT_DONE;
+        }
+    }
+    load_level(game->map, game->prev_map, game->static_plats[game->level], game->num_st_platforms[game->level], game->mov_plats[game->level], game->num_mov_platforms[game->level], game->raster[game->level], &game->plat_index);
+    game->y_pos = 127 - game->character_radius;
+    return events;
+}
+
+// Horizontal sweep along the current row from prev_x, leading edge first
+static void sweep_x(GameState *game, float prev_x) {
+    uint8_t r = game->character_radius;
+    int x0 = (int)(prev_x), x1 = (int)(game->x_pos), col;
+    int row = (int)(game->y_pos);
+    col = span_first_solid(game->map, row, (x0 < x1) ? x0 : x1, x1 + r);
+    if (col >= 0) {
+        game->x_pos = col - r;
+    }
+    x1 = (int)(game->x_pos);
+    col = span_last_solid(game->map, row, (x1 - r + 1 > 1) ? x1 - r + 1 : 1, (x0 > x1) ? x0 : x1);
+    if (col >= 0) {
+        game->x_pos = col + r;
+    }
+}
+
+// Game Find Platform
+int game_find_platform(const GameState *game, int row, int x_first, int x_last) {
+    const Platform *st_plats = game->static_plats[game->level];
+    const MovablePlatform *mov_plats = game->mov_plats[game->level];
+    int i;
+
+    if (!game->plat_index.overflow) {
+        return plat_index_find(&game->plat_index, row, x_first, x_last);
+    }
+    // Rows with more platforms than slots weren't indexed in full
+    if (x_first > x_last) {
+        return -1;
+    }
+    for (i = 0; i < game->num_st_platforms[game->level]; i++) {
+        if (row >= st_plats[i].y && row < st_plats[i].y + st_plats[i].thickness &&
+            x_last >= st_plats[i].x && x_first < st_plats[i].x + st_plats[i].length) {
+            return i;
+        }
+    }
+    for (i = 0; i < game->num_mov_platforms[game->level]; i++) {
+        if (row >= mov_plats[i].plat.y && row < mov_plats[i].plat.y + mov_plats[i].plat.thickness &&
+            x_last >= mov_plats[i].plat.x && x_first < mov_plats[i].plat.x + mov_plats[i].plat.length) {
+            return PLAT_MOVING | i;
+        }
+    }
+    return -1;
+}
+
+// Game Step
+uint8_t game_step(GameState *game, const Input *input) {
+    uint8_t events = GAME_EVENT_NONE;
+    uint8_t r = game->character_radius;
+    uint64_t mark = game_clock ? game_clock() : 0;
+    int row;
+
+    game->ticks++;
+
+    game->tilt = input->tilt_reg;
+    if (input->tilt_reg > 128) {
+        game->tilt = input->tilt_reg - 256;
+    }
+    game->tilt = -game->tilt / 4;
+
+    if (!input->adc_valid) {
+        phase_end(PHASE_INPUT, &mark);
+        return events;
+    }
+
+    float x_voltage = (((float)((input->adc_sample >> 2) & 0x0FFF)) * 1.4) / 4096;
+    if (x_voltage < 0.55 && x_voltage > .45) {
+        x_voltage = 0.5;
+    }
+    phase_end(PHASE_INPUT, &mark);
+
+    // Start of this tick's motion, the sweeps cover everything in between
+    float prev_x = game->x_pos, prev_y = game->y_pos;
+    game->x_pos -= ((x_voltage - 0.5) * game->x_speed);
+    if (game->x_pos < r) {
+        game->x_pos = r;
+    } else if (game->x_pos > 127 - r) {
+        game->x_pos = 127 - r;
+    }
+    if (game->on_ground == 1 && input->button) {
+        game->y_vel = game->jump_speed;
+        game->on_ground = 0;
+    }
+    game->y_pos -= game->y_vel;
+    game->y_vel -= game->gravity;
+    if (game->y_vel < -game->term_vel) {
+        game->y_vel = -game->term_vel;
+    }
+    if (game->y_pos > 127 - r) {
+        game->y_pos = 127 - r;
+        game->y_vel = 0;
+        game->on_ground = 1;
+    }
+    // Check if user beat level, unless a platform stops the jump first
+    else if (game->y_pos < r && sweep_up(game->map, (int)game->x_pos - r, (int)ceilf(game->x_pos + r) - 1,
+                                         (int)(prev_y), (int)(game->y_pos), r) < 0) {
+        events = next_level(game);
+        if (events & GAME_EVENT_DONE) {
+            return events;
+        }
+        prev_y = game->y_pos;
+    }
+
+    sweep_x(game, prev_x);
+
+    // Vertical sweep over the columns covered by the character, in the
+    // direction moved this tick (y_vel already has next tick's gravity)
+    int x_last = (int)ceilf(game->x_pos + r) - 1;
+    if (game->y_pos >= prev_y) {
+        row = sweep_down(game->map, (int)game->x_pos - r + 1, x_last, (int)(prev_y), (int)(game->y_pos), r);
+        if (row >= 0) {
+            game->y_pos = row - r - 1;
+            game->y_vel = 0;
+            game->on_ground = 1;
+        }
+    } else {
+        row = sweep_up(game->map, (int)game->x_pos - r, x_last, (int)(prev_y), (int)(game->y_pos), r);
+        if (row >= 0) {
+            game->y_pos = row + r + 1;
+            game->y_vel = 0;
+        }
+    }
+    phase_end(PHASE_PHYSICS, &mark);
+
+    // Moving platform under the character's feet, if any
+    MovablePlatform *mov_plats = game->mov_plats[game->level];
+    int ride = -1, ride_x = 0;
+    if (game->ride_platforms && game->on_ground) {
+        int id = game_find_platform(game, (int)(game->y_pos) + r + 1, (int)game->x_pos - r + 1, x_last);
+        if (id >= 0 && (id & PLAT_MOVING)) {
+            ride = id & ~PLAT_MOVING;
+            ride_x = mov_plats[ride].plat.x;
+        }
+    }
+
+    update_platforms(mov_plats, game->num_mov_platforms[game->level], game->tilt, game->map, &game->plat_index);
+
+    // Carry the character along with the platform it stands on
+    if (ride >= 0 && mov_plats[ride].plat.x != ride_x) {
+        prev_x = game->x_pos;
+        game->x_pos += mov_plats[ride].plat.x - ride_x;
+        if (game->x_pos < r) {
+            game->x_pos = r;
+        } else if (game->x_pos > 127 - r) {
+            game->x_pos = 127 - r;
+        }
+        sweep_x(game, prev_x);
+    }
+    phase_end(PHASE_PLATFORMS, &mark);
+
+    return events;
+}
+
+// Circle Mask
+// Pixels of a filled circle in one word of row y
+static uint64_t circle_mask(int x_pos, int y_pos, int radius, int y, int word) {
+    uint64_t mask = 0;
+    int x;
+    for (x = x_pos - radius; x < x_pos + radius; x++) {
+        if (x / 64 == word && x >= 0 && (x - x_pos) * (x - x_pos) + (y - y_pos) * (y - y_pos) < radius * radius) {
+            mask |= 0x8000000000000000 >> (x % 64);
+        }
+    }
+    return mask;
+}
+
+// Game Render
+void game_render(GameState *game, RenderDiff *diff) {
+    uint64_t mark = game_clock ? game_clock() : 0;
+    int x = (int)(game->x_pos), y = (int)(game->y_pos), r = game->character_radius;
+    int i;
+
+    diff->count = 0;
+    for (i = 0; i < MAP_WORDS; i++) {
+        // The character goes into the frame only. Drawing it into the map and
+        // deleting it after would also clear any platform pixels it overlaps.
+        uint64_t word = game->map[i];
+        if (i / 2 >= y - r && i / 2 < y + r) {
+            word |= circle_mask(x, y, r, i / 2, i % 2);
+        }
+        if (word != game->prev_map[i]) {
+            diff->word[diff->count] = i;
+            diff->bits[diff->count] = word;
+            diff->changed[diff->count] = word ^ game->prev_map[i];
+            diff->count++;
+            game->prev_map[i] = word;
+        }
+    }
+    phase_end(PHASE_RENDER, &mark);
+}
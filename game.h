@@ -0,0 +1,160 @@
+/*
+ * game.h
+ *
+ *  Headless game core. All simulation state lives in a GameState and is
+ *  advanced one fixed tick at a time by game_step() from raw Input samples,
+ *  with no driverlib or display calls, so the same code runs on the board
+ *  and on a Linux host. game_render() turns the state into the list of map
+ *  words that changed since the previous frame for the display driver.
+ */
+
+#ifndef GAME_H_
+#define GAME_H_
+
+#include <stdint.h>
+
+#include "plat_index.h"
+#include "arena.h"
+
+#define MAX_LEVELS          20
+#define MAX_PLATFORMS       127     /* Per kind and level, ids must fit PlatIndex */
+#define MAP_WORDS           256     /* 128 rows x 2 words of 64 pixels */
+#define TICKS_PER_SECOND    50      /* SysTick period is 20 ms */
+#define LEVEL_STORAGE_SIZE  2048    /* Platform records of every level of a map */
+
+// Set to 1 for moving platforms to carry the character standing on them,
+// the default ride_platforms. Off, they slide out from under it as before.
+#ifndef RIDE_PLATFORMS
+#define RIDE_PLATFORMS      0
+#endif
+
+typedef struct {
+    uint8_t length;
+    uint8_t thickness;
+    uint8_t x, y;
+} Platform;
+
+typedef struct {
+    Platform plat;
+    uint8_t x_min, x_max;
+} MovablePlatform;
+
+// Raw input for one tick, exactly as read from the hardware
+typedef struct {
+    uint8_t tilt_reg;       /* Accelerometer register byte from GetTilt */
+    uint8_t adc_valid;      /* ADC FIFO had a sample this tick */
+    uint8_t button;         /* Joystick button GPIO read, non-zero when pressed */
+    uint32_t adc_sample;    /* Raw ADC FIFO word */
+} Input;
+
+// A level compiled into const tables by tools/level_gen
+typedef struct {
+    const Platform *st_plats;
+    const MovablePlatform *mov_plats;   /* Starting positions, copied to RAM to move */
+    const uint64_t *raster;             /* Static platforms drawn as map words, or NULL */
+    uint8_t num_st, num_mov;
+} LevelTable;
+
+// Map words that changed since the last frame
+typedef struct {
+    uint16_t count;
+    uint8_t word[MAP_WORDS];        /* Index into the map (row * 2 + half) */
+    uint64_t bits[MAP_WORDS];       /* New contents of the word */
+    uint64_t changed[MAP_WORDS];    /* Pixels that differ from the last frame */
+} RenderDiff;
+
+// Platforms of every level and the renderer's diff share one arena
+#define GAME_ARENA_SIZE     (LEVEL_STORAGE_SIZE + ((sizeof(RenderDiff) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1)))
+
+typedef struct {
+    // Tuning
+    float gravity, x_speed, jump_speed, term_vel;
+    uint8_t character_radius;
+    uint8_t ride_platforms;     /* Standing on a moving platform carries the character */
+
+    // Character
+    float x_pos, y_pos, y_vel;
+    uint8_t on_ground;
+    int tilt;
+
+    // Progress
+    uint8_t level, num_levels;
+    uint32_t ticks;         /* Ticks simulated since game_start */
+    unsigned int color;
+    uint8_t endless;        /* Levels are generated as they are reached */
+    uint16_t depth;         /* Endless levels cleared */
+    uint32_t seed;          /* Endless seed, each level mixes in its depth */
+
+    // Levels, the platform arrays are sized to each level and live in the arena
+    // (static platforms of a compiled level point into its const table instead)
+    uint8_t num_st_platforms[MAX_LEVELS], num_mov_platforms[MAX_LEVELS];
+    const Platform *static_plats[MAX_LEVELS];
+    MovablePlatform *mov_plats[MAX_LEVELS];
+    const uint64_t *raster[MAX_LEVELS];     /* Static platforms already drawn, or NULL */
+
+    // Bitboards of the current level and of the last frame drawn
+    uint64_t map[MAP_WORDS], prev_map[MAP_WORDS];
+
+    // Platform spans of the current level by row
+    PlatIndex plat_index;
+
+    // Level storage from the bottom, the render diff from the top
+    Arena arena;
+    RenderDiff *diff;
+    uint64_t arena_mem[GAME_ARENA_SIZE / 8];
+} GameState;
+
+// Events returned by game_step()
+#define GAME_EVENT_NONE     0x00
+#define GAME_EVENT_LEVEL    0x01    /* A new level was loaded */
+#define GAME_EVENT_WIN      0x02    /* The WIN level was reached */
+#define GAME_EVENT_DONE     0x04    /* Past the WIN level, back to the menu */
+
+// Optional per-phase timing, enabled by pointing game_clock at a cycle counter
+typedef enum {
+    PHASE_INPUT,
+    PHASE_PHYSICS,
+    PHASE_PLATFORMS,
+    PHASE_RENDER,
+    PHASE_COUNT
+} GamePhase;
+
+extern uint64_t (*game_clock)(void);
+extern uint64_t game_phase_time[PHASE_COUNT];
+
+Platform create_static_platform(uint8_t x, uint8_t y, uint8_t length, uint8_t thickness);
+MovablePlatform create_mov_platform(uint8_t x, uint8_t y, uint8_t length, uint8_t thickness, uint8_t x_min, uint8_t x_max);
+// raster, if not NULL, holds the static platforms already drawn as map words
+void load_level(uint64_t *map, uint64_t *prev_map, const Platform *st_plats, uint8_t num_st_plats, MovablePlatform *mov_plats, uint8_t num_mov_plats, const uint64_t *raster, PlatIndex *index);
+void update_platforms(MovablePlatform *mov_plats, uint8_t num_plats, int tilt, uint64_t *map, PlatIndex *index);
+
+// Default tuning and an empty board
+void game_init(GameState *game);
+
+// Drop every level, O(1) however many were loaded
+void game_reset_levels(GameState *game);
+
+// Platform array for a level, NULL (and an empty level) if the arena is full
+Platform *game_alloc_static(GameState *game, uint8_t level, uint8_t count);
+MovablePlatform *game_alloc_moving(GameState *game, uint8_t level, uint8_t count);
+
+// Use a compiled level in place, only its moving platforms are copied.
+// Returns -1 (and an empty level) if the arena is full.
+int game_set_level(GameState *game, uint8_t level, const LevelTable *table);
+
+// Put the character at the start of the first level
+void game_start(GameState *game);
+
+// Advance one tick, returns GAME_EVENT_* flags
+uint8_t game_step(GameState *game, const Input *input);
+
+// Platform covering any of columns x_first..x_last of a row, as an id like
+// plat_index_find() returns, or -1. Scans the level's platforms when a row
+// overflowed the index.
+int game_find_platform(const GameState *game, int row, int x_first, int x_last);
+
+// Draw the character over the map and collect the words of the frame that
+// changed since the last one. The map itself keeps only the platforms.
+void game_render(GameState *game, RenderDiff *diff);
+
+#endif /* GAME_H_ */
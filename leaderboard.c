@@ -0,0 +1,316 @@
+/*
+ * leaderboard.c
+ *
+ *  Online leaderboard over the IoT TLS channel.
+ */
+
+#include "leaderboard.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils/flash_record.h"
+
+#define FILE_MAGIC      0x4253544C      /* "LTSB" */
+
+typedef struct {
+    uint32_t magic;
+    uint32_t count;
+    LbResult queue[LB_QUEUE_SIZE];
+    uint32_t hash;                      /* FNV-1a of everything above */
+} LbQueueFile;
+
+// Keep the start of a fetched shadow, the times come before its metadata
+static void body_sink(const char *data, int len, void *ctx) {
+    Leaderboard *lb = (Leaderboard *)ctx;
+    if (len > (int)sizeof(lb->body) - 1 - lb->body_len) {
+        len = sizeof(lb->body) - 1 - lb->body_len;
+    }
+    memcpy(lb->body + lb->body_len, data, len);
+    lb->body_len += len;
+    lb->body[lb->body_len] = '\0';
+}
+
+// Read "top":[t1,t2,...] from a shadow document
+static void parse_top(LbTop *top, const char *body) {
+    const char *p = strstr(body, "\"top\":[");
+    char *end;
+
+    top->count = 0;
+    if (!p) {
+        return;
+    }
+    p += 7;
+    while (top->count < LB_TOP_N && *p >= '0' && *p <= '9') {
+        top->times[top->count++] = strtoul(p, &end, 10);
+        p = end;
+        while (*p == ',' || *p == ' ') p++;
+    }
+}
+
+static int request_head(Leaderboard *lb, const char *method, const char *path, int body_len) {
+    return snprintf(lb->request, sizeof(lb->request),
+                    "%s %s HTTP/1.1\r\n"
+                    "Host: %s\r\n"
+                    "Content-Length: %d\r\n"
+                    "\r\n",
+                    method, path, lb->host, body_len);
+}
+
+// Post up to LB_BATCH of the oldest results
+static int start_submit(Leaderboard *lb) {
+    static char body[LB_REQUEST_SIZE];
+    int len, head, i;
+
+    lb->batch = (lb->count < LB_BATCH) ? lb->count : LB_BATCH;
+    len = snprintf(body, sizeof(body), "{\"scores\":[");
+    for (i = 0; i < lb->batch; i++) {
+        len += snprintf(body + len, sizeof(body) - len, "%s{\"map\":\"%s\",\"ms\":%u,\"replay\":\"%08x\"}",
+                        i ? "," : "", lb->queue[i].map, (unsigned int)lb->queue[i].time_ms,
+                        (unsigned int)lb->queue[i].replay_hash);
+    }
+    len += snprintf(body + len, sizeof(body) - len, "]}");
+    head = request_head(lb, "POST", LB_SUBMIT_PATH, len);
+    if (len >= (int)sizeof(body) || head + len >= (int)sizeof(lb->request)) {
+        return -1;
+    }
+    memcpy(lb->request + head, body, len);
+    lb->request_len = head + len;
+    return 0;
+}
+
+static int start_fetch(Leaderboard *lb) {
+    char path[64];
+
+    lb->batch = 0;
+    lb->fetch = lb->want_top;
+    snprintf(path, sizeof(path), LB_TOP_PATH, lb->top[lb->fetch].map);
+    lb->request_len = snprintf(lb->request, sizeof(lb->request),
+                               "GET %s HTTP/1.1\r\n"
+                               "Host: %s\r\n"
+                               "\r\n",
+                               path, lb->host);
+    return (lb->request_len < (int)sizeof(lb->request)) ? 0 : -1;
+}
+
+// Give up on the request and try again later, twice as long each time. A
+// response left part way can't be told from the next one, so the channel
+// is reconnected.
+static void fail(Leaderboard *lb, uint32_t now_ms) {
+    if (lb->phase == LB_RECEIVING && tls_channel_open(lb->channel)) {
+        tls_channel_reconnect(lb->channel, now_ms);
+    }
+    lb->phase = LB_IDLE;
+    lb->stats.failures++;
+    lb->retry_ms = lb->retry_ms ? lb->retry_ms * 2 : LB_RETRY_MIN_MS;
+    if (lb->retry_ms > LB_RETRY_MAX_MS) {
+        lb->retry_ms = LB_RETRY_MAX_MS;
+    }
+    lb->retry_at = now_ms + lb->retry_ms;
+}
+
+static void finish(Leaderboard *lb, uint32_t now_ms) {
+    int status = lb->parser.status;
+
+    if (lb->batch && status == 200) {
+        lb->count -= lb->batch;
+        memmove(lb->queue, lb->queue + lb->batch, lb->count * sizeof(LbResult));
+        lb->dirty = 1;
+        lb->stats.submitted += lb->batch;
+        lb->stats.batches++;
+    } else if (!lb->batch && (status == 200 || status == 404)) {
+        // 404 is a map nobody has finished yet
+        LbTop *top = &lb->top[lb->fetch];
+        parse_top(top, (status == 200) ? lb->body : "");
+        top->valid = 1;
+        top->fetched_at = now_ms;
+        if (lb->want_top == lb->fetch) {
+            lb->want_top = -1;
+        }
+        lb->stats.fetches++;
+    } else {
+        fail(lb, now_ms);
+        return;
+    }
+    if (!lb->parser.keep_alive) {
+        tls_channel_reconnect(lb->channel, now_ms);
+    }
+    lb->phase = LB_IDLE;
+    lb->retry_ms = 0;
+}
+
+// Leaderboard Init
+void leaderboard_init(Leaderboard *lb, TlsChannel *channel, const char *host) {
+    memset(lb, 0, sizeof(*lb));
+    lb->channel = channel;
+    lb->host = host;
+    lb->want_top = -1;
+}
+
+// Leaderboard Load
+void leaderboard_load(Leaderboard *lb) {
+    static LbQueueFile file;
+    uint32_t i;
+
+    if (flash_record_load(LB_QUEUE_FILE, &file, sizeof(file)) < 0 || file.magic != FILE_MAGIC ||
+        file.count > LB_QUEUE_SIZE) {
+        return;
+    }
+    // Results from this session are newer, so the saved ones go first
+    for (i = file.count; i > 0; i--) {
+        if (lb->count == LB_QUEUE_SIZE) {
+            lb->stats.dropped++;
+            continue;
+        }
+        memmove(lb->queue + 1, lb->queue, lb->count * sizeof(LbResult));
+        lb->queue[0] = file.queue[i - 1];
+        lb->queue[0].map[MAP_NAME_SIZE - 1] = '\0';
+        lb->count++;
+    }
+    lb->dirty = (file.count > 0);
+}
+
+// Leaderboard Save
+void leaderboard_save(Leaderboard *lb) {
+    static LbQueueFile file;
+
+    if (!lb->dirty) {
+        return;
+    }
+    memset(&file, 0, sizeof(file));
+    file.magic = FILE_MAGIC;
+    file.count = lb->count;
+    memcpy(file.queue, lb->queue, lb->count * sizeof(LbResult));
+    if (flash_record_save(LB_QUEUE_FILE, &file, sizeof(file)) == 0) {
+        lb->dirty = 0;
+    }
+}
+
+// Leaderboard Add
+void leaderboard_add(Leaderboard *lb, const char *map, uint32_t time_ms, uint32_t replay_hash) {
+    LbResult *result;
+
+    // A batch being sent keeps its place at the front
+    if (lb->count == LB_QUEUE_SIZE) {
+        int keep = (lb->phase != LB_IDLE) ? lb->batch : 0;
+        memmove(lb->queue + keep, lb->queue + keep + 1, (lb->count - keep - 1) * sizeof(LbResult));
+        lb->count--;
+        lb->stats.dropped++;
+    }
+    result = &lb->queue[lb->count++];
+    memset(result, 0, sizeof(*result));
+    strncpy(result->map, map, MAP_NAME_SIZE - 1);
+    result->time_ms = time_ms;
+    result->replay_hash = replay_hash;
+    lb->dirty = 1;
+}
+
+// Leaderboard Want Top
+void leaderboard_want_top(Leaderboard *lb, const char *map, uint32_t now_ms) {
+    int i, slot = -1;
+
+    for (i = 0; i < LB_TOP_MAPS; i++) {
+        if (strcmp(lb->top[i].map, map) == 0) {
+            slot = i;
+            break;
+        }
+        if (slot < 0 && !lb->top[i].map[0]) {
+            slot = i;
+        }
+    }
+    if (slot < 0) {
+        // Replace the one fetched longest ago
+        for (slot = 0, i = 1; i < LB_TOP_MAPS; i++) {
+            if ((int32_t)(lb->top[i].fetched_at - lb->top[slot].fetched_at) < 0) {
+                slot = i;
+            }
+        }
+    }
+    if (strcmp(lb->top[slot].map, map) != 0) {
+        // Mustn't change under a fetch under way
+        if (lb->phase != LB_IDLE && !lb->batch && lb->fetch == slot) {
+            return;
+        }
+        memset(&lb->top[slot], 0, sizeof(LbTop));
+        strncpy(lb->top[slot].map, map, MAP_NAME_SIZE - 1);
+    }
+    if (!lb->top[slot].valid || now_ms - lb->top[slot].fetched_at > LB_TOP_TTL_MS) {
+        lb->want_top = slot;
+    }
+}
+
+// Leaderboard Top
+const LbTop *leaderboard_top(const Leaderboard *lb, const char *map) {
+    int i;
+
+    for (i = 0; i < LB_TOP_MAPS; i++) {
+        if (lb->top[i].valid && strcmp(lb->top[i].map, map) == 0) {
+            return &lb->top[i];
+        }
+    }
+    return NULL;
+}
+
+// Leaderboard Poll
+void leaderboard_poll(Leaderboard *lb, uint32_t now_ms) {
+    char rx[256];
+    int ret;
+
+    if (lb->phase == LB_IDLE) {
+        if (!tls_channel_open(lb->channel) || (int32_t)(now_ms - lb->retry_at) < 0) {
+            return;
+        }
+        if (lb->count) {
+            ret = start_submit(lb);
+        } else if (lb->want_top >= 0) {
+            ret = start_fetch(lb);
+        } else {
+            return;
+        }
+        if (ret < 0) {
+            fail(lb, now_ms);
+            return;
+        }
+        lb->body_len = 0;
+        lb->body[0] = '\0';
+        lb->sent = 0;
+        http_parser_init(&lb->parser, body_sink, lb);
+        lb->phase = LB_SENDING;
+        lb->phase_start = now_ms;
+    }
+
+    if (lb->phase == LB_SENDING) {
+        ret = tls_channel_send(lb->channel, lb->request + lb->sent, lb->request_len - lb->sent, now_ms);
+        if (ret < 0) {
+            fail(lb, now_ms);
+            return;
+        }
+        lb->sent += ret;
+        if (lb->sent < lb->request_len) {
+            return;
+        }
+        lb->phase = LB_RECEIVING;
+        lb->phase_start = now_ms;
+    }
+
+    // One read per poll keeps each call short
+    ret = tls_channel_recv(lb->channel, rx, sizeof(rx), now_ms);
+    if (ret < 0) {
+        fail(lb, now_ms);
+        return;
+    }
+    if (ret == 0) {
+        if (now_ms - lb->phase_start > LB_REPLY_TIMEOUT_MS) {
+            fail(lb, now_ms);
+        }
+        return;
+    }
+    if (http_parser_feed(&lb->parser, rx, ret) < 0) {
+        fail(lb, now_ms);
+        return;
+    }
+    if (http_parser_done(&lb->parser)) {
+        finish(lb, now_ms);
+    }
+}
@@ -0,0 +1,125 @@
+/*
+ * leaderboard.h
+ *
+ *  Online leaderboard over the IoT TLS channel. Finished runs (map, time
+ *  and the replay hash that lets the server check them) are queued in RAM
+ *  and kept in flash, so results made offline or while the channel is down
+ *  go out later. The queue is posted in batches to the AWS IoT REST
+ *  endpoint as one MQTT publish each:
+ *      POST LB_SUBMIT_PATH
+ *      {"scores":[{"map":"Easy","ms":12340,"replay":"0a1b2c3d"},...]}
+ *  and a batch leaves the queue once it is acknowledged.
+ *
+ *  The best LB_TOP_N times of a map are read from a named shadow the cloud
+ *  side keeps up to date, {"state":{"reported":{"top":[12340,13020,...]}}},
+ *  and cached per map for LB_TOP_TTL_MS.
+ *
+ *  Everything is driven from leaderboard_poll() between game ticks; it
+ *  never waits on the network, and a failed request is retried with
+ *  backoff. Flash is only written by leaderboard_save(), which the caller
+ *  runs outside of play.
+ */
+
+#ifndef LEADERBOARD_H_
+#define LEADERBOARD_H_
+
+#include <stdint.h>
+
+#include "map_names.h"
+#include "utils/http_parser.h"
+#include "utils/tls_channel.h"
+
+#define LB_QUEUE_SIZE       16
+#define LB_BATCH            8           /* Results per request */
+#define LB_TOP_N            5
+#define LB_TOP_MAPS         MAP_NAMES_MAX
+#define LB_TOP_TTL_MS       (5 * 60 * 1000)
+#ifndef LB_REPLY_TIMEOUT_MS
+#define LB_REPLY_TIMEOUT_MS 5000
+#endif
+#ifndef LB_RETRY_MIN_MS
+#define LB_RETRY_MIN_MS     2000
+#endif
+#define LB_RETRY_MAX_MS     60000
+#define LB_REQUEST_SIZE     768
+#define LB_BODY_SIZE        256         /* Start of a shadow response kept for parsing */
+
+#define LB_QUEUE_FILE       "ttcache/scores"
+#define LB_SUBMIT_PATH      "/topics/tiltedterrain/scores?qos=1"
+#define LB_TOP_PATH         "/things/tiltedterrain/shadow?name=%s"
+
+typedef struct {
+    char map[MAP_NAME_SIZE];
+    uint32_t time_ms;
+    uint32_t replay_hash;
+} LbResult;
+
+typedef struct {
+    char map[MAP_NAME_SIZE];            /* Empty when the slot is free */
+    uint32_t times[LB_TOP_N];           /* Best first, in ms */
+    uint8_t count;
+    uint8_t valid;                      /* Fetched at least once */
+    uint32_t fetched_at;
+} LbTop;
+
+typedef enum {
+    LB_IDLE,
+    LB_SENDING,
+    LB_RECEIVING
+} LbPhase;
+
+typedef struct {
+    uint32_t submitted;                 /* Results acknowledged */
+    uint32_t batches;
+    uint32_t fetches;
+    uint32_t failures;                  /* Requests that failed or were refused */
+    uint32_t dropped;                   /* Oldest results pushed out of a full queue */
+} LbStats;
+
+typedef struct {
+    TlsChannel *channel;
+    const char *host;
+
+    LbResult queue[LB_QUEUE_SIZE];      /* Oldest first */
+    uint8_t count;
+    uint8_t dirty;                      /* Queue differs from flash */
+    LbTop top[LB_TOP_MAPS];
+    int want_top;                       /* Entry of top to fetch, -1 if none */
+
+    // Request under way
+    LbPhase phase;
+    uint8_t batch;                      /* Results in it, 0 for a fetch */
+    int fetch;                          /* Entry of top it fetches */
+    char request[LB_REQUEST_SIZE];
+    int request_len, sent;
+    HttpParser parser;
+    char body[LB_BODY_SIZE];
+    int body_len;
+    uint32_t phase_start;
+    uint32_t retry_at, retry_ms;
+
+    LbStats stats;
+} Leaderboard;
+
+// Set up with an empty queue, host goes in the Host header
+void leaderboard_init(Leaderboard *lb, TlsChannel *channel, const char *host);
+
+// Add results queued in flash by earlier sessions, needs the device started
+void leaderboard_load(Leaderboard *lb);
+
+// Write the queue to flash if it changed
+void leaderboard_save(Leaderboard *lb);
+
+// Queue a finished run, pushing out the oldest if the queue is full
+void leaderboard_add(Leaderboard *lb, const char *map, uint32_t time_ms, uint32_t replay_hash);
+
+// Fetch a map's best times if they aren't cached or are stale
+void leaderboard_want_top(Leaderboard *lb, const char *map, uint32_t now_ms);
+
+// Cached best times of a map, or NULL
+const LbTop *leaderboard_top(const Leaderboard *lb, const char *map);
+
+// Send and receive what can be done without waiting
+void leaderboard_poll(Leaderboard *lb, uint32_t now_ms);
+
+#endif /* LEADERBOARD_H_ */
@@ -0,0 +1,233 @@
+/*
+ * level_bin.c
+ *
+ *  Binary level loader and writer.
+ */
+
+#include "level_bin.h"
+
+#include <string.h>
+
+#define HDR_VERSION     4
+#define HDR_FLAGS       5
+#define HDR_NUM_ST      6
+#define HDR_NUM_MOV     7
+#define HDR_BOUNDS      8
+#define HDR_PAYLOAD     12
+#define HDR_RESERVED    14
+#define HDR_CRC         16
+
+#define ST_RECORD_SIZE  4
+#define MOV_RECORD_SIZE 6
+#define ROW_SIZE        16
+
+static uint16_t get_le16(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t get_le64(const uint8_t *p) {
+    return (uint64_t)get_le32(p) | ((uint64_t)get_le32(p + 4) << 32);
+}
+
+static void put_le16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_le32(uint8_t *p, uint32_t v) {
+    put_le16(p, (uint16_t)v);
+    put_le16(p + 2, (uint16_t)(v >> 16));
+}
+
+static void put_le64(uint8_t *p, uint64_t v) {
+    put_le32(p, (uint32_t)v);
+    put_le32(p + 4, (uint32_t)(v >> 32));
+}
+
+// Binary Detect
+int level_bin_detect(const uint8_t *data, uint32_t len) {
+    return len > 0 && data[0] == (uint8_t)LEVEL_BIN_MAGIC[0];
+}
+
+// CRC-32, a nibble at a time to keep the table to 16 entries
+uint32_t level_bin_crc32(uint32_t crc, const uint8_t *data, uint32_t len) {
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+    uint32_t i;
+    crc = ~crc;
+    for (i = 0; i < len; i++) {
+        crc = (crc >> 4) ^ table[(crc ^ data[i]) & 0x0F];
+        crc = (crc >> 4) ^ table[(crc ^ (data[i] >> 4)) & 0x0F];
+    }
+    return ~crc;
+}
+
+// Is a rectangle, plus a sliding range for moving platforms, inside the bounds
+static int in_bounds(const uint8_t *b, int x_first, int x_last, int y, int length, int thickness) {
+    return length > 0 && thickness > 0 && x_first >= b[0] && y >= b[1] &&
+           x_last + length - 1 <= b[2] && y + thickness - 1 <= b[3];
+}
+
+// Binary Load
+int level_bin_load(const uint8_t *data, uint32_t len, GameState *game, uint8_t level, uint64_t *raster_buf) {
+    const uint8_t *b, *p;
+    Platform *st;
+    MovablePlatform *mov;
+    uint8_t num_st, num_mov, flags, i;
+    uint32_t payload, expected;
+
+    game->num_st_platforms[level] = 0;
+    game->num_mov_platforms[level] = 0;
+    game->raster[level] = 0;
+
+    if (len < LEVEL_BIN_HEADER_SIZE || memcmp(data, LEVEL_BIN_MAGIC, 4) != 0 ||
+        data[HDR_VERSION] != LEVEL_BIN_VERSION || (data[HDR_FLAGS] & ~LEVEL_BIN_RASTER) ||
+        get_le16(data + HDR_RESERVED) != 0) {
+        return LEVEL_BIN_E_HEADER;
+    }
+    flags = data[HDR_FLAGS];
+    num_st = data[HDR_NUM_ST];
+    num_mov = data[HDR_NUM_MOV];
+    b = data + HDR_BOUNDS;
+    payload = get_le16(data + HDR_PAYLOAD);
+    if (b[0] > b[2] || b[1] > b[3] || b[2] > 127 || b[3] > 127) {
+        return LEVEL_BIN_E_RANGE;
+    }
+
+    expected = num_st * ST_RECORD_SIZE + num_mov * MOV_RECORD_SIZE;
+    if (flags & LEVEL_BIN_RASTER) {
+        expected += (b[3] - b[1] + 1) * ROW_SIZE;
+    }
+    if (num_st > MAX_PLATFORMS || num_mov > MAX_PLATFORMS || payload != expected ||
+        len < LEVEL_BIN_HEADER_SIZE + payload) {
+        return LEVEL_BIN_E_SIZE;
+    }
+    p = data + LEVEL_BIN_HEADER_SIZE;
+    if (level_bin_crc32(0, p, payload) != get_le32(data + HDR_CRC)) {
+        return LEVEL_BIN_E_CRC;
+    }
+
+    // Storage is sized by the header, records go straight into it and a bad
+    // one empties the level again
+    st = game_alloc_static(game, level, num_st);
+    mov = game_alloc_moving(game, level, num_mov);
+    if (!st || !mov) {
+        game->num_st_platforms[level] = game->num_mov_platforms[level] = 0;
+        return LEVEL_BIN_E_MEMORY;
+    }
+    for (i = 0; i < num_st; i++, p += ST_RECORD_SIZE) {
+        if (!in_bounds(b, p[0], p[0], p[1], p[2], p[3])) {
+            game->num_st_platforms[level] = game->num_mov_platforms[level] = 0;
+            return LEVEL_BIN_E_RANGE;
+        }
+        st[i] = create_static_platform(p[0], p[1], p[2], p[3]);
+    }
+    for (i = 0; i < num_mov; i++, p += MOV_RECORD_SIZE) {
+        if (p[4] > p[0] || p[0] > p[5] || !in_bounds(b, p[4], p[5], p[1], p[2], p[3])) {
+            game->num_st_platforms[level] = game->num_mov_platforms[level] = 0;
+            return LEVEL_BIN_E_RANGE;
+        }
+        mov[i] = create_mov_platform(p[0], p[1], p[2], p[3], p[4], p[5]);
+    }
+
+    if ((flags & LEVEL_BIN_RASTER) && raster_buf) {
+        int row;
+        memset(raster_buf, 0, MAP_WORDS * sizeof(uint64_t));
+        for (row = b[1]; row <= b[3]; row++, p += ROW_SIZE) {
+            raster_buf[row * 2] = get_le64(p);
+            raster_buf[row * 2 + 1] = get_le64(p + 8);
+        }
+        game->raster[level] = raster_buf;
+    }
+    return LEVEL_BIN_OK;
+}
+
+// Binary Write
+int level_bin_write(const GameState *game, uint8_t level, uint8_t flags, uint8_t *out, uint32_t out_size) {
+    const Platform *st = game->static_plats[level];
+    const MovablePlatform *mov = game->mov_plats[level];
+    uint8_t num_st = game->num_st_platforms[level], num_mov = game->num_mov_platforms[level];
+    int b[4] = {127, 127, 0, 0};
+    uint8_t *p;
+    uint32_t payload;
+    int i;
+
+    // Bounds over every platform, moving ones over their whole range
+    for (i = 0; i < num_st + num_mov; i++) {
+        const Platform *plat = (i < num_st) ? &st[i] : &mov[i - num_st].plat;
+        int x_first = (i < num_st) ? plat->x : mov[i - num_st].x_min;
+        int x_last = ((i < num_st) ? plat->x : mov[i - num_st].x_max) + plat->length - 1;
+        if (plat->length == 0 || plat->thickness == 0 ||
+            (i >= num_st && (plat->x < mov[i - num_st].x_min || plat->x > mov[i - num_st].x_max))) {
+            return -1;
+        }
+        if (x_first < b[0]) b[0] = x_first;
+        if (plat->y < b[1]) b[1] = plat->y;
+        if (x_last > b[2]) b[2] = x_last;
+        if (plat->y + plat->thickness - 1 > b[3]) b[3] = plat->y + plat->thickness - 1;
+    }
+    if (num_st + num_mov == 0) {
+        b[0] = b[1] = 0;
+    }
+    if (b[2] > 127 || b[3] > 127) {
+        return -1;      // Platform hangs off the board, the loader would reject it
+    }
+
+    flags &= LEVEL_BIN_RASTER;
+    payload = num_st * ST_RECORD_SIZE + num_mov * MOV_RECORD_SIZE;
+    if (flags & LEVEL_BIN_RASTER) {
+        payload += (b[3] - b[1] + 1) * ROW_SIZE;
+    }
+    if (LEVEL_BIN_HEADER_SIZE + payload > out_size) {
+        return -1;
+    }
+
+    memcpy(out, LEVEL_BIN_MAGIC, 4);
+    out[HDR_VERSION] = LEVEL_BIN_VERSION;
+    out[HDR_FLAGS] = flags;
+    out[HDR_NUM_ST] = num_st;
+    out[HDR_NUM_MOV] = num_mov;
+    for (i = 0; i < 4; i++) {
+        out[HDR_BOUNDS + i] = (uint8_t)b[i];
+    }
+    put_le16(out + HDR_PAYLOAD, (uint16_t)payload);
+    put_le16(out + HDR_RESERVED, 0);
+
+    p = out + LEVEL_BIN_HEADER_SIZE;
+    for (i = 0; i < num_st; i++) {
+        *p++ = st[i].x;
+        *p++ = st[i].y;
+        *p++ = st[i].length;
+        *p++ = st[i].thickness;
+    }
+    for (i = 0; i < num_mov; i++) {
+        *p++ = mov[i].plat.x;
+        *p++ = mov[i].plat.y;
+        *p++ = mov[i].plat.length;
+        *p++ = mov[i].plat.thickness;
+        *p++ = mov[i].x_min;
+        *p++ = mov[i].x_max;
+    }
+    if (flags & LEVEL_BIN_RASTER) {
+        int row, x;
+        for (row = b[1]; row <= b[3]; row++, p += ROW_SIZE) {
+            uint64_t words[2] = {0, 0};
+            for (i = 0; i < num_st; i++) {
+                if (row < st[i].y || row >= st[i].y + st[i].thickness) continue;
+                for (x = st[i].x; x < st[i].x + st[i].length && x < 128; x++) {
+                    words[x / 64] |= 0x8000000000000000 >> (x % 64);
+                }
+            }
+            put_le64(p, words[0]);
+            put_le64(p + 8, words[1]);
+        }
+    }
+    put_le32(out + HDR_CRC, level_bin_crc32(0, out + LEVEL_BIN_HEADER_SIZE, payload));
+    return LEVEL_BIN_HEADER_SIZE + payload;
+}
@@ -0,0 +1,61 @@
+/*
+ * level_bin.h
+ *
+ *  Binary level format. A fixed header is followed by the platform records
+ *  and, optionally, the static platforms already rasterized into map rows:
+ *
+ *      0   "TTLV"
+ *      4   version (LEVEL_BIN_VERSION)
+ *      5   flags (LEVEL_BIN_RASTER)
+ *      6   static platform count, 7 moving platform count
+ *      8   bounds: x_min, y_min, x_max, y_max of every platform, inclusive
+ *      12  payload length, uint16 little-endian
+ *      14  reserved, 0
+ *      16  CRC-32 of the payload, uint32 little-endian
+ *      20  payload:
+ *          x, y, length, thickness                 per static platform
+ *          x, y, length, thickness, x_min, x_max   per moving platform
+ *          rows y_min..y_max as two little-endian uint64 map words each,
+ *          static platforms only                   if LEVEL_BIN_RASTER
+ *
+ *  All multi-byte fields are little-endian, so the image can be read
+ *  straight out of a socket or flash buffer with no alignment needs.
+ */
+
+#ifndef LEVEL_BIN_H_
+#define LEVEL_BIN_H_
+
+#include <stdint.h>
+
+#include "game.h"
+
+#define LEVEL_BIN_MAGIC         "TTLV"
+#define LEVEL_BIN_VERSION       1
+#define LEVEL_BIN_HEADER_SIZE   20
+#define LEVEL_BIN_RASTER        0x01    /* Payload ends with rasterized rows */
+#define LEVEL_BIN_MAX_SIZE      (LEVEL_BIN_HEADER_SIZE + MAX_PLATFORMS * 10 + MAP_WORDS * 8)
+
+// Errors returned by level_bin_load()
+#define LEVEL_BIN_OK            0
+#define LEVEL_BIN_E_HEADER      -1      /* Bad magic, version or reserved bits */
+#define LEVEL_BIN_E_SIZE        -2      /* Truncated, or lengths don't add up */
+#define LEVEL_BIN_E_CRC         -3
+#define LEVEL_BIN_E_RANGE       -4      /* A platform is off the board or outside the bounds */
+#define LEVEL_BIN_E_MEMORY      -5      /* No room left in the level arena */
+
+// Is this the start of a binary level (needs only the first byte)
+int level_bin_detect(const uint8_t *data, uint32_t len);
+
+// CRC-32 (IEEE), pass 0 as crc to start
+uint32_t level_bin_crc32(uint32_t crc, const uint8_t *data, uint32_t len);
+
+// Validate an image and load it into a level slot. Raster rows, if present
+// and raster_buf is given, are unpacked into raster_buf (MAP_WORDS words)
+// and used by load_level instead of drawing the static platforms.
+int level_bin_load(const uint8_t *data, uint32_t len, GameState *game, uint8_t level, uint64_t *raster_buf);
+
+// Encode a level slot, returns the image size, or -1 if a platform is off
+// the board or the image doesn't fit in out
+int level_bin_write(const GameState *game, uint8_t level, uint8_t flags, uint8_t *out, uint32_t out_size);
+
+#endif /* LEVEL_BIN_H_ */
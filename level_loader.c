@@ -0,0 +1,195 @@
+/*
+ * level_loader.c
+ *
+ *  Format detection and streaming of level files and packs.
+ */
+
+#include "level_loader.h"
+
+#include <string.h>
+
+#include "level_bin.h"
+
+static uint32_t get_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void put_le32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+// Loader Init
+void level_loader_init(LevelLoader *loader, GameState *game, uint8_t first_level, uint8_t max_levels,
+                       uint8_t *buf, uint32_t buf_size, uint64_t *raster_buf) {
+    memset(loader, 0, sizeof(*loader));
+    loader->game = game;
+    loader->first_level = first_level;
+    loader->max_levels = max_levels;
+    loader->state = LL_DETECT;
+    loader->buf = buf;
+    loader->buf_size = buf_size;
+    loader->raster_buf = raster_buf;
+    loader->need = 4;
+    level_parser_init(&loader->parser, game, first_level, max_levels);
+}
+
+// Copy input into buf until it holds need bytes, returns 1 once it does
+static int take(LevelLoader *loader, const char **data, int *len) {
+    uint32_t n = loader->need - loader->buf_len;
+    if (n > (uint32_t)*len) {
+        n = (uint32_t)*len;
+    }
+    memcpy(loader->buf + loader->buf_len, *data, n);
+    loader->buf_len += n;
+    *data += n;
+    *len -= n;
+    return loader->buf_len == loader->need;
+}
+
+// Check the pack index: images must follow it back to back and each fit in buf
+static LevelLoadState read_index(LevelLoader *loader) {
+    uint32_t offset = LEVEL_PACK_HEADER_SIZE + loader->pack_levels * LEVEL_PACK_ENTRY_SIZE;
+    const uint8_t *entry = loader->buf + LEVEL_PACK_HEADER_SIZE;
+    uint8_t i;
+
+    for (i = 0; i < loader->pack_levels; i++, entry += LEVEL_PACK_ENTRY_SIZE) {
+        uint16_t len = (uint16_t)(entry[4] | (entry[5] << 8));
+        if (get_le32(entry) != offset || len < LEVEL_BIN_HEADER_SIZE || len > loader->buf_size) {
+            return LL_ERROR;
+        }
+        loader->entry_len[i] = len;
+        offset += len;
+    }
+    loader->pack_level = 0;
+    loader->buf_len = 0;
+    loader->need = loader->entry_len[0];
+    return LL_PACK_LEVEL;
+}
+
+// Loader Feed
+void level_loader_feed(LevelLoader *loader, const char *data, int len) {
+    loader->bytes += len;
+    while (len > 0) {
+        switch (loader->state) {
+        case LL_DETECT:
+            // Text starts with a digit, whitespace or "PACK", binary with "TT"
+            if (loader->buf_len == 0 && !level_bin_detect((const uint8_t *)data, len)) {
+                loader->state = LL_TEXT;
+                break;
+            }
+            if (!take(loader, &data, &len)) {
+                return;
+            }
+            if (memcmp(loader->buf, LEVEL_PACK_MAGIC, 4) == 0) {
+                loader->state = LL_PACK_HEADER;
+                loader->need = LEVEL_PACK_HEADER_SIZE;
+            } else {
+                loader->state = LL_BIN;
+                loader->need = loader->buf_size;
+            }
+            break;
+
+        case LL_TEXT:
+            if (level_parser_feed(&loader->parser, data, len) == LP_ERROR) {
+                loader->state = LL_ERROR;
+            }
+            return;
+
+        case LL_BIN:
+            if (loader->buf_len + len > loader->buf_size) {
+                loader->error = LEVEL_BIN_E_SIZE;
+                loader->state = LL_ERROR;
+                return;
+            }
+            take(loader, &data, &len);
+            break;
+
+        case LL_PACK_HEADER:
+            if (!take(loader, &data, &len)) {
+                return;
+            }
+            loader->pack_levels = loader->buf[5];
+            if (loader->buf[4] != LEVEL_PACK_VERSION || loader->pack_levels == 0 ||
+                loader->pack_levels > loader->max_levels || loader->buf[6] || loader->buf[7] ||
+                (uint32_t)(LEVEL_PACK_HEADER_SIZE + loader->pack_levels * LEVEL_PACK_ENTRY_SIZE) > loader->buf_size) {
+                loader->state = LL_ERROR;
+                return;
+            }
+            loader->state = LL_PACK_INDEX;
+            loader->need = LEVEL_PACK_HEADER_SIZE + loader->pack_levels * LEVEL_PACK_ENTRY_SIZE;
+            break;
+
+        case LL_PACK_INDEX:
+            if (!take(loader, &data, &len)) {
+                return;
+            }
+            loader->state = read_index(loader);
+            break;
+
+        case LL_PACK_LEVEL:
+            if (!take(loader, &data, &len)) {
+                return;
+            }
+            loader->error = level_bin_load(loader->buf, loader->buf_len, loader->game,
+                                           loader->first_level + loader->pack_level, 0);
+            if (loader->error != LEVEL_BIN_OK) {
+                loader->state = LL_ERROR;
+                return;
+            }
+            if (++loader->pack_level == loader->pack_levels) {
+                loader->state = LL_DONE;
+                return;
+            }
+            loader->buf_len = 0;
+            loader->need = loader->entry_len[loader->pack_level];
+            break;
+
+        default:
+            return;     // Done or failed, the rest is ignored
+        }
+    }
+}
+
+// Loader Finish
+int level_loader_finish(LevelLoader *loader) {
+    switch (loader->state) {
+    case LL_TEXT:
+        return (level_parser_finish(&loader->parser) == 0) ? loader->parser.levels : -1;
+    case LL_BIN:
+        loader->error = level_bin_load(loader->buf, loader->buf_len, loader->game, loader->first_level, loader->raster_buf);
+        return (loader->error == LEVEL_BIN_OK) ? 1 : -1;
+    case LL_DONE:
+        return loader->pack_levels;
+    default:
+        return -1;
+    }
+}
+
+// Pack Write
+int level_pack_write(const GameState *game, uint8_t first_level, uint8_t num_levels, uint8_t *out, uint32_t out_size) {
+    uint32_t offset = LEVEL_PACK_HEADER_SIZE + num_levels * LEVEL_PACK_ENTRY_SIZE;
+    uint8_t i;
+
+    if (num_levels == 0 || num_levels > MAX_LEVELS || offset > out_size) {
+        return -1;
+    }
+    memcpy(out, LEVEL_PACK_MAGIC, 4);
+    out[4] = LEVEL_PACK_VERSION;
+    out[5] = num_levels;
+    out[6] = out[7] = 0;
+    for (i = 0; i < num_levels; i++) {
+        uint8_t *entry = out + LEVEL_PACK_HEADER_SIZE + i * LEVEL_PACK_ENTRY_SIZE;
+        int len = level_bin_write(game, first_level + i, 0, out + offset, out_size - offset);
+        if (len < 0) {
+            return -1;
+        }
+        put_le32(entry, offset);
+        entry[4] = (uint8_t)len;
+        entry[5] = (uint8_t)(len >> 8);
+        offset += len;
+    }
+    return (int)offset;
+}
@@ -0,0 +1,78 @@
+/*
+ * level_loader.h
+ *
+ *  Loads a downloaded level file of any supported format as it streams in:
+ *  text levels and "PACK" text packs go through level_parser, binary TTLV
+ *  levels are collected and validated whole, and binary TTPK packs are
+ *  split into their TTLV images as they arrive. The format is picked from
+ *  the first bytes. A pack fills consecutive level slots, so one download
+ *  can carry every level of a map.
+ *
+ *  Binary pack layout, little-endian:
+ *      0   "TTPK"
+ *      4   version (LEVEL_PACK_VERSION)
+ *      5   level count
+ *      6   reserved, 0
+ *      8   index: per level, offset of its TTLV image from the start of
+ *          the pack (uint32) and its length (uint16)
+ *      ... the TTLV images, back to back in index order
+ */
+
+#ifndef LEVEL_LOADER_H_
+#define LEVEL_LOADER_H_
+
+#include <stdint.h>
+
+#include "game.h"
+#include "level_parser.h"
+
+#define LEVEL_PACK_MAGIC        "TTPK"
+#define LEVEL_PACK_VERSION      1
+#define LEVEL_PACK_HEADER_SIZE  8
+#define LEVEL_PACK_ENTRY_SIZE   6
+
+typedef enum {
+    LL_DETECT,
+    LL_TEXT,
+    LL_BIN,
+    LL_PACK_HEADER,
+    LL_PACK_INDEX,
+    LL_PACK_LEVEL,
+    LL_DONE,
+    LL_ERROR
+} LevelLoadState;
+
+typedef struct {
+    GameState *game;
+    uint8_t first_level, max_levels;
+    LevelLoadState state;
+    int error;                          /* LEVEL_BIN_E_* of a rejected image, 0 otherwise */
+
+    LevelParser parser;                 /* Text files */
+
+    // Binary files are gathered one image at a time in the caller's buffer
+    uint8_t *buf;
+    uint32_t buf_size, buf_len, need;
+    uint64_t *raster_buf;               /* Rows of a single rasterized level */
+
+    // Pack index
+    uint8_t pack_levels, pack_level;
+    uint16_t entry_len[MAX_LEVELS];
+    uint32_t bytes;                     /* Bytes consumed */
+} LevelLoader;
+
+// Start loading into slots first_level..first_level + max_levels - 1. buf
+// must hold the largest binary image expected (LEVEL_BIN_MAX_SIZE).
+void level_loader_init(LevelLoader *loader, GameState *game, uint8_t first_level, uint8_t max_levels,
+                       uint8_t *buf, uint32_t buf_size, uint64_t *raster_buf);
+
+// Feed the next piece of the download
+void level_loader_feed(LevelLoader *loader, const char *data, int len);
+
+// End of the download, returns the number of levels loaded or -1
+int level_loader_finish(LevelLoader *loader);
+
+// Encode slots first_level.. as a binary pack, returns its size or -1
+int level_pack_write(const GameState *game, uint8_t first_level, uint8_t num_levels, uint8_t *out, uint32_t out_size);
+
+#endif /* LEVEL_LOADER_H_ */
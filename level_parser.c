@@ -0,0 +1,183 @@
+/*
+ * level_parser.c
+ *
+ *  Streaming text level parser.
+ */
+
+#include "level_parser.h"
+
+#include <string.h>
+
+// Level Start
+// Empty a level slot before it is filled
+static void start_level(LevelParser *parser, uint8_t level) {
+    parser->level = level;
+    parser->state = LP_ST_COUNT;
+    parser->game->num_st_platforms[level] = 0;
+    parser->game->num_mov_platforms[level] = 0;
+    parser->game->raster[level] = 0;
+}
+
+// Parser Init
+void level_parser_init(LevelParser *parser, GameState *game, uint8_t first_level, uint8_t max_levels) {
+    memset(parser, 0, sizeof(*parser));
+    parser->game = game;
+    parser->first_level = first_level;
+    parser->max_levels = max_levels;
+    parser->levels = 1;
+    parser->line = 1;
+    start_level(parser, first_level);
+}
+
+// Close the number being read, returns -1 on a line with too many fields
+static int end_field(LevelParser *parser) {
+    if (parser->num_fields >= LEVEL_MAX_FIELDS) {
+        return -1;
+    }
+    parser->fields[parser->num_fields++] = parser->value;
+    parser->value = 0;
+    parser->in_number = 0;
+    parser->number_done = 0;
+    return 0;
+}
+
+// A platform whose rightmost position starts at x_last stays on the 128x128 board
+static int on_board(int x_last, int y, int length, int thickness) {
+    return length > 0 && thickness > 0 && x_last + length <= 128 && y + thickness <= 128;
+}
+
+// Store a complete line
+static LevelParseState end_record(LevelParser *parser) {
+    GameState *game = parser->game;
+    uint16_t *f = parser->fields;
+    uint8_t n = parser->num_fields, i;
+
+    parser->num_fields = 0;
+    if (n == 0) {
+        return parser->state;   // Blank line
+    }
+    for (i = 0; i < n; i++) {
+        if (f[i] > 255) {
+            return LP_ERROR;
+        }
+    }
+
+    // "PACK <n>" header
+    if (parser->keyword) {
+        if (parser->keyword != 4 || n != 1 || f[0] == 0 || f[0] > parser->max_levels) {
+            return LP_ERROR;
+        }
+        parser->keyword = 0;
+        parser->levels = f[0];
+        return LP_ST_COUNT;
+    }
+
+    switch (parser->state) {
+    case LP_ST_COUNT:
+    case LP_MOV_COUNT:
+        if (n != 1 || f[0] > MAX_PLATFORMS) {
+            return LP_ERROR;
+        }
+        parser->count = f[0];
+        parser->plat = 0;
+
+        // Storage is sized by the count, a map that doesn't fit fails here
+        if (parser->state == LP_ST_COUNT) {
+            parser->st_plats = game_alloc_static(game, parser->level, parser->count);
+            if (!parser->st_plats) {
+                return LP_ERROR;
+            }
+            game->num_st_platforms[parser->level] = 0;
+            return (parser->count > 0) ? LP_ST_PLATS : LP_MOV_COUNT;
+        }
+        if (!game_alloc_moving(game, parser->level, parser->count)) {
+            return LP_ERROR;
+        }
+        game->num_mov_platforms[parser->level] = 0;
+        return (parser->count > 0) ? LP_MOV_PLATS : LP_DONE;
+
+    case LP_ST_PLATS:
+        if (n != 4 || !on_board(f[0], f[1], f[2], f[3])) {
+            return LP_ERROR;
+        }
+        parser->st_plats[parser->plat] = create_static_platform(f[0], f[1], f[2], f[3]);
+        game->num_st_platforms[parser->level] = ++parser->plat;
+        return (parser->plat < parser->count) ? LP_ST_PLATS : LP_MOV_COUNT;
+
+    case LP_MOV_PLATS:
+        if (n != 6 || f[4] > f[0] || f[0] > f[5] || !on_board(f[5], f[1], f[2], f[3])) {
+            return LP_ERROR;
+        }
+        game->mov_plats[parser->level][parser->plat] = create_mov_platform(f[0], f[1], f[2], f[3], f[4], f[5]);
+        game->num_mov_platforms[parser->level] = ++parser->plat;
+        return (parser->plat < parser->count) ? LP_MOV_PLATS : LP_DONE;
+
+    default:
+        return parser->state;
+    }
+}
+
+// Parser Feed
+LevelParseState level_parser_feed(LevelParser *parser, const char *data, int len) {
+    int i;
+
+    for (i = 0; i < len && parser->state < LP_DONE; i++) {
+        char c = data[i];
+        if (c >= '0' && c <= '9') {
+            if (parser->number_done) {
+                parser->state = LP_ERROR;   // Two numbers without a comma
+                break;
+            }
+            if (parser->value <= 255) {
+                parser->value = parser->value * 10 + (c - '0');
+            }
+            parser->in_number = 1;
+        } else if (c == ',') {
+            if (!parser->in_number || end_field(parser) < 0) {
+                parser->state = LP_ERROR;
+                break;
+            }
+        } else if (c == '\n') {
+            if (parser->in_number) {
+                if (end_field(parser) < 0) {
+                    parser->state = LP_ERROR;
+                    break;
+                }
+            } else if (parser->num_fields > 0) {
+                parser->state = LP_ERROR;   // Line ends in a comma
+                break;
+            }
+            parser->state = end_record(parser);
+            parser->line++;
+            if (parser->state == LP_DONE && ++parser->levels_done < parser->levels) {
+                start_level(parser, parser->level + 1);
+            }
+        } else if (parser->line == 1 && parser->num_fields == 0 && !parser->in_number &&
+                   parser->keyword < 4 && c == "PACK"[parser->keyword]) {
+            parser->keyword++;
+        } else if (c == ' ' || c == '\t' || c == '\r') {
+            if (parser->in_number) {
+                parser->number_done = 1;
+            }
+        } else {
+            parser->state = LP_ERROR;
+            break;
+        }
+    }
+    parser->bytes += i;
+    return parser->state;
+}
+
+// Parser Finish
+int level_parser_finish(LevelParser *parser) {
+    // Last line without a newline
+    if (parser->state < LP_DONE && (parser->in_number || parser->num_fields > 0)) {
+        level_parser_feed(parser, "\n", 1);
+    }
+    // The moving platform count of the last level is optional
+    if (parser->state == LP_MOV_COUNT && parser->levels_done + 1 == parser->levels) {
+        parser->state = LP_DONE;
+        parser->levels_done++;
+    }
+    return (parser->state == LP_DONE) ? 0 : -1;
+}
@@ -0,0 +1,71 @@
+/*
+ * level_parser.h
+ *
+ *  Incremental parser for the text level format. Data is fed in whatever
+ *  pieces recv() hands back and platforms are written straight into the
+ *  GameState as each line completes, so a level never has to fit in memory.
+ *
+ *  Format, one record per line, blank lines and spaces/tabs/CR ignored:
+ *      <static platform count>
+ *      x,y,length,thickness            (once per static platform)
+ *      <moving platform count>         (optional, 0 if missing)
+ *      x,y,length,thickness,x_min,x_max (once per moving platform)
+ *  Numbers may have any number of digits but must fit in a byte. Platforms
+ *  must lie on the 128x128 board over their whole range of movement, with
+ *  x_min <= x <= x_max, or the file is rejected.
+ *
+ *  A pack holds several levels in one file. Its first line is "PACK <n>"
+ *  and the n levels follow back to back, each going to the next slot. The
+ *  moving platform count is required in packs except for the last level.
+ */
+
+#ifndef LEVEL_PARSER_H_
+#define LEVEL_PARSER_H_
+
+#include <stdint.h>
+
+#include "game.h"
+
+#define LEVEL_MAX_FIELDS    6
+
+typedef enum {
+    LP_ST_COUNT,
+    LP_ST_PLATS,
+    LP_MOV_COUNT,
+    LP_MOV_PLATS,
+    LP_DONE,
+    LP_ERROR
+} LevelParseState;
+
+typedef struct {
+    GameState *game;
+    uint8_t level;                      /* Slot being filled */
+    uint8_t first_level, max_levels;    /* Slots the file may fill */
+    uint8_t levels;                     /* Levels in the file, 1 unless it is a pack */
+    uint8_t levels_done;
+    uint8_t keyword;                    /* Characters of "PACK" matched */
+    LevelParseState state;
+    uint8_t plat;                       /* Records of the current kind stored so far */
+    uint8_t count;                      /* Records of the current kind expected */
+    Platform *st_plats;                 /* Arena storage of the level's static platforms */
+
+    // Current line
+    uint8_t num_fields;
+    uint16_t fields[LEVEL_MAX_FIELDS];
+    uint16_t value;                     /* Number being read, saturates above 255 */
+    uint8_t in_number, number_done;
+
+    uint32_t line;                      /* Line number, for error reports */
+    uint32_t bytes;                     /* Bytes consumed */
+} LevelParser;
+
+// Start parsing a level file or pack into slots first_level onwards
+void level_parser_init(LevelParser *parser, GameState *game, uint8_t first_level, uint8_t max_levels);
+
+// Feed the next piece of the file, returns the parser state
+LevelParseState level_parser_feed(LevelParser *parser, const char *data, int len);
+
+// End of file, returns 0 if every level in the file was read
+int level_parser_finish(LevelParser *parser);
+
+#endif /* LEVEL_PARSER_H_ */
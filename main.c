@@ -41,6 +41,21 @@
 
 // Custom includes
 #include "utils/network_utils.h"
+#include "utils/level_cache.h"
+#include "utils/http_client.h"
+#include "utils/dns_cache.h"
+#include "utils/tls_channel.h"
+#include "dist_field.h"
+#include "game.h"
+#include "replay.h"
+#include "level_loader.h"
+#include "level_bin.h"
+#include "offline_levels.h"
+#include "procgen.h"
+#include "map_names.h"
+#include "manifest.h"
+#include "map_prefetch.h"
+#include "leaderboard.h"
 
 // Constants
 #define DATE                28    /* Current Date */
@@ -54,11 +69,21 @@
 #define APPLICATION_VERSION   "SQ24"
 #define SERVER_NAME           "a1ytls0rwh8mrv-ats.iot.us-east-2.amazonaws.com"
 #define GOOGLE_DST_PORT       8443
+#define MAP_HOST              "mapdownloadsluke.s3.us-east-2.amazonaws.com"
 #define PORT                  80
 #define BUFFER_SIZE           4096
+#define MAP_DOWNLOAD_TRIES    3
+#define MAP_RESUME_TRIES      5     /* Range requests to finish one cut-short download */
+#define MAP_RETRY_MIN_MS      500   /* Backoff before the first retry, doubling after */
+#define MAP_RETRY_MAX_MS      8000
+#define MAP_LARGE_SIZE        LEVEL_CACHE_FILE_MAX  /* Maps bigger than this aren't kept in flash */
 #define SYSCLKFREQ            80000000ULL
 #define SYSTICK_RELOAD_VAL    1600000UL
 #define SPI_IF_BIT_RATE       20000000
+#define MAX_CATCHUP_TICKS     5     /* Simulation ticks run back to back before discarding */
+#define MAP_PREFETCH_ENABLE   1     /* Download maps while the map menu is shown */
+#define CONNECT_FRAME_TICKS   5     /* Systicks between frames of the connect animation */
+#define CONNECT_FAIL_SHOW_MS  2000
 
 #define SUCCESS               0
 #define RET_IF_ERR(Func)      {int iRetVal = (Func); if (SUCCESS != iRetVal) return iRetVal;}
@@ -72,41 +97,59 @@ extern uVectorEntry __vector_table;
 
 // Global Variables
 char buffer[BUFFER_SIZE];
+int buffer_len = 0;
+HttpClient map_client;                      /* Kept-alive connection to the map host */
+MapPrefetch map_prefetch;
+TlsChannel iot_channel;                     /* Kept-open secure connection to the IoT host */
+Leaderboard leaderboard;
 volatile int systick_cnt = 0;
 volatile int sel_delay_cnt = 0;
-volatile uint8_t tick = 0;
-volatile int total_time = 0;
-
-
+volatile uint32_t sim_ticks = 0;
+uint32_t sim_done = 0;
+uint32_t win_ticks = 0;                     /* Game ticks to the WIN level, 0 until reached */
 
 typedef struct {
-    uint8_t length;
-    uint8_t thickness;
-    uint8_t x, y;
-} Platform;
-
+    uint32_t sim_steps;         /* Fixed simulation ticks advanced */
+    uint32_t frames_drawn;
+    uint32_t frames_dropped;    /* Ticks coalesced into a later frame */
+    uint32_t ticks_discarded;   /* Backlog beyond MAX_CATCHUP_TICKS */
+    uint32_t overruns;          /* Loop iterations longer than one tick */
+    uint32_t overrun_us_total;
+    uint32_t overrun_us_max;
+} FrameStats;
+
+FrameStats frame_stats;
+GameState game;
+ReplayLog replay_log;
+ReplayPlayer replay_player;
+LevelLoader level_loader;
+uint64_t level_raster[MAP_WORDS];   /* Rasterized rows of a single binary level */
+
+// Consumer of a cached download and the progress drawn for it
 typedef struct {
-    Platform plat;
-    uint8_t x_min, x_max;
-} MovablePlatform;
+    HttpBodySink on_body;
+    void *ctx;
+    uint8_t show_progress;
+    int8_t percent;         /* Progress last drawn, -1 if none */
+} DownloadSink;
 
-Platform static_plats[20][20];
-MovablePlatform mov_plats[20][20];
+LevelCacheTee cache_tee;
+DownloadSink download_sink;
 
 // Function Prototypes
 static void BoardInit(void);
 static void SysTickInit(void);
 static inline void SysTickReset(void);
 static void SysTickHandler(void);
-static int set_time(void);
-int http_map_download(const char *path);
+static uint64_t systick_cycles(void);
+static uint32_t clock_ms(void);
+static void report_frame_stats(void);
+static void report_level_memory(void);
+static void report_tls_stats(void);
 void console_map(uint64_t *map);
-void map_fillCircle(int x_pos, int y_pos, int radius, uint8_t delete, uint64_t *map);
-void map_draw(uint64_t *map, uint64_t *prev_map, unsigned int color);
-Platform create_static_platform(uint8_t x, uint8_t y, uint8_t length, uint8_t thickness);
-MovablePlatform create_mov_platform(uint8_t x, uint8_t y, uint8_t length, uint8_t thickness, uint8_t x_min, uint8_t x_max);
-void load_level(uint64_t *map, uint64_t *prev_map, Platform *st_plats, uint8_t num_st_plats, MovablePlatform *mov_plats, uint8_t num_mov_plats);
-void update_platforms(MovablePlatform *mov_plats, uint8_t num_plats, int tilt, uint64_t *map);
+void map_draw(const RenderDiff *diff, unsigned int color);
+void read_input(Input *input, unsigned long uiChannel);
+void replay_dump(const ReplayLog *log);
 
 // Board Initialization
 static void BoardInit(void) {
@@ -131,91 +174,196 @@ static void SysTickInit(void) {
 }
 
 // SysTick Reset
+// Restarts the frame pacing count only. The down-counter is left running,
+// clearing it would set clock_ms() back and upset the timers built on it.
 static inline void SysTickReset(void) {
-    HWREG(NVIC_ST_CURRENT) = 1;
     systick_cnt = 0;
 }
 
 // SysTick Handler
 static void SysTickHandler(void) {
-    tick = 1;
+    sim_ticks++;
     systick_cnt++;
     sel_delay_cnt++;
-    total_time++;
 }
 
-// Set Time
-static int set_time(void) {
-    SlDateTime g_time;
-    long retVal;
+// Cycles since SysTick was started, combining the tick count with the down-counter
+static uint64_t systick_cycles(void) {
+    uint32_t ticks, current;
+    do {
+        ticks = sim_ticks;
+        current = HWREG(NVIC_ST_CURRENT);
+    } while (ticks != sim_ticks);
+    return (uint64_t)ticks * SYSTICK_RELOAD_VAL + (SYSTICK_RELOAD_VAL - current);
+}
 
-    g_time.tm_day = DATE;
-    g_time.tm_mon = MONTH;
-    g_time.tm_year = YEAR;
-    g_time.tm_sec = SECOND;
-    g_time.tm_hour = HOUR;
-    g_time.tm_min = MINUTE;
+// Milliseconds since SysTick was started, the DNS cache's clock
+static uint32_t clock_ms(void) {
+    return (uint32_t)(systick_cycles() / (SYSCLKFREQ / 1000));
+}
 
-    retVal = sl_DevSet(SL_DEVICE_GENERAL_CONFIGURATION,
-                       SL_DEVICE_GENERAL_CONFIGURATION_DATE_TIME,
-                       sizeof(SlDateTime), (unsigned char *)(&g_time));
+// Report and clear frame timing counters
+static void report_frame_stats(void) {
+    Report("Frames: %u sim ticks, %u drawn, %u dropped, %u discarded\r\n",
+           frame_stats.sim_steps, frame_stats.frames_drawn,
+           frame_stats.frames_dropped, frame_stats.ticks_discarded);
+    Report("Overrun: %u frames, %u us total, %u us max\r\n",
+           frame_stats.overruns, frame_stats.overrun_us_total, frame_stats.overrun_us_max);
+    memset(&frame_stats, 0, sizeof(frame_stats));
+}
 
-    if (retVal < 0) return retVal;
-    return SUCCESS;
+// SRAM the level just loaded takes, reported at every load since endless
+// levels are generated into the arena one at a time
+static void report_level_memory(void) {
+#if DIST_FIELD_ENABLE
+    Report("Distance fields: %u bytes\r\n", dist_field_bytes());
+#endif
+    Report("Level arena: %u bytes high water, %u free\r\n", game.arena.high_water,
+           arena_free_bytes(&game.arena));
+    if (game.plat_index.overflow) {
+        Report("Platform index: a row has more than %u platforms, scanning them instead\r\n", PLAT_ROW_SPANS);
+    }
 }
 
-// HTTP Map Download
-int http_map_download(const char *path) {
-    int sockfd;
-    struct sockaddr_in server_addr;
-    _u32 ip_addr;
-    _i8 *host = "mapdownloadsluke.s3.us-east-2.amazonaws.com";
-    _u16 host_len = strlen(host);
-    _u8 family = SL_AF_INET;
+// Handshake cost against replies on the kept-open IoT channel
+static void report_tls_stats(void) {
+    const TlsStats *stats = &iot_channel.stats;
+    Report("TLS: %u handshakes, last %u ms, avg %u ms; %u failed, %u dropped\r\n", stats->handshakes,
+           stats->handshake_ms_last, stats->handshakes ? stats->handshake_ms_total / stats->handshakes : 0,
+           stats->failures, stats->drops);
+    Report("TLS: %u replies on the open channel, last %u ms, avg %u ms\r\n", stats->exchanges,
+           stats->reply_ms_last, stats->exchanges ? stats->reply_ms_total / stats->exchanges : 0);
+    Report("Leaderboard: %u queued, %u submitted in %u batches, %u fetches, %u failed, %u dropped\r\n",
+           leaderboard.count, leaderboard.stats.submitted, leaderboard.stats.batches,
+           leaderboard.stats.fetches, leaderboard.stats.failures, leaderboard.stats.dropped);
+}
 
-    if (sl_NetAppDnsGetHostByName(host, host_len, &ip_addr, family) < 0) {
-        fprintf(stderr, "Failed to resolve hostname: %s\n", host);
-        return 1;
+// Percent of the file received, -1 while its size isn't known
+static int download_percent(const LevelCacheTee *tee) {
+    if (!tee->total) {
+        return -1;
     }
+    return (tee->delivered >= tee->total) ? 100 : (int)((uint64_t)tee->delivered * 100 / tee->total);
+}
 
-    if ((sockfd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-        perror("Socket creation failed");
-        return 1;
-    }
+static void draw_download_progress(int percent) {
+    char label[24];
+
+    snprintf(label, sizeof(label), "Loading %d%%", percent);
+    setTextSize(1);
+    fillRect(10, 45, 118, 8, BLACK);
+    setCursor(10, 45);
+    Outstr(label);
+    drawRect(10, 60, 104, 8, WHITE);
+    fillRect(12, 62, percent, 4, WHITE);     // The bar is 100 pixels inside
+}
+
+static void clear_download_progress(void) {
+    fillRect(10, 45, 118, 23, BLACK);
+}
 
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(PORT);
-    server_addr.sin_addr.s_addr = htonl(ip_addr);
+// Wait before retry number attempt (from 0): doubling from MAP_RETRY_MIN_MS
+// up to MAP_RETRY_MAX_MS, and a random half to all of that so devices that
+// lost the same server don't all come back at once
+static void download_backoff(int attempt) {
+    static uint32_t seed;
+    uint32_t delay = MAP_RETRY_MIN_MS << ((attempt < 5) ? attempt : 5), start = clock_ms();
 
-    if (connect(sockfd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
-        perror("Connection failed");
-        close(sockfd);
-        return 1;
+    if (delay > MAP_RETRY_MAX_MS) {
+        delay = MAP_RETRY_MAX_MS;
     }
+    if (!seed) {
+        seed = (uint32_t)systick_cycles() | 1;
+    }
+    delay = delay / 2 + procgen_rand(&seed) % (delay / 2 + 1);
+    while (clock_ms() - start < delay) {
+        _SlNonOsMainLoopTask();
+    }
+}
 
-    snprintf(buffer, sizeof(buffer),
-             "GET %s HTTP/1.1\r\n"
-             "Host: %s\r\n"
-             "Connection: close\r\n"
-             "\r\n",
-             path, host);
+// Pass a piece the tee stored on to the consumer, then redraw the progress
+static void download_body(const char *data, int len, void *ctx) {
+    DownloadSink *sink = (DownloadSink *)ctx;
+    int percent;
 
-    if (send(sockfd, buffer, strlen(buffer), 0) < 0) {
-        perror("Send failed");
-        close(sockfd);
-        return 1;
+    sink->on_body(data, len, sink->ctx);
+    percent = download_percent(&cache_tee);
+    if (sink->show_progress && percent != sink->percent) {
+        sink->percent = percent;
+        draw_download_progress(percent);
     }
+}
 
-    memset(buffer, 0, sizeof(buffer));
-    int bytes_received;
-    while ((bytes_received = recv(sockfd, buffer, sizeof(buffer) - 1, 0)) > 0) {
-        buffer[bytes_received] = '\0';
-        //printf("%s", buffer);
+// Download through the flash cache: a cached copy is revalidated with its
+// ETag and replayed on 304, a 200 response is stored as it streams past, and
+// if the server can't be reached before any data arrived the cached copy is
+// used as is. With manifest info a cached copy of the same size and hash is
+// used without asking the server, and a new copy reserves only its size in
+// flash. A response cut short is resumed with Range requests from where it
+// stopped, as long as the ETag or the manifest hash can tell whether the
+// pieces belong together; a resumed file is checked against the manifest.
+// Returns 0 once on_body has seen the whole file.
+int cached_download(const char *path, const MapInfo *info, int show_progress, HttpBodySink on_body, void *ctx) {
+    const LevelCacheEntry *entry = level_cache_find(path);
+    int ret, resumes;
+
+    if (entry && info && info->hash && entry->hash == info->hash && entry->size == info->size &&
+        level_cache_read(path, on_body, ctx) == 0) {
+        Report("%s: matches the manifest, read from flash\r\n", path);
+        return 0;
     }
 
-    close(sockfd);
-    return 0;
+    download_sink.on_body = on_body;
+    download_sink.ctx = ctx;
+    download_sink.show_progress = show_progress;
+    download_sink.percent = -1;
+    level_cache_tee_init(&cache_tee, path, info ? info->size : 0, &map_client.parser, download_body, &download_sink);
+    ret = http_get(&map_client, path, entry ? entry->etag : NULL, level_cache_tee_body, &cache_tee);
+
+    if (ret == 0 && map_client.parser.status == 304) {
+        if (level_cache_read(path, on_body, ctx) == 0) {
+            Report("%s: not modified, read from flash\r\n", path);
+            return 0;
+        }
+        // The cached copy was damaged and has been dropped, fetch it whole
+        ret = http_get(&map_client, path, NULL, level_cache_tee_body, &cache_tee);
+    }
+
+    for (resumes = 0; ret != 0 && resumes < MAP_RESUME_TRIES && cache_tee.delivered && !cache_tee.mismatch &&
+                      (cache_tee.etag[0] || (info && info->hash)); resumes++) {
+        Report("%s: HTTP error %d after %u bytes, resuming\r\n", path, ret, cache_tee.delivered);
+        download_backoff(resumes);
+        cache_tee.started = 0;
+        cache_tee.resumed = 1;
+        ret = http_get_range(&map_client, path, cache_tee.etag, cache_tee.delivered, level_cache_tee_body,
+                             &cache_tee);
+    }
+
+    if (ret == 0 && (map_client.parser.status == 200 || map_client.parser.status == 206) && !cache_tee.mismatch) {
+        if (cache_tee.resumed && info && info->hash &&
+            (cache_tee.hash != info->hash || (info->size && cache_tee.delivered != info->size))) {
+            Report("%s: resumed download doesn't match the manifest\r\n", path);
+            level_cache_abort();
+            return -1;
+        }
+        if (cache_tee.caching) {
+            level_cache_commit();
+        }
+        return 0;
+    }
+    level_cache_abort();
+    if (cache_tee.mismatch) {
+        Report("%s: changed on the server while resuming\r\n", path);
+    } else if (ret != 0) {
+        Report("%s: HTTP error %d\r\n", path, ret);
+    } else {
+        Report("%s: HTTP status %d\r\n", path, map_client.parser.status);
+    }
+    if (ret != 0 && cache_tee.delivered == 0 && level_cache_read(path, on_body, ctx) == 0) {
+        Report("%s: server unreachable, read from flash\r\n", path);
+        return 0;
+    }
+    return -1;
 }
 
 int GetTilt(unsigned char ucDevAddr, unsigned char ucRegOffset, unsigned char ucRdLen, unsigned char *aucRdDataBuf) {
@@ -240,114 +388,47 @@ void console_map(uint64_t *map) {
     }
 }
 
-// Fill Circle in Map
-void map_fillCircle(int x_pos, int y_pos, int radius, uint8_t delete, uint64_t *map) {
-    int x, y;
-    for (y = y_pos - radius; y < y_pos + radius; y++) {
-        for (x = x_pos - radius; x < x_pos + radius; x++) {
-            if ((x - x_pos) * (x - x_pos) + (y - y_pos) * (y - y_pos) < radius * radius) {
-                if (delete) {
-                    uint64_t delete_mask = (0xFFFFFFFFFFFFFFFF << (64 - (x) % 64)) | (0xFFFFFFFFFFFFFFFF >> ((x) % 64) + 1);
-                    map[(y) * 2 + ((x) / 64)] &= delete_mask;
-                } else {
-                    map[(y) * 2 + ((x) / 64)] |= 0x8000000000000000 >> (x % 64);
-                }
-            }
-        }
-    }
-}
-
 // Draw Map
-void map_draw(uint64_t *map, uint64_t *prev_map, unsigned int color) {
+void map_draw(const RenderDiff *diff, unsigned int color) {
     unsigned int i, j;
-    for (i = 0; i < 256; i++) {
-        if (map[i] != prev_map[i]) {
-            uint64_t map_row = map[i], prev_map_row = prev_map[i];
-            uint64_t diff = map_row ^ prev_map_row;
-            for (j = 0; j < 64; j++) {
-                if ((diff << j) & 0x8000000000000000) {
-                    if ((map_row << j) & 0x8000000000000000) {
-                        drawPixel((i % 2) * 64 + j, i / 2, color);
-                    } else {
-                        drawPixel((i % 2) * 64 + j, i / 2, BLACK);
-                    }
+    for (i = 0; i < diff->count; i++) {
+        unsigned int word = diff->word[i];
+        uint64_t map_row = diff->bits[i], changed = diff->changed[i];
+        for (j = 0; j < 64; j++) {
+            if ((changed << j) & 0x8000000000000000) {
+                if ((map_row << j) & 0x8000000000000000) {
+                    drawPixel((word % 2) * 64 + j, word / 2, color);
+                } else {
+                    drawPixel((word % 2) * 64 + j, word / 2, BLACK);
                 }
             }
         }
     }
 }
 
-// Create Static Platform
-Platform create_static_platform(uint8_t x, uint8_t y, uint8_t length, uint8_t thickness) {
-    Platform plat = {length, thickness, x, y};
-    return plat;
-}
-
-// Create Movable Platform
-MovablePlatform create_mov_platform(uint8_t x, uint8_t y, uint8_t length, uint8_t thickness, uint8_t x_min, uint8_t x_max) {
-    MovablePlatform mov_plat = {{length, thickness, x, y}, x_min, x_max};
-    return mov_plat;
+// Read Input
+void read_input(Input *input, unsigned long uiChannel) {
+    GetTilt(0x18, 0x5, 1, &input->tilt_reg);
+    input->adc_valid = MAP_ADCFIFOLvlGet(ADC_BASE, uiChannel) ? 1 : 0;
+    input->adc_sample = input->adc_valid ? MAP_ADCFIFORead(ADC_BASE, uiChannel) : 0;
+    input->button = GPIOPinRead(GPIOA0_BASE, 0x80) ? 1 : 0;
 }
 
-// Load Level
-void load_level(uint64_t *map, uint64_t *prev_map, Platform *st_plats, uint8_t num_st_plats, MovablePlatform *mov_plats, uint8_t num_mov_plats) {
-    uint8_t i, j, k;
-    int map_idx;
-    for (map_idx = 0; map_idx < 256; map_idx++) {
-        map[map_idx] = 0;
-    }
-    for (i = 0; i < num_st_plats; i++) {
-        for (k = 0; k < st_plats[i].thickness; k++) {
-            for (j = 0; j < st_plats[i].length; j++) {
-                uint8_t y = st_plats[i].y + k;
-                uint8_t x = st_plats[i].x + j;
-                uint64_t mask = 0x8000000000000000 >> (x % 64);
-                map[(y) * 2 + ((x) / 64)] |= mask;
-                uint64_t delete_mask = (0xFFFFFFFFFFFFFFFF << (64 - (x) % 64)) | (0xFFFFFFFFFFFFFFFF >> ((x) % 64) + 1);
-                prev_map[(y) * 2 + ((x) / 64)] &= delete_mask;
-            }
-        }
-    }
-    for (i = 0; i < num_mov_plats; i++) {
-        for (k = 0; k < mov_plats[i].plat.thickness; k++) {
-            for (j = 0; j < mov_plats[i].plat.length; j++) {
-                uint8_t y = mov_plats[i].plat.y + k;
-                uint8_t x = mov_plats[i].plat.x + j;
-                uint64_t mask = 0x8000000000000000 >> (x % 64);
-                map[(y) * 2 + ((x) / 64)] |= mask;
-                uint64_t delete_mask = (0xFFFFFFFFFFFFFFFF << (64 - (x) % 64)) | (0xFFFFFFFFFFFFFFFF >> ((x) % 64) + 1);
-                prev_map[(y) * 2 + ((x) / 64)] &= delete_mask;
-            }
+// Dump a recording over UART as hex, for replaying on the device or host
+void replay_dump(const ReplayLog *log) {
+    unsigned int i;
+    Report("REPLAY v1 source=%u color=%x ticks=%u len=%u hash=%08x path=%s\r\n",
+           log->source, log->color, log->ticks, log->len, replay_hash(log), log->path);
+    for (i = 0; i < log->len; i++) {
+        Report("%02x", log->data[i]);
+        if (i % 32 == 31 || i == log->len - 1) {
+            Report("\r\n");
         }
     }
+    Report("END%s\r\n", log->overflow ? " overflow" : "");
 }
 
-// Update Platforms
-void update_platforms(MovablePlatform *mov_plats, uint8_t num_plats, int tilt, uint64_t *map) {
-    int i, y, x;
-    if (tilt != 0) {
-        for (i = 0; i < num_plats; i++) {
-            mov_plats[i].plat.x += tilt;
-            if (mov_plats[i].plat.x > mov_plats[i].x_max) {
-                mov_plats[i].plat.x = mov_plats[i].x_max;
-            } else if (mov_plats[i].plat.x < mov_plats[i].x_min) {
-                mov_plats[i].plat.x = mov_plats[i].x_min;
-            }
-            for (y = mov_plats[i].plat.y; y < mov_plats[i].plat.y + mov_plats[i].plat.thickness; y++) {
-                for (x = mov_plats[i].x_min; x < mov_plats[i].x_max + mov_plats[i].plat.length; x++) {
-                    if (x < mov_plats[i].plat.x || x > mov_plats[i].plat.x + mov_plats[i].plat.length) {
-                        uint64_t delete_mask = (0xFFFFFFFFFFFFFFFF << (64 - (x) % 64)) | (0xFFFFFFFFFFFFFFFF >> ((x) % 64) + 1);
-                        map[(y) * 2 + ((x) / 64)] &= delete_mask;
-                    } else {
-                        map[(y) * 2 + ((x) / 64)] |= 0x8000000000000000 >> (x % 64);
-                    }
-                }
-            }
-        }
-    }
-}
-
-void start_menu(char mode_names[2][10], int num_modes, unsigned long uiChannel, uint8_t *mode) {
+void start_menu(char mode_names[][10], int num_modes, unsigned long uiChannel, uint8_t *mode) {
     setTextSize(2);
     int mode_idx;
     unsigned long ulSample;
@@ -392,79 +473,154 @@ void start_menu(char mode_names[2][10], int num_modes, unsigned long uiChannel,
     }
 }
 
+// Draw the connect progress: state name, a bar and a spinner
+static void draw_connect_progress(const WifiConnect *wc, uint8_t frame) {
+    static const char spinner[] = "|/-\\";
+    char label[24];
+    int width = wifi_connect_progress(wc);     // The bar is 100 pixels inside
+
+    snprintf(label, sizeof(label), "%c %s", spinner[frame % 4], wifi_state_name(wc->state));
+    fillRect(10, 45, 118, 8, BLACK);
+    setCursor(10, 45);
+    Outstr(label);
+    drawRect(10, 60, 104, 8, WHITE);
+    fillRect(12, 62, width, 4, WHITE);
+}
+
+// Connect to WIFI and the IoT host while animating the progress. Pressing
+// the button cancels back to the start menu.
 int WIFI_connect(uint8_t *connected) {
+    WifiConnect wc;
+    uint8_t frame = 0;
+    uint32_t shown_at;
+    int ret;
+
     if (*connected) {
         return 0;
     }
-    // Connect to WIFI
-    long lRetVal = -1;
-
     setTextSize(1);
     setCursor(10, 30);
     Outstr("Connecting to WIFI");
+    setCursor(10, 80);
+    Outstr("Press to cancel");
     g_app_config.host = SERVER_NAME;
     g_app_config.port = GOOGLE_DST_PORT;
-    lRetVal = connectToAccessPoint();
-    lRetVal = set_time();
-    if (lRetVal < 0) {
-        UART_PRINT("Unable to set time in the device");
-        setCursor(10, 60);
-        Outstr("Connection Failed");
-        MAP_UtilsDelay(40000000);
-        fillScreen(BLACK);
-        return -1;
-    }
+    memset(&g_time, 0, sizeof(g_time));
+    g_time.tm_day = DATE;
+    g_time.tm_mon = MONTH;
+    g_time.tm_year = YEAR;
+    g_time.tm_sec = SECOND;
+    g_time.tm_hour = HOUR;
+    g_time.tm_min = MINUTE;
 
-    lRetVal = tls_connect();
-    if (lRetVal < 0) {
-        ERR_PRINT(lRetVal);
-        setCursor(10, 60);
-        Outstr("Connection Failed");
-        MAP_UtilsDelay(40000000);
+    sel_delay_cnt = 0;
+    SysTickReset();
+    wifi_connect_start(&wc, clock_ms());
+    while ((ret = wifi_connect_poll(&wc, clock_ms())) == WIFI_PENDING) {
+        if (systick_cnt >= CONNECT_FRAME_TICKS) {
+            draw_connect_progress(&wc, frame++);
+            SysTickReset();
+        }
+        if (GPIOPinRead(GPIOA0_BASE, 0x80) && sel_delay_cnt >= 20) {
+            wifi_connect_cancel(&wc);
+            sel_delay_cnt = 0;
+            fillScreen(BLACK);
+            return -1;
+        }
+    }
+    if (ret < 0) {
+        ERR_PRINT(ret);
+        draw_connect_progress(&wc, frame);
+        setCursor(10, 30);
+        Outstr("Connection Failed ");
+        // Leave the message up a moment, pressing the button skips it
+        shown_at = clock_ms();
+        while (clock_ms() - shown_at < CONNECT_FAIL_SHOW_MS &&
+               !(GPIOPinRead(GPIOA0_BASE, 0x80) && sel_delay_cnt >= 20));
+        sel_delay_cnt = 0;
         fillScreen(BLACK);
         return -1;
     }
     fillScreen(BLACK);
+    tls_channel_adopt(&iot_channel, wc.sock, wc.tls_ms, clock_ms());
+    leaderboard_load(&leaderboard);
     *connected = 1;
     return 0;
+}
 
+// Append a piece of a download to buffer, keeping it NUL terminated
+static void buffer_append(const char *data, int len, void *ctx) {
+    if (len > (int)sizeof(buffer) - 1 - buffer_len) {
+        len = sizeof(buffer) - 1 - buffer_len;
+    }
+    memcpy(buffer + buffer_len, data, len);
+    buffer_len += len;
+    buffer[buffer_len] = '\0';
 }
 
-void download_file(char *map_names_txt, char **content) {
-    while (*content == NULL) {
-        Report("Trying download of map names\r\n");
-        http_map_download(map_names_txt);
-        *content = strstr(buffer, "close");
-        if (*content == NULL) {
+// Download a text file into buffer, returns -1 if it never arrived
+int download_file(const char *path, int max_tries, char **content) {
+    int tries;
+    *content = NULL;
+    for (tries = 0; tries < max_tries && *content == NULL; tries++) {
+        if (tries) {
+            download_backoff(tries - 1);
+        }
+        Report("Trying download of %s\r\n", path);
+        buffer_len = 0;
+        buffer[0] = '\0';
+        if (cached_download(path, NULL, 0, buffer_append, NULL) == 0) {
             *content = buffer;
-        } else {
-            *content += 5;
         }
-        //*content = strstr(buffer, "\r\n\r\n");
+    }
+    if (*content == NULL) {
+        return -1;
     }
 
     while (**content == '\t' || **content == '\n' || **content == '\v' || **content == '\f' || **content == '\r' || **content == ' ') {
         *content = *content + 1;
     }
+    return 0;
 }
 
-void parse_map_names(char map_names[20][20], char *content, int *num_maps) {
-    int idx = 0, map_char_idx = 0;
-    *num_maps = 0;
-    while (1) {
-        if (content[idx] == '_') {
-            map_names[*num_maps][map_char_idx] = '\0';
-            *num_maps = *num_maps + 1;
-            map_char_idx = 0;
-            idx += 10;
+// Fetch the list of maps: the manifest if the server has one, else the
+// plain name list with nothing known about the files. Maps with more
+// levels than there are slots are left out. Returns the number of maps.
+int download_map_list(MapInfo *maps) {
+    char names[MAP_NAMES_MAX][MAP_NAME_SIZE];
+    char *content;
+    int num_maps, i, kept;
+
+    // A server without a manifest answers 404, which isn't worth retrying
+    if (download_file(MANIFEST_PATH, 1, &content) == 0 &&
+        (num_maps = parse_manifest(maps, MAP_NAMES_MAX, content)) > 0) {
+        for (i = 0, kept = 0; i < num_maps; i++) {
+            Report("%s: %u bytes, hash %08x, %u level(s), difficulty %u\r\n", maps[i].name,
+                   maps[i].size, maps[i].hash, maps[i].levels, maps[i].difficulty);
+            if (maps[i].levels > MAX_LEVELS - 1) {
+                Report("%s: more levels than fit, skipped\r\n", maps[i].name);
+                continue;
+            }
+            maps[kept++] = maps[i];
         }
-        if (content[idx] == '\0') return;
-        map_names[*num_maps][map_char_idx++] = content[idx];
-        idx++;
+        return kept;
     }
+
+    if (download_file("/Map_names.txt", MAP_DOWNLOAD_TRIES, &content) < 0) {
+        return 0;
+    }
+    num_maps = parse_map_names(names, MAP_NAMES_MAX, content);
+    memset(maps, 0, num_maps * sizeof(MapInfo));
+    for (i = 0; i < num_maps; i++) {
+        strcpy(maps[i].name, names[i]);
+    }
+    return num_maps;
 }
 
-int map_menu(char map_names[20][20], int num_maps, unsigned long uiChannel) {
+// Maps too big for the flash cache are shown in yellow, they are fetched
+// in full every time. With a prefetcher, maps download while the menu waits
+// for input and the highlighted one is fetched first.
+int map_menu(const MapInfo *maps, int num_maps, MapPrefetch *pf, unsigned long uiChannel) {
     uint8_t map_sel = num_maps - 1;
     int map_idx;
     unsigned long ulSample;
@@ -473,12 +629,19 @@ int map_menu(char map_names[20][20], int num_maps, unsigned long uiChannel) {
 
     setTextSize(2);
     for (map_idx = 0; map_idx < num_maps; map_idx++) {
+        unsigned int text_color = (maps[map_idx].size > MAP_LARGE_SIZE) ? YELLOW : WHITE;
+        setTextColor(text_color, text_color);
         setCursor(10, 5 + map_idx * 20);
-        Outstr(map_names[map_idx]);
+        Outstr((char *)maps[map_idx].name);
     }
+    setTextColor(WHITE, WHITE);
 
     // Map selection menu
     while (1) {
+        if (pf) {
+            _SlNonOsMainLoopTask();
+            map_prefetch_poll(pf);
+        }
         if (MAP_ADCFIFOLvlGet(ADC_BASE, uiChannel)) {
             ulSample = MAP_ADCFIFORead(ADC_BASE, uiChannel);
             x_voltage = (((float)((ulSample >> 2) & 0x0FFF)) * 1.4) / 4096;
@@ -488,21 +651,24 @@ int map_menu(char map_names[20][20], int num_maps, unsigned long uiChannel) {
             }
             if (GPIOPinRead(GPIOA0_BASE, 0x80) && sel_delay_cnt >= 20) {
                 uint8_t x = 5, y = 20 * map_sel;
-                fillRect(x, y, strlen(map_names[map_sel]) * 12 + 5, 3, BLACK);
+                fillRect(x, y, strlen(maps[map_sel].name) * 12 + 5, 3, BLACK);
                 fillRect(x - 3, y, 3, 23, BLACK);
-                fillRect(x - 3, y + 20, strlen(map_names[map_sel]) * 12 + 11, 3, BLACK);
-                fillRect(x + strlen(map_names[map_sel]) * 12 + 5, y, 3, 20, BLACK);
+                fillRect(x - 3, y + 20, strlen(maps[map_sel].name) * 12 + 11, 3, BLACK);
+                fillRect(x + strlen(maps[map_sel].name) * 12 + 5, y, 3, 20, BLACK);
                 map_sel = (map_sel == 0) ? num_maps - 1 : map_sel - 1;
+                if (pf) {
+                    map_prefetch_select(pf, map_sel);
+                }
                 sel_delay_cnt = 0;
                 systick_cnt = 30;
                 highlight_color = WHITE;
             }
             if (systick_cnt >= 30) {
                 uint8_t x = 5, y = 20 * map_sel;
-                fillRect(x, y, strlen(map_names[map_sel]) * 12 + 5, 3, highlight_color);
+                fillRect(x, y, strlen(maps[map_sel].name) * 12 + 5, 3, highlight_color);
                 fillRect(x - 3, y, 3, 23, highlight_color);
-                fillRect(x - 3, y + 20, strlen(map_names[map_sel]) * 12 + 11, 3, highlight_color);
-                fillRect(x + strlen(map_names[map_sel]) * 12 + 5, y, 3, 20, highlight_color);
+                fillRect(x - 3, y + 20, strlen(maps[map_sel].name) * 12 + 11, 3, highlight_color);
+                fillRect(x + strlen(maps[map_sel].name) * 12 + 5, y, 3, 20, highlight_color);
                 highlight_color = (highlight_color == BLACK) ? WHITE : BLACK;
                 SysTickReset();
             }
@@ -511,132 +677,79 @@ int map_menu(char map_names[20][20], int num_maps, unsigned long uiChannel) {
     return map_sel;
 }
 
-void parse_map_file(char *map_content, uint8_t *num_st_platforms, uint8_t *num_mov_platforms) {
-    int i = 0;
-    int idx = 0;
-    int level = 0;
-
-    // Extract number of static platforms
-    char num_st_plats[4];
-    while (map_content[idx] != '\n') {
-        num_st_plats[idx] = map_content[idx];
-        idx++;
-    }
-    num_st_plats[idx] = '\0';
-
-
-    // Convert to integer
-    num_st_platforms[level] = atoi(num_st_plats);
-
-    while (map_content[idx] == '\n' || map_content[idx] == '\t' || map_content[idx] == ' ') {
-        idx++;
-    }
-
-
-    // Create static platforms for level
-    for (i = 0; i < num_st_platforms[level]; i++) {
-        // Store arguments for static platform
-        char params[4][4];
+// Feed a piece of a level download to the loader
+static void level_body(const char *data, int len, void *ctx) {
+    level_loader_feed((LevelLoader *)ctx, data, len);
+}
 
-        // Extract the 4 arguments (x,y,length,thickness)
-        int arg_idx = 0;
-        int param_idx = 0;
-        while (map_content[idx] != '\n') {
-            if (map_content[idx] == ',') {
-                // Go to next argument
-                params[arg_idx][param_idx] = '\0';
-                param_idx = 0;
-                arg_idx++;
-                idx++;
-            }
-            params[arg_idx][param_idx] = map_content[idx];
-            idx++;
-            param_idx++;
+// Download a level file or pack into the slots from 0 and put the WIN level
+// after it, returns the number of levels or -1 if it never loaded. A local
+// file (just prefetched) is read from flash without asking the server.
+int download_levels(const char *path, const MapInfo *info, int local, GameState *game) {
+    int tries, levels;
+    for (tries = 0; tries < MAP_DOWNLOAD_TRIES; tries++) {
+        if (tries) {
+            download_backoff(tries - 1);
         }
-        idx++;
-        static_plats[level][i].x = (uint8_t)atoi(params[0]);
-        static_plats[level][i].y = (uint8_t)atoi(params[1]);
-        static_plats[level][i].length = (uint8_t)atoi(params[2]);
-        static_plats[level][i].thickness = (uint8_t)atoi(params[3]);
-    }
-
-
-    while (map_content[idx] == '\n' || map_content[idx] == '\t' || map_content[idx] == ' ') {
-        idx++;
-    }
-
-
-    // Extract number of moving platforms
-    int plat_idx = 0;
-    char num_mov_plats[4];
-    while (map_content[idx] != '\n' && map_content[idx] != '\0') {
-        num_mov_plats[plat_idx++] = map_content[idx];
-        idx++;
-    }
-    num_mov_plats[idx] = '\0';
-
-
-    // Convert to integer
-    num_mov_platforms[level] = atoi(num_mov_plats);
-
-    while (map_content[idx] == '\n' || map_content[idx] == '\t' || map_content[idx] == ' ') {
-        idx++;
-    }
-
-    // Create static platforms for level
-    for (i = 0; i < num_mov_platforms[level]; i++) {
-        // Store arguments for static platform
-        char params[6][4];
-
-        // Extract the 4 arguments (x,y,length,thickness)
-        int arg_idx = 0;
-        int param_idx = 0;
-        while (map_content[idx] != '\n') {
-            if (map_content[idx] == ',') {
-                // Go to next argument
-                params[arg_idx][param_idx] = '\0';
-                param_idx = 0;
-                arg_idx++;
-                idx++;
-            }
-            params[arg_idx][param_idx] = map_content[idx];
-            idx++;
-            param_idx++;
+        Report("Trying download of %s\r\n", path);
+        game_reset_levels(game);
+        level_loader_init(&level_loader, game, 0, MAX_LEVELS - 1, (uint8_t *)buffer, sizeof(buffer), level_raster);
+        if (local && level_cache_read(path, level_body, &level_loader) == 0) {
+            Report("%s: prefetched, read from flash\r\n", path);
+        } else if (cached_download(path, info, 1, level_body, &level_loader) != 0) {
+            continue;
+        }
+        local = 0;
+        levels = level_loader_finish(&level_loader);
+        if (levels > 0) {
+            Report("Loaded %d level(s) from %u bytes%s\r\n", levels, level_loader.bytes,
+                   game->raster[0] ? ", rasterized" : "");
+            Report("Cache: %u hits, %u misses, %u stores, %u evictions, %u corrupt\r\n",
+                   level_cache_stats.hits, level_cache_stats.misses, level_cache_stats.stores,
+                   level_cache_stats.evictions, level_cache_stats.corrupt);
+            Report("HTTP: %u requests on %u connections, %u resent, %u timed out, %u resumed\r\n",
+                   map_client.stats.requests, map_client.stats.connects, map_client.stats.retries,
+                   map_client.stats.timeouts, map_client.stats.ranges);
+            Report("DNS: %u hits, %u misses, %u failed, %u negative hits, %u expired\r\n",
+                   dns_cache_stats.hits, dns_cache_stats.misses, dns_cache_stats.failures,
+                   dns_cache_stats.negative_hits, dns_cache_stats.expired);
+            Report("Prefetch: %u started, %u done, %u cancelled, %u failed, %u bytes\r\n",
+                   map_prefetch.stats.started, map_prefetch.stats.done, map_prefetch.stats.cancelled,
+                   map_prefetch.stats.failed, map_prefetch.stats.bytes);
+            clear_download_progress();
+            game->num_levels = levels + 1;
+            return levels;
+        }
+        // Don't keep serving a file that doesn't load
+        level_cache_drop(path);
+        if (level_loader.error == LEVEL_BIN_E_MEMORY || game->arena.failures) {
+            Report("Map needs more than %u bytes of level storage\r\n", LEVEL_STORAGE_SIZE);
+        } else if (level_loader.error) {
+            Report("Binary level rejected (%d)\r\n", level_loader.error);
+        } else if (level_loader.parser.state == LP_ERROR) {
+            Report("Level file error on line %u\r\n", level_loader.parser.line);
         }
-        idx++;
-        mov_plats[level][i].plat.x = (uint8_t)atoi(params[0]);
-        mov_plats[level][i].plat.y = (uint8_t)atoi(params[1]);
-        mov_plats[level][i].plat.length = (uint8_t)atoi(params[2]);
-        mov_plats[level][i].plat.thickness = (uint8_t)atoi(params[3]);
-        mov_plats[level][i].x_min = (uint8_t)atoi(params[4]);
-        mov_plats[level][i].x_max = (uint8_t)atoi(params[5]);
     }
+    clear_download_progress();
+    return -1;
 }
 
 // Main Function
 void main(void) {
     // Variables
-    float gravity = 1, x_speed = 5, jump_speed = 8;
-    uint8_t character_radius = 5, max_levels = 10;
-    uint8_t on_ground = 1, level, num_levels = 0;
-    unsigned int color;
-    int tilt = 0;
-
-    uint8_t num_st_platforms[max_levels], num_mov_platforms[max_levels];
-    uint64_t map[256], prev_map[256];
-    float x_pos, y_pos;
-
-    unsigned long uiAdcInputPin = PIN_60, uiChannel = ADC_CH_3, ulSample;
-    float x_voltage = 0;
-    uint8_t mode = 1, num_modes = 2;
-    char mode_names[2][10] = {"Online", "Offline"};
-
-    float y_vel = 0, term_vel = 5;
+    unsigned long uiAdcInputPin = PIN_60, uiChannel = ADC_CH_3;
+    uint8_t mode = 1, num_modes = 4;
+    char mode_names[4][10] = {"Online", "Offline", "Replay", "Endless"};
+    uint8_t level;
+    Input input;
 
     uint8_t connected = 0;
-    char *content;
-    char map_names[20][20];
+    MapInfo maps[MAP_NAMES_MAX];
+    const MapInfo *sel_map = NULL;
+    char sel_map_name[REPLAY_PATH_SIZE];
     int num_maps;
+    int map_local = 0;
+    uint64_t select_time = 0;
 
 
     // Initialization
@@ -659,33 +772,46 @@ void main(void) {
     MAP_ADCTimerEnable(ADC_BASE);
     MAP_ADCEnable(ADC_BASE);
     MAP_ADCChannelEnable(ADC_BASE, uiChannel);
-
-    int row, i;
+    dns_cache_init(NULL, clock_ms);
+    http_client_init(&map_client, MAP_HOST, PORT);
+    leaderboard_init(&leaderboard, &iot_channel, SERVER_NAME);
 
 
 
 startMenu:
-    // Initialize Map
-    for (i = 0; i < 256; i++) {
-        map[i] = 0;
-        prev_map[i] = 0;
+    // A reconnect's lookup can wait for a menu, never for a game tick
+    if (connected) {
+        tls_channel_setup(&iot_channel, clock_ms());
     }
 
-    color = WHITE;
-    x_pos = 64, y_pos = 127 - character_radius;
-    y_vel = 0;
-    level = 0;
+    // Initialize game state and map
+    game_init(&game);
+
     // Start Menu to select online or offline mode
     start_menu(mode_names, num_modes, uiChannel, &mode);
 
 
-    if (mode == 1) {
+    if (mode == 2) {
+        // Replay the last recorded session on the same levels
+        if (replay_log.ticks == 0) {
+            goto startMenu;
+        }
+        replay_play(&replay_player, &replay_log);
+        if (replay_log.source == REPLAY_SOURCE_OFFLINE) {
+            game_load_offline_levels(&game);
+            goto map_create;
+        }
+    } else if (mode == 1) {
         // Offline
-        num_levels = 4;
+        game_load_offline_levels(&game);
+        goto map_create;
+    } else if (mode == 3) {
+        // Endless, seeded from how long the menu took
+        uint64_t gen_start = systick_cycles();
+        game_load_endless(&game, (uint32_t)gen_start);
+        Report("Endless seed %08x, level made in %u us\r\n", game.seed,
+               (uint32_t)((systick_cycles() - gen_start) / (SYSCLKFREQ / 1000000)));
         goto map_create;
-    } else {
-        // Online
-        num_levels = 2;
     }
 
     // Connect to WIFI
@@ -693,200 +819,175 @@ startMenu:
         // If WIFI failed go back to start menu
         goto startMenu;
     }
+    level_cache_init();
 
-    // Download list of map names
-    content = NULL;
-    download_file("/Map_names.txt", &content);
-
-    Report("content = '%s'\r\n", content);
-
-    parse_map_names(map_names, content, &num_maps);
-
-    //Report("content = '%s'\r\n", content);
+    if (mode == 2) {
+        strcpy(sel_map_name, replay_log.path);
+        sel_map = NULL;
+        map_local = 0;
+        goto map_download;
+    }
 
+    // Download the list of maps
+    num_maps = download_map_list(maps);
+    if (num_maps == 0) {
+        Report("No maps in the list\r\n");
+        goto startMenu;
+    }
 
-    level = map_menu(map_names, num_maps, uiChannel);
+#if MAP_PREFETCH_ENABLE
+    map_prefetch_init(&map_prefetch, &map_client, maps, num_maps, num_maps - 1);
+    level = map_menu(maps, num_maps, &map_prefetch, uiChannel);
+    select_time = systick_cycles();
+    map_local = map_prefetch_finish(&map_prefetch, level);
+#else
+    memset(&map_prefetch, 0, sizeof(map_prefetch));
+    level = map_menu(maps, num_maps, NULL, uiChannel);
+    select_time = systick_cycles();
+#endif
+    sel_map = &maps[level];
 
     if (level == 1) {
-        color = CYAN;
+        game.color = CYAN;
     } else if (level == 2) {
-        color = RED;
+        game.color = RED;
     } else if (level == 3) {
-        color = MAGENTA;
+        game.color = MAGENTA;
     }
 
     // Download selected level
-    char sel_map_name[20];
-    sprintf(sel_map_name, "/%s_map.txt", map_names[level]);
-
-    content = NULL;
-    download_file(sel_map_name, &content);
+    snprintf(sel_map_name, sizeof(sel_map_name), "/%s_map.txt", sel_map->name);
 
-    Report("content = '%s'\r\n", content);
-    level = 0;
-
-    parse_map_file(content, num_st_platforms, num_mov_platforms);
+map_download:
+    if (download_levels(sel_map_name, sel_map, map_local, &game) < 0) {
+        goto startMenu;
+    }
+    if (sel_map) {
+        leaderboard_want_top(&leaderboard, sel_map->name, clock_ms());
+    }
 
 
 map_create:
-    if (mode == 1) {
-        num_st_platforms[0] = 5;
-        static_plats[0][0] = create_static_platform(100, 108, 20, 3);
-        static_plats[0][1] = create_static_platform(60, 88, 20, 3);
-        static_plats[0][2] = create_static_platform(20, 68, 20, 3);
-        static_plats[0][3] = create_static_platform(60, 48, 20, 3);
-        static_plats[0][4] = create_static_platform(100, 28, 20, 3);
-
-        num_mov_platforms[0] = 0;
-
-        num_st_platforms[1] = 2;
-        static_plats[1][0] = create_static_platform(80, 108, 20, 3);
-        static_plats[1][1] = create_static_platform(50, 88, 20, 3);
-
-        num_mov_platforms[1] = 3;
-        mov_plats[1][0] = create_mov_platform(20, 68, 20, 3, 15, 100);
-        mov_plats[1][1] = create_mov_platform(20, 48, 20, 3, 15, 60);
-        mov_plats[1][2] = create_mov_platform(20, 28, 20, 3, 15, 20);
-
-        num_st_platforms[2] = 3;
-        static_plats[2][0] = create_static_platform(100, 108, 15, 3);
-        static_plats[2][1] = create_static_platform(20, 48, 15, 3);
-        static_plats[2][2] = create_static_platform(0, 3, 100, 3);
-
-        num_mov_platforms[2] = 2;
-        mov_plats[2][0] = create_mov_platform(20, 78, 20, 3, 15, 100);
-        mov_plats[2][1] = create_mov_platform(10, 20, 20, 3, 10, 107);
-    }
-
-    // WIN Level
-    static_plats[num_levels - 1][0] = create_static_platform(20, 95, 4, 17);
-    static_plats[num_levels - 1][1] = create_static_platform(20, 112, 32, 4);
-    static_plats[num_levels - 1][2] = create_static_platform(34, 95, 4, 17);
-    static_plats[num_levels - 1][3] = create_static_platform(48, 95, 4, 17);
-    static_plats[num_levels - 1][4] = create_static_platform(60, 95, 4, 4);
-    static_plats[num_levels - 1][5] = create_static_platform(60, 101, 4, 15);
-    static_plats[num_levels - 1][6] = create_static_platform(72, 95, 4, 21);
-    static_plats[num_levels - 1][7] = create_static_platform(76, 95, 12, 4);
-    static_plats[num_levels - 1][8] = create_static_platform(88, 95, 4, 21);
-    static_plats[num_levels - 1][9] = create_static_platform(54, 64, 20, 3);
-    num_st_platforms[num_levels - 1] = 10;
-    mov_plats[num_levels - 1][0] = create_mov_platform(54, 32, 20, 3, 34, 74);
-    num_mov_platforms[num_levels - 1] = 1;
-
-    load_level(map, prev_map, static_plats[level], num_st_platforms[level], mov_plats[level], num_mov_platforms[level]);
-
-    total_time = 0;
+    if (!game.endless) {
+        game_add_win_level(&game);
+    }
+    if (mode == 2) {
+        game.color = replay_log.color;
+    } else if (mode == 1) {
+        replay_begin(&replay_log, REPLAY_SOURCE_OFFLINE, NULL, game.color);
+    } else if (mode == 0) {
+        replay_begin(&replay_log, REPLAY_SOURCE_ONLINE, sel_map_name, game.color);
+    }
+    game_start(&game);
+    if (mode == 0) {
+        Report("Time to play: %u ms from select (%s)\r\n",
+               (uint32_t)((systick_cycles() - select_time) / (SYSCLKFREQ / 1000)),
+               map_local ? "prefetched" : "downloaded");
+    }
+    report_level_memory();
+
+    win_ticks = 0;
+    sim_done = sim_ticks;
+    memset(&frame_stats, 0, sizeof(frame_stats));
     while (1) {
-        if (tick == 1) {
-            tick = 0;
-            unsigned char reg_tilt;
-            GetTilt(0x18, 0x5, 1, &reg_tilt);
-            tilt = reg_tilt;
-            if (reg_tilt > 128) {
-                tilt = reg_tilt - 256;
+        if (sim_ticks != sim_done) {
+            uint64_t frame_start = systick_cycles();
+            uint8_t steps = 0;
+
+            // Don't try to catch up on a backlog longer than MAX_CATCHUP_TICKS
+            if (sim_ticks - sim_done > MAX_CATCHUP_TICKS) {
+                frame_stats.ticks_discarded += sim_ticks - sim_done - MAX_CATCHUP_TICKS;
+                sim_done = sim_ticks - MAX_CATCHUP_TICKS;
             }
-            tilt = -tilt / 4;
 
-            if (MAP_ADCFIFOLvlGet(ADC_BASE, uiChannel)) {
-                ulSample = MAP_ADCFIFORead(ADC_BASE, uiChannel);
-                x_voltage = (((float)((ulSample >> 2) & 0x0FFF)) * 1.4) / 4096;
-                if (x_voltage < 0.55 && x_voltage > .45) {
-                    x_voltage = 0.5;
-                }
+            // Advance the simulation one fixed tick at a time
+            while (sim_ticks != sim_done) {
+                sim_done++;
+                steps++;
+                frame_stats.sim_steps++;
 
-                x_pos -= ((x_voltage - 0.5) * x_speed);
-                if (x_pos < character_radius) {
-                    x_pos = character_radius;
-                } else if (x_pos > 127 - character_radius) {
-                    x_pos = 127 - character_radius;
-                }
-                if (on_ground == 1 && GPIOPinRead(GPIOA0_BASE, 0x80)) {
-                    y_vel = jump_speed;
-                    on_ground = 0;
-                }
-                y_pos -= y_vel;
-                y_vel -= gravity;
-                if (y_vel < -term_vel) {
-                    y_vel = -term_vel;
-                }
-                if (y_pos > 127 - character_radius) {
-                    y_pos = 127 - character_radius;
-                    y_vel = 0;
-                    on_ground = 1;
-                }
-                // Check if user beat level
-                else if (y_pos < character_radius) {
-                    level++;
-                    if (level == 1) {
-                        color = CYAN;
-                    } else if (level == 2) {
-                        color = RED;
-                    }
-                    if (level == num_levels - 1) {
-                        setCursor(30, 40);
-                        setTextSize(1);
-                        char dis_time[32];
-                        sprintf(dis_time, "Time: %.2f", total_time / 50.0);
-                        Outstr(dis_time);
-                        color = MAGENTA;
-                    } else if (level >= num_levels) {
+                if (mode == 2) {
+                    if (!replay_next(&replay_player, &input)) {
+                        Report("Replay finished after %u ticks\r\n", replay_player.tick);
+                        report_frame_stats();
                         fillScreen(BLACK);
                         goto startMenu;
                     }
-                    load_level(map, prev_map, static_plats[level], num_st_platforms[level], mov_plats[level], num_mov_platforms[level]);
-                    y_pos = 127 - character_radius;
-                }
-
-                uint64_t cur_rows[2] = {map[(int)(y_pos) * 2], map[(int)(y_pos) * 2 + 1]};
-                int col;
-                for (col = (int)(x_pos); col <= (int)(x_pos) + character_radius && col < 128; col++) {
-                    if ((cur_rows[col / 64] << (col % 64)) & 0x8000000000000000) {
-                        x_pos = col - character_radius;
-                        break;
+                } else {
+                    read_input(&input, uiChannel);
+                    // Endless runs don't end, so they aren't recorded
+                    if (!game.endless) {
+                        replay_record(&replay_log, &input);
                     }
                 }
-
-                for (col = (int)(x_pos); col > (int)(x_pos) - character_radius && col > 0; col--) {
-                    if ((cur_rows[col / 64] << (col % 64)) & 0x8000000000000000) {
-                        x_pos = col + character_radius;
-                        break;
+                uint8_t events = game_step(&game, &input);
+                if (events & GAME_EVENT_LEVEL) {
+                    report_frame_stats();
+                    if (game.endless) {
+                        Report("Endless level %u, seed %08x\r\n", game.depth + 1, game_endless_seed(&game));
                     }
+                    report_level_memory();
+#if DIST_FIELD_ENABLE && defined(DIST_FIELD_DEBUG)
+                    Report("Distance field mismatches: %d\r\n", dist_field_verify(game.map));
+#endif
                 }
-
-                if (y_vel <= 0) {
-                    for (row = (int)(y_pos); row <= (int)(y_pos) + character_radius && row < 128; row++) {
-                        for (i = (int)x_pos - character_radius + 1; i < x_pos + character_radius; i++) {
-                            uint64_t cur_row = map[row * 2 + (i / 64)];
-                            if ((cur_row << (i % 64)) & 0x8000000000000000) {
-                                y_pos = row - character_radius - 1;
-                                y_vel = 0;
-                                on_ground = 1;
-                                break;
-                            }
+                if (events & GAME_EVENT_WIN) {
+                    setCursor(30, 40);
+                    setTextSize(1);
+                    char dis_time[32];
+                    // Simulated time, so the replay gives the same result
+                    win_ticks = game.ticks;
+                    sprintf(dis_time, "Time: %.2f", win_ticks / (float)TICKS_PER_SECOND);
+                    Outstr(dis_time);
+                    if (mode == 0 && sel_map) {
+                        const LbTop *top = leaderboard_top(&leaderboard, sel_map->name);
+                        if (top && top->count) {
+                            setCursor(30, 55);
+                            sprintf(dis_time, "Best: %.2f", top->times[0] / 1000.0);
+                            Outstr(dis_time);
                         }
                     }
-                } else {
-                    for (row = (int)(y_pos); row >= (int)(y_pos) - character_radius && row > 0; row--) {
-                        for (i = (int)x_pos - character_radius; i < x_pos + character_radius; i++) {
-                            uint64_t cur_row = map[row * 2 + (i / 64)];
-                            if ((cur_row << (i % 64)) & 0x8000000000000000) {
-                                y_pos = row + character_radius + 1;
-                                y_vel = 0;
-                                break;
-                            }
-                        }
+                } else if (events & GAME_EVENT_DONE) {
+                    report_frame_stats();
+                    // Online runs go on the leaderboard once the log is finished, so
+                    // the hash matches the replay that is dumped. A log that filled up
+                    // can't be checked against it.
+                    if (mode == 0 && sel_map && win_ticks && !replay_log.overflow) {
+                        leaderboard_add(&leaderboard, sel_map->name, win_ticks * 1000 / TICKS_PER_SECOND,
+                                        replay_hash(&replay_log));
+                    }
+                    if (connected) {
+                        report_tls_stats();
+                        leaderboard_save(&leaderboard);
+                    }
+                    if (mode != 2) {
+                        replay_dump(&replay_log);
                     }
+                    fillScreen(BLACK);
+                    goto startMenu;
                 }
+            }
 
-                update_platforms(mov_plats[level], num_mov_platforms[level], tilt, map);
-                map_fillCircle((int)(x_pos), (int)(y_pos), character_radius, 0, map);
-                map_draw(map, prev_map, color);
-
-                for (i = 0; i < 256; i++) {
-                    prev_map[i] = map[i];
+            // Draw once for all the ticks advanced, ticks in between are dropped frames
+            game_render(&game, game.diff);
+            map_draw(game.diff, game.color);
+            frame_stats.frames_drawn++;
+            frame_stats.frames_dropped += steps - 1;
+
+            // Anything past one tick period is overrun that pushes the next frame back
+            uint64_t frame_cycles = systick_cycles() - frame_start;
+            if (frame_cycles > SYSTICK_RELOAD_VAL) {
+                uint32_t overrun_us = (uint32_t)((frame_cycles - SYSTICK_RELOAD_VAL) / (SYSCLKFREQ / 1000000));
+                frame_stats.overruns++;
+                frame_stats.overrun_us_total += overrun_us;
+                if (overrun_us > frame_stats.overrun_us_max) {
+                    frame_stats.overrun_us_max = overrun_us;
                 }
-                map_fillCircle((int)(x_pos), (int)(y_pos), character_radius, 1, map);
             }
+        } else if (connected) {
+            // Between ticks, keep the IoT channel up and send results
+            tls_channel_poll(&iot_channel, clock_ms());
+            leaderboard_poll(&leaderboard, clock_ms());
         }
     }
 }
@@ -0,0 +1,102 @@
+/*
+ * manifest.c
+ *
+ *  Map manifest parser.
+ */
+
+#include "manifest.h"
+
+#include <stddef.h>
+
+#define NUM_FIELDS      4       /* Numbers after the name */
+
+static int is_name_char(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-';
+}
+
+static int is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Read one number of a line, returns the position after it or NULL if it
+// is missing, has too many digits or overflows max
+static const char *parse_field(const char *p, int hex, uint32_t max, uint32_t *value) {
+    uint32_t v = 0;
+    int digits = 0, d;
+
+    while (is_blank(*p)) p++;
+    while ((d = hex ? hex_digit(*p) : ((*p >= '0' && *p <= '9') ? *p - '0' : -1)) >= 0) {
+        if (++digits > (hex ? 8 : 10)) {
+            return NULL;
+        }
+        if (!hex && v > (max - d) / 10) {
+            return NULL;
+        }
+        v = hex ? (v << 4) | d : v * 10 + d;
+        p++;
+    }
+    while (is_blank(*p)) p++;
+    if (digits == 0 || v > max) {
+        return NULL;
+    }
+    *value = v;
+    return p;
+}
+
+// Parse one line into map, returns 1 if the whole line was valid
+static int parse_line(const char *p, MapInfo *map) {
+    static const uint32_t field_max[NUM_FIELDS] = {0xFFFFFFFF, 0xFFFFFFFF, 255, 255};
+    uint32_t values[NUM_FIELDS];
+    int len = 0, i;
+
+    while (is_blank(*p)) p++;
+    while (is_name_char(p[len])) {
+        if (len == MAP_NAME_SIZE - 1) {
+            return 0;
+        }
+        map->name[len] = p[len];
+        len++;
+    }
+    if (len == 0) {
+        return 0;
+    }
+    map->name[len] = '\0';
+    p += len;
+    while (is_blank(*p)) p++;
+
+    for (i = 0; i < NUM_FIELDS; i++) {
+        if (*p++ != ',' || !(p = parse_field(p, i == 1, field_max[i], &values[i]))) {
+            return 0;
+        }
+    }
+    if (*p != '\n' && *p != '\0') {
+        return 0;
+    }
+    map->size = values[0];
+    map->hash = values[1];
+    map->levels = values[2];
+    map->difficulty = values[3];
+    return 1;
+}
+
+// Parse Manifest
+int parse_manifest(MapInfo *maps, int max_maps, const char *content) {
+    int num_maps = 0;
+
+    while (num_maps < max_maps && *content) {
+        const char *line = content;
+        while (is_blank(*line)) line++;
+        if (*line != '#' && *line != '\n' && *line != '\0' && parse_line(line, &maps[num_maps])) {
+            num_maps++;
+        }
+        while (*content && *content++ != '\n');
+    }
+    return num_maps;
+}
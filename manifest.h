@@ -0,0 +1,34 @@
+/*
+ * manifest.h
+ *
+ *  Parser for the server's map manifest (Map_manifest.txt), the structured
+ *  replacement for the bare name list. One map per line:
+ *      <name>,<size>,<hash>,<levels>,<difficulty>
+ *  name is the part of the file name before "_map.txt", size is the file's
+ *  length in bytes, hash its fnv1a() as 8 hex digits (the same hash the
+ *  flash cache stores), levels the number of levels in it and difficulty
+ *  0-255. Blank lines and lines starting with '#' are ignored, and lines
+ *  that don't parse are skipped like bad lines in the name list.
+ */
+
+#ifndef MANIFEST_H_
+#define MANIFEST_H_
+
+#include <stdint.h>
+
+#include "map_names.h"
+
+#define MANIFEST_PATH       "/Map_manifest.txt"
+
+typedef struct {
+    char name[MAP_NAME_SIZE];
+    uint32_t size;          /* File size in bytes, 0 if unknown */
+    uint32_t hash;          /* FNV-1a of the file, 0 if unknown */
+    uint8_t levels;         /* Levels in the file, 0 if unknown */
+    uint8_t difficulty;
+} MapInfo;
+
+// Fill maps from a NUL-terminated manifest, returns the number of maps found
+int parse_manifest(MapInfo *maps, int max_maps, const char *content);
+
+#endif /* MANIFEST_H_ */
@@ -0,0 +1,72 @@
+/*
+ * map_names.c
+ *
+ *  Map list parser.
+ */
+
+#include "map_names.h"
+
+#include <stdint.h>
+
+// Character classes, a table lookup per byte keeps the checks about as
+// cheap as the unchecked parser this replaced
+#define CH_NAME     0x01
+#define CH_BLANK    0x02
+#define CH_END      0x04    /* '_', end of line or end of the list */
+
+// 0x80 and up are all 0
+static const uint8_t char_class[256] = {
+    4, 0, 0, 0, 0, 0, 0, 0, 0, 2, 6, 0, 0, 6, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0,
+    0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 4,
+    0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0,
+};
+
+// Parse Map Names
+int parse_map_names(char names[][MAP_NAME_SIZE], int max_names, const char *content) {
+    int num_names = 0;
+
+    while (num_names < max_names) {
+        char *out = names[num_names], *end = out + MAP_NAME_SIZE - 1;
+        int ok = 1;
+        uint8_t cls;
+
+        while (char_class[(uint8_t)*content] & CH_BLANK) {
+            content++;
+        }
+        if (!*content) {
+            break;
+        }
+
+        // Name up to '_' or the end of the line, only blanks may follow it
+        while (char_class[(uint8_t)*content] == CH_NAME && out < end) {
+            *out++ = *content++;
+        }
+        while (!((cls = char_class[(uint8_t)*content]) & CH_END)) {
+            ok &= (cls == CH_BLANK);
+            content++;
+        }
+
+        // The rest of the line is ignored, usually it is just "_map.txt"
+        if (content[0] == '_' && content[1] == 'm' && content[2] == 'a' && content[3] == 'p' &&
+            content[4] == '.' && content[5] == 't' && content[6] == 'x' && content[7] == 't') {
+            content += 8;
+        }
+        if (content[0] == '\r' && content[1] == '\n') {
+            content += 2;
+        } else {
+            while (*content && *content != '\n') {
+                content++;
+            }
+        }
+        if (ok && out > names[num_names]) {
+            *out = '\0';
+            num_names++;
+        }
+    }
+    return num_names;
+}
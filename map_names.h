@@ -0,0 +1,20 @@
+/*
+ * map_names.h
+ *
+ *  Parser for the server's list of maps (Map_names.txt). Each line names a
+ *  map file, "Easy_map.txt", and the map's name is the part before the
+ *  first '_'. Lines with a name that is empty, too long or not made of
+ *  letters, digits and '-' are skipped, so a damaged list can't overrun
+ *  the menu or build a bad download path.
+ */
+
+#ifndef MAP_NAMES_H_
+#define MAP_NAMES_H_
+
+#define MAP_NAMES_MAX   6       /* Entries that fit the map menu */
+#define MAP_NAME_SIZE   15      /* "/<name>_map.txt" must fit a cache or replay path */
+
+// Fill names from a NUL-terminated list, returns the number of maps found
+int parse_map_names(char names[][MAP_NAME_SIZE], int max_names, const char *content);
+
+#endif /* MAP_NAMES_H_ */
@@ -0,0 +1,150 @@
+/*
+ * map_prefetch.c
+ *
+ *  Background map downloads for the map menu.
+ */
+
+#include "map_prefetch.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Simplelink includes
+#include "simplelink.h"
+
+static void map_path(const MapInfo *info, char *path) {
+    snprintf(path, LEVEL_CACHE_NAME_SIZE, "/%s_map.txt", info->name);
+}
+
+static void drop_active(MapPrefetch *pf, PrefetchState state) {
+    http_cancel(pf->client);
+    level_cache_abort();
+    pf->state[pf->active] = state;
+    pf->active = -1;
+}
+
+// The highlighted map if it is waiting, else the first waiting in list order
+static int next_map(const MapPrefetch *pf) {
+    int i;
+
+    if (pf->state[pf->want] == PF_WAITING) {
+        return pf->want;
+    }
+    for (i = 0; i < pf->num_maps; i++) {
+        if (pf->state[i] == PF_WAITING) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void start(MapPrefetch *pf, int map) {
+    const MapInfo *info = &pf->maps[map];
+    const LevelCacheEntry *entry;
+    uint32_t alloc = info->size ? info->size : LEVEL_CACHE_FILE_MAX;
+
+    map_path(info, pf->path);
+    entry = level_cache_find(pf->path);
+    if (entry && info->hash && entry->hash == info->hash && entry->size == info->size) {
+        pf->state[map] = PF_DONE;
+        pf->reserved += entry->alloc;
+        pf->stats.done++;
+        return;
+    }
+    // Room is kept for everything fetched so far, the normal download can
+    // still evict them for the map that is actually chosen
+    if (pf->reserved + alloc > LEVEL_CACHE_BUDGET) {
+        pf->state[map] = PF_SKIPPED;
+        return;
+    }
+    level_cache_tee_init(&pf->tee, pf->path, info->size, &pf->client->parser, NULL, NULL);
+    if (http_start(pf->client, pf->path, entry ? entry->etag : NULL, level_cache_tee_body, &pf->tee) < 0) {
+        pf->state[map] = PF_SKIPPED;
+        pf->stats.failed++;
+        return;
+    }
+    pf->state[map] = PF_ACTIVE;
+    pf->active = map;
+    pf->stats.started++;
+}
+
+// Finish the active download once the response is in, ret is what
+// http_poll() or http_wait() returned
+static void settle(MapPrefetch *pf, int ret) {
+    const LevelCacheEntry *entry;
+
+    if (ret == HTTP_PENDING) {
+        // Bigger than the reservation, no use fetching the rest
+        if (pf->tee.delivered && !pf->tee.caching) {
+            drop_active(pf, PF_SKIPPED);
+            pf->stats.failed++;
+        }
+        return;
+    }
+    if (ret == 0 && pf->client->parser.status == 200 && pf->tee.caching && level_cache_commit() == 0) {
+        entry = level_cache_find(pf->path);
+        pf->reserved += entry ? entry->alloc : pf->tee.delivered;
+        pf->stats.bytes += pf->tee.delivered;
+    } else if (ret == 0 && pf->client->parser.status == 304 && (entry = level_cache_find(pf->path))) {
+        pf->reserved += entry->alloc;
+    } else {
+        drop_active(pf, PF_SKIPPED);
+        pf->stats.failed++;
+        return;
+    }
+    pf->state[pf->active] = PF_DONE;
+    pf->active = -1;
+    pf->stats.done++;
+}
+
+// Prefetch Init
+void map_prefetch_init(MapPrefetch *pf, HttpClient *client, const MapInfo *maps, int num_maps, int selected) {
+    memset(pf, 0, sizeof(*pf));
+    pf->client = client;
+    pf->maps = maps;
+    pf->num_maps = num_maps;
+    pf->active = -1;
+    pf->want = selected;
+}
+
+// Prefetch Select
+void map_prefetch_select(MapPrefetch *pf, int map) {
+    pf->want = map;
+    // Dropping a download costs the connection too, so only do it when
+    // the new map still has to be fetched
+    if (pf->active >= 0 && pf->active != map && pf->state[map] == PF_WAITING) {
+        drop_active(pf, PF_WAITING);
+        pf->stats.cancelled++;
+    }
+}
+
+// Prefetch Poll
+void map_prefetch_poll(MapPrefetch *pf) {
+    int map;
+
+    if (pf->active >= 0) {
+        settle(pf, http_poll(pf->client));
+    }
+    // Maps that need no request are settled right away
+    while (pf->active < 0 && (map = next_map(pf)) >= 0) {
+        start(pf, map);
+    }
+}
+
+// Prefetch Finish
+int map_prefetch_finish(MapPrefetch *pf, int map) {
+    char path[LEVEL_CACHE_NAME_SIZE];
+
+    pf->want = map;
+    if (pf->active >= 0 && pf->active != map) {
+        drop_active(pf, PF_WAITING);
+        pf->stats.cancelled++;
+    }
+    // Waiting gives up if the connection goes quiet
+    if (pf->active >= 0) {
+        settle(pf, http_wait(pf->client));
+    }
+    // A later prefetch may have evicted a map that was current before it
+    map_path(&pf->maps[map], path);
+    return pf->state[map] == PF_DONE && level_cache_find(path) != NULL;
+}
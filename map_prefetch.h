@@ -0,0 +1,69 @@
+/*
+ * map_prefetch.h
+ *
+ *  Downloads maps into the flash cache in the background while the map
+ *  menu is shown, so the chosen map is usually local by the time the user
+ *  selects it. The highlighted map goes first, then the rest in list order,
+ *  one at a time on the kept-alive map connection. Moving the highlight to
+ *  a map that isn't fetched yet drops the download under way and starts
+ *  that one instead. Maps already cached with the manifest's size and hash
+ *  are skipped, cached maps without one are revalidated with their ETag, and
+ *  maps too big for the cache aren't fetched. Prefetches stop before one
+ *  would push an earlier one out of the cache.
+ */
+
+#ifndef MAP_PREFETCH_H_
+#define MAP_PREFETCH_H_
+
+#include <stdint.h>
+
+#include "manifest.h"
+#include "utils/http_client.h"
+#include "utils/level_cache.h"
+
+typedef enum {
+    PF_WAITING,
+    PF_ACTIVE,
+    PF_DONE,                /* In flash and current */
+    PF_SKIPPED              /* Too big, no room or failed, left for the normal download */
+} PrefetchState;
+
+typedef struct {
+    uint32_t started;       /* Downloads sent */
+    uint32_t done;          /* Maps stored, revalidated or already current */
+    uint32_t cancelled;     /* Downloads dropped for a new selection */
+    uint32_t failed;
+    uint32_t bytes;         /* Body bytes stored */
+} PrefetchStats;
+
+typedef struct {
+    HttpClient *client;
+    const MapInfo *maps;
+    int num_maps;
+    uint8_t state[MAP_NAMES_MAX];
+    int active;                         /* Map being downloaded, -1 if none */
+    int want;                           /* Highlighted map */
+    uint32_t reserved;                  /* Flash taken by maps prefetched so far */
+
+    // Download under way, stored by the tee without a consumer
+    char path[LEVEL_CACHE_NAME_SIZE];
+    LevelCacheTee tee;
+
+    PrefetchStats stats;
+} MapPrefetch;
+
+// Set up for a map list, nothing is sent until the first poll
+void map_prefetch_init(MapPrefetch *pf, HttpClient *client, const MapInfo *maps, int num_maps, int selected);
+
+// The highlight moved, fetch that map next
+void map_prefetch_select(MapPrefetch *pf, int map);
+
+// Move the prefetch on without waiting, call from the menu loop
+void map_prefetch_poll(MapPrefetch *pf);
+
+// The map was chosen. Waits for it if it is downloading and drops any other
+// download, returns 1 if its file in flash is current and can be used
+// without asking the server again.
+int map_prefetch_finish(MapPrefetch *pf, int map);
+
+#endif /* MAP_PREFETCH_H_ */
@@ -0,0 +1,23 @@
+/*
+ * offline_levels.c
+ *
+ *  Built-in levels and the WIN screen.
+ */
+
+#include "offline_levels.h"
+
+// Offline Levels
+void game_load_offline_levels(GameState *game) {
+    uint8_t i;
+    game_reset_levels(game);
+    for (i = 0; i < num_offline_levels; i++) {
+        game_set_level(game, i, &offline_levels[i]);
+    }
+    game->num_levels = num_offline_levels + 1;
+}
+
+// WIN Level
+void game_add_win_level(GameState *game) {
+    // A full arena leaves the WIN level empty rather than failing the run
+    game_set_level(game, game->num_levels - 1, &win_level);
+}
@@ -0,0 +1,25 @@
+/*
+ * offline_levels.h
+ *
+ *  Built-in levels, played in Offline mode, and the WIN screen that ends
+ *  every map. Their platforms are const tables in offline_tables.c,
+ *  generated from the text files in levels/ by tools/level_gen, so they
+ *  take no RAM beyond their moving platforms.
+ */
+
+#ifndef OFFLINE_LEVELS_H_
+#define OFFLINE_LEVELS_H_
+
+#include <stdint.h>
+
+#include "game.h"
+
+extern const uint8_t num_offline_levels;
+extern const LevelTable offline_levels[];
+extern const LevelTable win_level;
+
+// Built-in offline levels, and the WIN screen as the last level
+void game_load_offline_levels(GameState *game);
+void game_add_win_level(GameState *game);
+
+#endif /* OFFLINE_LEVELS_H_ */
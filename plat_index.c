@@ -0,0 +1,132 @@
+/*
+ * plat_index.c
+ *
+ *  Per-row platform interval index.
+ */
+
+#include "plat_index.h"
+
+#include <string.h>
+
+// Recompute the running reach of a row from span i onwards
+static void row_reach(PlatSpan *spans, uint8_t count, int i) {
+    uint8_t reach = (i > 0) ? spans[i - 1].reach : 0;
+    for (; i < count; i++) {
+        if (i == 0 || spans[i].x_last > reach) {
+            reach = spans[i].x_last;
+        }
+        spans[i].reach = reach;
+    }
+}
+
+// Move span i of a row to its sorted position after its columns changed
+static void row_resort(PlatSpan *spans, uint8_t count, int i) {
+    PlatSpan span = spans[i];
+    int first = i;
+    while (i > 0 && spans[i - 1].x_first > span.x_first) {
+        spans[i] = spans[i - 1];
+        i--;
+    }
+    while (i + 1 < count && spans[i + 1].x_first < span.x_first) {
+        spans[i] = spans[i + 1];
+        i++;
+    }
+    spans[i] = span;
+    row_reach(spans, count, (i < first) ? i : first);
+}
+
+// Clip a platform's columns to the board, returns 0 if nothing is left
+static int clip_cols(int x, int length, uint8_t *x_first, uint8_t *x_last) {
+    int last = x + length - 1;
+    if (x < 0) x = 0;
+    if (last > PLAT_INDEX_ROWS - 1) last = PLAT_INDEX_ROWS - 1;
+    if (length <= 0 || x > last) {
+        return 0;
+    }
+    *x_first = (uint8_t)x;
+    *x_last = (uint8_t)last;
+    return 1;
+}
+
+// Index Clear
+void plat_index_clear(PlatIndex *index) {
+    memset(index->count, 0, sizeof(index->count));
+    index->overflow = 0;
+}
+
+// Index Add
+void plat_index_add(PlatIndex *index, uint8_t id, int x, int y, int length, int thickness) {
+    PlatSpan span;
+    int row;
+
+    if (!clip_cols(x, length, &span.x_first, &span.x_last)) {
+        return;
+    }
+    span.id = id;
+    for (row = (y > 0) ? y : 0; row < y + thickness && row < PLAT_INDEX_ROWS; row++) {
+        uint8_t count = index->count[row];
+        if (count >= PLAT_ROW_SPANS) {
+            index->overflow = 1;
+            continue;
+        }
+        index->spans[row][count] = span;
+        index->count[row] = count + 1;
+        row_resort(index->spans[row], count + 1, count);
+    }
+}
+
+// Index Move
+void plat_index_move(PlatIndex *index, uint8_t id, int old_x, int new_x, int y, int length, int thickness) {
+    uint8_t x_first, x_last;
+    int row, i;
+
+    if (old_x == new_x) {
+        return;
+    }
+    if (!clip_cols(new_x, length, &x_first, &x_last)) {
+        return;
+    }
+    for (row = (y > 0) ? y : 0; row < y + thickness && row < PLAT_INDEX_ROWS; row++) {
+        PlatSpan *spans = index->spans[row];
+        for (i = 0; i < index->count[row]; i++) {
+            if (spans[i].id == id) {
+                spans[i].x_first = x_first;
+                spans[i].x_last = x_last;
+                row_resort(spans, index->count[row], i);
+                break;
+            }
+        }
+    }
+}
+
+// Index Find
+int plat_index_find(const PlatIndex *index, int row, int x_first, int x_last) {
+    const PlatSpan *spans;
+    int lo, hi;
+
+    if (row < 0 || row >= PLAT_INDEX_ROWS || x_first > x_last) {
+        return -1;
+    }
+    spans = index->spans[row];
+
+    // Last span starting at or before x_last
+    lo = 0;
+    hi = index->count[row];
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (spans[mid].x_first <= x_last) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    // Walk back while an earlier span can still reach x_first, only
+    // overlapping platforms make this more than one step
+    for (lo--; lo >= 0 && spans[lo].reach >= x_first; lo--) {
+        if (spans[lo].x_last >= x_first) {
+            return spans[lo].id;
+        }
+    }
+    return -1;
+}
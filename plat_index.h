@@ -0,0 +1,44 @@
+/*
+ * plat_index.h
+ *
+ *  Per-row interval index of the platforms in the current level. Each row
+ *  of the board keeps the spans of the platforms crossing it sorted by first
+ *  column, so "which platform covers these pixels" is a binary search in one
+ *  row instead of a pixel scan. Moving platforms keep their spans up to date
+ *  as they slide, which is what lets the character ride them.
+ */
+
+#ifndef PLAT_INDEX_H_
+#define PLAT_INDEX_H_
+
+#include <stdint.h>
+
+#define PLAT_INDEX_ROWS     128
+#define PLAT_ROW_SPANS      12      /* Platforms crossing one row, the WIN level needs 7 */
+#define PLAT_MOVING         0x80    /* Set in the id of a moving platform */
+
+typedef struct {
+    uint8_t x_first, x_last;    /* Columns covered, inclusive */
+    uint8_t reach;              /* Largest x_last of this and the earlier spans in the row */
+    uint8_t id;                 /* Static platform number, or PLAT_MOVING | number */
+} PlatSpan;
+
+typedef struct {
+    uint8_t count[PLAT_INDEX_ROWS];
+    uint8_t overflow;           /* A row ran out of slots, lookups may miss */
+    PlatSpan spans[PLAT_INDEX_ROWS][PLAT_ROW_SPANS];
+} PlatIndex;
+
+// Empty the index
+void plat_index_clear(PlatIndex *index);
+
+// Add a platform's rectangle under the given id
+void plat_index_add(PlatIndex *index, uint8_t id, int x, int y, int length, int thickness);
+
+// Move a platform that was added at old_x to new_x
+void plat_index_move(PlatIndex *index, uint8_t id, int old_x, int new_x, int y, int length, int thickness);
+
+// Id of a platform covering any of columns x_first..x_last of a row, -1 if none
+int plat_index_find(const PlatIndex *index, int row, int x_first, int x_last);
+
+#endif /* PLAT_INDEX_H_ */
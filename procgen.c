@@ -0,0 +1,194 @@
+/*
+ * procgen.c
+ *
+ *  Procedural level generator.
+ */
+
+#include "procgen.h"
+
+#define MAX_STEPS       16      /* Platforms in one level, the board fits about 8 */
+#define SEED_DEFAULT    0x9E3779B9
+#define SEED_STEP       0x9E3779B9      /* Golden ratio, spreads the per-level seeds */
+
+typedef struct {
+    int x0, x1;                 /* Columns, inclusive */
+    int top, bottom;            /* Rows, inclusive */
+    uint8_t moving;
+} Step;
+
+// Jump Reach
+// Rows gained by a jump, and how many ticks of it are spent at least rise
+// rows up (the time the character has to move over a platform that high)
+static int jump_height(const GameState *game, int rise, int *ticks_above) {
+    float height = 0, vel = game->jump_speed, best = 0;
+    int tick;
+    *ticks_above = 0;
+    for (tick = 0; tick < 128 && height >= 0; tick++) {
+        height += vel;
+        vel -= game->gravity;
+        if (vel < -game->term_vel) {
+            vel = -game->term_vel;
+        }
+        if (height > best) {
+            best = height;
+        }
+        if (height >= rise) {
+            (*ticks_above)++;
+        }
+    }
+    return (int)best;
+}
+
+static int rand_range(uint32_t *state, int lo, int hi) {
+    if (hi <= lo) {
+        return lo;
+    }
+    return lo + (int)(procgen_rand(state) % (uint32_t)(hi - lo + 1));
+}
+
+static int overlaps(int a0, int a1, int b0, int b1) {
+    return a0 <= b1 && b0 <= a1;
+}
+
+// Procgen Rand
+uint32_t procgen_rand(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+// Procgen Level
+int procgen_level(GameState *game, uint8_t level, uint32_t seed, uint8_t difficulty) {
+    Step steps[MAX_STEPS], cur, next;
+    int r = game->character_radius, body = 2 * r + 1;
+    int num_steps = 0, num_mov = 0, dir, i, tries, ticks;
+    int path0 = 0, path1 = -1, arc_top = 0;
+    uint32_t state = seed ? seed : SEED_DEFAULT;
+    Platform *st;
+    MovablePlatform *mov;
+
+    if (difficulty > PROCGEN_MAX_DIFFICULTY) {
+        difficulty = PROCGEN_MAX_DIFFICULTY;
+    }
+
+    // Limits from the tuning: a full jump gains height rows, steps use at
+    // most 3/4 of it at the top difficulty so there is time to move across
+    int height = jump_height(game, 0, &ticks);
+    int rise_hi = height - height / 4 - (height / 4) * (PROCGEN_MAX_DIFFICULTY - difficulty) / PROCGEN_MAX_DIFFICULTY;
+    int rise_lo = body + 1;
+    int len_hi = 36 - 2 * difficulty;
+    int len_lo = body + 2;
+    int exit_top = height + 2 * r - 2;     /* From here a jump leaves the board */
+    if (rise_lo > rise_hi) {
+        rise_lo = rise_hi;
+    }
+    if (len_hi < len_lo) {
+        len_hi = len_lo;
+    }
+
+    // The floor is the first surface
+    cur.x0 = 0;
+    cur.x1 = 127;
+    cur.top = 128;
+    dir = (procgen_rand(&state) & 1) ? 1 : -1;
+
+    while (cur.top > exit_top && num_steps < MAX_STEPS) {
+        int placed = 0;
+        for (tries = 0; tries < PROCGEN_TRIES; tries++) {
+            int rise = rand_range(&state, rise_lo, rise_hi);
+            int len = rand_range(&state, len_lo, len_hi);
+            int gap_hi, lo, hi;
+
+            // Horizontal gap covered in the ticks spent above the new platform
+            jump_height(game, rise, &ticks);
+            gap_hi = (int)(ticks * game->x_speed / 2) - r;
+            gap_hi = (gap_hi > 0) ? gap_hi * difficulty / PROCGEN_MAX_DIFFICULTY : 0;
+
+            // Keep climbing the same way and turn back at a wall. The current
+            // surface must stick out body columns to jump from.
+            if (dir > 0) {
+                lo = cur.x0 + body;
+                hi = (cur.x1 + 1 + gap_hi < 128 - len) ? cur.x1 + 1 + gap_hi : 128 - len;
+            } else {
+                lo = (cur.x0 - gap_hi - len > 0) ? cur.x0 - gap_hi - len : 0;
+                hi = cur.x1 - body - len + 1;
+            }
+            if (lo > hi) {
+                dir = -dir;
+                continue;
+            }
+            next.x0 = rand_range(&state, lo, hi);
+            next.x1 = next.x0 + len - 1;
+            next.top = cur.top - rise;
+            next.bottom = next.top + rand_range(&state, 2, 4) - 1;
+            next.moving = (int)(procgen_rand(&state) % 100) < difficulty * 6;
+            placed = 1;
+
+            // Don't hang it over the path of the last jump
+            if (!overlaps(next.x0, next.x1, path0, path1) || next.bottom < arc_top) {
+                break;
+            }
+        }
+        if (!placed) {
+            break;
+        }
+
+        // Path of the jump onto next: a body-wide spot beside it, up and over
+        // onto its near end. It reaches up to arc_top.
+        if (dir > 0) {
+            path1 = (next.x0 - 1 < cur.x1) ? next.x0 - 1 : cur.x1;
+            path0 = path1 - body + 1;
+            path1 = next.x0 + body - 1;
+        } else {
+            path0 = (next.x1 + 1 > cur.x0) ? next.x1 + 1 : cur.x0;
+            path1 = path0 + body - 1;
+            path0 = next.x1 - body + 1;
+        }
+        arc_top = cur.top - body - height;
+
+        steps[num_steps++] = next;
+        num_mov += next.moving;
+        cur = next;
+    }
+
+    // Everything is drawn, now size the level to it
+    st = game_alloc_static(game, level, num_steps - num_mov);
+    mov = game_alloc_moving(game, level, num_mov);
+    game->raster[level] = 0;
+    if (!st || !mov) {
+        game->num_st_platforms[level] = game->num_mov_platforms[level] = 0;
+        return -1;
+    }
+    for (i = 0; i < num_steps; i++) {
+        Step *s = &steps[i];
+        uint8_t len = s->x1 - s->x0 + 1, thickness = s->bottom - s->top + 1;
+        if (s->moving) {
+            // Starts where the staircase needs it, tilting slides it away
+            int span = 8 + 2 * difficulty;
+            int x_min = (s->x0 > span) ? s->x0 - span : 0;
+            int x_max = (s->x0 + span < 128 - len) ? s->x0 + span : 128 - len;
+            *mov++ = create_mov_platform(s->x0, s->top, len, thickness, x_min, x_max);
+        } else {
+            *st++ = create_static_platform(s->x0, s->top, len, thickness);
+        }
+    }
+    return num_steps;
+}
+
+// Load Endless
+void game_load_endless(GameState *game, uint32_t seed) {
+    game_reset_levels(game);
+    game->endless = 1;
+    game->seed = seed;
+    game->depth = 0;
+    game->num_levels = 1;
+    procgen_level(game, 0, game_endless_seed(game), 0);
+}
+
+// Endless Seed
+uint32_t game_endless_seed(const GameState *game) {
+    return game->seed ^ (game->depth * SEED_STEP);
+}
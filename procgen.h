@@ -0,0 +1,36 @@
+/*
+ * procgen.h
+ *
+ *  Procedural levels for Endless mode. A level is a staircase of platforms
+ *  from the floor to the top of the board, each step placed within what a
+ *  jump can cover under the current tuning (jump_speed, gravity, x_speed
+ *  and the character's size). Higher difficulties use shorter platforms,
+ *  taller steps and more moving platforms. The same seed and difficulty
+ *  always produce the same level.
+ */
+
+#ifndef PROCGEN_H_
+#define PROCGEN_H_
+
+#include <stdint.h>
+
+#include "game.h"
+
+#define PROCGEN_MAX_DIFFICULTY  10
+#define PROCGEN_TRIES           16      /* Draws per platform before settling for the last one */
+
+// xorshift32, state must not be 0
+uint32_t procgen_rand(uint32_t *state);
+
+// Generate a level into a slot, returns the number of platforms or -1 if
+// the arena is full (the level is then empty)
+int procgen_level(GameState *game, uint8_t level, uint32_t seed, uint8_t difficulty);
+
+// Switch to Endless mode: levels are made in slot 0 as they are reached,
+// each one harder. Call before game_start().
+void game_load_endless(GameState *game, uint32_t seed);
+
+// Seed of the current Endless level
+uint32_t game_endless_seed(const GameState *game);
+
+#endif /* PROCGEN_H_ */
@@ -0,0 +1,151 @@
+/*
+ * replay.c
+ *
+ *  Delta-encoded input log and player.
+ */
+
+#include "replay.h"
+
+#include <string.h>
+
+#include "utils/fnv.h"
+
+#define TAG_RUN         0x80    /* Low 7 bits: repeats - 1 */
+#define TAG_TILT        0x01    /* Tilt register byte follows */
+#define TAG_ADC         0x02    /* ADC delta varint follows */
+#define TAG_ADC_VALID   0x04
+#define TAG_BUTTON      0x08
+
+#define ADC_DATA(sample)    (((sample) >> 2) & 0x0FFF)
+
+// Record Start
+void replay_begin(ReplayLog *log, uint8_t source, const char *path, unsigned int color) {
+    memset(log, 0, sizeof(*log));
+    log->source = source;
+    if (path) {
+        strncpy(log->path, path, REPLAY_PATH_SIZE - 1);
+    }
+    log->color = color;
+    log->run_pos = 0;
+}
+
+static int put_byte(ReplayLog *log, uint8_t b) {
+    if (log->len >= REPLAY_LOG_SIZE) {
+        log->overflow = 1;
+        return -1;
+    }
+    log->data[log->len++] = b;
+    return 0;
+}
+
+// Record Tick
+int replay_record(ReplayLog *log, const Input *input) {
+    uint16_t adc = ADC_DATA(input->adc_sample), last_adc = ADC_DATA(log->last.adc_sample);
+    uint8_t valid = input->adc_valid ? 1 : 0, button = input->button ? 1 : 0;
+    uint16_t start = log->len;
+
+    if (log->overflow) {
+        return -1;
+    }
+
+    // Same as the last tick: extend the open run or start a new one
+    if (log->ticks > 0 && input->tilt_reg == log->last.tilt_reg && adc == last_adc &&
+        valid == log->last.adc_valid && button == log->last.button) {
+        if (log->run_pos < log->len && (log->data[log->run_pos] & 0x7F) < 0x7F) {
+            log->data[log->run_pos]++;
+        } else {
+            log->run_pos = log->len;
+            if (put_byte(log, TAG_RUN) < 0) {
+                return -1;
+            }
+        }
+        log->ticks++;
+        return 0;
+    }
+
+    uint8_t tag = (valid ? TAG_ADC_VALID : 0) | (button ? TAG_BUTTON : 0);
+    if (log->ticks == 0 || input->tilt_reg != log->last.tilt_reg) tag |= TAG_TILT;
+    if (adc != last_adc) tag |= TAG_ADC;
+
+    int ok = put_byte(log, tag);
+    if (tag & TAG_TILT) ok |= put_byte(log, input->tilt_reg);
+    if (tag & TAG_ADC) {
+        // Zigzag so small changes either way fit in one byte
+        int32_t delta = (int32_t)adc - (int32_t)last_adc;
+        uint32_t zz = (uint32_t)((delta << 1) ^ (delta >> 31));
+        while (zz >= 0x80) {
+            ok |= put_byte(log, (uint8_t)(zz | 0x80));
+            zz >>= 7;
+        }
+        ok |= put_byte(log, (uint8_t)zz);
+    }
+    if (ok < 0) {
+        // Drop the partial record so the log stays decodable
+        log->len = start;
+        log->overflow = 1;
+        return -1;
+    }
+
+    log->run_pos = log->len;
+    log->last.tilt_reg = input->tilt_reg;
+    log->last.adc_sample = adc << 2;
+    log->last.adc_valid = valid;
+    log->last.button = button;
+    log->ticks++;
+    return 0;
+}
+
+// Play Start
+void replay_play(ReplayPlayer *player, const ReplayLog *log) {
+    memset(player, 0, sizeof(*player));
+    player->log = log;
+}
+
+// Play Tick
+int replay_next(ReplayPlayer *player, Input *input) {
+    const ReplayLog *log = player->log;
+
+    if (player->tick >= log->ticks) {
+        return 0;
+    }
+
+    if (player->run == 0) {
+        if (player->pos >= log->len) {
+            return 0;
+        }
+        uint8_t tag = log->data[player->pos++];
+        if (tag & TAG_RUN) {
+            player->run = (tag & 0x7F) + 1;
+        } else {
+            player->last.adc_valid = (tag & TAG_ADC_VALID) ? 1 : 0;
+            player->last.button = (tag & TAG_BUTTON) ? 1 : 0;
+            if ((tag & TAG_TILT) && player->pos < log->len) {
+                player->last.tilt_reg = log->data[player->pos++];
+            }
+            if (tag & TAG_ADC) {
+                uint32_t zz = 0;
+                int shift = 0;
+                while (player->pos < log->len && shift < 32) {
+                    uint8_t b = log->data[player->pos++];
+                    zz |= (uint32_t)(b & 0x7F) << shift;
+                    shift += 7;
+                    if (!(b & 0x80)) break;
+                }
+                int32_t delta = (int32_t)(zz >> 1) ^ -(int32_t)(zz & 1);
+                player->last.adc_sample = (uint32_t)(ADC_DATA(player->last.adc_sample) + delta) << 2;
+            }
+        }
+    }
+    if (player->run > 0) {
+        player->run--;
+    }
+
+    *input = player->last;
+    player->tick++;
+    return 1;
+}
+
+// Replay Hash
+uint32_t replay_hash(const ReplayLog *log) {
+    return fnv1a(FNV_INIT, log->data, log->len);
+}
@@ -0,0 +1,66 @@
+/*
+ * replay.h
+ *
+ *  Per-tick input recording for bit-exact replays of a play session.
+ *
+ *  Each tick is delta-encoded against the previous one. A tag byte with the
+ *  top bit set is a run of 1-128 ticks identical to the previous tick.
+ *  Otherwise the tag holds the ADC-valid and button states and flags for
+ *  what follows it: the new tilt register byte and/or the change in the ADC
+ *  reading as a zigzag varint. Only the 12 data bits of the ADC FIFO word
+ *  are kept since those are all game_step() reads, so a replay produces
+ *  the exact same GameState as the recorded session.
+ */
+
+#ifndef REPLAY_H_
+#define REPLAY_H_
+
+#include <stdint.h>
+
+#include "game.h"
+
+#define REPLAY_LOG_SIZE         8192
+#define REPLAY_PATH_SIZE        24
+
+// Where the levels of a recorded session came from
+#define REPLAY_SOURCE_OFFLINE   0
+#define REPLAY_SOURCE_ONLINE    1
+
+typedef struct {
+    uint8_t source;
+    char path[REPLAY_PATH_SIZE];    /* Map file downloaded for online sessions */
+    unsigned int color;             /* Starting color picked from the map menu */
+    uint32_t ticks;                 /* Ticks recorded */
+    uint16_t len;                   /* Bytes of data used */
+    uint8_t overflow;               /* Log filled up and recording stopped */
+    uint8_t data[REPLAY_LOG_SIZE];
+
+    // Encoder state
+    Input last;
+    uint16_t run_pos;               /* Offset of the open run tag, or len if none */
+} ReplayLog;
+
+typedef struct {
+    const ReplayLog *log;
+    uint16_t pos;
+    uint8_t run;                    /* Repeats left from the current run tag */
+    uint32_t tick;
+    Input last;
+} ReplayPlayer;
+
+// Start a new recording
+void replay_begin(ReplayLog *log, uint8_t source, const char *path, unsigned int color);
+
+// Append one tick of input, returns -1 once the log is full
+int replay_record(ReplayLog *log, const Input *input);
+
+// Start playing a recording from the first tick
+void replay_play(ReplayPlayer *player, const ReplayLog *log);
+
+// Next tick of input, returns 0 when the recording is exhausted
+int replay_next(ReplayPlayer *player, Input *input);
+
+// FNV-1a hash of the recording, identifies a session's inputs
+uint32_t replay_hash(const ReplayLog *log);
+
+#endif /* REPLAY_H_ */
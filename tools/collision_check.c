@@ -0,0 +1,260 @@
+/*
+ * collision_check.c
+ *
+ *  Linux check that fast movement can't pass through thin platforms. Runs
+ *  the real game_step() with term_vel, jump_speed and x_speed raised far
+ *  above the 3-pixel platform thickness the levels use, against 1-pixel
+ *  platforms and walls, and checks after every tick that the character is
+ *  still on its own side:
+ *      - a fall lands on the platform, at rest just above it
+ *      - a jump stops under the platform and never leaves the top of the
+ *        board through it
+ *      - a run stops at a 1-pixel wall
+ *  Then, on random maps of 1-pixel platforms and walls, compares the span
+ *  tests with a pixel scan of the row and sweep_down()/sweep_up() with a
+ *  row-by-row scan, for moves of every length up to the whole board.
+ *
+ *  Host-only, not part of the CCS build. Build it both with and without
+ *  the distance fields. From the tools directory:
+ *      gcc -O2 -I.. -o collision_check collision_check.c ../game.c ../collision.c ../dist_field.c ../plat_index.c ../arena.c ../procgen.c -lm
+ *      gcc -O2 -I.. -DDIST_FIELD_ENABLE=1 -o collision_check_df collision_check.c ../game.c ../collision.c ../dist_field.c ../plat_index.c ../arena.c ../procgen.c -lm
+ *      ./collision_check [trials]
+ */
+
+#ifndef ccs
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "game.h"
+#include "collision.h"
+#include "dist_field.h"
+
+#define STICK_LEFT      (2925 << 2)
+#define STICK_STILL     (1463 << 2)
+#define STICK_RIGHT     0
+#define MAX_TICKS       300
+
+static GameState game;
+static Platform plats[2];
+static uint64_t map[MAP_WORDS];
+
+// Make a level of the given platforms the only one and start it
+static void start_level(int count) {
+    LevelTable table;
+
+    memset(&table, 0, sizeof(table));
+    table.st_plats = plats;
+    table.num_st = count;
+    game_init(&game);
+    game_set_level(&game, 0, &table);
+    game_start(&game);
+}
+
+static void set_input(Input *input, uint32_t stick, uint8_t button) {
+    memset(input, 0, sizeof(*input));
+    input->adc_valid = 1;
+    input->adc_sample = stick;
+    input->button = button;
+}
+
+// Fall from y onto a full-width 1-pixel platform at row
+static int check_fall(int row, float y, float term_vel) {
+    int r, tick;
+    Input input;
+
+    plats[0] = create_static_platform(0, row, 128, 1);
+    start_level(1);
+    r = game.character_radius;
+    game.term_vel = term_vel;
+    game.gravity = term_vel / 4 + 1;
+    game.y_pos = y;
+    game.on_ground = 0;
+    set_input(&input, STICK_STILL, 0);
+    for (tick = 0; tick < MAX_TICKS && !game.on_ground; tick++) {
+        game_step(&game, &input);
+        if ((int)game.y_pos + r >= row) {
+            printf("FAIL: fell through row %d from %.0f at term_vel %.0f, now at %.1f\n", row, y, term_vel,
+                   game.y_pos);
+            return 1;
+        }
+    }
+    if (!game.on_ground || (int)game.y_pos != row - r - 1) {
+        printf("FAIL: fall onto row %d from %.0f at term_vel %.0f ended at %.1f\n", row, y, term_vel, game.y_pos);
+        return 1;
+    }
+    return 0;
+}
+
+// Jump from the floor at a full-width 1-pixel platform at row
+static int check_jump(int row, float jump_speed) {
+    int r, tick;
+    Input input;
+
+    plats[0] = create_static_platform(0, row, 128, 1);
+    start_level(1);
+    r = game.character_radius;
+    game.jump_speed = jump_speed;
+    game.term_vel = jump_speed;
+    set_input(&input, STICK_STILL, 1);
+    for (tick = 0; tick < MAX_TICKS; tick++) {
+        uint8_t events = game_step(&game, &input);
+        input.button = 0;
+        if (events != GAME_EVENT_NONE || game.level != 0) {
+            printf("FAIL: jump at %.0f left the board through row %d\n", jump_speed, row);
+            return 1;
+        }
+        if ((int)game.y_pos - r <= row) {
+            printf("FAIL: jump at %.0f went through row %d, now at %.1f\n", jump_speed, row, game.y_pos);
+            return 1;
+        }
+        if (tick > 0 && game.on_ground) {
+            return 0;
+        }
+    }
+    printf("FAIL: jump at %.0f under row %d never came down\n", jump_speed, row);
+    return 1;
+}
+
+// Run at a 1-pixel wall at col from x, towards it
+static int check_run(int col, float x, float x_speed) {
+    int tick, right = x < col;
+    Input input;
+
+    // The wall stands on the floor so the character meets it side on
+    plats[0] = create_static_platform(col, 0, 1, 128);
+    start_level(1);
+    game.x_speed = x_speed;
+    game.x_pos = x;
+    set_input(&input, right ? STICK_RIGHT : STICK_LEFT, 0);
+    for (tick = 0; tick < 20; tick++) {
+        game_step(&game, &input);
+        if (right ? game.x_pos >= col : game.x_pos <= col) {
+            printf("FAIL: run from %.0f at %.0f went through the wall at %d, now at %.1f\n", x, x_speed, col,
+                   game.x_pos);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int pixel(int x, int y) {
+    return (map[y * 2 + x / 64] >> (63 - x % 64)) & 1;
+}
+
+// Pixel and row scans the span tests and sweeps must agree with
+static int scan_first(int row, int x_first, int x_last) {
+    int x;
+    for (x = (x_first < 0) ? 0 : x_first; x <= x_last && x <= 127; x++) {
+        if (pixel(x, row)) return x;
+    }
+    return -1;
+}
+
+static int scan_last(int row, int x_first, int x_last) {
+    int x;
+    for (x = (x_last > 127) ? 127 : x_last; x >= x_first && x >= 0; x--) {
+        if (pixel(x, row)) return x;
+    }
+    return -1;
+}
+
+static int scan_down(int x_first, int x_last, int y0, int y1, int radius) {
+    int row, top = (y0 < y1) ? y0 : y1, bottom = ((y0 < y1) ? y1 : y0) + radius;
+    for (row = (top < 0) ? 0 : top; row <= bottom && row <= 127; row++) {
+        if (scan_first(row, x_first, x_last) >= 0) return row;
+    }
+    return -1;
+}
+
+static int scan_up(int x_first, int x_last, int y0, int y1, int radius) {
+    int row, bottom = (y0 < y1) ? y1 : y0, top = ((y0 < y1) ? y0 : y1) - radius;
+    for (row = (bottom > 127) ? 127 : bottom; row >= top && row >= 1; row--) {
+        if (scan_first(row, x_first, x_last) >= 0) return row;
+    }
+    return -1;
+}
+
+// A map of a few 1-pixel platforms and walls
+static void random_map(void) {
+    int num = 1 + rand() % 8, i, j;
+
+    memset(map, 0, sizeof(map));
+    for (i = 0; i < num; i++) {
+        int x = rand() % 128, y = rand() % 128;
+        if (rand() % 4) {
+            int len = 1 + rand() % (128 - x);
+            for (j = x; j < x + len; j++) {
+                map[y * 2 + j / 64] |= 0x8000000000000000 >> (j % 64);
+            }
+        } else {
+            int len = 1 + rand() % (128 - y);
+            for (j = y; j < y + len; j++) {
+                map[j * 2 + x / 64] |= 0x8000000000000000 >> (x % 64);
+            }
+        }
+    }
+#if DIST_FIELD_ENABLE
+    dist_field_build(map);
+#endif
+}
+
+static int check_sweeps(int trials) {
+    int trial, i, failures = 0;
+
+    for (trial = 0; trial < trials; trial++) {
+        random_map();
+        for (i = 0; i < 64; i++) {
+            int row = rand() % 128, x0 = rand() % 128, x1 = rand() % 128;
+            int lo = (x0 < x1) ? x0 : x1, hi = (x0 < x1) ? x1 : x0;
+            if (span_first_solid(map, row, lo, hi) != scan_first(row, lo, hi) ||
+                span_last_solid(map, row, lo, hi) != scan_last(row, lo, hi)) {
+                if (failures++ < 5) {
+                    printf("FAIL: span of row %d over columns %d-%d\n", row, lo, hi);
+                }
+            }
+        }
+        for (i = 0; i < 64; i++) {
+            int x_first = rand() % 128, x_last = x_first + rand() % 10, y0 = rand() % 128, y1 = rand() % 128;
+            int radius = rand() % 6;
+            if (x_last > 127) x_last = 127;
+            if (sweep_down(map, x_first, x_last, y0, y1, radius) != scan_down(x_first, x_last, y0, y1, radius) ||
+                sweep_up(map, x_first, x_last, y0, y1, radius) != scan_up(x_first, x_last, y0, y1, radius)) {
+                if (failures++ < 5) {
+                    printf("FAIL: sweep over columns %d-%d from row %d to %d, radius %d\n", x_first, x_last, y0,
+                           y1, radius);
+                }
+            }
+        }
+    }
+    return failures;
+}
+
+int main(int argc, char **argv) {
+    static const float speeds[] = {4, 6, 12, 24, 48, 100, 127};
+    int trials = (argc > 1) ? atoi(argv[1]) : 2000;
+    int trial, s, r, failures = 0;
+
+    srand(1);
+    game_init(&game);
+    r = game.character_radius;
+    for (trial = 0; trial < trials; trial++) {
+        for (s = 0; s < (int)(sizeof(speeds) / sizeof(speeds[0])); s++) {
+            int row = 2 * r + 3 + rand() % (127 - 2 * r - 3);
+            int col = 2 * r + rand() % (128 - 4 * r);
+            float y = r + rand() % (row - 2 * r - 1);
+            failures += check_fall(row, y, speeds[s]);
+            failures += check_jump(1 + rand() % (127 - 3 * r - 2), speeds[s]);
+            failures += check_run(col, (rand() & 1) ? r : 127 - r, speeds[s]);
+        }
+    }
+    printf("%d falls, jumps and runs at up to %.0f pixels a tick\n", 3 * trials * s, speeds[s - 1]);
+    failures += check_sweeps(trials);
+    printf("%d random maps of spans and sweeps against a pixel scan\n", trials);
+    printf("%s distance fields, %d failure(s)\n", DIST_FIELD_ENABLE ? "With" : "Without", failures);
+    return failures ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,316 @@
+/*
+ * dist_field_check.c
+ *
+ *  Linux check of the distance tables against a brute-force scan of each
+ *  column of the map, entry by entry. Covers:
+ *      - tables built from random maps
+ *      - tables kept by dist_field_update_mask() while platforms slide over
+ *        random maps and over each other, redrawn the way update_platforms()
+ *        does, so anything else on a platform's rows is cleared too
+ *      - the offline and generated levels as load_level() builds them and
+ *        update_platforms() keeps them while the board is tilted back and
+ *        forth for a hundred-odd ticks, plus a level whose moving platforms
+ *        share rows with each other and with a static one
+ *      - a game played through game_step() and game_render() the way
+ *        main.c plays it, checked after every tick and every frame: the
+ *        offline levels to the end on the routes game_route() finds, then
+ *        scripted input that jumps about and tilts the board
+ *  Then times the lookups the sweeps make against the scan they replace,
+ *  and reports what the tables cost in SRAM.
+ *
+ *  Host-only, not part of the CCS build. The tables are off by default, so
+ *  build with them on. From the tools directory:
+ *      gcc -O2 -I.. -DDIST_FIELD_ENABLE=1 -o dist_field_check dist_field_check.c game_route.c ../game.c ../collision.c ../dist_field.c ../plat_index.c ../arena.c ../procgen.c ../offline_levels.c ../offline_tables.c -lm
+ *      ./dist_field_check [levels]
+ */
+
+#ifndef ccs
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "game.h"
+#include "collision.h"
+#include "dist_field.h"
+#include "offline_levels.h"
+#include "procgen.h"
+#include "game_route.h"
+
+#if !DIST_FIELD_ENABLE
+#error "Build with -DDIST_FIELD_ENABLE=1"
+#endif
+
+#define TILT_TICKS      120
+
+static GameState game;
+static uint64_t map[MAP_WORDS];
+
+static uint64_t clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int pixel(const uint64_t *map, int x, int y) {
+    return (map[y * 2 + x / 64] >> (63 - x % 64)) & 1;
+}
+
+static void set_pixel(uint64_t *map, int x, int y, int on) {
+    if (on) {
+        map[y * 2 + x / 64] |= 0x8000000000000000 >> (x % 64);
+    } else {
+        map[y * 2 + x / 64] &= ~(0x8000000000000000 >> (x % 64));
+    }
+}
+
+// Entries that differ from walking each column up and down from every row
+static int scan_mismatches(const uint64_t *map) {
+    int x, y, r, mismatches = 0;
+
+    for (x = 0; x < DIST_FIELD_COLS; x++) {
+        for (y = 0; y < DIST_FIELD_ROWS; y++) {
+            int below = DIST_NONE, above = DIST_NONE;
+            for (r = y; r < DIST_FIELD_ROWS && below == DIST_NONE; r++) {
+                if (pixel(map, x, r)) below = r - y;
+            }
+            for (r = y; r >= 0 && above == DIST_NONE; r--) {
+                if (pixel(map, x, r)) above = y - r;
+            }
+            mismatches += (dist_below[y][x] != below) + (dist_above[y][x] != above);
+        }
+    }
+    return mismatches;
+}
+
+// Random map, each word set with a 1 in density chance
+static void random_map(int density) {
+    int i;
+    for (i = 0; i < MAP_WORDS; i++) {
+        map[i] = ((uint64_t)rand() << 40 ^ (uint64_t)rand() << 20 ^ rand()) & ((uint64_t)0 - (rand() % density == 0));
+    }
+}
+
+// Slide a few platforms back and forth over the map, checking the tables after each move
+static int check_slides(int trial) {
+    int x_min[4], x_max[4], x[4], y[4], len[4], thick[4];
+    int n = 1 + rand() % 4, i, tick, row, col, mismatches;
+
+    for (i = 0; i < n; i++) {
+        len[i] = 1 + rand() % 30;
+        thick[i] = 1 + rand() % 4;
+        x_min[i] = rand() % (128 - len[i]);
+        x_max[i] = x_min[i] + rand() % (128 - len[i] - x_min[i] + 1);
+        x[i] = x_min[i];
+        y[i] = rand() % (128 - thick[i]);
+    }
+    for (tick = 0; tick < TILT_TICKS; tick++) {
+        int tilt = ((tick / 20) % 2 ? -1 : 1) * (1 + (tick / 40) * 3);
+        for (i = 0; i < n; i++) {
+            uint64_t changed[2] = {0, 0};
+            x[i] += tilt;
+            if (x[i] > x_max[i]) x[i] = x_max[i];
+            if (x[i] < x_min[i]) x[i] = x_min[i];
+            for (row = y[i]; row < y[i] + thick[i]; row++) {
+                uint64_t before[2] = {map[row * 2], map[row * 2 + 1]};
+                for (col = x_min[i]; col < x_max[i] + len[i]; col++) {
+                    set_pixel(map, col, row, col >= x[i] && col < x[i] + len[i]);
+                }
+                changed[0] |= before[0] ^ map[row * 2];
+                changed[1] |= before[1] ^ map[row * 2 + 1];
+            }
+            dist_field_update_mask(map, changed);
+            if ((mismatches = scan_mismatches(map))) {
+                printf("FAIL: map %d: %d mismatches after tick %d, tilt %d\n", trial, mismatches, tick, tilt);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// Load a level and tilt it side to side, checking the tables after each tick
+static int check_level(uint8_t level, const char *what) {
+    int tick, mismatches;
+
+    load_level(game.map, game.prev_map, game.static_plats[level], game.num_st_platforms[level],
+               game.mov_plats[level], game.num_mov_platforms[level], game.raster[level], &game.plat_index);
+    if ((mismatches = scan_mismatches(game.map))) {
+        printf("FAIL: %s: %d mismatches after load\n", what, mismatches);
+        return 1;
+    }
+    for (tick = 0; tick < TILT_TICKS; tick++) {
+        // Sweeps of different speeds, past both ends of every platform's range
+        int tilt = ((tick / 20) % 2 ? -1 : 1) * (1 + (tick / 40) * 3);
+        update_platforms(game.mov_plats[level], game.num_mov_platforms[level], tilt, game.map, &game.plat_index);
+        if ((mismatches = scan_mismatches(game.map))) {
+            printf("FAIL: %s: %d mismatches after tick %d, tilt %d\n", what, mismatches, tick, tilt);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Scripted input, same as game_bench: the stick sweeps side to side, a
+// jump every 25 ticks and the board tilts back and forth
+static void script_input(uint32_t tick, Input *input) {
+    uint32_t phase = tick % 200;
+    int tilt = (int)((tick / 40) % 5) * 16 - 32;
+
+    memset(input, 0, sizeof(*input));
+    input->tilt_reg = (uint8_t)tilt;
+    input->adc_valid = 1;
+    input->adc_sample = (phase < 100 ? phase * 40 : (200 - phase) * 40) << 2;
+    input->button = (tick % 25) == 0;
+}
+
+// One tick and frame the way main.c runs them, verifying the tables after each
+static int play_tick(const Input *input, uint8_t *events, const char *what) {
+    RenderDiff diff;
+    int mismatches;
+
+    *events = game_step(&game, input);
+    if ((mismatches = dist_field_verify(game.map))) {
+        printf("FAIL: %s: %d mismatches after tick %u, level %u\n", what, mismatches, game.ticks, game.level + 1);
+        return 1;
+    }
+    game_render(&game, &diff);
+    if ((mismatches = dist_field_verify(game.map))) {
+        printf("FAIL: %s: %d mismatches after the frame at tick %u, level %u\n", what, mismatches, game.ticks,
+               game.level + 1);
+        return 1;
+    }
+    return 0;
+}
+
+// Play the offline levels through to the end of the game, one game_route()
+// per level, then with the scripted input for the given ticks
+static int check_play(uint32_t ticks) {
+    static Input moves[4096];
+    uint8_t events = 0;
+    uint32_t tick, levels = 0;
+    int n, i;
+
+    game_init(&game);
+    game_load_offline_levels(&game);
+    game_add_win_level(&game);
+    game_start(&game);
+    while (!(events & GAME_EVENT_DONE)) {
+        n = game_route(&game, 1, moves, sizeof(moves) / sizeof(moves[0]));
+        if (n < 0 || n > (int)(sizeof(moves) / sizeof(moves[0]))) {
+            printf("FAIL: no route out of level %u\n", game.level + 1);
+            return 1;
+        }
+        for (i = 0; i < n; i++) {
+            if (play_tick(&moves[i], &events, "route")) {
+                return 1;
+            }
+        }
+        levels++;
+    }
+    printf("Routed through %u levels in %u ticks\n", levels, game.ticks);
+
+    game_init(&game);
+    game_load_offline_levels(&game);
+    game_add_win_level(&game);
+    game_start(&game);
+    for (tick = 0; tick < ticks; tick++) {
+        Input input;
+        script_input(tick, &input);
+        if (play_tick(&input, &events, "script")) {
+            return 1;
+        }
+        if (events & GAME_EVENT_DONE) {
+            game_start(&game);
+        }
+    }
+    return 0;
+}
+
+// Moving platforms that clear each other's pixels and a static one's as they pass
+static const Platform shared_st[] = {{10, 3, 40, 60}};
+static const MovablePlatform shared_mov[] = {{{12, 3, 10, 60}, 0, 80}, {{12, 3, 50, 61}, 30, 100}};
+
+int main(int argc, char **argv) {
+    LevelTable shared;
+    int levels = (argc > 1) ? atoi(argv[1]) : 20;
+    int i, row, x_first, failures = 0, found = 0;
+    uint64_t begin, table_ns, scan_ns;
+    char what[48];
+
+    // Random maps, from empty to noise
+    srand(1);
+    for (i = 0; i < levels; i++) {
+        random_map(8);
+        dist_field_build(map);
+        if (scan_mismatches(map)) {
+            printf("FAIL: random map %d\n", i);
+            failures++;
+        }
+    }
+
+    // Platforms sliding over sparse maps and over each other
+    for (i = 0; i < levels; i++) {
+        random_map(4 + i % 8);
+        dist_field_build(map);
+        failures += check_slides(i);
+    }
+
+    // Built-in and generated levels, with their moving platforms moving
+    game_init(&game);
+    game_load_offline_levels(&game);
+    for (i = 0; i < num_offline_levels; i++) {
+        sprintf(what, "offline level %d", i + 1);
+        failures += check_level(i, what);
+    }
+    for (i = 0; i < levels; i++) {
+        game_init(&game);
+        procgen_level(&game, 0, 1000 + i, 1 + i % 10);
+        sprintf(what, "generated level %d", 1000 + i);
+        failures += check_level(0, what);
+    }
+    memset(&shared, 0, sizeof(shared));
+    shared.st_plats = shared_st;
+    shared.num_st = 1;
+    shared.mov_plats = shared_mov;
+    shared.num_mov = 2;
+    game_init(&game);
+    game_set_level(&game, 0, &shared);
+    failures += check_level(0, "shared rows");
+    printf("%d random maps, %d with sliding platforms, %d offline, %d generated and 1 shared-row level over %d ticks each\n",
+           levels, levels, num_offline_levels, levels, TILT_TICKS);
+
+    failures += check_play(400);
+
+    // A sweep's worth of lookups against the column scan, on the last level
+    begin = clock_ns();
+    for (i = 0; i < 1000; i++) {
+        for (row = 0; row < 128; row++) {
+            x_first = (row * 7 + i) % 118;
+            found += dist_field_min_below(row, x_first, x_first + 9) != DIST_NONE;
+        }
+    }
+    table_ns = clock_ns() - begin;
+    begin = clock_ns();
+    for (i = 0; i < 1000; i++) {
+        for (row = 0; row < 128; row++) {
+            int r;
+            x_first = (row * 7 + i) % 118;
+            for (r = row; r < 128 && span_first_solid(game.map, r, x_first, x_first + 9) < 0; r++);
+            found -= r < 128;
+        }
+    }
+    scan_ns = clock_ns() - begin;
+    if (found != 0) {
+        printf("FAIL: lookups and scans disagree\n");
+        failures++;
+    }
+    printf("Ground lookup: %.1f ns with the tables, %.1f ns scanning; tables take %u bytes\n",
+           table_ns / 128000.0, scan_ns / 128000.0, dist_field_bytes());
+    printf("%d failure(s)\n", failures);
+    return failures ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,170 @@
+/*
+ * dns_cache_check.c
+ *
+ *  Linux self-check for the DNS cache against a mock resolver and a mock
+ *  clock: hits within the TTL, a fresh lookup once it runs out, failures
+ *  remembered for the negative TTL and no longer, invalidation after a
+ *  failed connect, eviction when more hosts are used than there are
+ *  slots, clock wrap-around, and the statistics for all of it. Built
+ *  without -DDNS_CACHE_PERSIST=0 it also checks that entries outlive a
+ *  reboot with the time they had left, through the shim's flash files, and
+ *  that a damaged file is ignored.
+ *
+ *  Host-only, not part of the CCS build. From the tools directory:
+ *      gcc -O2 -Ishim -I.. -DDNS_CACHE_PERSIST=0 -o dns_cache_check dns_cache_check.c shim/simplelink.c \
+ *          ../utils/dns_cache.c ../utils/flash_record.c ../utils/fnv.c -lssl -lcrypto
+ *      ./dns_cache_check
+ */
+
+#ifndef ccs
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "simplelink.h"
+#include "utils/dns_cache.h"
+
+#define DNS_ERROR       -161    /* What the mock returns for a dead name */
+
+static uint32_t now;
+static int lookups;
+static uint32_t next_ip = 0x0A000001;
+static int failures = 0;
+
+// Names starting with "dead" don't resolve, everything else gets a new address
+static int32_t mock_resolve(const char *host, uint32_t *ip) {
+    lookups++;
+    if (strncmp(host, "dead", 4) == 0) {
+        return DNS_ERROR;
+    }
+    *ip = next_ip++;
+    return 0;
+}
+
+static uint32_t mock_clock(void) {
+    return now;
+}
+
+static void expect(int ok, const char *what) {
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+// Resolve and check the result and whether the resolver was asked
+static void resolve(const char *host, int32_t want_ret, int want_lookup, const char *what) {
+    uint32_t ip = 0;
+    int before = lookups;
+    int32_t ret = dns_cache_resolve(host, &ip);
+    expect(ret == want_ret && (lookups != before) == want_lookup, what);
+}
+
+#if DNS_CACHE_PERSIST
+
+// Change the saved address of a host, as a bad flash write might, -1 if it isn't there
+static int damage_file(const char *host) {
+    static uint8_t data[1024];
+    _i32 handle, got = -1, i;
+    _u32 token = 0;
+
+    if (sl_FsOpen((_u8 *)DNS_CACHE_FILE, FS_MODE_OPEN_READ, &token, &handle) >= 0) {
+        got = sl_FsRead(handle, 0, data, sizeof(data));
+        sl_FsClose(handle, 0, 0, 0);
+    }
+    for (i = 0; i + DNS_CACHE_HOST_SIZE + 4 <= got; i++) {
+        if (strcmp((const char *)&data[i], host) == 0 &&
+            sl_FsOpen((_u8 *)DNS_CACHE_FILE, FS_MODE_OPEN_WRITE, &token, &handle) >= 0) {
+            data[i + offsetof(DnsCacheEntry, ip)] ^= 0x01;
+            sl_FsWrite(handle, i + offsetof(DnsCacheEntry, ip), &data[i + offsetof(DnsCacheEntry, ip)], 1);
+            sl_FsClose(handle, 0, 0, 0);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+#endif
+
+int main(void) {
+    uint32_t ip_a, ip_b;
+    char host[16];
+    int i;
+#if DNS_CACHE_PERSIST
+    sl_FsDel((_u8 *)DNS_CACHE_FILE, 0);
+#endif
+
+    now = 1000;
+    dns_cache_init(mock_resolve, mock_clock);
+
+    resolve("map.example", 0, 1, "first lookup goes to the resolver");
+    dns_cache_resolve("map.example", &ip_a);
+    resolve("map.example", 0, 0, "second lookup is a hit");
+    now += DNS_CACHE_TTL - 1;
+    resolve("map.example", 0, 0, "still a hit just inside the TTL");
+    now += 1;
+    resolve("map.example", 0, 1, "looked up again once the TTL runs out");
+    dns_cache_resolve("map.example", &ip_b);
+    expect(ip_b != ip_a, "the new lookup's address is used");
+
+    resolve("dead.example", DNS_ERROR, 1, "failed lookup returns the resolver's error");
+    resolve("dead.example", DNS_ERROR, 0, "failure is remembered");
+    now += DNS_CACHE_NEG_TTL;
+    resolve("dead.example", DNS_ERROR, 1, "failure is retried after the negative TTL");
+
+    dns_cache_invalidate("map.example");
+    resolve("map.example", 0, 1, "invalidated host is looked up again");
+
+    // More hosts than slots: the one closest to expiring goes
+    for (i = 0; i < DNS_CACHE_ENTRIES + 2; i++) {
+        sprintf(host, "host%d.example", i);
+        now += 10;
+        resolve(host, 0, 1, "new host is looked up");
+    }
+    resolve("map.example", 0, 1, "evicted host is looked up again");
+    sprintf(host, "host%d.example", DNS_CACHE_ENTRIES + 1);
+    resolve(host, 0, 0, "recent host is still cached");
+
+#if DNS_CACHE_PERSIST
+    // A reboot restarts the clock, saved entries keep the time they had left
+    dns_cache_init(mock_resolve, mock_clock);
+    now = 5000;
+    resolve("saved.example", 0, 1, "lookup before the reboot");
+    dns_cache_resolve("saved.example", &ip_a);
+    dns_cache_init(mock_resolve, mock_clock);
+    now = 900000;
+    resolve("saved.example", 0, 0, "saved address is a hit after the reboot");
+    dns_cache_resolve("saved.example", &ip_b);
+    expect(ip_b == ip_a, "saved address is the one looked up");
+    now += DNS_CACHE_TTL - 1;
+    resolve("saved.example", 0, 0, "saved address lasts the rest of its TTL");
+    now += 1;
+    resolve("saved.example", 0, 1, "saved address runs out");
+
+    // One changed bit and the file is ignored
+    expect(damage_file("saved.example") == 0, "saved file holds the host");
+    dns_cache_init(mock_resolve, mock_clock);
+    resolve("saved.example", 0, 1, "damaged file is ignored");
+#endif
+
+    // Expiry across the clock wrapping
+    dns_cache_init(mock_resolve, mock_clock);
+    now = 0xFFFFFFFF - DNS_CACHE_TTL / 2;
+    resolve("wrap.example", 0, 1, "lookup before the wrap");
+    now += DNS_CACHE_TTL / 4;
+    resolve("wrap.example", 0, 0, "hit before the wrap");
+    now += DNS_CACHE_TTL / 2;
+    resolve("wrap.example", 0, 0, "hit after the wrap");
+    now += DNS_CACHE_TTL / 2;
+    resolve("wrap.example", 0, 1, "expired after the wrap");
+
+    printf("DNS cache: %u hits, %u negative hits, %u misses, %u failed, %u expired, %u invalidated, %u evictions\n",
+           dns_cache_stats.hits, dns_cache_stats.negative_hits, dns_cache_stats.misses, dns_cache_stats.failures,
+           dns_cache_stats.expired, dns_cache_stats.invalidated, dns_cache_stats.evictions);
+    printf("%d failure(s)\n", failures);
+    return failures ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,243 @@
+/*
+ * game_bench.c
+ *
+ *  Linux throughput benchmark for the headless game core. Reports simulated
+ *  ticks per second and the time spent in each phase of game_step() and
+ *  game_render() for two workloads over the offline levels:
+ *      - scripted input that sweeps the stick, jumps and tilts the board
+ *        back and forth, so the moving platforms move
+ *      - a session that plays every level through to the WIN screen and
+ *        the end, one game_route() per level, recorded with replay_record()
+ *        and played back with replay_next(), so level loads, rasters and
+ *        index rebuilds are timed too. Every pass must end in the state the
+ *        recording ended in, which round-trips the replay format across the
+ *        level changes.
+ *
+ *  With -r, the session comes from a recording dumped over UART by the
+ *  device (the REPLAY ... END block) instead, and the scripted workload is
+ *  skipped. Every pass must end in the same state, so recorded sessions
+ *  double as regression workloads with a known tick count.
+ *
+ *  Host-only, not part of the CCS build. From the tools directory:
+ *      gcc -O2 -I.. -o game_bench game_bench.c game_route.c ../game.c ../collision.c ../dist_field.c ../replay.c ../utils/fnv.c ../plat_index.c ../arena.c ../procgen.c ../offline_levels.c ../offline_tables.c -lm
+ *      ./game_bench [-r replay.txt] [ticks]
+ */
+
+#ifndef ccs
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "game.h"
+#include "offline_levels.h"
+#include "replay.h"
+#include "game_route.h"
+
+static GameState game;
+static RenderDiff diff;
+static ReplayLog replay_log;
+static GameState route_end;
+static Input moves[REPLAY_LOG_SIZE];
+
+static uint64_t clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Scripted input: joystick sweeps side to side, jumps every 25 ticks and
+// the board tilts back and forth, all derived from the tick number
+static void script_input(uint32_t tick, Input *input) {
+    uint32_t phase = tick % 200;
+    int tilt = (int)((tick / 40) % 5) * 16 - 32;
+
+    input->tilt_reg = (uint8_t)tilt;
+    input->adc_valid = 1;
+    input->adc_sample = (phase < 100 ? phase * 40 : (200 - phase) * 40) << 2;
+    input->button = (tick % 25) == 0;
+}
+
+// Read a REPLAY ... END block as printed by replay_dump() on the device
+static int load_replay(const char *file, ReplayLog *log) {
+    char line[256];
+    unsigned int source, color, ticks, len, hash;
+    int in_block = 0;
+    FILE *f = fopen(file, "r");
+
+    if (!f) {
+        perror(file);
+        return -1;
+    }
+    memset(log, 0, sizeof(*log));
+    while (fgets(line, sizeof(line), f)) {
+        char *p = strstr(line, "REPLAY v1 ");
+        if (p) {
+            if (sscanf(p, "REPLAY v1 source=%u color=%x ticks=%u len=%u hash=%x path=%23s",
+                       &source, &color, &ticks, &len, &hash, log->path) < 5) {
+                break;
+            }
+            log->source = source;
+            log->color = color;
+            log->ticks = ticks;
+            in_block = 1;
+        } else if (in_block && strncmp(line, "END", 3) == 0) {
+            fclose(f);
+            if (log->len != len || replay_hash(log) != hash) {
+                fprintf(stderr, "%s: corrupt recording\n", file);
+                return -1;
+            }
+            return 0;
+        } else if (in_block) {
+            for (p = line; p[0] && p[1] && p[0] != '\r' && p[0] != '\n'; p += 2) {
+                unsigned int b;
+                if (sscanf(p, "%2x", &b) != 1 || log->len >= REPLAY_LOG_SIZE) {
+                    break;
+                }
+                log->data[log->len++] = (uint8_t)b;
+            }
+        }
+    }
+    fclose(f);
+    fprintf(stderr, "%s: no complete REPLAY block\n", file);
+    return -1;
+}
+
+static void start(void) {
+    game_init(&game);
+    game_load_offline_levels(&game);
+    game_add_win_level(&game);
+    game_start(&game);
+}
+
+// Record a session that leaves each level by its shortest route until the
+// game ends, and keep the state it ends in. Returns the levels changed.
+static int record_route(ReplayLog *log, GameState *end) {
+    uint8_t events = 0;
+    int levels = 0, n, i;
+
+    start();
+    replay_begin(log, REPLAY_SOURCE_OFFLINE, "", game.color);
+    while (!(events & GAME_EVENT_DONE)) {
+        n = game_route(&game, 1, moves, REPLAY_LOG_SIZE);
+        if (n < 0 || n > REPLAY_LOG_SIZE) {
+            fprintf(stderr, "No route out of level %u\n", game.level + 1);
+            return -1;
+        }
+        for (i = 0; i < n; i++) {
+            replay_record(log, &moves[i]);
+            events = game_step(&game, &moves[i]);
+            game_render(&game, &diff);
+        }
+        if (!(events & (GAME_EVENT_LEVEL | GAME_EVENT_DONE)) || log->overflow) {
+            fprintf(stderr, "Route out of level %u didn't play back\n", game.level + 1);
+            return -1;
+        }
+        levels++;
+    }
+    *end = game;
+    return levels;
+}
+
+// Run one workload, from the script when log is NULL, returns the passes
+// through the session that ended in a different state
+static uint32_t bench(const char *what, uint32_t ticks, const ReplayLog *log, const GameState *expect) {
+    uint32_t tick, levels = 0, games = 0, frames_changed = 0, passes = 0, mismatches = 0;
+    const char *phase_names[PHASE_COUNT] = {"input", "physics", "platforms", "render"};
+    ReplayPlayer player;
+    static GameState first_end;
+    Input input;
+    uint64_t begin, elapsed;
+    int i;
+
+    if (log) {
+        replay_play(&player, log);
+    }
+    start();
+    memset(game_phase_time, 0, sizeof(game_phase_time));
+    begin = clock_ns();
+    for (tick = 0; tick < ticks; tick++) {
+        if (!log) {
+            script_input(tick, &input);
+        } else if (!replay_next(&player, &input)) {
+            // End of the recording: every pass must end in the same state
+            if (passes++ == 0 && !expect) {
+                first_end = game;
+            } else if (memcmp(expect ? expect : &first_end, &game, sizeof(game)) != 0) {
+                mismatches++;
+            }
+            replay_play(&player, log);
+            start();
+            replay_next(&player, &input);
+        }
+        uint8_t events = game_step(&game, &input);
+        if (events & GAME_EVENT_LEVEL) {
+            levels++;
+        }
+        if (events & GAME_EVENT_DONE) {
+            games++;
+            if (log) {
+                // The recorded session ended here too, finish the pass
+                player.tick = log->ticks;
+            } else {
+                start();
+            }
+        }
+        game_render(&game, &diff);
+        if (diff.count) {
+            frames_changed++;
+        }
+    }
+    elapsed = clock_ns() - begin;
+
+    printf("%s: %u ticks in %.3f s: %.0f ticks/s (%.0fx real time)\n", what, ticks, elapsed / 1e9,
+           ticks / (elapsed / 1e9), ticks / (elapsed / 1e9) / TICKS_PER_SECOND);
+    printf("  %u levels completed, %u games, %u frames with changes\n", levels, games, frames_changed);
+    for (i = 0; i < PHASE_COUNT; i++) {
+        printf("  %-10s %8.1f ns/tick\n", phase_names[i], (double)game_phase_time[i] / ticks);
+    }
+    if (log) {
+        printf("  %u complete passes, %u ended in a different state\n", passes, mismatches);
+    }
+    return mismatches;
+}
+
+int main(int argc, char **argv) {
+    uint32_t ticks = 5000000, mismatches;
+    const char *replay_file = NULL;
+    int i, levels;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            replay_file = argv[++i];
+        } else {
+            ticks = (uint32_t)strtoul(argv[i], NULL, 10);
+        }
+    }
+    game_clock = clock_ns;
+    if (replay_file) {
+        if (load_replay(replay_file, &replay_log) < 0) {
+            return 1;
+        }
+        if (replay_log.source != REPLAY_SOURCE_OFFLINE) {
+            fprintf(stderr, "%s: only offline sessions can be replayed on the host\n", replay_file);
+            return 1;
+        }
+        printf("Replaying %u recorded ticks (%u bytes)\n", replay_log.ticks, replay_log.len);
+        mismatches = bench("Recording", ticks, &replay_log, NULL);
+        return mismatches ? 1 : 0;
+    }
+
+    bench("Scripted", ticks, NULL, NULL);
+    if ((levels = record_route(&replay_log, &route_end)) < 0) {
+        return 1;
+    }
+    printf("Routed session: %u ticks through %d levels, recorded in %u bytes\n", replay_log.ticks, levels,
+           replay_log.len);
+    mismatches = bench("Routed", ticks, &replay_log, &route_end);
+    return mismatches ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,261 @@
+/*
+ * game_route.c
+ *
+ *  Breadth-first route search over game_step() for the host tools.
+ */
+
+#ifndef ccs
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "game_route.h"
+#include "dist_field.h"
+
+// Visited poses: x in half pixels, y, y_vel and on_ground
+#define KEY_X           256
+#define KEY_Y           128
+#define KEY_VEL         32
+#define NUM_KEYS        (KEY_X * KEY_Y * KEY_VEL * 2)
+
+// Stick left, still or right, each with and without the button, then
+// standing still on the ground with the board tilted either way
+#define LEVEL_MOVES     6
+#define TILT_MOVES      8
+#define MAX_CONFIGS     256     /* Distinct moving platform positions searched */
+#define TILT_REG        32      /* Tilt register byte, moves platforms 8 pixels a tick */
+
+#define NONE            0xFFFFFFFF
+
+typedef struct {
+    float x, y, y_vel;
+    uint8_t on_ground;
+    uint8_t move;           /* Move that reached this pose from its parent */
+    uint16_t config;        /* Moving platform positions, index into configs */
+    uint32_t ticks;         /* Ticks from the start */
+    uint32_t parent;        /* Queue index of the parent pose */
+    uint32_t next;          /* Next pose waiting in the same config, or NONE */
+} Pose;
+
+// ADC readings for full left, centered and full right on the joystick, and
+// the tilt register either way
+static const uint32_t stick[3] = {0, 1463 << 2, 2925 << 2};
+static const uint8_t tilts[2] = {TILT_REG, (uint8_t)-TILT_REG};
+
+static uint8_t *visited[MAX_CONFIGS];
+static uint8_t configs[MAX_CONFIGS][256];   /* x of each moving platform */
+static uint32_t waiting[MAX_CONFIGS][2];    /* First and last pose still to expand */
+static int num_configs;
+static Pose *queue;
+static uint32_t queue_size, queue_len;
+static uint32_t *ground;
+static uint32_t ground_size;
+static GameState saved;
+
+// Mark a pose visited, returns 0 if it already was
+static int visit(const Pose *p) {
+    int x = (int)(p->x * 2), y = (int)p->y, vel = (int)p->y_vel + KEY_VEL / 2;
+    uint32_t key;
+    if (x < 0 || x >= KEY_X || y < 0 || y >= KEY_Y || vel < 0 || vel >= KEY_VEL) {
+        return 0;
+    }
+    key = ((((uint32_t)x * KEY_Y + y) * KEY_VEL + vel) << 1) | p->on_ground;
+    if (visited[p->config][key >> 3] & (1 << (key & 7))) {
+        return 0;
+    }
+    visited[p->config][key >> 3] |= 1 << (key & 7);
+    return 1;
+}
+
+// Index of the game's moving platform positions, added if new, -1 if full
+static int find_config(const GameState *game) {
+    const MovablePlatform *mov = game->mov_plats[game->level];
+    int n = game->num_mov_platforms[game->level], i, c;
+
+    for (c = 0; c < num_configs; c++) {
+        for (i = 0; i < n && configs[c][i] == mov[i].plat.x; i++);
+        if (i == n) {
+            return c;
+        }
+    }
+    if (num_configs == MAX_CONFIGS) {
+        return -1;
+    }
+    if (!visited[c]) {
+        visited[c] = malloc(NUM_KEYS / 8);
+    }
+    for (i = 0; i < n; i++) {
+        configs[c][i] = mov[i].plat.x;
+    }
+    memset(visited[c], 0, NUM_KEYS / 8);
+    waiting[c][0] = waiting[c][1] = NONE;
+    return num_configs++;
+}
+
+// Put the moving platforms back where a config has them, redrawn the way a tilt does
+static void set_config(GameState *game, int c) {
+    MovablePlatform *mov = game->mov_plats[game->level];
+    int n = game->num_mov_platforms[game->level], i, old_x;
+
+    for (i = 0; i < n; i++) {
+        old_x = mov[i].plat.x;
+        if (old_x != configs[c][i]) {
+            // One platform at a time, so the index is moved here under its own id
+            update_platforms(&mov[i], 1, configs[c][i] - old_x, game->map, NULL);
+            plat_index_move(&game->plat_index, PLAT_MOVING | i, old_x, configs[c][i],
+                            mov[i].plat.y, mov[i].plat.length, mov[i].plat.thickness);
+        }
+    }
+}
+
+// Stick, button and tilt register for a move
+static void move_input(int move, Input *input) {
+    memset(input, 0, sizeof(*input));
+    input->adc_valid = 1;
+    if (move < LEVEL_MOVES) {
+        input->adc_sample = stick[move % 3];
+        input->button = move >= 3;
+    } else {
+        input->adc_sample = stick[1];
+        input->tilt_reg = tilts[move - LEVEL_MOVES];
+    }
+}
+
+// Queue the pose the game is in, reached from parent by move, if it's new
+static void add_pose(const GameState *game, int config, uint32_t parent, int move) {
+    Pose p;
+
+    p.x = game->x_pos;
+    p.y = game->y_pos;
+    p.y_vel = game->y_vel;
+    p.on_ground = game->on_ground;
+    p.move = move;
+    p.config = config;
+    p.ticks = (parent == NONE) ? 0 : queue[parent].ticks + 1;
+    p.parent = parent;
+    p.next = NONE;
+    if (!visit(&p)) {
+        return;
+    }
+    if (queue_len == queue_size) {
+        queue_size *= 2;
+        queue = realloc(queue, queue_size * sizeof(Pose));
+    }
+    if (waiting[config][0] == NONE) {
+        waiting[config][0] = queue_len;
+    } else {
+        queue[waiting[config][1]].next = queue_len;
+    }
+    waiting[config][1] = queue_len;
+    queue[queue_len++] = p;
+}
+
+// Step from a queued pose, returns the ticks to leave if the move leaves
+static int try_move(GameState *game, uint32_t node, int move, Input *moves, int max) {
+    Input input;
+    int ticks = queue[node].ticks + 1, i;
+
+    game->x_pos = queue[node].x;
+    game->y_pos = queue[node].y;
+    game->y_vel = queue[node].y_vel;
+    game->on_ground = queue[node].on_ground;
+    move_input(move, &input);
+    if (!(game_step(game, &input) & (GAME_EVENT_LEVEL | GAME_EVENT_DONE))) {
+        return -1;
+    }
+    // Walk back up the parents to write the moves out in order
+    if (moves && ticks <= max) {
+        move_input(move, &moves[ticks - 1]);
+        for (i = ticks - 2; i >= 0; node = queue[node].parent, i--) {
+            move_input(queue[node].move, &moves[i]);
+        }
+    }
+    return ticks;
+}
+
+// Search breadth first with the platforms where they are, then from every
+// pose on the ground, tilt into the next arrangement and search that the
+// same way, until one leaves. Returns the ticks to leave or -1.
+static int search(GameState *game, int tilt, Input *moves, int max) {
+    static uint8_t tilted[KEY_X * KEY_Y / 8];
+    uint32_t node, num_ground, g, key;
+    int c, current = 0, config, move, ticks;
+
+    num_configs = 0;
+    queue_len = 0;
+    find_config(game);
+    add_pose(game, 0, NONE, 0);
+
+    for (;;) {
+        for (c = 0; c < num_configs && waiting[c][0] == NONE; c++);
+        if (c == num_configs) {
+            return -1;
+        }
+        if (current != c) {
+            set_config(game, c);
+        }
+        current = c;
+        num_ground = 0;
+        memset(tilted, 0, sizeof(tilted));
+        while ((node = waiting[c][0]) != NONE) {
+            waiting[c][0] = queue[node].next;
+            for (move = 0; move < LEVEL_MOVES; move++) {
+                if (move >= 3 && !queue[node].on_ground) {
+                    break;
+                }
+                if ((ticks = try_move(game, node, move, moves, max)) >= 0) {
+                    return ticks;
+                }
+                add_pose(game, c, node, move);
+            }
+            // One tilt from each pixel the character stands on is plenty
+            key = (uint32_t)queue[node].x * KEY_Y + (uint32_t)queue[node].y;
+            if (tilt && queue[node].on_ground && !(tilted[key >> 3] & (1 << (key & 7)))) {
+                tilted[key >> 3] |= 1 << (key & 7);
+                if (num_ground == ground_size) {
+                    ground_size *= 2;
+                    ground = realloc(ground, ground_size * sizeof(uint32_t));
+                }
+                ground[num_ground++] = node;
+            }
+        }
+
+        // Tilting moves the platforms, put them back before each one
+        for (g = 0; g < num_ground; g++) {
+            for (move = LEVEL_MOVES; move < TILT_MOVES; move++) {
+                if (current != c) {
+                    set_config(game, c);
+                }
+                if ((ticks = try_move(game, ground[g], move, moves, max)) >= 0) {
+                    return ticks;
+                }
+                current = config = find_config(game);
+                if (config >= 0) {
+                    add_pose(game, config, ground[g], move);
+                }
+            }
+        }
+    }
+}
+
+// Game Route
+int game_route(GameState *game, int tilt, Input *moves, int max) {
+    int ticks;
+
+    if (!queue) {
+        queue_size = NUM_KEYS;
+        queue = malloc(queue_size * sizeof(Pose));
+        ground_size = NUM_KEYS / 8;
+        ground = malloc(ground_size * sizeof(uint32_t));
+    }
+    saved = *game;
+    ticks = search(game, tilt && game->num_mov_platforms[game->level], moves, max);
+    *game = saved;
+#if DIST_FIELD_ENABLE
+    // The tables live outside the game, and leaving the level rebuilt them
+    dist_field_build(game->map);
+#endif
+    return ticks;
+}
+
+#endif
@@ -0,0 +1,26 @@
+/*
+ * game_route.h
+ *
+ *  Host-side route finder for the headless game core, shared by the
+ *  benchmarks and checks that need to play a level through to its exit.
+ *  Searches the moves of the real game_step() (left, still or right on the
+ *  stick, with and without the button) breadth first from the character's
+ *  pose, with the board held level so moving platforms stay where they are.
+ *  A route found that way can always be played on the device. Levels that
+ *  need their platforms moved can also tilt the board either way while the
+ *  character stands still, and each arrangement of the moving platforms
+ *  that reaches is searched in turn the same way.
+ */
+
+#ifndef GAME_ROUTE_H_
+#define GAME_ROUTE_H_
+
+#include "game.h"
+
+// Ticks of input from the game's current pose that leave the level, the
+// fewest with the board level, or tilting too if that fails and tilt is
+// set. Written to moves if it isn't NULL and they fit in max. Returns the
+// tick count or -1 if the level can't be left. The game is left as it was.
+int game_route(GameState *game, int tilt, Input *moves, int max);
+
+#endif /* GAME_ROUTE_H_ */
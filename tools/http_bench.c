@@ -0,0 +1,518 @@
+/*
+ * http_bench.c
+ *
+ *  Linux check and benchmark for the keep-alive HTTP client, run against a
+ *  local server stand-in on a loopback port. The server answers with
+ *  Content-Length, chunked (in random chunk sizes) or close-delimited
+ *  bodies, 304 for a matching If-None-Match and 404 for unknown paths. It
+ *  ends connections after a few requests, sometimes announcing it with
+ *  Connection: close and sometimes silently, as an idle timeout would. Every
+ *  body is checked, then the same requests are timed with the connection
+ *  kept open and with a new connection per request.
+ *
+ *  Next, files are downloaded the way the game resumes them: the server
+ *  honours Range with If-Range, and cuts a third of its bodies short,
+ *  closing at once or going quiet past the receive timeout first. Some
+ *  files change each time they are cut, so a resume gets the whole new
+ *  file and the download has to start over. Each must end up whole and
+ *  right.
+ *
+ *  Then times how long a map takes to be in hand once it is chosen on the
+ *  map menu, as main.c gets it with MAP_PREFETCH_ENABLE 0 and 1: a download
+ *  through the flash cache after the choice, or prefetches on the menu's
+ *  polling while the user moves the highlight, then map_prefetch_finish()
+ *  and a read from flash. SHIM_LATENCY_MS sets the round trip, and 0
+ *  requests skips the sections above, which take one per request. Round
+ *  trips longer than the 100 ms receive timeout below need a build without
+ *  -DHTTP_RECV_TIMEOUT_MS.
+ *
+ *  Host-only, not part of the CCS build. From the tools directory:
+ *      gcc -O2 -Ishim -I.. -DDNS_CACHE_PERSIST=0 -DHTTP_RECV_TIMEOUT_MS=100 -o http_bench http_bench.c \
+ *          ../map_prefetch.c shim/simplelink.c ../utils/http_client.c ../utils/http_parser.c \
+ *          ../utils/dns_cache.c ../utils/level_cache.c ../utils/flash_record.c ../utils/fnv.c -lssl -lcrypto -lpthread
+ *      ./http_bench [requests] [menu milliseconds]
+ *      SHIM_LATENCY_MS=50 ./http_bench 0
+ */
+
+#ifndef ccs
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <netinet/tcp.h>
+
+#include "simplelink.h"
+#include "utils/http_client.h"
+#include "utils/level_cache.h"
+#include "map_prefetch.h"
+
+#define MAX_BODY        8192
+#define REQS_PER_CONN   5       /* Server ends a connection after this many */
+#define RESUME_TRIES    8       /* Range requests per download, as many as the game makes and more */
+#define MENU_MAPS       5
+#define MENU_TICK_MS    20      /* The menu loop polls about once a SysTick */
+#define MENU_MOVES      3       /* Highlight moves before the choice */
+#define PLAY_TRIALS     5
+
+static int listen_fd;
+static uint16_t server_port;
+static int version;             /* Of the changing files, bumped when one is cut short */
+
+static uint64_t clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Contents of a file, from its path: /<kind><size>, kind l, c, x, r
+// (resumable) or v (changes when cut short, a version follows the size)
+static int file_body(const char *path, char *body, char *kind) {
+    int size, i;
+    uint32_t seed = 2166136261u;
+
+    if (sscanf(path, "/%c%d", kind, &size) != 2 || size < 0 || size > MAX_BODY ||
+        (*kind != 'l' && *kind != 'c' && *kind != 'x' && *kind != 'r' && *kind != 'v')) {
+        return -1;
+    }
+    for (i = 0; path[i]; i++) {
+        seed = (seed ^ (uint8_t)path[i]) * 16777619u;
+    }
+    for (i = 0; i < size; i++) {
+        seed = seed * 1103515245u + 12345u;
+        body[i] = "0123456789,\r\n"[(seed >> 16) % 13];
+    }
+    return size;
+}
+
+static int send_all(int fd, const char *data, int len) {
+    int sent, ret;
+    for (sent = 0; sent < len; sent += ret) {
+        if ((ret = send(fd, data + sent, len - sent, MSG_NOSIGNAL)) <= 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Serve one connection until the client or the server ends it
+static void serve(int fd, unsigned int *seed) {
+    static char request[1024], body[MAX_BODY], head[256];
+    int len = 0, served = 0, got;
+
+    while ((got = recv(fd, request + len, sizeof(request) - 1 - len, 0)) > 0) {
+        char path[64], etag[64] = "", if_range[64] = "", current[96], *end, *match, kind;
+        int size, head_len, last, silent, range = 0;
+
+        len += got;
+        request[len] = '\0';
+        if (!(end = strstr(request, "\r\n\r\n"))) {
+            continue;
+        }
+        sscanf(request, "GET %63s", path);
+        if ((match = strstr(request, "If-None-Match: "))) {
+            sscanf(match + 15, "%63s", etag);
+        }
+        if ((match = strstr(request, "Range: bytes="))) {
+            range = atoi(match + 13);
+        }
+        if ((match = strstr(request, "If-Range: "))) {
+            sscanf(match + 10, "%63s", if_range);
+        }
+        memmove(request, end + 4, len - (end + 4 - request));
+        len -= end + 4 - request;
+
+        served++;
+        last = (served == REQS_PER_CONN);
+        silent = last && (rand_r(seed) & 1);
+        size = file_body(path, body, &kind);
+        sprintf(current, "\"%s\"", path + 1);
+        if (size > 0 && kind == 'v') {
+            char versioned[80];
+            sprintf(versioned, "%s.%d", path, version);
+            file_body(versioned, body, &kind);
+            sprintf(current, "\"%s\"", versioned + 1);
+        }
+        if (size > 0 && (kind == 'r' || kind == 'v')) {
+            // A range is only served from the file the client has the start of
+            int from = (range > 0 && range < size && strcmp(if_range, current) == 0) ? range : 0;
+            int cut = (rand_r(seed) % 3 == 0) ? from + rand_r(seed) % (size - from) : size;
+            if (from) {
+                head_len = sprintf(head, "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes %d-%d/%d\r\n"
+                                   "Content-Length: %d\r\nETag: %s\r\n\r\n", from, size - 1, size, size - from,
+                                   current);
+            } else {
+                head_len = sprintf(head, "HTTP/1.1 200 OK\r\nContent-Length: %d\r\nETag: %s\r\n\r\n", size,
+                                   current);
+            }
+            send_all(fd, head, head_len);
+            send_all(fd, body + from, cut - from);
+            if (cut < size) {
+                if (rand_r(seed) % 4 == 0) {
+                    usleep(HTTP_RECV_TIMEOUT_MS * 2000);
+                }
+                version += (kind == 'v');
+                break;
+            }
+        } else if (size < 0) {
+            head_len = sprintf(head, "HTTP/1.1 404 Not Found\r\nContent-Length: 9\r\n%s\r\n",
+                               (last && !silent) ? "Connection: close\r\n" : "");
+            send_all(fd, head, head_len);
+            send_all(fd, "Not Found", 9);
+        } else if (strcmp(etag, current) == 0) {
+            head_len = sprintf(head, "HTTP/1.1 304 Not Modified\r\nETag: \"%s\"\r\n%s\r\n", path + 1,
+                               (last && !silent) ? "Connection: close\r\n" : "");
+            send_all(fd, head, head_len);
+        } else if (kind == 'l') {
+            head_len = sprintf(head, "HTTP/1.1 200 OK\r\nContent-Length: %d\r\nETag: \"%s\"\r\n%s\r\n", size,
+                               path + 1, (last && !silent) ? "Connection: close\r\n" : "");
+            send_all(fd, head, head_len);
+            send_all(fd, body, size);
+        } else if (kind == 'c') {
+            int pos = 0;
+            head_len = sprintf(head, "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\nETag: \"%s\"\r\n%s\r\n",
+                               path + 1, (last && !silent) ? "Connection: close\r\n" : "");
+            send_all(fd, head, head_len);
+            while (pos < size) {
+                int n = 1 + rand_r(seed) % 700;
+                n = (n > size - pos) ? size - pos : n;
+                head_len = sprintf(head, "%x%s\r\n", n, (rand_r(seed) & 3) ? "" : ";ext=1");
+                send_all(fd, head, head_len);
+                send_all(fd, body + pos, n);
+                send_all(fd, "\r\n", 2);
+                pos += n;
+            }
+            send_all(fd, "0\r\n\r\n", 5);
+        } else {
+            // No length, the body ends with the connection
+            head_len = sprintf(head, "HTTP/1.1 200 OK\r\nConnection: close\r\n\r\n");
+            send_all(fd, head, head_len);
+            send_all(fd, body, size);
+            break;
+        }
+        if (last) {
+            break;
+        }
+    }
+    close(fd);
+}
+
+static void *server_main(void *arg) {
+    unsigned int seed = 7;
+    int fd, one = 1;
+    while ((fd = accept(listen_fd, NULL, NULL)) >= 0) {
+        // The pieces of a response go out as written, as from a real server
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        serve(fd, &seed);
+    }
+    return NULL;
+}
+
+static void start_server(void) {
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    pthread_t thread;
+    int one = 1;
+
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_fd, 4) < 0) {
+        perror("server");
+        exit(1);
+    }
+    getsockname(listen_fd, (struct sockaddr *)&addr, &addr_len);
+    server_port = ntohs(addr.sin_port);
+    pthread_create(&thread, NULL, server_main, NULL);
+}
+
+typedef struct {
+    char data[MAX_BODY];
+    int len;
+} Body;
+
+static void collect(const char *data, int len, void *ctx) {
+    Body *body = (Body *)ctx;
+    if (body->len + len <= MAX_BODY) {
+        memcpy(body->data + body->len, data, len);
+    }
+    body->len += len;
+}
+
+// Fetch a path and check the answer, returns 0 if it was right
+static int fetch(HttpClient *client, const char *path, int use_etag) {
+    static Body body;
+    char expect[MAX_BODY], kind, etag[64];
+    int size = file_body(path, expect, &kind), ret;
+
+    sprintf(etag, "\"%s\"", path + 1);
+    use_etag = use_etag && size >= 0 && kind != 'x';
+    body.len = 0;
+    ret = http_get(client, path, use_etag ? etag : NULL, collect, &body);
+    if (ret < 0) {
+        printf("%s: error %d\n", path, ret);
+        return -1;
+    }
+    if (size < 0) {
+        return (client->parser.status == 404 && body.len == 0) ? 0 : -1;
+    }
+    if (use_etag) {
+        return (client->parser.status == 304 && body.len == 0) ? 0 : -1;
+    }
+    if (client->parser.status != 200 || body.len != size || memcmp(body.data, expect, size) != 0) {
+        printf("%s: status %d, %d of %d bytes\n", path, client->parser.status, body.len, size);
+        return -1;
+    }
+    return (kind == 'x' || strcmp(client->parser.etag, etag) == 0) ? 0 : -1;
+}
+
+typedef struct {
+    HttpClient *client;
+    Body body;
+    uint8_t started;            /* The current response has delivered body bytes */
+    uint8_t mismatch;           /* A response didn't continue the body */
+} Resume;
+
+// Keep a response's body only if it carries on from what is already in
+static void resume_collect(const char *data, int len, void *ctx) {
+    Resume *r = (Resume *)ctx;
+    const HttpParser *parser = &r->client->parser;
+
+    if (!r->started) {
+        r->started = 1;
+        r->mismatch = r->body.len && (parser->status != 206 || !parser->has_range ||
+                                      parser->range_start != (uint32_t)r->body.len);
+    }
+    if (!r->mismatch) {
+        collect(data, len, &r->body);
+    }
+}
+
+typedef struct {
+    uint32_t cut;               /* Downloads that needed a resume */
+    uint32_t restarts;          /* Started over after the file changed */
+} ResumeStats;
+
+// Download a file, resuming it with Range requests as the game does and
+// starting over if it changed. Returns 0 if it arrived whole and right.
+static int fetch_resumable(HttpClient *client, const char *path, ResumeStats *stats) {
+    static Resume r;
+    char etag[HTTP_ETAG_SIZE], expect[MAX_BODY], versioned[80], kind;
+    int attempt, resumes, ret = -1, size;
+
+    for (attempt = 0; attempt < RESUME_TRIES && ret != 0; attempt++) {
+        r.client = client;
+        r.body.len = 0;
+        r.started = r.mismatch = 0;
+        ret = http_get(client, path, NULL, resume_collect, &r);
+        strcpy(etag, client->parser.etag);
+        for (resumes = 0; ret != 0 && r.body.len && resumes < RESUME_TRIES; resumes++) {
+            r.started = 0;
+            ret = http_get_range(client, path, etag, r.body.len, resume_collect, &r);
+            if (r.mismatch) {
+                stats->restarts++;
+                ret = -1;
+                break;
+            }
+        }
+        stats->cut += (resumes > 0);
+    }
+    size = file_body(path, expect, &kind);
+    if (kind == 'v') {
+        sprintf(versioned, "%s.%d", path, version);
+        file_body(versioned, expect, &kind);
+    }
+    if (ret != 0 || r.body.len != size || memcmp(r.body.data, expect, size) != 0) {
+        printf("%s: error %d, %d of %d bytes\n", path, ret, r.body.len, size);
+        return -1;
+    }
+    return 0;
+}
+
+// Maps on the menu, their files are served with a Content-Length
+static const uint32_t menu_sizes[MENU_MAPS] = {3000, 4500, 2500, 6000, 3500};
+
+static uint32_t clock_ms(void) {
+    return (uint32_t)(clock_ns() / 1000000);
+}
+
+// Read a map the way download_levels() does, from flash if it is local and
+// otherwise through the tee, returns 0 if it arrived whole and right
+static int play_map(HttpClient *client, const MapInfo *info, int local) {
+    static Body body;
+    static LevelCacheTee tee;
+    char path[64], expect[MAX_BODY], kind;
+    int ret;
+
+    snprintf(path, sizeof(path), "/%s_map.txt", info->name);
+    body.len = 0;
+    if (local && level_cache_read(path, collect, &body) == 0) {
+        ret = 0;
+    } else {
+        body.len = 0;
+        level_cache_tee_init(&tee, path, info->size, &client->parser, collect, &body);
+        ret = http_get(client, path, NULL, level_cache_tee_body, &tee);
+        if (ret == 0 && client->parser.status == 200 && tee.caching) {
+            level_cache_commit();
+        } else {
+            level_cache_abort();
+        }
+    }
+    if (ret != 0 || body.len != file_body(path, expect, &kind) || memcmp(body.data, expect, body.len) != 0) {
+        printf("%s: error %d, %d bytes\n", path, ret, body.len);
+        return -1;
+    }
+    return 0;
+}
+
+// Milliseconds from the choice on a menu shown for menu_ms, with or without
+// prefetching, -1 if the map didn't arrive right
+static double time_to_play(const MapInfo *maps, int prefetch, int menu_ms, int *prefetched) {
+    static MapPrefetch pf;
+    HttpClient client;
+    char path[64];
+    uint64_t select;
+    uint32_t start;
+    int sel = MENU_MAPS - 1, moves = 0, local = 0, i;
+
+    for (i = 0; i < MENU_MAPS; i++) {
+        snprintf(path, sizeof(path), "/%s_map.txt", maps[i].name);
+        level_cache_drop(path);
+    }
+    // The map list came in on the same connection just before the menu
+    http_client_init(&client, "localhost", server_port);
+    fetch(&client, "/l300", 0);
+
+    if (prefetch) {
+        map_prefetch_init(&pf, &client, maps, MENU_MAPS, sel);
+    }
+    start = clock_ms();
+    while (clock_ms() - start < (uint32_t)menu_ms) {
+        if (prefetch) {
+            _SlNonOsMainLoopTask();
+            map_prefetch_poll(&pf);
+        }
+        if (moves < MENU_MOVES && clock_ms() - start >= (uint32_t)(moves + 1) * menu_ms / (MENU_MOVES + 1)) {
+            sel = (sel == 0) ? MENU_MAPS - 1 : sel - 1;
+            moves++;
+            if (prefetch) {
+                map_prefetch_select(&pf, sel);
+            }
+        }
+        usleep(MENU_TICK_MS * 1000);
+    }
+    select = clock_ns();
+    if (prefetch) {
+        local = map_prefetch_finish(&pf, sel);
+    }
+    *prefetched += local;
+    i = play_map(&client, &maps[sel], local);
+    select = clock_ns() - select;
+    http_client_close(&client);
+    return (i == 0) ? select / 1e6 : -1;
+}
+
+static void make_path(char *path, int i) {
+    static const char kinds[] = "llllcccx";
+    if (i % 23 == 7) {
+        sprintf(path, "/missing%d", i);
+    } else {
+        sprintf(path, "/%c%d", kinds[i % 8], (i * 7919) % MAX_BODY);
+    }
+}
+
+int main(int argc, char **argv) {
+    int requests = (argc > 1) ? atoi(argv[1]) : 2000, i, pass, failures = 0;
+    int menu_ms = (argc > 2) ? atoi(argv[2]) : 1500;
+    HttpClient client;
+    char path[64];
+
+    signal(SIGPIPE, SIG_IGN);
+    start_server();
+    http_client_init(&client, "localhost", server_port);
+
+    // The client checks and timings, one round trip per request under SHIM_LATENCY_MS
+    if (requests > 0) {
+        for (i = 0; i < requests; i++) {
+            make_path(path, i);
+            if (fetch(&client, path, i % 5 == 4) < 0) {
+                failures++;
+            }
+        }
+        printf("%d requests, %u connections, %u reused, %u resent after a silent close, %d failures\n",
+               requests, client.stats.connects, client.stats.reused, client.stats.retries, failures);
+
+        // Time the same requests both ways, the server's per-connection limit is
+        // what keeps the keep-alive figure from being a single connection
+        for (pass = 0; pass < 2; pass++) {
+            uint64_t begin = clock_ns();
+            // The stand-in serves one connection at a time, so let go of the last one
+            http_client_close(&client);
+            http_client_init(&client, "localhost", server_port);
+            for (i = 0; i < requests; i++) {
+                make_path(path, i);
+                failures += (fetch(&client, path, 0) < 0);
+                if (pass == 1) {
+                    http_client_close(&client);
+                }
+            }
+            printf("%s: %.1f us per request, %u connections\n", pass ? "New connection each" : "Keep-alive         ",
+                   (clock_ns() - begin) / 1e3 / requests, client.stats.connects);
+        }
+
+        // Downloads cut short, resumed where they stopped
+        {
+            ResumeStats stats = {0, 0};
+            int downloads = requests / 10, resume_failures = 0;
+
+            http_client_close(&client);
+            http_client_init(&client, "localhost", server_port);
+            for (i = 0; i < downloads; i++) {
+                sprintf(path, "/%c%d", (i % 4 == 3) ? 'v' : 'r', 1 + (i * 7919) % MAX_BODY);
+                resume_failures += (fetch_resumable(&client, path, &stats) < 0);
+            }
+            printf("%d downloads: %u cut short and resumed with %u range requests, %u timed out, "
+                   "%u started over after a change, %d failures\n", downloads, stats.cut, client.stats.ranges,
+                   client.stats.timeouts, stats.restarts, resume_failures);
+            failures += resume_failures;
+        }
+    }
+
+    // Time to play, with a cold cache each time
+    {
+        MapInfo maps[MENU_MAPS];
+        double total[2] = {0, 0}, worst[2] = {0, 0}, ms;
+        int prefetched = 0, trial;
+
+        http_client_close(&client);
+        level_cache_init();
+        memset(maps, 0, sizeof(maps));
+        for (i = 0; i < MENU_MAPS; i++) {
+            sprintf(maps[i].name, "l%u", menu_sizes[i]);
+            maps[i].size = menu_sizes[i];
+        }
+        for (trial = 0; trial < PLAY_TRIALS; trial++) {
+            for (pass = 0; pass < 2; pass++) {
+                if ((ms = time_to_play(maps, pass, menu_ms, &prefetched)) < 0) {
+                    failures++;
+                    continue;
+                }
+                total[pass] += ms;
+                worst[pass] = (ms > worst[pass]) ? ms : worst[pass];
+            }
+        }
+        printf("Time to play after %d ms on the menu, SHIM_LATENCY_MS=%s, %d trials:\n", menu_ms,
+               getenv("SHIM_LATENCY_MS") ? getenv("SHIM_LATENCY_MS") : "0", PLAY_TRIALS);
+        printf("  MAP_PREFETCH_ENABLE 0: %.1f ms average, %.1f ms worst\n", total[0] / PLAY_TRIALS, worst[0]);
+        printf("  MAP_PREFETCH_ENABLE 1: %.1f ms average, %.1f ms worst, %d of %d chosen maps read from flash\n",
+               total[1] / PLAY_TRIALS, worst[1], prefetched, PLAY_TRIALS);
+    }
+    return failures ? 1 : 0;
+}
+
+#endif
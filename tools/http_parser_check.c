@@ -0,0 +1,241 @@
+/*
+ * http_parser_check.c
+ *
+ *  Linux self-check and benchmark for the incremental HTTP response
+ *  parser. Each response in the table is fed whole, split in two at every
+ *  byte offset, split in three at every pair of offsets, and a byte at a
+ *  time; every way must give the same status, ETag, keep-alive, body and
+ *  result, and stop at the end of the response so a following one is left
+ *  alone. Content-Range values are checked on their own. Then a large chunked response is streamed through in TCP-sized
+ *  pieces to show the memory stays at sizeof(HttpParser) whatever the size.
+ *
+ *  Host-only, not part of the CCS build. From the tools directory:
+ *      gcc -O2 -I.. -o http_parser_check http_parser_check.c ../utils/http_parser.c
+ *      ./http_parser_check [megabytes]
+ */
+
+#ifndef ccs
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "utils/http_parser.h"
+
+#define MAX_BODY        4096
+#define NEXT_RESPONSE   "HTTP/1.1 200 OK\r\n"   /* Appended to check nothing past the end is used */
+
+typedef struct {
+    const char *name;
+    const char *response;
+    int result;             /* 0, or the HTTP_E_* expected from feed or finish */
+    int status;
+    const char *body;
+    const char *etag;
+    int keep_alive;
+    int delimited;          /* The response says where it ends, so NEXT_RESPONSE can follow */
+} Case;
+
+static const Case cases[] = {
+    {"content-length", "HTTP/1.1 200 OK\r\nContent-Length: 11\r\nETag: \"abc\"\r\n\r\nhello world",
+     0, 200, "hello world", "\"abc\"", 1, 1},
+    {"header case and spacing", "HTTP/1.1 200 OK\r\ncOnTeNt-LeNgTh:5   \r\netag:\t\"x\"\r\nServer: test\r\n\r\n12345",
+     0, 200, "12345", "\"x\"", 1, 1},
+    {"bare LF line endings", "HTTP/1.1 200 OK\nContent-Length: 3\n\nabc", 0, 200, "abc", "", 1, 1},
+    {"zero length", "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n", 0, 200, "", "", 1, 1},
+    {"chunked", "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhello\r\n1;ext=\"a\"\r\n \r\n"
+     "A\r\n0123456789\r\n0\r\n\r\n", 0, 200, "hello 0123456789", "", 1, 1},
+    {"chunked with trailer", "HTTP/1.1 200 OK\r\nTransfer-Encoding: gzip, Chunked\r\n\r\n3\r\nabc\r\n0\r\n"
+     "X-Trailer: 1\r\n\r\n", 0, 200, "abc", "", 1, 1},
+    {"chunked beats length", "HTTP/1.1 200 OK\r\nContent-Length: 99\r\nTransfer-Encoding: chunked\r\n\r\n"
+     "2\r\nok\r\n0\r\n\r\n", 0, 200, "ok", "", 1, 1},
+    {"partial content", "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes 6-10/11\r\nContent-Length: 5\r\n"
+     "ETag: \"abc\"\r\n\r\nworld", 0, 206, "world", "\"abc\"", 1, 1},
+    {"not modified", "HTTP/1.1 304 Not Modified\r\nETag: \"v2\"\r\n\r\n", 0, 304, "", "\"v2\"", 1, 1},
+    {"no content", "HTTP/1.1 204 No Content\r\nContent-Length: 0\r\n\r\n", 0, 204, "", "", 1, 1},
+    {"interim 100", "HTTP/1.1 100 Continue\r\n\r\nHTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nhi",
+     0, 200, "hi", "", 1, 1},
+    {"not found", "HTTP/1.1 404 Not Found\r\nContent-Length: 9\r\n\r\nNot Found", 0, 404, "Not Found", "", 1, 1},
+    {"connection close", "HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: 1\r\n\r\nz", 0, 200, "z", "", 0, 1},
+    {"HTTP/1.0", "HTTP/1.0 200 OK\r\nContent-Length: 1\r\n\r\nq", 0, 200, "q", "", 0, 1},
+    {"close delimited", "HTTP/1.1 200 OK\r\n\r\nuntil the end", 0, 200, "until the end", "", 0, 0},
+    {"long header line", "HTTP/1.1 200 OK\r\nX-Long: 0123456789012345678901234567890123456789012345678901234567890123"
+     "456789012345678901234567890123456789\r\nContent-Length: 2\r\n\r\nok", 0, 200, "ok", "", 1, 1},
+    {"truncated body", "HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\nshort", HTTP_E_CLOSED, 200, "short", "", 1, 0},
+    {"truncated headers", "HTTP/1.1 200 OK\r\nContent-Len", HTTP_E_CLOSED, 200, "", "", 1, 0},
+    {"truncated chunk", "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nab", HTTP_E_CLOSED, 200, "ab", "", 1, 0},
+    {"bad status line", "HTTP/2 200 OK\r\n\r\n", HTTP_E_PROTOCOL, 0, "", "", 0, 0},
+    {"bad status code", "HTTP/1.1 20x OK\r\n\r\n", HTTP_E_PROTOCOL, 0, "", "", 0, 0},
+    {"bad length", "HTTP/1.1 200 OK\r\nContent-Length: 12a\r\n\r\n", HTTP_E_PROTOCOL, 200, "", "", 1, 0},
+    {"length overflow", "HTTP/1.1 200 OK\r\nContent-Length: 4294967296\r\n\r\n", HTTP_E_PROTOCOL, 200, "", "", 1, 0},
+    {"bad chunk size", "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n", HTTP_E_PROTOCOL, 200, "", "", 1, 0},
+    {"missing chunk CRLF", "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n2\r\nokX\r\n0\r\n\r\n",
+     HTTP_E_PROTOCOL, 200, "ok", "", 1, 0},
+};
+
+#define NUM_CASES   ((int)(sizeof(cases) / sizeof(cases[0])))
+
+static const struct {
+    const char *value;
+    int has_range;
+    uint32_t start, total;
+} ranges[] = {
+    {"bytes 6-10/11", 1, 6, 11},
+    {"Bytes 0-0/*", 1, 0, 0},
+    {"bytes 4294967294-4294967294/4294967295", 1, 4294967294u, 4294967295u},
+    {"bytes 5-4/11", 0, 0, 0},
+    {"bytes 6-11/11", 0, 0, 0},
+    {"bytes */11", 0, 0, 0},
+    {"bytes 1-4294967296/5", 0, 0, 0},
+    {"items 1-2/3", 0, 0, 0},
+};
+
+#define NUM_RANGES  ((int)(sizeof(ranges) / sizeof(ranges[0])))
+
+typedef struct {
+    char data[MAX_BODY];
+    int len;
+} Body;
+
+static void collect(const char *data, int len, void *ctx) {
+    Body *body = (Body *)ctx;
+    if (body->len + len <= MAX_BODY) {
+        memcpy(body->data + body->len, data, len);
+    }
+    body->len += len;
+}
+
+static void count(const char *data, int len, void *ctx) {
+    *(uint64_t *)ctx += len;
+}
+
+static uint64_t clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Feed a case in pieces ending at the given offsets and check the outcome
+static int run(const Case *c, const int *cuts, int num_cuts) {
+    static char input[1024];
+    HttpParser parser;
+    Body body;
+    int len = strlen(c->response), total, pos = 0, piece, used = 0, ret = 0;
+
+    strcpy(input, c->response);
+    total = len;
+    if (c->delimited) {
+        strcpy(input + len, NEXT_RESPONSE);
+        total += strlen(NEXT_RESPONSE);
+    }
+    body.len = 0;
+    http_parser_init(&parser, collect, &body);
+    for (piece = 0; piece <= num_cuts && ret >= 0 && !http_parser_done(&parser); piece++) {
+        int end = (piece < num_cuts) ? cuts[piece] : total;
+        ret = http_parser_feed(&parser, input + pos, end - pos);
+        if (ret >= 0) {
+            used += ret;
+        }
+        pos = end;
+    }
+    if (ret >= 0) {
+        ret = http_parser_finish(&parser);
+    }
+    if (ret != c->result) {
+        return -1;
+    }
+    if (parser.status != c->status || body.len != (int)strlen(c->body) || memcmp(body.data, c->body, body.len) != 0) {
+        return -1;
+    }
+    if (c->result == 0 && (strcmp(parser.etag, c->etag) != 0 || parser.keep_alive != c->keep_alive || used != len)) {
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int megabytes = (argc > 1) ? atoi(argv[1]) : 64;
+    int i, a, b, len, runs = 0, failures = 0;
+    int cuts[1024];
+
+    for (i = 0; i < NUM_CASES; i++) {
+        const Case *c = &cases[i];
+        int bad = 0;
+        len = strlen(c->response) + (c->delimited ? strlen(NEXT_RESPONSE) : 0);
+
+        bad |= run(c, NULL, 0);
+        runs++;
+        for (a = 0; a <= len; a++) {
+            bad |= run(c, &a, 1);
+            runs++;
+            for (b = a; b <= len; b++) {
+                cuts[0] = a;
+                cuts[1] = b;
+                bad |= run(c, cuts, 2);
+                runs++;
+            }
+        }
+        for (a = 0; a < len; a++) {
+            cuts[a] = a + 1;
+        }
+        bad |= run(c, cuts, len - 1);
+        runs++;
+        if (bad) {
+            printf("FAIL: %s\n", c->name);
+            failures++;
+        }
+    }
+    printf("%d responses fed %d ways, %d failure(s)\n", NUM_CASES, runs, failures);
+
+    for (i = 0; i < NUM_RANGES; i++) {
+        static char response[256];
+        HttpParser parser;
+
+        len = sprintf(response, "HTTP/1.1 206 Partial Content\r\nContent-Range: %s\r\nContent-Length: 0\r\n\r\n",
+                      ranges[i].value);
+        http_parser_init(&parser, NULL, NULL);
+        if (http_parser_feed(&parser, response, len) != len || parser.has_range != ranges[i].has_range ||
+            parser.range_start != ranges[i].start || parser.range_total != ranges[i].total) {
+            printf("FAIL: Content-Range: %s\n", ranges[i].value);
+            failures++;
+        }
+    }
+
+    // A large chunked body in 1460-byte segments, generated a segment at a time
+    {
+        static char segment[1460], wire[2 * 1460];
+        uint64_t body_bytes = 0, target = (uint64_t)megabytes << 20, sent = 0, begin;
+        HttpParser parser;
+        int wire_len;
+
+        memset(segment, 'x', sizeof(segment));
+        http_parser_init(&parser, count, &body_bytes);
+        begin = clock_ns();
+        wire_len = sprintf(wire, "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n");
+        http_parser_feed(&parser, wire, wire_len);
+        while (sent < target) {
+            int n = 1 + (int)((sent * 2654435761u) % 1200);
+            wire_len = sprintf(wire, "%x\r\n", n);
+            memcpy(wire + wire_len, segment, n);
+            wire_len += n;
+            wire_len += sprintf(wire + wire_len, "\r\n");
+            if (http_parser_feed(&parser, wire, wire_len) != wire_len) {
+                printf("FAIL: large chunked body\n");
+                return 1;
+            }
+            sent += n;
+        }
+        http_parser_feed(&parser, "0\r\n\r\n", 5);
+        if (!http_parser_done(&parser) || body_bytes != sent) {
+            printf("FAIL: large chunked body\n");
+            return 1;
+        }
+        printf("%d MB chunked body through %zu bytes of parser state: %.0f MB/s\n", megabytes,
+               sizeof(HttpParser), (double)sent / ((clock_ns() - begin) / 1e9) / (1 << 20));
+    }
+    return failures ? 1 : 0;
+}
+
+#endif
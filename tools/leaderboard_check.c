@@ -0,0 +1,382 @@
+/*
+ * leaderboard_check.c
+ *
+ *  Linux check for the leaderboard queue, run against a local HTTPS
+ *  stand-in for the AWS IoT REST endpoint on a loopback port. The stand-in
+ *  takes score batches and serves top-time shadows, and now and then
+ *  refuses a batch with 503, closes without answering or answers slowly,
+ *  as a flaky link would. The device's own network code carries it: the
+ *  Wi-Fi connect of network_utils.c over the shim's simulated AP, then the
+ *  real TLS channel over the shim's OpenSSL sockets, with a throwaway
+ *  certificate written where the device keeps its own and the client
+ *  certificate asked for as AWS IoT does. Checked:
+ *      - results go out in order, at least once each, and leave the queue
+ *        only when acknowledged; a full queue drops the oldest
+ *      - best times are fetched, cached per map, and a missing board is
+ *        cached as empty
+ *      - the queue survives a save and load through the sl_Fs shim
+ *      - no poll waits on the network: the slowest leaderboard_poll() and
+ *        tls_channel_poll() are reported, across the handshakes of every
+ *        reconnect the faults cause, beside tls_channel_setup(), which
+ *        main.c keeps out of play
+ *  The backoffs are shortened with -D so the faults don't take minutes.
+ *
+ *  Host-only, not part of the CCS build. From the tools directory:
+ *      gcc -O2 -Ishim -I.. -DDNS_CACHE_PERSIST=0 -DLB_RETRY_MIN_MS=20 -DLB_REPLY_TIMEOUT_MS=500 \
+ *          -DTLS_BACKOFF_MIN_MS=20 -o leaderboard_check leaderboard_check.c shim/simplelink.c ../leaderboard.c \
+ *          ../utils/http_parser.c ../utils/network_utils.c ../utils/tls_channel.c ../utils/dns_cache.c \
+ *          ../utils/flash_record.c ../utils/fnv.c -lssl -lcrypto -lpthread
+ *      ./leaderboard_check [results]
+ */
+
+#ifndef ccs
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <netinet/tcp.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include <openssl/evp.h>
+
+#include "simplelink.h"
+#include "leaderboard.h"
+#include "utils/network_utils.h"
+#include "utils/tls_channel.h"
+#include "utils/dns_cache.h"
+
+// The stand-in's socket isn't the device's, so sl_Stop() mustn't close it
+#undef socket
+
+#define MAX_RESULTS     4096
+#define HOST            "localhost"
+
+static int listen_fd;
+static uint16_t server_port;
+static X509 *server_cert;
+static EVP_PKEY *server_key;
+static int received_count[MAX_RESULTS];     /* Times the server saw each result */
+static int requests_seen;
+
+static uint32_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+//*****************************************************************************
+// Certificates
+//*****************************************************************************
+
+static X509 *make_cert(EVP_PKEY *key, const char *name) {
+    X509 *cert = X509_new();
+    X509_NAME *subject;
+
+    X509_set_version(cert, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), -60);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 24 * 3600);
+    X509_set_pubkey(cert, key);
+    subject = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(subject, "CN", MBSTRING_ASC, (const unsigned char *)name, -1, -1, 0);
+    X509_set_issuer_name(cert, subject);
+    X509_sign(cert, key, EVP_sha256());
+    return cert;
+}
+
+static void write_der(const char *name, X509 *cert, EVP_PKEY *key) {
+    char path[256];
+    FILE *f;
+
+    shim_fs_path((const _u8 *)name, path, sizeof(path));
+    if (!(f = fopen(path, "wb")) || !(cert ? i2d_X509_fp(f, cert) : i2d_PrivateKey_fp(f, key))) {
+        perror(path);
+        exit(1);
+    }
+    fclose(f);
+}
+
+// One key and certificate do for the server, the client and the CA
+static void make_certs(void) {
+    server_key = EVP_RSA_gen(2048);
+    server_cert = make_cert(server_key, HOST);
+    write_der(SL_SSL_CA_CERT, server_cert, NULL);
+    write_der(SL_SSL_CLIENT, server_cert, NULL);
+    write_der(SL_SSL_PRIVATE, NULL, server_key);
+}
+
+//*****************************************************************************
+// IoT REST stand-in
+//*****************************************************************************
+
+// Read one request, returns its length with the body or 0 if the connection closed
+static int read_request(SSL *ssl, char *req, int size) {
+    int len = 0, got;
+    char *end;
+
+    for (;;) {
+        req[len] = '\0';
+        if ((end = strstr(req, "\r\n\r\n"))) {
+            const char *cl = strstr(req, "Content-Length: ");
+            int want = (end + 4 - req) + (cl ? atoi(cl + 16) : 0);
+            if (len >= want) {
+                return want;
+            }
+        }
+        if (len == size - 1 || (got = SSL_read(ssl, req + len, size - 1 - len)) <= 0) {
+            return 0;
+        }
+        len += got;
+    }
+}
+
+static void reply(SSL *ssl, const char *status, const char *body) {
+    char resp[512];
+    int len = snprintf(resp, sizeof(resp), "HTTP/1.1 %s\r\nContent-Type: application/json\r\nContent-Length: %zu\r\n\r\n%s",
+                       status, strlen(body), body);
+    SSL_write(ssl, resp, len);
+}
+
+// Record each {"map":..,"ms":N,..}, the time holds the result number
+static void take_scores(const char *body) {
+    const char *p = body;
+
+    while ((p = strstr(p, "\"ms\":"))) {
+        uint32_t ms = strtoul(p + 5, NULL, 10);
+        if (ms < MAX_RESULTS) {
+            received_count[ms]++;
+        }
+        p += 5;
+    }
+}
+
+// Answer requests until the client goes or a fault drops the connection
+static void serve(SSL *ssl, unsigned int *seed) {
+    static char req[4096];
+
+    for (;;) {
+        int len = read_request(ssl, req, sizeof(req)), fault = rand_r(seed) % 10;
+        if (len == 0) {
+            return;
+        }
+        requests_seen++;
+        if (fault == 0) {
+            return;                     // Drop the connection without answering
+        }
+        if (fault == 1) {
+            usleep(20000);              // A slow answer
+        }
+        if (strncmp(req, "POST /topics/tiltedterrain/scores?qos=1 ", 40) == 0) {
+            if (fault == 2) {
+                reply(ssl, "503 Service Unavailable", "{}");
+                continue;
+            }
+            // A fault after the batch is taken makes the client send it again
+            take_scores(strstr(req, "\r\n\r\n") + 4);
+            if (fault == 3) {
+                return;
+            }
+            reply(ssl, "200 OK", "{\"message\":\"OK\",\"traceId\":\"x\"}");
+        } else if (strncmp(req, "GET /things/tiltedterrain/shadow?name=Easy ", 43) == 0) {
+            reply(ssl, "200 OK", "{\"state\":{\"reported\":{\"top\":[12340,13020,15000]}},"
+                                 "\"metadata\":{\"reported\":{\"top\":[{\"timestamp\":1}]}},\"version\":3}");
+        } else {
+            reply(ssl, "404 Not Found", "{\"code\":\"ResourceNotFoundException\"}");
+        }
+    }
+}
+
+static void *server(void *arg) {
+    SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+    unsigned int seed = 7;
+    int fd, one = 1;
+
+    SSL_CTX_use_certificate(ctx, server_cert);
+    SSL_CTX_use_PrivateKey(ctx, server_key);
+    X509_STORE_add_cert(SSL_CTX_get_cert_store(ctx), server_cert);
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT, NULL);
+    while ((fd = accept(listen_fd, NULL, NULL)) >= 0) {
+        SSL *ssl = SSL_new(ctx);
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        SSL_set_fd(ssl, fd);
+        if (SSL_accept(ssl) == 1) {
+            serve(ssl, &seed);
+        }
+        SSL_free(ssl);
+        close(fd);
+    }
+    return NULL;
+}
+
+static void start_server(void) {
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    pthread_t thread;
+    int one = 1;
+
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr));
+    listen(listen_fd, 4);
+    getsockname(listen_fd, (struct sockaddr *)&addr, &addr_len);
+    server_port = ntohs(addr.sin_port);
+    pthread_create(&thread, NULL, server, NULL);
+}
+
+//*****************************************************************************
+
+// Longest single call of each, the game makes the polls between ticks and
+// the setup from its menus
+static uint64_t lb_ns_max, poll_ns_max, setup_ns_max;
+
+static void timed_max(uint64_t begin, uint64_t *max) {
+    uint64_t took = now_ns() - begin;
+    *max = (took > *max) ? took : *max;
+}
+
+// Step the channel and the leaderboard once, as the game loop does
+static void step(Leaderboard *lb, TlsChannel *ch) {
+    uint64_t begin = now_ns();
+
+    tls_channel_setup(ch, now_ms());
+    timed_max(begin, &setup_ns_max);
+    begin = now_ns();
+    tls_channel_poll(ch, now_ms());
+    timed_max(begin, &poll_ns_max);
+    begin = now_ns();
+    leaderboard_poll(lb, now_ms());
+    timed_max(begin, &lb_ns_max);
+}
+
+// Poll until the queue and the wanted fetch are done, returns -1 on timeout
+static int drain(Leaderboard *lb, TlsChannel *ch, uint32_t limit_ms) {
+    uint32_t start = now_ms();
+
+    while (lb->count || lb->want_top >= 0 || lb->phase != LB_IDLE) {
+        step(lb, ch);
+        if (now_ms() - start > limit_ms) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    static Leaderboard lb, reloaded;
+    static TlsChannel channel;
+    WifiConnect wc;
+    int results = (argc > 1) ? atoi(argv[1]) : 500;
+    int i, failures = 0, missing = 0, duplicates = 0;
+    const LbTop *top;
+
+    if (results > MAX_RESULTS) {
+        results = MAX_RESULTS;
+    }
+    make_certs();
+    start_server();
+    g_app_config.host = (signed char *)HOST;
+    g_app_config.port = server_port;
+    dns_cache_init(NULL, now_ms);
+
+    // Connected as main.c does, then the channel takes the socket over
+    wifi_connect_start(&wc, now_ms());
+    while ((i = wifi_connect_poll(&wc, now_ms())) == WIFI_PENDING) {
+    }
+    if (i != 0) {
+        printf("FAIL: connect returned %d\n", i);
+        return 1;
+    }
+    tls_channel_adopt(&channel, wc.sock, wc.tls_ms, now_ms());
+    leaderboard_init(&lb, &channel, HOST);
+
+    // A full queue keeps the newest
+    for (i = 0; i < LB_QUEUE_SIZE + 4; i++) {
+        leaderboard_add(&lb, "Easy", i, 0x1000 + i);
+    }
+    if (lb.count != LB_QUEUE_SIZE || lb.queue[0].time_ms != 4 || lb.stats.dropped != 4) {
+        printf("FAIL: full queue\n");
+        failures++;
+    }
+
+    // Saved and loaded through the file shim, ahead of newer results
+    leaderboard_save(&lb);
+    leaderboard_init(&reloaded, &channel, HOST);
+    leaderboard_add(&reloaded, "Hard", 99, 0);
+    leaderboard_load(&reloaded);
+    if (reloaded.count != LB_QUEUE_SIZE || reloaded.queue[0].time_ms != 5 ||
+        reloaded.queue[LB_QUEUE_SIZE - 1].time_ms != 99 || reloaded.stats.dropped != 1) {
+        printf("FAIL: save and load\n");
+        failures++;
+    }
+    sl_FsDel((const _u8 *)LB_QUEUE_FILE, 0);
+
+    // Results added while earlier batches are under way, over the flaky server
+    memset(&lb, 0, sizeof(lb));
+    leaderboard_init(&lb, &channel, HOST);
+    for (i = 0; i < results; i++) {
+        leaderboard_add(&lb, (i % 2) ? "Easy" : "Hard", i, 0x1000 + i);
+        step(&lb, &channel);
+        if (lb.count == LB_QUEUE_SIZE && drain(&lb, &channel, 10000) < 0) {
+            break;
+        }
+    }
+    if (drain(&lb, &channel, 10000) < 0) {
+        printf("FAIL: queue didn't drain, %d left\n", lb.count);
+        failures++;
+    }
+    for (i = 0; i < results; i++) {
+        if (!received_count[i]) {
+            missing++;
+        } else if (received_count[i] > 1) {
+            duplicates++;
+        }
+    }
+    if (missing || lb.stats.dropped || lb.stats.submitted != (uint32_t)results) {
+        printf("FAIL: %d result(s) never arrived, %u dropped, %u acknowledged\n", missing, lb.stats.dropped,
+               lb.stats.submitted);
+        failures++;
+    }
+    printf("%d results in %u batches over %d requests: %u failed and retried, %d sent twice\n", results,
+           lb.stats.batches, requests_seen, lb.stats.failures, duplicates);
+
+    // Best times, cached once fetched
+    leaderboard_want_top(&lb, "Easy", now_ms());
+    leaderboard_want_top(&lb, "Hard", now_ms());
+    drain(&lb, &channel, 10000);
+    leaderboard_want_top(&lb, "Easy", now_ms());
+    drain(&lb, &channel, 10000);
+    top = leaderboard_top(&lb, "Easy");
+    if (!top || top->count != 3 || top->times[0] != 12340 || top->times[2] != 15000) {
+        printf("FAIL: top times\n");
+        failures++;
+    }
+    top = leaderboard_top(&lb, "Hard");
+    if (!top || top->count != 0) {
+        printf("FAIL: missing board\n");
+        failures++;
+    }
+    if (leaderboard_top(&lb, "Other")) {
+        printf("FAIL: unfetched board\n");
+        failures++;
+    }
+    printf("Top times: %u fetches\n", lb.stats.fetches);
+    printf("Slowest call across %u handshakes and %u drops: leaderboard_poll %.0f us, tls_channel_poll %.0f us, "
+           "tls_channel_setup %.0f us\n", channel.stats.handshakes, channel.stats.drops, lb_ns_max / 1e3,
+           poll_ns_max / 1e3, setup_ns_max / 1e3);
+    printf("%d failure(s)\n", failures);
+    return failures ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,206 @@
+/*
+ * level_cache_check.c
+ *
+ *  Linux check for the flash map cache over the sl_Fs shim, whose files
+ *  are plain files in SHIM_FS_DIR. Runs the cache the way cached_download()
+ *  does and checks that:
+ *      - a stored file reads back whole, with its ETag for revalidation,
+ *        and nothing is visible before commit
+ *      - a refresh replaces the old copy on commit, and one that fails,
+ *        is cancelled or outgrows its reservation leaves the old copy
+ *        readable
+ *      - a full index or budget evicts the least recently used file,
+ *        where reads count as use
+ *      - a damaged data file is caught by its hash before the sink sees
+ *        it, and the entry is dropped
+ *
+ *  Host-only, not part of the CCS build. From the tools directory:
+ *      gcc -O2 -Ishim -I.. -o level_cache_check level_cache_check.c ../utils/level_cache.c ../utils/flash_record.c ../utils/fnv.c shim/simplelink.c -lssl -lcrypto
+ *      ./level_cache_check
+ */
+
+#ifndef ccs
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "simplelink.h"
+#include "utils/level_cache.h"
+
+#define MAX_FILE        LEVEL_CACHE_FILE_MAX
+
+static char contents[MAX_FILE], readback[MAX_FILE];
+static int readback_len;
+static int failures;
+
+static void check(int ok, const char *what) {
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+// Contents of version v of a file, different for every name and version
+static int make_file(const char *name, int v, int len) {
+    uint32_t x = 2166136261u ^ (uint32_t)v;
+    int i;
+    for (i = 0; name[i]; i++) {
+        x = (x ^ (uint8_t)name[i]) * 16777619u;
+    }
+    for (i = 0; i < len; i++) {
+        x = x * 1103515245u + 12345;
+        contents[i] = (char)(x >> 16);
+    }
+    return len;
+}
+
+static void collect(const char *data, int len, void *ctx) {
+    if (readback_len + len <= MAX_FILE) {
+        memcpy(readback + readback_len, data, len);
+    }
+    readback_len += len;
+}
+
+// Store version v of a file in pieces the size TCP hands back, returns the begin result
+static int put(const char *name, const char *etag, int v, int len, uint32_t size_hint) {
+    int pos, ret = level_cache_begin(name, etag, size_hint);
+    make_file(name, v, len);
+    for (pos = 0; ret == 0 && pos < len; pos += 700) {
+        ret = level_cache_append(contents + pos, (len - pos < 700) ? len - pos : 700);
+    }
+    return (ret == 0) ? level_cache_commit() : ret;
+}
+
+// Whether the cache holds version v of a file, read through the sink
+static int holds(const char *name, const char *etag, int v, int len) {
+    const LevelCacheEntry *entry = level_cache_find(name);
+    readback_len = 0;
+    if (!entry || strcmp(entry->etag, etag) != 0 || level_cache_read(name, collect, NULL) != 0) {
+        return 0;
+    }
+    make_file(name, v, len);
+    return readback_len == len && memcmp(readback, contents, len) == 0;
+}
+
+static int entries_used(void) {
+    char name[16];
+    int i, used = 0;
+    for (i = 0; i < 64; i++) {
+        sprintf(name, "/m%d.txt", i);
+        used += level_cache_find(name) != NULL;
+    }
+    return used + (level_cache_find("/Easy_map.txt") != NULL);
+}
+
+// Flip a byte of the data file behind a cached entry, found by its hash
+static void damage(const char *name) {
+    const LevelCacheEntry *entry = level_cache_find(name);
+    char file[32], path[256];
+    uint32_t hash;
+    FILE *f;
+    int slot, n, i;
+
+    for (slot = 0; slot < LEVEL_CACHE_ENTRIES; slot++) {
+        sprintf(file, LEVEL_CACHE_DATA_FILE, (unsigned int)slot);
+        shim_fs_path((const _u8 *)file, path, sizeof(path));
+        if (!(f = fopen(path, "r+b"))) {
+            continue;
+        }
+        n = fread(readback, 1, MAX_FILE, f);
+        for (hash = 2166136261u, i = 0; i < n; i++) {
+            hash = (hash ^ (uint8_t)readback[i]) * 16777619u;
+        }
+        if (n == (int)entry->size && hash == entry->hash) {
+            fseek(f, n / 2, SEEK_SET);
+            fputc(readback[n / 2] ^ 0x40, f);
+            slot = LEVEL_CACHE_ENTRIES;
+        }
+        fclose(f);
+    }
+}
+
+int main(void) {
+    char name[16], file[32];
+    int i, len;
+
+    // Start from an empty cache
+    sl_FsDel((const _u8 *)LEVEL_CACHE_INDEX_FILE, 0);
+    for (i = 0; i < LEVEL_CACHE_ENTRIES; i++) {
+        sprintf(file, LEVEL_CACHE_DATA_FILE, (unsigned int)i);
+        sl_FsDel((const _u8 *)file, 0);
+    }
+    level_cache_init();
+
+    // Store and look up, nothing shows before commit
+    check(level_cache_read("/Easy_map.txt", collect, NULL) < 0, "miss on an empty cache");
+    len = make_file("/Easy_map.txt", 1, 3000);
+    check(level_cache_begin("/Easy_map.txt", "\"v1\"", 0) == 0 && level_cache_append(contents, len) == 0,
+          "store a file");
+    check(level_cache_find("/Easy_map.txt") == NULL, "file visible before commit");
+    check(level_cache_commit() == 0 && holds("/Easy_map.txt", "\"v1\"", 1, 3000), "read back a stored file");
+    check(level_cache_find("/Easy_map.txt")->size == 3000, "stored size");
+
+    // Revalidated and refreshed: the new copy replaces the old on commit
+    check(put("/Easy_map.txt", "\"v2\"", 2, 5000, 0) == 0 && holds("/Easy_map.txt", "\"v2\"", 2, 5000),
+          "refresh replaces the old copy");
+    check(entries_used() == 1, "refresh leaves one entry");
+
+    // Refreshes that don't finish keep the last good copy
+    make_file("/Easy_map.txt", 3, 4000);
+    check(level_cache_begin("/Easy_map.txt", "\"v3\"", 0) == 0 && level_cache_append(contents, 2000) == 0,
+          "start a refresh");
+    check(holds("/Easy_map.txt", "\"v2\"", 2, 5000), "old copy readable during a refresh");
+    level_cache_abort();
+    check(holds("/Easy_map.txt", "\"v2\"", 2, 5000), "old copy kept after a failed refresh");
+    level_cache_begin("/Easy_map.txt", "\"v3\"", 0);
+    level_cache_begin("/other.txt", "", 0);
+    level_cache_abort();
+    check(holds("/Easy_map.txt", "\"v2\"", 2, 5000), "old copy kept after a cancelled refresh");
+    check(put("/Easy_map.txt", "\"v3\"", 3, 4000, 1000) < 0, "refresh past its reservation fails");
+    check(holds("/Easy_map.txt", "\"v2\"", 2, 5000), "old copy kept after an oversized refresh");
+
+    // A full index evicts the least recently used, reads count as use
+    for (i = 0; i < LEVEL_CACHE_ENTRIES - 1; i++) {
+        sprintf(name, "/m%d.txt", i);
+        put(name, "", i, 100 + i, 200);
+    }
+    holds("/Easy_map.txt", "\"v2\"", 2, 5000);
+    put("/m7.txt", "", 7, 107, 200);
+    check(level_cache_find("/m0.txt") == NULL, "least recently used evicted from a full index");
+    check(holds("/Easy_map.txt", "\"v2\"", 2, 5000) && holds("/m1.txt", "", 1, 101) &&
+          holds("/m7.txt", "", 7, 107), "recently used files kept");
+    check(entries_used() == LEVEL_CACHE_ENTRIES, "full index");
+
+    // Refreshing a file in a full index keeps it until the new copy is in
+    check(put("/m1.txt", "\"r\"", 11, 150, 200) == 0 && holds("/m1.txt", "\"r\"", 11, 150),
+          "refresh in a full index");
+    check(entries_used() == LEVEL_CACHE_ENTRIES - 1, "refresh in a full index evicts one other file");
+
+    // The budget evicts by reserved size, the copy being replaced isn't counted
+    for (i = 10; i < 10 + LEVEL_CACHE_BUDGET / MAX_FILE; i++) {
+        sprintf(name, "/m%d.txt", i);
+        check(put(name, "", i, 1000, 0) == 0, "store a full-size reservation");
+    }
+    check(entries_used() == LEVEL_CACHE_BUDGET / MAX_FILE, "budget evicts the rest");
+    check(level_cache_begin("/m10.txt", "\"b\"", 0) == 0, "refresh at a full budget");
+    level_cache_abort();
+    check(entries_used() == LEVEL_CACHE_BUDGET / MAX_FILE && holds("/m10.txt", "", 10, 1000),
+          "failed refresh at a full budget evicts nothing");
+    check(put("/m10.txt", "\"b\"", 20, 1200, 0) == 0 && holds("/m10.txt", "\"b\"", 20, 1200) &&
+          entries_used() == LEVEL_CACHE_BUDGET / MAX_FILE, "refresh at a full budget");
+
+    // A damaged file is dropped before the sink sees any of it
+    damage("/m11.txt");
+    readback_len = 0;
+    check(level_cache_read("/m11.txt", collect, NULL) < 0 && readback_len == 0, "damaged file rejected");
+    check(level_cache_find("/m11.txt") == NULL && level_cache_stats.corrupt == 1, "damaged file dropped");
+
+    printf("Cache: %u hits, %u misses, %u stores, %u evictions, %u corrupt\n", level_cache_stats.hits,
+           level_cache_stats.misses, level_cache_stats.stores, level_cache_stats.evictions, level_cache_stats.corrupt);
+    printf("%d failure(s)\n", failures);
+    return failures ? 1 : 0;
+}
+
+#endif
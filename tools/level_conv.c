@@ -0,0 +1,137 @@
+/*
+ * level_conv.c
+ *
+ *  Converts text levels (N / x,y,len,thick ... / M / x,y,len,thick,min,max)
+ *  to the binary formats read by the level loader. A single level becomes a
+ *  TTLV image, with -r also storing its static platforms pre-rasterized. A
+ *  "PACK" text file, or several level files given with -p, become a TTPK
+ *  pack. The output is loaded back and compared with the text levels before
+ *  it is written.
+ *
+ *  Host-only, not part of the CCS build. From the tools directory:
+ *      gcc -O2 -I.. -o level_conv level_conv.c ../level_loader.c ../level_bin.c ../level_parser.c ../game.c ../collision.c ../dist_field.c ../plat_index.c ../arena.c ../procgen.c -lm
+ *      ./level_conv [-r] level_map.txt level_map.bin
+ *      ./level_conv -p pack.bin level1.txt level2.txt ...
+ */
+
+#ifndef ccs
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "game.h"
+#include "level_loader.h"
+#include "level_bin.h"
+
+#define OUT_SIZE    (LEVEL_PACK_HEADER_SIZE + MAX_LEVELS * (LEVEL_PACK_ENTRY_SIZE + LEVEL_BIN_MAX_SIZE))
+
+static GameState text_game, bin_game;
+static uint8_t image[OUT_SIZE], scratch[LEVEL_BIN_MAX_SIZE];
+static uint64_t raster[MAP_WORDS];
+static uint64_t text_map[MAP_WORDS], bin_map[MAP_WORDS], prev_map[MAP_WORDS];
+
+// Load a level file or pack into slots from first, returns the level count
+static int load_file(const char *name, GameState *game, uint8_t first) {
+    LevelLoader loader;
+    char chunk[512];
+    size_t n;
+    int levels;
+    FILE *in = fopen(name, "rb");
+
+    if (!in) {
+        perror(name);
+        return -1;
+    }
+    level_loader_init(&loader, game, first, MAX_LEVELS - 1 - first, scratch, sizeof(scratch), raster);
+    while ((n = fread(chunk, 1, sizeof(chunk), in)) > 0) {
+        level_loader_feed(&loader, chunk, (int)n);
+    }
+    fclose(in);
+    levels = level_loader_finish(&loader);
+    if (levels < 0) {
+        fprintf(stderr, "%s: parse error on line %u\n", name, loader.parser.line);
+    }
+    return levels;
+}
+
+// Same records, and the same board once drawn
+static int same_level(uint8_t level) {
+    load_level(text_map, prev_map, text_game.static_plats[level], text_game.num_st_platforms[level],
+               text_game.mov_plats[level], text_game.num_mov_platforms[level], NULL, NULL);
+    load_level(bin_map, prev_map, bin_game.static_plats[level], bin_game.num_st_platforms[level],
+               bin_game.mov_plats[level], bin_game.num_mov_platforms[level], bin_game.raster[level], NULL);
+    return memcmp(text_map, bin_map, sizeof(text_map)) == 0 &&
+           text_game.num_st_platforms[level] == bin_game.num_st_platforms[level] &&
+           text_game.num_mov_platforms[level] == bin_game.num_mov_platforms[level] &&
+           memcmp(text_game.static_plats[level], bin_game.static_plats[level], text_game.num_st_platforms[level] * sizeof(Platform)) == 0 &&
+           memcmp(text_game.mov_plats[level], bin_game.mov_plats[level], text_game.num_mov_platforms[level] * sizeof(MovablePlatform)) == 0;
+}
+
+int main(int argc, char **argv) {
+    uint8_t flags = 0, pack = 0;
+    const char *out_name;
+    LevelLoader loader;
+    int argi = 1, len, levels = 0, n, i;
+    FILE *out;
+
+    if (argi < argc && strcmp(argv[argi], "-r") == 0) {
+        flags |= LEVEL_BIN_RASTER;
+        argi++;
+    } else if (argi < argc && strcmp(argv[argi], "-p") == 0) {
+        pack = 1;
+        argi++;
+    }
+    if ((!pack && argc - argi != 2) || (pack && argc - argi < 2)) {
+        fprintf(stderr, "usage: %s [-r] level.txt level.bin\n"
+                        "       %s -p pack.bin level.txt...\n", argv[0], argv[0]);
+        return 2;
+    }
+    out_name = pack ? argv[argi++] : argv[argc - 1];
+
+    game_init(&text_game);
+    for (i = argi; i < argc - (pack ? 0 : 1); i++) {
+        n = load_file(argv[i], &text_game, levels);
+        if (n < 0) {
+            return 1;
+        }
+        levels += n;
+    }
+    pack |= levels > 1;
+
+    if (pack) {
+        len = level_pack_write(&text_game, 0, levels, image, sizeof(image));
+    } else {
+        len = level_bin_write(&text_game, 0, flags, image, sizeof(image));
+    }
+    if (len < 0) {
+        fprintf(stderr, "%s: a platform is off the board\n", out_name);
+        return 1;
+    }
+
+    game_init(&bin_game);
+    level_loader_init(&loader, &bin_game, 0, MAX_LEVELS - 1, scratch, sizeof(scratch), raster);
+    level_loader_feed(&loader, (const char *)image, len);
+    if (level_loader_finish(&loader) != levels) {
+        fprintf(stderr, "%s: image does not load back (%d)\n", out_name, loader.error);
+        return 1;
+    }
+    for (i = 0; i < levels; i++) {
+        if (!same_level(i)) {
+            fprintf(stderr, "%s: level %d differs from the text level\n", out_name, i + 1);
+            return 1;
+        }
+    }
+
+    if (!(out = fopen(out_name, "wb")) || fwrite(image, 1, (size_t)len, out) != (size_t)len) {
+        perror(out_name);
+        return 1;
+    }
+    fclose(out);
+    printf("%s: %d level(s), %d bytes%s%s\n", out_name, levels, len, pack ? " (pack)" : "",
+           (flags & LEVEL_BIN_RASTER) && !pack ? " (rasterized)" : "");
+    return 0;
+}
+
+#endif
@@ -0,0 +1,183 @@
+/*
+ * level_gen.c
+ *
+ *  Compiles text levels into the const tables the firmware links in
+ *  (offline_tables.c), so the offline levels and the WIN screen are used in
+ *  place instead of being built in RAM. With -r each level also gets its
+ *  static platforms pre-rasterized into map words, which load_level copies
+ *  in one pass instead of drawing pixel by pixel. That costs 2 KB of image
+ *  per level.
+ *
+ *  Host-only, not part of the CCS build. From the tools directory:
+ *      gcc -O2 -I.. -o level_gen level_gen.c ../level_loader.c ../level_bin.c ../level_parser.c ../game.c ../collision.c ../dist_field.c ../plat_index.c ../arena.c ../procgen.c -lm
+ *      ./level_gen [-r] ../offline_tables.c ../levels/offline1.txt ... -w ../levels/win.txt
+ */
+
+#ifndef ccs
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "game.h"
+#include "level_loader.h"
+#include "level_bin.h"
+
+static GameState game;
+static uint8_t scratch[LEVEL_BIN_MAX_SIZE];
+static uint64_t raster[MAP_WORDS], map[MAP_WORDS], prev_map[MAP_WORDS];
+
+// Load one text level into a slot, 0 if it loaded and every platform is on the board
+static int load_file(const char *name, uint8_t level) {
+    LevelLoader loader;
+    char chunk[512];
+    size_t n;
+    FILE *in = fopen(name, "rb");
+
+    if (!in) {
+        perror(name);
+        return -1;
+    }
+    level_loader_init(&loader, &game, level, 1, scratch, sizeof(scratch), raster);
+    while ((n = fread(chunk, 1, sizeof(chunk), in)) > 0) {
+        level_loader_feed(&loader, chunk, (int)n);
+    }
+    fclose(in);
+    if (level_loader_finish(&loader) != 1) {
+        fprintf(stderr, "%s: parse error on line %u\n", name, loader.parser.line);
+        return -1;
+    }
+    // The binary writer already checks the platforms against the board
+    if (level_bin_write(&game, level, 0, scratch, sizeof(scratch)) < 0) {
+        fprintf(stderr, "%s: platform off the board\n", name);
+        return -1;
+    }
+    return 0;
+}
+
+static void emit_level(FILE *out, uint8_t level, const char *prefix, const char *source, int rasterize) {
+    uint8_t i;
+    int w;
+
+    while (strncmp(source, "../", 3) == 0) {
+        source += 3;
+    }
+    fprintf(out, "// %s\n", source);
+    if (game.num_st_platforms[level]) {
+        fprintf(out, "static const Platform %s_st[] = {\n", prefix);
+        for (i = 0; i < game.num_st_platforms[level]; i++) {
+            const Platform *p = &game.static_plats[level][i];
+            fprintf(out, "    {%u, %u, %u, %u},\n", p->length, p->thickness, p->x, p->y);
+        }
+        fprintf(out, "};\n");
+    }
+    if (game.num_mov_platforms[level]) {
+        fprintf(out, "static const MovablePlatform %s_mov[] = {\n", prefix);
+        for (i = 0; i < game.num_mov_platforms[level]; i++) {
+            const MovablePlatform *m = &game.mov_plats[level][i];
+            fprintf(out, "    {{%u, %u, %u, %u}, %u, %u},\n", m->plat.length, m->plat.thickness,
+                    m->plat.x, m->plat.y, m->x_min, m->x_max);
+        }
+        fprintf(out, "};\n");
+    }
+    if (rasterize) {
+        load_level(map, prev_map, game.static_plats[level], game.num_st_platforms[level], NULL, 0, NULL, NULL);
+        fprintf(out, "static const uint64_t %s_raster[MAP_WORDS] = {\n", prefix);
+        for (w = 0; w < MAP_WORDS; w += 4) {
+            fprintf(out, "    0x%016llxULL, 0x%016llxULL, 0x%016llxULL, 0x%016llxULL,\n",
+                    (unsigned long long)map[w], (unsigned long long)map[w + 1],
+                    (unsigned long long)map[w + 2], (unsigned long long)map[w + 3]);
+        }
+        fprintf(out, "};\n");
+    }
+    fprintf(out, "\n");
+}
+
+static void emit_table(FILE *out, uint8_t level, const char *prefix, int rasterize) {
+    char st[32] = "0", mov[32] = "0", ras[32] = "0";
+    if (game.num_st_platforms[level]) {
+        sprintf(st, "%s_st", prefix);
+    }
+    if (game.num_mov_platforms[level]) {
+        sprintf(mov, "%s_mov", prefix);
+    }
+    if (rasterize) {
+        sprintf(ras, "%s_raster", prefix);
+    }
+    fprintf(out, "{%s, %s, %s, %u, %u}", st, mov, ras, game.num_st_platforms[level], game.num_mov_platforms[level]);
+}
+
+int main(int argc, char **argv) {
+    int rasterize = 0, arg = 1, i, num_levels = 0;
+    const char *win = NULL, *sources[MAX_LEVELS];
+    char prefix[16];
+    FILE *out;
+
+    if (arg < argc && strcmp(argv[arg], "-r") == 0) {
+        rasterize = 1;
+        arg++;
+    }
+    if (argc - arg < 2) {
+        fprintf(stderr, "usage: %s [-r] offline_tables.c level1.txt ... -w win.txt\n", argv[0]);
+        return 2;
+    }
+    for (i = arg + 1; i < argc; i++) {
+        if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            win = argv[++i];
+        } else if (num_levels < MAX_LEVELS - 1) {
+            sources[num_levels++] = argv[i];
+        } else {
+            fprintf(stderr, "At most %d levels\n", MAX_LEVELS - 1);
+            return 1;
+        }
+    }
+    if (num_levels == 0 || !win) {
+        fprintf(stderr, "Need at least one level and the WIN level (-w)\n");
+        return 1;
+    }
+
+    // The WIN level goes in the last slot, as it does at run time
+    game_init(&game);
+    for (i = 0; i < num_levels; i++) {
+        if (load_file(sources[i], i) < 0) {
+            return 1;
+        }
+    }
+    if (load_file(win, num_levels) < 0) {
+        return 1;
+    }
+
+    out = fopen(argv[arg], "w");
+    if (!out) {
+        perror(argv[arg]);
+        return 1;
+    }
+    fprintf(out, "/*\n * offline_tables.c\n *\n *  Generated by tools/level_gen%s, do not edit.\n */\n\n",
+            rasterize ? " -r" : "");
+    fprintf(out, "#include \"offline_levels.h\"\n\n");
+    fprintf(out, "// Platform is {length, thickness, x, y}, MovablePlatform adds x_min, x_max\n\n");
+    for (i = 0; i < num_levels; i++) {
+        sprintf(prefix, "level%d", i + 1);
+        emit_level(out, i, prefix, sources[i], rasterize);
+    }
+    emit_level(out, num_levels, "win", win, rasterize);
+
+    fprintf(out, "const uint8_t num_offline_levels = %d;\n\n", num_levels);
+    fprintf(out, "const LevelTable offline_levels[] = {\n");
+    for (i = 0; i < num_levels; i++) {
+        sprintf(prefix, "level%d", i + 1);
+        fprintf(out, "    ");
+        emit_table(out, i, prefix, rasterize);
+        fprintf(out, ",\n");
+    }
+    fprintf(out, "};\n\nconst LevelTable win_level = ");
+    emit_table(out, num_levels, "win", rasterize);
+    fprintf(out, ";\n");
+    fclose(out);
+
+    printf("%s: %d level(s) and the WIN level%s\n", argv[arg], num_levels, rasterize ? ", rasterized" : "");
+    return 0;
+}
+
+#endif
@@ -0,0 +1,123 @@
+/*
+ * manifest_gen.c
+ *
+ *  Writes the map manifest (Map_manifest.txt) for a set of map files. Each
+ *  file is loaded the way the device loads it, so a map that wouldn't load
+ *  is reported here instead of on the device, and its size, FNV-1a hash
+ *  and level count are taken from the file itself. The name is the part of
+ *  the file name before "_map.txt"; difficulty follows a ':' and is 0 if
+ *  not given. The written manifest is parsed back as a check.
+ *
+ *  Host-only, not part of the CCS build. From the tools directory:
+ *      gcc -O2 -I.. -o manifest_gen manifest_gen.c ../manifest.c ../utils/fnv.c ../level_loader.c ../level_bin.c ../level_parser.c ../game.c ../collision.c ../dist_field.c ../plat_index.c ../arena.c ../procgen.c -lm
+ *      ./manifest_gen Map_manifest.txt Easy_map.txt:1 Medium_map.txt:3 ...
+ */
+
+#ifndef ccs
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "game.h"
+#include "manifest.h"
+#include "utils/fnv.h"
+#include "level_loader.h"
+#include "level_bin.h"
+
+static GameState game;
+static uint8_t scratch[LEVEL_BIN_MAX_SIZE];
+static uint64_t raster[MAP_WORDS];
+static char text[MAP_NAMES_MAX * 64];
+
+// Load a map file and fill in what the manifest says about it, 0 on success
+static int describe(const char *path, MapInfo *info) {
+    LevelLoader loader;
+    uint8_t chunk[512];
+    const char *base = strrchr(path, '/'), *end;
+    size_t n;
+    int levels;
+    FILE *in;
+
+    base = base ? base + 1 : path;
+    end = strstr(base, "_map.txt");
+    if (!end || end == base || end - base >= MAP_NAME_SIZE) {
+        fprintf(stderr, "%s: not a <name>_map.txt file, or the name is too long\n", path);
+        return -1;
+    }
+    memcpy(info->name, base, end - base);
+    info->name[end - base] = '\0';
+
+    in = fopen(path, "rb");
+    if (!in) {
+        perror(path);
+        return -1;
+    }
+    info->size = 0;
+    info->hash = FNV_INIT;
+    game_init(&game);
+    level_loader_init(&loader, &game, 0, MAX_LEVELS - 1, scratch, sizeof(scratch), raster);
+    while ((n = fread(chunk, 1, sizeof(chunk), in)) > 0) {
+        info->size += n;
+        info->hash = fnv1a(info->hash, chunk, n);
+        level_loader_feed(&loader, (const char *)chunk, (int)n);
+    }
+    fclose(in);
+    levels = level_loader_finish(&loader);
+    if (levels <= 0) {
+        fprintf(stderr, "%s: doesn't load (error %d, line %u)\n", path, loader.error, loader.parser.line);
+        return -1;
+    }
+    info->levels = levels;
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    MapInfo maps[MAP_NAMES_MAX], check[MAP_NAMES_MAX];
+    int num_maps = argc - 2, i, len = 0;
+    FILE *out;
+
+    if (num_maps < 1) {
+        fprintf(stderr, "usage: %s Map_manifest.txt name_map.txt[:difficulty] ...\n", argv[0]);
+        return 2;
+    }
+    if (num_maps > MAP_NAMES_MAX) {
+        fprintf(stderr, "At most %d maps fit the menu\n", MAP_NAMES_MAX);
+        return 1;
+    }
+    // Zeroed so the structs compare whole
+    memset(maps, 0, sizeof(maps));
+    memset(check, 0, sizeof(check));
+    for (i = 0; i < num_maps; i++) {
+        char path[256], *colon;
+        snprintf(path, sizeof(path), "%s", argv[i + 2]);
+        colon = strrchr(path, ':');
+        maps[i].difficulty = 0;
+        if (colon) {
+            *colon = '\0';
+            maps[i].difficulty = atoi(colon + 1);
+        }
+        if (describe(path, &maps[i]) < 0) {
+            return 1;
+        }
+        len += sprintf(text + len, "%s,%u,%08x,%u,%u\n", maps[i].name, maps[i].size, maps[i].hash,
+                       maps[i].levels, maps[i].difficulty);
+    }
+
+    if (parse_manifest(check, MAP_NAMES_MAX, text) != num_maps || memcmp(check, maps, sizeof(MapInfo) * num_maps) != 0) {
+        fprintf(stderr, "Manifest doesn't parse back\n");
+        return 1;
+    }
+    out = fopen(argv[1], "w");
+    if (!out) {
+        perror(argv[1]);
+        return 1;
+    }
+    fputs(text, out);
+    fclose(out);
+    printf("%s", text);
+    return 0;
+}
+
+#endif
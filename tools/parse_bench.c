@@ -0,0 +1,150 @@
+/*
+ * parse_bench.c
+ *
+ *  Linux benchmark and self-check for the streaming level parser. Builds a
+ *  synthetic level file of the requested size (random platforms padded out
+ *  with leading zeros, blank lines and CRLF/LF line endings), feeds it to
+ *  level_parser in random pieces the size of TCP segments, checks that the
+ *  platforms come out right and reports the throughput.
+ *
+ *  Host-only, not part of the CCS build. From the tools directory:
+ *      gcc -O2 -I.. -o parse_bench parse_bench.c ../level_parser.c ../game.c ../collision.c ../dist_field.c ../plat_index.c ../arena.c ../procgen.c -lm
+ *      ./parse_bench [megabytes] [passes]
+ */
+
+#ifndef ccs
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "game.h"
+#include "level_parser.h"
+
+#define MAX_SEGMENT     1460    /* Typical TCP payload per recv() */
+
+static GameState game;
+static Platform st_plats[MAX_PLATFORMS];
+static MovablePlatform mov_plats[MAX_PLATFORMS];
+
+static uint64_t clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Append a number with zero padding so the file reaches its target size
+static size_t put_number(char *out, unsigned int value, int width) {
+    return (size_t)sprintf(out, "%0*u", width, value);
+}
+
+static size_t put_line(char *out, const unsigned int *values, int count, int width) {
+    size_t len = 0;
+    int i;
+    for (i = 0; i < count; i++) {
+        if (i > 0) {
+            len += (size_t)sprintf(out + len, (rand() & 1) ? "," : " ,\t");
+        }
+        len += put_number(out + len, values[i], width);
+    }
+    len += (size_t)sprintf(out + len, (rand() & 1) ? "\r\n" : "\n");
+    return len;
+}
+
+// Synthetic level of about size bytes
+static char *make_level(size_t size, size_t *out_len, int *num_st, int *num_mov) {
+    // Every number is padded to the same width, the rest goes to blank lines
+    int records = 2 + MAX_PLATFORMS * 4 + MAX_PLATFORMS * 6;
+    int width = (int)(size / 2 / records);
+    size_t pad = size / 2 / (MAX_PLATFORMS * 2 + 2);
+    char *text = malloc(size + (size_t)records * 8 + 4096);
+    size_t len = 0;
+    unsigned int v[6];
+    int i;
+
+    if (width < 1) width = 1;
+    *num_st = *num_mov = MAX_PLATFORMS;
+    v[0] = *num_st;
+    len += put_line(text + len, v, 1, width);
+    // Platforms stay on the board, as the parser requires
+    for (i = 0; i < *num_st; i++) {
+        uint8_t length = 1 + rand() % 40;
+        st_plats[i] = create_static_platform(rand() % (129 - length), rand() % 124, length, 1 + rand() % 5);
+        v[0] = st_plats[i].x; v[1] = st_plats[i].y; v[2] = st_plats[i].length; v[3] = st_plats[i].thickness;
+        len += put_line(text + len, v, 4, width);
+        memset(text + len, '\n', pad / 2);
+        len += pad / 2;
+    }
+    v[0] = *num_mov;
+    len += put_line(text + len, v, 1, width);
+    for (i = 0; i < *num_mov; i++) {
+        uint8_t x_min = rand() % 64;
+        mov_plats[i] = create_mov_platform(x_min + rand() % 32, rand() % 124, 1 + rand() % 33, 1 + rand() % 5, x_min, x_min + 32);
+        v[0] = mov_plats[i].plat.x; v[1] = mov_plats[i].plat.y; v[2] = mov_plats[i].plat.length;
+        v[3] = mov_plats[i].plat.thickness; v[4] = mov_plats[i].x_min; v[5] = mov_plats[i].x_max;
+        len += put_line(text + len, v, 6, width);
+        memset(text + len, (i & 1) ? ' ' : '\n', pad / 2);
+        len += pad / 2;
+    }
+    *out_len = len;
+    return text;
+}
+
+static int check_level(int num_st, int num_mov) {
+    int i, bad = 0;
+    if (game.num_st_platforms[0] != num_st || game.num_mov_platforms[0] != num_mov) {
+        return 1;
+    }
+    for (i = 0; i < num_st; i++) {
+        bad |= memcmp(&game.static_plats[0][i], &st_plats[i], sizeof(Platform)) != 0;
+    }
+    for (i = 0; i < num_mov; i++) {
+        bad |= memcmp(&game.mov_plats[0][i], &mov_plats[i], sizeof(MovablePlatform)) != 0;
+    }
+    return bad;
+}
+
+int main(int argc, char **argv) {
+    double mb = (argc > 1) ? atof(argv[1]) : 4;
+    int passes = (argc > 2) ? atoi(argv[2]) : 20;
+    int num_st, num_mov, pass, failures = 0;
+    size_t len, pos, total = 0;
+    uint64_t begin, elapsed = 0;
+    LevelParser parser;
+
+    srand(1);
+    char *text = make_level((size_t)(mb * 1024 * 1024), &len, &num_st, &num_mov);
+    printf("Level file: %zu bytes, %d static and %d moving platforms\n", len, num_st, num_mov);
+
+    for (pass = 0; pass < passes; pass++) {
+        // Segment sizes are drawn up front so only parsing is timed
+        static int seg[1 << 20];
+        int nseg = 0, s;
+        for (pos = 0; pos < len && nseg < (int)(sizeof(seg) / sizeof(seg[0])); pos += seg[nseg++]) {
+            seg[nseg] = 1 + rand() % MAX_SEGMENT;
+            if (seg[nseg] > (int)(len - pos)) seg[nseg] = (int)(len - pos);
+        }
+
+        game_init(&game);
+        level_parser_init(&parser, &game, 0, 1);
+        begin = clock_ns();
+        for (s = 0, pos = 0; s < nseg; pos += seg[s++]) {
+            level_parser_feed(&parser, text + pos, seg[s]);
+        }
+        int ok = level_parser_finish(&parser) == 0;
+        elapsed += clock_ns() - begin;
+        total += len;
+        if (!ok || check_level(num_st, num_mov)) {
+            failures++;
+        }
+    }
+
+    printf("%d passes in random segments: %.1f MB/s, %d failures\n", passes,
+           total / (elapsed / 1e9) / (1024 * 1024), failures);
+    free(text);
+    return failures ? 1 : 0;
+}
+
+#endif
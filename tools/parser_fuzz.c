@@ -0,0 +1,492 @@
+/*
+ * parser_fuzz.c
+ *
+ *  Linux robustness and throughput check for the parsers that read server
+ *  files: parse_map_names() and the level loader (text, TTLV and TTPK).
+ *  Feeds them random bytes and mutations of well-formed files, the shipped
+ *  levels among them, and checks after every input that nothing was written
+ *  out of bounds, every result is in range and every platform that loaded
+ *  lies on the 128x128 board. Loaded levels are drawn into a board of their
+ *  own, outside the GameState, so the sanitizer sees a platform that draws
+ *  past it. Then times parse_map_names() and the streaming level parser
+ *  against the parsers they replaced, on files the old ones could handle.
+ *
+ *  Host-only, not part of the CCS build. From the tools directory:
+ *      gcc -O2 -g -fsanitize=address,undefined -I.. -o parser_fuzz parser_fuzz.c ../map_names.c ../level_loader.c ../level_bin.c ../level_parser.c ../game.c ../collision.c ../dist_field.c ../plat_index.c ../arena.c ../procgen.c -lm
+ *      ./parser_fuzz [rounds] [levels directory, ../levels by default]
+ *
+ *  With -DLIBFUZZER and -fsanitize=fuzzer instead, the same checks run as a
+ *  libFuzzer target; the first input byte picks the parser. Seed it with the
+ *  files in levels/, each prefixed with a 0 byte.
+ */
+
+#ifndef ccs
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "game.h"
+#include "map_names.h"
+#include "level_loader.h"
+#include "level_bin.h"
+#include "level_parser.h"
+#include "procgen.h"
+
+#define MAX_INPUT       4096
+#define CANARY          0x5A
+#define NUM_SEEDS       8       /* Generated seeds, then the shipped levels */
+
+static GameState game;
+static uint8_t scratch[LEVEL_BIN_MAX_SIZE];
+static uint64_t raster[MAP_WORDS];
+static uint64_t board[MAP_WORDS], prev_board[MAP_WORDS];
+
+// Names with a guard row either side
+static char names[MAP_NAMES_MAX + 2][MAP_NAME_SIZE];
+
+static uint64_t clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// The parser as it was in main.c, for the throughput comparison only. Kept
+// out of line like the real one so neither gets inlined into the timing loop.
+__attribute__((noinline)) static void legacy_parse_map_names(char map_names[20][20], char *content, int *num_maps) {
+    int idx = 0, map_char_idx = 0;
+    *num_maps = 0;
+    while (1) {
+        if (content[idx] == '_') {
+            map_names[*num_maps][map_char_idx] = '\0';
+            *num_maps = *num_maps + 1;
+            map_char_idx = 0;
+            idx += 10;
+        }
+        if (content[idx] == '\0') return;
+        map_names[*num_maps][map_char_idx++] = content[idx];
+        idx++;
+    }
+}
+
+// The level parser as it was in main.c before downloads were streamed, for
+// the throughput comparison only. It reads one level of well-formed LF text
+// into arrays of its own. Two fixes so it is safe to run: the last field of
+// each line is terminated, and num_mov_plats is terminated at plat_idx
+// rather than idx, which wrote past the end of the array.
+static Platform legacy_st[MAX_PLATFORMS];
+static MovablePlatform legacy_mov[MAX_PLATFORMS];
+static int legacy_num_st, legacy_num_mov;
+
+__attribute__((noinline)) static void legacy_parse_map_file(char *map_content) {
+    int i = 0;
+    int idx = 0;
+
+    // Extract number of static platforms
+    char num_st_plats[4];
+    while (map_content[idx] != '\n') {
+        num_st_plats[idx] = map_content[idx];
+        idx++;
+    }
+    num_st_plats[idx] = '\0';
+    legacy_num_st = atoi(num_st_plats);
+
+    while (map_content[idx] == '\n' || map_content[idx] == '\t' || map_content[idx] == ' ') {
+        idx++;
+    }
+
+    for (i = 0; i < legacy_num_st; i++) {
+        char params[4][4];
+        int arg_idx = 0;
+        int param_idx = 0;
+        while (map_content[idx] != '\n') {
+            if (map_content[idx] == ',') {
+                params[arg_idx][param_idx] = '\0';
+                param_idx = 0;
+                arg_idx++;
+                idx++;
+            }
+            params[arg_idx][param_idx] = map_content[idx];
+            idx++;
+            param_idx++;
+        }
+        params[arg_idx][param_idx] = '\0';
+        idx++;
+        legacy_st[i].x = (uint8_t)atoi(params[0]);
+        legacy_st[i].y = (uint8_t)atoi(params[1]);
+        legacy_st[i].length = (uint8_t)atoi(params[2]);
+        legacy_st[i].thickness = (uint8_t)atoi(params[3]);
+    }
+
+    while (map_content[idx] == '\n' || map_content[idx] == '\t' || map_content[idx] == ' ') {
+        idx++;
+    }
+
+    // Extract number of moving platforms
+    int plat_idx = 0;
+    char num_mov_plats[4];
+    while (map_content[idx] != '\n' && map_content[idx] != '\0') {
+        num_mov_plats[plat_idx++] = map_content[idx];
+        idx++;
+    }
+    num_mov_plats[plat_idx] = '\0';
+    legacy_num_mov = atoi(num_mov_plats);
+
+    while (map_content[idx] == '\n' || map_content[idx] == '\t' || map_content[idx] == ' ') {
+        idx++;
+    }
+
+    for (i = 0; i < legacy_num_mov; i++) {
+        char params[6][4];
+        int arg_idx = 0;
+        int param_idx = 0;
+        while (map_content[idx] != '\n') {
+            if (map_content[idx] == ',') {
+                params[arg_idx][param_idx] = '\0';
+                param_idx = 0;
+                arg_idx++;
+                idx++;
+            }
+            params[arg_idx][param_idx] = map_content[idx];
+            idx++;
+            param_idx++;
+        }
+        params[arg_idx][param_idx] = '\0';
+        idx++;
+        legacy_mov[i].plat.x = (uint8_t)atoi(params[0]);
+        legacy_mov[i].plat.y = (uint8_t)atoi(params[1]);
+        legacy_mov[i].plat.length = (uint8_t)atoi(params[2]);
+        legacy_mov[i].plat.thickness = (uint8_t)atoi(params[3]);
+        legacy_mov[i].x_min = (uint8_t)atoi(params[4]);
+        legacy_mov[i].x_max = (uint8_t)atoi(params[5]);
+    }
+}
+
+static void fail(const char *what, const uint8_t *data, size_t len) {
+    size_t i;
+    fprintf(stderr, "FAIL: %s, input of %zu bytes:\n", what, len);
+    for (i = 0; i < len; i++) {
+        fprintf(stderr, "%02x%s", data[i], (i % 32 == 31) ? "\n" : "");
+    }
+    fprintf(stderr, "\n");
+    abort();
+}
+
+static void check_names(const uint8_t *data, size_t len) {
+    static char text[MAX_INPUT + 1];
+    int count, i, j;
+
+    memcpy(text, data, len);
+    text[len] = '\0';
+    memset(names, CANARY, sizeof(names));
+    count = parse_map_names(names + 1, MAP_NAMES_MAX, text);
+
+    if (count < 0 || count > MAP_NAMES_MAX) {
+        fail("map name count out of range", data, len);
+    }
+    for (j = 0; j < MAP_NAME_SIZE; j++) {
+        if (names[0][j] != CANARY || names[MAP_NAMES_MAX + 1][j] != CANARY) {
+            fail("map names written out of bounds", data, len);
+        }
+    }
+    for (i = 1; i <= count; i++) {
+        size_t n = strnlen(names[i], MAP_NAME_SIZE);
+        if (n == 0 || n >= MAP_NAME_SIZE) {
+            fail("map name not terminated", data, len);
+        }
+        for (j = 0; j < (int)n; j++) {
+            char c = names[i][j];
+            if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-')) {
+                fail("bad character in map name", data, len);
+            }
+        }
+    }
+}
+
+// Every platform of a level, at every position it can move to, fits on the board
+static int level_on_board(int level) {
+    int i;
+
+    for (i = 0; i < game.num_st_platforms[level]; i++) {
+        const Platform *p = &game.static_plats[level][i];
+        if (!p->length || !p->thickness || p->x + p->length > 128 || p->y + p->thickness > 128) {
+            return 0;
+        }
+    }
+    for (i = 0; i < game.num_mov_platforms[level]; i++) {
+        const MovablePlatform *m = &game.mov_plats[level][i];
+        if (!m->plat.length || !m->plat.thickness || m->x_min > m->plat.x || m->plat.x > m->x_max ||
+            m->x_max + m->plat.length > 128 || m->plat.y + m->plat.thickness > 128) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Returns the number of levels that loaded
+static int check_levels(const uint8_t *data, size_t len, size_t piece) {
+    LevelLoader loader;
+    size_t pos;
+    int levels, i;
+
+    game_init(&game);
+    level_loader_init(&loader, &game, 0, MAX_LEVELS - 1, scratch, sizeof(scratch), raster);
+    for (pos = 0; pos < len; pos += piece) {
+        level_loader_feed(&loader, (const char *)data + pos, (int)((len - pos < piece) ? len - pos : piece));
+    }
+    levels = level_loader_finish(&loader);
+
+    if (levels > MAX_LEVELS - 1) {
+        fail("too many levels", data, len);
+    }
+    if (game.arena.bottom + game.arena.top > game.arena.size) {
+        fail("arena overrun", data, len);
+    }
+    for (i = 0; i < MAX_LEVELS; i++) {
+        if (game.num_st_platforms[i] > MAX_PLATFORMS || game.num_mov_platforms[i] > MAX_PLATFORMS) {
+            fail("platform count out of range", data, len);
+        }
+    }
+    // Whatever loaded has to be drawable without leaving the board
+    for (i = 0; i < levels; i++) {
+        if (!level_on_board(i)) {
+            fail("platform off the board", data, len);
+        }
+        load_level(board, prev_board, game.static_plats[i], game.num_st_platforms[i],
+                   game.mov_plats[i], game.num_mov_platforms[i], game.raster[i], &game.plat_index);
+    }
+    return levels;
+}
+
+static void check_input(const uint8_t *data, size_t len) {
+    if (len == 0 || len > MAX_INPUT) {
+        return;
+    }
+    if (data[0] & 1) {
+        check_names(data + 1, len - 1);
+    } else {
+        check_levels(data + 1, len - 1, 1 + data[0] % 61);
+    }
+}
+
+#ifdef LIBFUZZER
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    check_input(data, size);
+    return 0;
+}
+
+#else
+
+// Well-formed inputs to mutate: a map list, a text level, a TTLV image, a
+// TTPK pack and the shipped levels
+static uint8_t seeds[NUM_SEEDS][MAX_INPUT];
+static size_t seed_len[NUM_SEEDS];
+static const char *level_files[NUM_SEEDS - 4] = {"offline1.txt", "offline2.txt", "offline3.txt", "win.txt"};
+
+// Returns 0 if a level file can't be read
+static int make_seeds(const char *dir) {
+    char path[256];
+    FILE *file;
+    const char *list = "Easy_map.txt\r\nMedium_map.txt\r\nHard_map.txt\r\n";
+    int i, len = 0;
+
+    seeds[0][0] = 1;
+    strcpy((char *)seeds[0] + 1, list);
+    seed_len[0] = 1 + strlen(list);
+
+    game_init(&game);
+    procgen_level(&game, 0, 12345, 4);
+    procgen_level(&game, 1, 67890, 8);
+    len += sprintf((char *)seeds[1] + 1 + len, "%u\n", game.num_st_platforms[0]);
+    for (i = 0; i < game.num_st_platforms[0]; i++) {
+        const Platform *p = &game.static_plats[0][i];
+        len += sprintf((char *)seeds[1] + 1 + len, "%u,%u,%u,%u\n", p->x, p->y, p->length, p->thickness);
+    }
+    len += sprintf((char *)seeds[1] + 1 + len, "%u\n", game.num_mov_platforms[0]);
+    for (i = 0; i < game.num_mov_platforms[0]; i++) {
+        const MovablePlatform *m = &game.mov_plats[0][i];
+        len += sprintf((char *)seeds[1] + 1 + len, "%u,%u,%u,%u,%u,%u\n", m->plat.x, m->plat.y,
+                       m->plat.length, m->plat.thickness, m->x_min, m->x_max);
+    }
+    seed_len[1] = 1 + len;
+
+    seed_len[2] = 1 + level_bin_write(&game, 0, LEVEL_BIN_RASTER, seeds[2] + 1, MAX_INPUT - 1);
+    seed_len[3] = 1 + level_pack_write(&game, 0, 2, seeds[3] + 1, MAX_INPUT - 1);
+    for (i = 4; i < NUM_SEEDS; i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, level_files[i - 4]);
+        if (!(file = fopen(path, "rb"))) {
+            printf("Can't open %s\n", path);
+            return 0;
+        }
+        seed_len[i] = 1 + fread(seeds[i] + 1, 1, MAX_INPUT - 2, file);
+        fclose(file);
+    }
+    for (i = 1; i < NUM_SEEDS; i++) {
+        seeds[i][0] = 2 * (i * 7);
+    }
+    return 1;
+}
+
+// Text levels at and just past the edges of the board
+static const struct {
+    const char *text;
+    int levels;
+} edges[] = {
+    {"1\n100,250,200,200\n0\n", 0},
+    {"1\n0,0,128,1\n0\n", 1},
+    {"1\n0,0,129,1\n0\n", 0},
+    {"1\n120,0,9,1\n0\n", 0},
+    {"1\n0,125,1,3\n0\n", 1},
+    {"1\n0,126,1,3\n0\n", 0},
+    {"1\n0,0,0,1\n0\n", 0},
+    {"1\n0,0,1,0\n0\n", 0},
+    {"0\n1\n10,0,28,1,0,100\n", 1},
+    {"0\n1\n10,0,29,1,0,100\n", 0},
+    {"0\n1\n5,0,4,1,6,20\n", 0},
+    {"0\n1\n30,0,4,1,6,20\n", 0},
+    {"0\n1\n10,127,4,2,0,20\n", 0},
+};
+
+static size_t mutate(uint8_t *out, uint32_t round) {
+    int kind = rand() % 5, edits, e;
+    size_t len;
+
+    if (kind == 4) {
+        // Pure noise
+        len = 1 + rand() % 512;
+        for (e = 0; e < (int)len; e++) {
+            out[e] = rand();
+        }
+        return len;
+    }
+    len = seed_len[kind];
+    memcpy(out, seeds[kind], len);
+    out[0] = (out[0] & 1) | ((round & 0x7F) << 1);
+    edits = 1 + rand() % 8;
+    for (e = 0; e < edits; e++) {
+        size_t at = 1 + rand() % (len > 1 ? len - 1 : 1);
+        switch (rand() % 4) {
+        case 0:     // Flip a byte
+            out[at] = rand();
+            break;
+        case 1:     // Digits and separators hit the text parsers hardest
+            out[at] = "0123456789,_\r\n 9"[rand() % 16];
+            break;
+        case 2:     // Truncate
+            len = at;
+            break;
+        default:    // Duplicate a stretch
+            if (len < MAX_INPUT / 2) {
+                size_t n = 1 + rand() % (len - at + 1);
+                memmove(out + at + n, out + at, len - at);
+                len += n;
+            }
+            break;
+        }
+    }
+    return len;
+}
+
+int main(int argc, char **argv) {
+    uint32_t rounds = (argc > 1) ? (uint32_t)atoi(argv[1]) : 200000, round;
+    const char *dir = (argc > 2) ? argv[2] : "../levels";
+    static uint8_t input[MAX_INPUT];
+    static char list[1024], legacy_names[20][20];
+    char fixed_names[20][MAP_NAME_SIZE];
+    int i, n, rep, passes = 1000000;
+    uint64_t begin, legacy_ns, new_ns;
+
+    srand(1);
+    if (!make_seeds(dir)) {
+        return 1;
+    }
+    for (i = 0; i < NUM_SEEDS; i++) {
+        check_input(seeds[i], seed_len[i]);
+    }
+    for (i = 0; i < (int)(sizeof(edges) / sizeof(edges[0])); i++) {
+        n = check_levels((const uint8_t *)edges[i].text, strlen(edges[i].text), 3);
+        if ((n > 0) != edges[i].levels) {
+            printf("FAIL: level \"%s\" %s\n", edges[i].text, n > 0 ? "accepted" : "rejected");
+            return 1;
+        }
+    }
+    for (round = 0; round < rounds; round++) {
+        check_input(input, mutate(input, round));
+    }
+    printf("%u mutated and random inputs, no failures\n", rounds);
+
+    // A 20-entry list, the most the old parser could take
+    for (i = 0, n = 0; i < 20; i++) {
+        n += sprintf(list + n, "Map%d-%c_map.txt\r\n", i, 'a' + i % 26);
+    }
+    // Best of a few runs each, interleaved so both see the same machine
+    legacy_ns = new_ns = UINT64_MAX;
+    for (rep = 0; rep < 5; rep++) {
+        uint64_t t;
+        begin = clock_ns();
+        for (i = 0; i < passes; i++) {
+            legacy_parse_map_names(legacy_names, list, &n);
+        }
+        t = clock_ns() - begin;
+        legacy_ns = (t < legacy_ns) ? t : legacy_ns;
+        begin = clock_ns();
+        for (i = 0; i < passes; i++) {
+            n = parse_map_names(fixed_names, 20, list);
+        }
+        t = clock_ns() - begin;
+        new_ns = (t < new_ns) ? t : new_ns;
+    }
+    if (n != 20 || strcmp(fixed_names[19], legacy_names[19]) != 0) {
+        printf("Parsers disagree on the benchmark list\n");
+        return 1;
+    }
+    printf("Map list of %zu bytes: old %.1f MB/s, new %.1f MB/s\n", strlen(list),
+           (double)strlen(list) * passes / (legacy_ns / 1e9) / (1024 * 1024),
+           (double)strlen(list) * passes / (new_ns / 1e9) / (1024 * 1024));
+
+    // Each shipped level, parsed whole as the old parser needed it
+    for (i = 4; i < NUM_SEEDS; i++) {
+        char *text = (char *)seeds[i] + 1;
+        size_t len = seed_len[i] - 1;
+        LevelParser parser;
+        int pass, level_passes = passes / 4;
+
+        text[len] = '\0';
+        legacy_ns = new_ns = UINT64_MAX;
+        for (rep = 0; rep < 5; rep++) {
+            uint64_t t;
+            begin = clock_ns();
+            for (pass = 0; pass < level_passes; pass++) {
+                legacy_parse_map_file(text);
+            }
+            t = clock_ns() - begin;
+            legacy_ns = (t < legacy_ns) ? t : legacy_ns;
+            begin = clock_ns();
+            for (pass = 0; pass < level_passes; pass++) {
+                game_reset_levels(&game);
+                level_parser_init(&parser, &game, 0, 1);
+                level_parser_feed(&parser, text, (int)len);
+                level_parser_finish(&parser);
+            }
+            t = clock_ns() - begin;
+            new_ns = (t < new_ns) ? t : new_ns;
+        }
+        if (game.num_st_platforms[0] != legacy_num_st || game.num_mov_platforms[0] != legacy_num_mov ||
+            memcmp(game.static_plats[0], legacy_st, legacy_num_st * sizeof(Platform)) != 0 ||
+            memcmp(game.mov_plats[0], legacy_mov, legacy_num_mov * sizeof(MovablePlatform)) != 0) {
+            printf("Parsers disagree on %s\n", level_files[i - 4]);
+            return 1;
+        }
+        printf("%s, %zu bytes: old %.1f MB/s, new %.1f MB/s\n", level_files[i - 4], len,
+               (double)len * level_passes / (legacy_ns / 1e9) / (1024 * 1024),
+               (double)len * level_passes / (new_ns / 1e9) / (1024 * 1024));
+    }
+    return 0;
+}
+
+#endif
+
+#endif
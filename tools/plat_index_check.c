@@ -0,0 +1,224 @@
+/*
+ * plat_index_check.c
+ *
+ *  Linux cross-check of the per-row platform index against the lookups it
+ *  replaces. On the offline levels, the WIN level and generated levels,
+ *  tilted at random for a few hundred ticks, every row is queried over
+ *  random column ranges after every tick and plat_index_find() must agree
+ *  with:
+ *      - a scan of the level's Platform and MovablePlatform records, the
+ *        platform it returns must cover the columns and it may only miss
+ *        when none does
+ *      - a pixel scan of the map row, which is how "is there a platform
+ *        here" was answered before the index
+ *  A level whose moving platforms share rows with each other and a static
+ *  one checks the records only, since a redraw clears the other platforms'
+ *  pixels there. A level with more platforms in a row than the index has
+ *  slots must set overflow, and game_find_platform() must then fall back to
+ *  the scan and still find them all. Then times the three lookups.
+ *
+ *  Host-only, not part of the CCS build. From the tools directory:
+ *      gcc -O2 -I.. -o plat_index_check plat_index_check.c ../game.c ../collision.c ../dist_field.c ../plat_index.c ../arena.c ../procgen.c ../offline_levels.c ../offline_tables.c -lm
+ *      ./plat_index_check [levels]
+ */
+
+#ifndef ccs
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "game.h"
+#include "collision.h"
+#include "offline_levels.h"
+#include "procgen.h"
+
+#define TILT_TICKS      300
+#define QUERIES         8       /* Random column ranges per row and tick */
+
+static GameState game;
+
+static uint64_t clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Does platform id cover any of columns x_first..x_last of a row
+static int covers(int id, int row, int x_first, int x_last) {
+    const Platform *plat = (id & PLAT_MOVING) ? &game.mov_plats[game.level][id & ~PLAT_MOVING].plat
+                                              : &game.static_plats[game.level][id];
+    return row >= plat->y && row < plat->y + plat->thickness && x_last >= plat->x && x_first < plat->x + plat->length;
+}
+
+// Scan of the level's records, returns the number of platforms covering the columns
+static int scan_records(int row, int x_first, int x_last) {
+    int i, found = 0;
+    for (i = 0; i < game.num_st_platforms[game.level]; i++) {
+        found += covers(i, row, x_first, x_last);
+    }
+    for (i = 0; i < game.num_mov_platforms[game.level]; i++) {
+        found += covers(PLAT_MOVING | i, row, x_first, x_last);
+    }
+    return found;
+}
+
+// One lookup's result against the records and, if pixels is set, the map
+static int check_find(int id, int row, int x_first, int x_last, int pixels, const char *what, int tick) {
+    int found = scan_records(row, x_first, x_last);
+    if ((id < 0 && found) || (id >= 0 && !covers(id, row, x_first, x_last))) {
+        printf("FAIL: %s: tick %d, row %d, columns %d-%d: found %d, %d platform(s) there\n", what, tick, row,
+               x_first, x_last, id, found);
+        return 1;
+    }
+    if (pixels && (id >= 0) != (span_first_solid(game.map, row, x_first, x_last) >= 0)) {
+        printf("FAIL: %s: tick %d, row %d, columns %d-%d: found %d, map disagrees\n", what, tick, row, x_first,
+               x_last, id);
+        return 1;
+    }
+    return 0;
+}
+
+// Tilt the level at random, querying every row after every tick
+static int check_level(uint8_t level, int pixels, const char *what) {
+    int tick, row, q, x_first, x_last;
+
+    game.level = level;
+    load_level(game.map, game.prev_map, game.static_plats[level], game.num_st_platforms[level],
+               game.mov_plats[level], game.num_mov_platforms[level], game.raster[level], &game.plat_index);
+    if (game.plat_index.overflow) {
+        printf("FAIL: %s: index overflowed\n", what);
+        return 1;
+    }
+    for (tick = 0; tick < TILT_TICKS; tick++) {
+        update_platforms(game.mov_plats[level], game.num_mov_platforms[level], rand() % 21 - 10, game.map,
+                         &game.plat_index);
+        for (row = 0; row < 128; row++) {
+            for (q = 0; q < QUERIES; q++) {
+                x_first = rand() % 128;
+                x_last = x_first + rand() % 12;
+                if (x_last > 127) {
+                    x_last = 127;
+                }
+                if (check_find(plat_index_find(&game.plat_index, row, x_first, x_last), row, x_first, x_last,
+                               pixels, what, tick)) {
+                    return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+// Moving platforms that clear each other's pixels and a static one's as they pass
+static const Platform shared_st[] = {{10, 3, 40, 60}};
+static const MovablePlatform shared_mov[] = {{{12, 3, 10, 60}, 0, 80}, {{12, 3, 50, 61}, 30, 100}};
+
+// More platforms on rows 90-92 than the index has slots for
+static Platform crowded_st[PLAT_ROW_SPANS + 2];
+static const MovablePlatform crowded_mov[] = {{{6, 3, 0, 91}, 0, 120}};
+
+int main(int argc, char **argv) {
+    LevelTable table;
+    int levels = (argc > 1) ? atoi(argv[1]) : 20;
+    int i, x, row, x_first, failures = 0, offline, hits[3] = {0, 0, 0};
+    uint64_t begin, index_ns, records_ns, pixels_ns;
+    char what[48];
+
+    srand(1);
+
+    // Offline levels and the WIN screen
+    game_init(&game);
+    game_load_offline_levels(&game);
+    game_add_win_level(&game);
+    for (i = 0; i < game.num_levels; i++) {
+        sprintf(what, "offline level %d", i + 1);
+        failures += check_level(i, 1, what);
+    }
+    offline = game.num_levels;
+
+    // Generated levels of every difficulty
+    for (i = 0; i < levels; i++) {
+        game_init(&game);
+        procgen_level(&game, 0, 2000 + i, 1 + i % PROCGEN_MAX_DIFFICULTY);
+        sprintf(what, "generated level %d", 2000 + i);
+        failures += check_level(0, 1, what);
+    }
+
+    // Shared rows, checked against the records only
+    memset(&table, 0, sizeof(table));
+    table.st_plats = shared_st;
+    table.num_st = 1;
+    table.mov_plats = shared_mov;
+    table.num_mov = 2;
+    game_init(&game);
+    game_set_level(&game, 0, &table);
+    failures += check_level(0, 0, "shared rows");
+
+    // Overflow: the index misses some, the fallback scan finds them all
+    for (i = 0; i < PLAT_ROW_SPANS + 2; i++) {
+        crowded_st[i] = create_static_platform(i * 9, 90, 4, 3);
+    }
+    table.st_plats = crowded_st;
+    table.num_st = PLAT_ROW_SPANS + 2;
+    table.mov_plats = crowded_mov;
+    table.num_mov = 1;
+    game_init(&game);
+    game_set_level(&game, 0, &table);
+    load_level(game.map, game.prev_map, game.static_plats[0], game.num_st_platforms[0], game.mov_plats[0],
+               game.num_mov_platforms[0], game.raster[0], &game.plat_index);
+    if (!game.plat_index.overflow) {
+        printf("FAIL: crowded rows: index didn't overflow\n");
+        failures++;
+    }
+    for (row = 88; row < 95; row++) {
+        for (x = 0; x < 128; x++) {
+            failures += check_find(game_find_platform(&game, row, x, x), row, x, x, 1, "crowded rows", 0);
+        }
+    }
+    printf("%d offline, %d generated, 1 shared-row level over %d ticks each, 1 overflowing level\n",
+           offline, levels, TILT_TICKS);
+
+    // The lookup under the character's feet, on the last generated level
+    game_init(&game);
+    procgen_level(&game, 0, 2000 + levels - 1, PROCGEN_MAX_DIFFICULTY);
+    load_level(game.map, game.prev_map, game.static_plats[0], game.num_st_platforms[0], game.mov_plats[0],
+               game.num_mov_platforms[0], game.raster[0], &game.plat_index);
+    begin = clock_ns();
+    for (i = 0; i < 1000; i++) {
+        for (row = 0; row < 128; row++) {
+            x_first = (row * 7 + i) % 118;
+            hits[0] += plat_index_find(&game.plat_index, row, x_first, x_first + 9) >= 0;
+        }
+    }
+    index_ns = clock_ns() - begin;
+    begin = clock_ns();
+    for (i = 0; i < 1000; i++) {
+        for (row = 0; row < 128; row++) {
+            x_first = (row * 7 + i) % 118;
+            hits[1] += scan_records(row, x_first, x_first + 9) > 0;
+        }
+    }
+    records_ns = clock_ns() - begin;
+    begin = clock_ns();
+    for (i = 0; i < 1000; i++) {
+        for (row = 0; row < 128; row++) {
+            x_first = (row * 7 + i) % 118;
+            hits[2] += span_first_solid(game.map, row, x_first, x_first + 9) >= 0;
+        }
+    }
+    pixels_ns = clock_ns() - begin;
+    if (hits[0] != hits[1] || hits[0] != hits[2]) {
+        printf("FAIL: timed lookups hit %d, %d and %d times\n", hits[0], hits[1], hits[2]);
+        failures++;
+    }
+    printf("Platform lookup: %.1f ns indexed, %.1f ns scanning %u records, %.1f ns scanning pixels; index takes %u bytes\n",
+           index_ns / 128000.0, records_ns / 128000.0,
+           game.num_st_platforms[0] + game.num_mov_platforms[0], pixels_ns / 128000.0, (unsigned int)sizeof(PlatIndex));
+    printf("%d failure(s)\n", failures);
+    return failures ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,51 @@
+/*
+ * common.h
+ *
+ *  Host stand-in for the SDK examples' common.h: the AP settings, status
+ *  bits and error helpers network_utils.c uses. The AP is the shim's
+ *  simulated one, which takes any SSID and key.
+ */
+
+#ifndef SHIM_COMMON_H_
+#define SHIM_COMMON_H_
+
+#include "uart_if.h"
+
+#define SSID_NAME           "shim"
+#define SECURITY_TYPE       SL_SEC_TYPE_WPA_WPA2
+#define SECURITY_KEY        "shimshim"
+#define SSID_LEN_MAX        32
+#define BSSID_LEN_MAX       6
+#define SL_STOP_TIMEOUT     200
+#define SUCCESS             0
+
+#define UART_PRINT          Report
+#define ERR_PRINT(x)        Report("Error [%d] at line [%d] in function [%s]\n\r", (int)(x), __LINE__, __func__)
+
+#define ASSERT_ON_ERROR(error_code) \
+    do { \
+        if ((error_code) < 0) { \
+            ERR_PRINT(error_code); \
+            return error_code; \
+        } \
+    } while (0)
+
+typedef enum {
+    STATUS_BIT_CONNECTION,
+    STATUS_BIT_STA_CONNECTED,
+    STATUS_BIT_IP_AQUIRED,
+    STATUS_BIT_IP_LEASED,
+    STATUS_BIT_CONNECTION_FAILED,
+    STATUS_BIT_P2P_NEG_REQ_RECEIVED,
+    STATUS_BIT_SMARTCONFIG_DONE,
+    STATUS_BIT_SMARTCONFIG_STOPPED
+} e_StatusBits;
+
+#define SET_STATUS_BIT(status_variable, bit)    ((status_variable) |= (1 << (bit)))
+#define CLR_STATUS_BIT(status_variable, bit)    ((status_variable) &= ~(1 << (bit)))
+#define CLR_STATUS_BIT_ALL(status_variable)     ((status_variable) = 0)
+#define GET_STATUS_BIT(status_variable, bit)    (0 != ((status_variable) & (1 << (bit))))
+#define IS_CONNECTED(status_variable)           GET_STATUS_BIT(status_variable, STATUS_BIT_CONNECTION)
+#define IS_IP_ACQUIRED(status_variable)         GET_STATUS_BIT(status_variable, STATUS_BIT_IP_AQUIRED)
+
+#endif /* SHIM_COMMON_H_ */
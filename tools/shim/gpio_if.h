@@ -0,0 +1,29 @@
+/*
+ * gpio_if.h
+ *
+ *  Host stand-in for the SDK's LED helpers, the LEDs are ignored.
+ */
+
+#ifndef SHIM_GPIO_IF_H_
+#define SHIM_GPIO_IF_H_
+
+#define LED1                1
+#define LED2                2
+#define LED3                4
+#define MCU_RED_LED_GPIO    9
+#define MCU_ORANGE_LED_GPIO 10
+#define MCU_GREEN_LED_GPIO  11
+
+static inline void GPIO_IF_LedConfigure(unsigned char pins) {
+    (void)pins;
+}
+
+static inline void GPIO_IF_LedOn(char gpio) {
+    (void)gpio;
+}
+
+static inline void GPIO_IF_LedOff(char gpio) {
+    (void)gpio;
+}
+
+#endif /* SHIM_GPIO_IF_H_ */
@@ -0,0 +1,11 @@
+/*
+ * hw_ints.h
+ *
+ *  Empty host stand-in for the SDK header, so network_utils.c builds
+ *  against the shim. Nothing from it is used off the device.
+ */
+
+#ifndef SHIM_HW_INTS_H_
+#define SHIM_HW_INTS_H_
+
+#endif /* SHIM_HW_INTS_H_ */
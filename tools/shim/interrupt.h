@@ -0,0 +1,11 @@
+/*
+ * interrupt.h
+ *
+ *  Empty host stand-in for the SDK header, so network_utils.c builds
+ *  against the shim. Nothing from it is used off the device.
+ */
+
+#ifndef SHIM_INTERRUPT_H_
+#define SHIM_INTERRUPT_H_
+
+#endif /* SHIM_INTERRUPT_H_ */
@@ -0,0 +1,11 @@
+/*
+ * prcm.h
+ *
+ *  Empty host stand-in for the SDK header, so network_utils.c builds
+ *  against the shim. Nothing from it is used off the device.
+ */
+
+#ifndef SHIM_PRCM_H_
+#define SHIM_PRCM_H_
+
+#endif /* SHIM_PRCM_H_ */
@@ -0,0 +1,11 @@
+/*
+ * rom_map.h
+ *
+ *  Empty host stand-in for the SDK header, so network_utils.c builds
+ *  against the shim. Nothing from it is used off the device.
+ */
+
+#ifndef SHIM_ROM_MAP_H_
+#define SHIM_ROM_MAP_H_
+
+#endif /* SHIM_ROM_MAP_H_ */
@@ -0,0 +1,777 @@
+/*
+ * simplelink.c
+ *
+ *  Linux stand-in for the SimpleLink socket, NetApp and sl_Fs calls, on
+ *  POSIX sockets and OpenSSL, with latency and loss injection, and a
+ *  simulated AP for the Wlan calls.
+ */
+
+#define SHIM_IMPL
+#include "simplelink.h"
+
+#include <stdlib.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sched.h>
+#include <sys/time.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/x509.h>
+
+#define SHIM_MAX_SOCKETS    1024
+#define SHIM_HOLD_SIZE      16384       /* Received data waiting out its delay */
+#define SHIM_NAME_SIZE      64
+#define SHIM_DNS_ERROR      (-161)      /* What the device returns when a lookup gets no answer */
+#define SHIM_PROFILE_FILE   "shim/profile"  /* Exists while an AP profile is stored */
+#define SHIM_AP_IP          0xC0A80164      /* 192.168.1.100 */
+#define SHIM_AP_GATEWAY     0xC0A80101
+
+typedef enum {
+    SHIM_NEW,
+    SHIM_TCP,                   /* TCP connect under way */
+    SHIM_TCP_WAIT,              /* Connected, waiting out the latency */
+    SHIM_TLS,                   /* Handshake under way */
+    SHIM_TLS_WAIT,              /* Handshake done, waiting out its round trips */
+    SHIM_OPEN,
+    SHIM_FAILED
+} ShimPhase;
+
+typedef struct {
+    ShimPhase phase;
+    uint8_t secure;
+    uint8_t tls12;              /* SL_SO_SECMETHOD asked for TLS 1.2 */
+    uint8_t awaiting;           /* Sent since the last data arrived */
+    uint8_t reset;              /* Reset by the injected faults */
+    uint32_t rcvtimeo_ms;       /* 0 waits for ever */
+    uint64_t ready_at;          /* ms the connect step or the held data is due */
+    char ca[SHIM_NAME_SIZE];    /* sl_Fs names, empty if not set */
+    char cert[SHIM_NAME_SIZE];
+    char key[SHIM_NAME_SIZE];
+    SSL *ssl;
+    char held[SHIM_HOLD_SIZE];
+    int held_pos, held_len;
+} ShimSocket;
+
+// Joining the simulated AP
+typedef struct {
+    uint8_t joining;            /* Asked to join, connect event not sent yet */
+    uint8_t connected;          /* Connect event sent, IP event pending or sent */
+    uint8_t has_ip;
+    uint8_t leaving;            /* Disconnect event pending */
+    uint64_t connect_at, ip_at;
+} ShimWlan;
+
+ShimNetStats shim_net_stats;
+
+// Defined by network_utils.c when it is linked in
+void SimpleLinkWlanEventHandler(SlWlanEvent_t *event) __attribute__((weak));
+void SimpleLinkNetAppEventHandler(SlNetAppEvent_t *event) __attribute__((weak));
+
+static ShimSocket *sockets[SHIM_MAX_SOCKETS];
+static ShimWlan wlan;
+static ShimNetConfig config;
+static int configured;
+static unsigned int seed;
+
+static uint32_t env(const char *name, uint32_t value) {
+    const char *s = getenv(name);
+    return s ? strtoul(s, NULL, 10) : value;
+}
+
+static void configure(void) {
+    if (configured) {
+        return;
+    }
+    config.latency_ms = env("SHIM_LATENCY_MS", 0);
+    config.jitter_ms = env("SHIM_JITTER_MS", 0);
+    config.loss_pct = env("SHIM_LOSS_PCT", 0);
+    config.rto_ms = env("SHIM_RTO_MS", 200);
+    config.reset_pct = env("SHIM_RESET_PCT", 0);
+    config.dns_ms = env("SHIM_DNS_MS", 0);
+    config.dns_fail_pct = env("SHIM_DNS_FAIL_PCT", 0);
+    config.start_ms = env("SHIM_START_MS", 0);
+    config.assoc_ms = env("SHIM_ASSOC_MS", 0);
+    config.dhcp_ms = env("SHIM_DHCP_MS", 0);
+    config.seed = env("SHIM_SEED", 1);
+    seed = config.seed;
+    // A write to a closed connection fails on the device, it doesn't raise a signal
+    signal(SIGPIPE, SIG_IGN);
+    configured = 1;
+}
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void sleep_ms(uint64_t ms) {
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (ms % 1000) * 1000000;
+    nanosleep(&ts, NULL);
+}
+
+static int chance(uint32_t pct) {
+    return pct && (uint32_t)(rand_r(&seed) % 100) < pct;
+}
+
+static uint32_t latency(void) {
+    return config.latency_ms + (config.jitter_ms ? rand_r(&seed) % (config.jitter_ms + 1) : 0);
+}
+
+// Set with SL_SO_NONBLOCKING or straight through fcntl()
+static int nonblocking(int sd) {
+    return (fcntl(sd, F_GETFL, 0) & O_NONBLOCK) != 0;
+}
+
+static ShimSocket *lookup(int sd) {
+    return (sd >= 0 && sd < SHIM_MAX_SOCKETS) ? sockets[sd] : NULL;
+}
+
+// Error code of a failed call, SimpleLink's match the negated errno values
+static int sl_error(void) {
+    return (errno == EWOULDBLOCK) ? SL_EAGAIN : -errno;
+}
+
+// Wait until ready_at, or return busy on a non-blocking socket. A blocking
+// one waits no longer than its receive timeout when timeout is set.
+static int wait_until(ShimSocket *s, int sd, int busy, int timeout) {
+    uint64_t now = now_ms();
+
+    if (now >= s->ready_at) {
+        return 0;
+    }
+    if (nonblocking(sd)) {
+        return busy;
+    }
+    if (timeout && s->rcvtimeo_ms && s->ready_at - now > s->rcvtimeo_ms) {
+        sleep_ms(s->rcvtimeo_ms);
+        return SL_EAGAIN;
+    }
+    sleep_ms(s->ready_at - now);
+    return 0;
+}
+
+static int load_ca(SSL_CTX *ctx, const char *name) {
+    char path[256];
+    FILE *f;
+    X509 *cert;
+
+    shim_fs_path((const _u8 *)name, path, sizeof(path));
+    if (!(f = fopen(path, "rb"))) {
+        return -1;
+    }
+    cert = d2i_X509_fp(f, NULL);
+    fclose(f);
+    if (!cert || !X509_STORE_add_cert(SSL_CTX_get_cert_store(ctx), cert)) {
+        X509_free(cert);
+        return -1;
+    }
+    X509_free(cert);
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, NULL);
+    return 0;
+}
+
+// Set up the TLS side with the sl_Fs files the socket was given, all DER
+// as on the device
+static int start_tls(ShimSocket *s, int sd) {
+    char path[256];
+    SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+    int ok = (ctx != NULL);
+
+    if (ok && s->tls12) {
+        ok = SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION) && SSL_CTX_set_max_proto_version(ctx, TLS1_2_VERSION);
+    }
+    if (ok && s->ca[0]) {
+        ok = (load_ca(ctx, s->ca) == 0);
+    }
+    if (ok && s->cert[0]) {
+        shim_fs_path((const _u8 *)s->cert, path, sizeof(path));
+        ok = SSL_CTX_use_certificate_file(ctx, path, SSL_FILETYPE_ASN1);
+    }
+    if (ok && s->key[0]) {
+        shim_fs_path((const _u8 *)s->key, path, sizeof(path));
+        ok = SSL_CTX_use_PrivateKey_file(ctx, path, SSL_FILETYPE_ASN1);
+    }
+    if (ok) {
+        // A server that just closes reads as the end of the data, as on the device
+        SSL_CTX_set_options(ctx, SSL_OP_IGNORE_UNEXPECTED_EOF);
+        ok = ((s->ssl = SSL_new(ctx)) != NULL) && SSL_set_fd(s->ssl, sd);
+    }
+    SSL_CTX_free(ctx);
+    return ok ? 0 : -1;
+}
+
+static void free_socket(int sd) {
+    ShimSocket *s = sockets[sd];
+
+    if (s->ssl) {
+        if (s->phase == SHIM_OPEN && !s->reset) {
+            SSL_shutdown(s->ssl);
+        }
+        SSL_free(s->ssl);
+    }
+    free(s);
+    sockets[sd] = NULL;
+}
+
+// Shim Net Config
+void shim_net_config(const ShimNetConfig *cfg) {
+    configure();
+    config = *cfg;
+    seed = config.seed ? config.seed : 1;
+}
+
+// Start joining the AP, the events follow from the main loop task
+static void wlan_join(void) {
+    wlan.joining = 1;
+    wlan.connected = wlan.has_ip = 0;
+    wlan.connect_at = now_ms() + config.assoc_ms;
+    wlan.ip_at = wlan.connect_at + config.dhcp_ms;
+}
+
+static int profile_stored(void) {
+    char path[256];
+
+    shim_fs_path((const _u8 *)SHIM_PROFILE_FILE, path, sizeof(path));
+    return access(path, F_OK) == 0;
+}
+
+// Main Loop Task
+_i16 _SlNonOsMainLoopTask(void) {
+    SlWlanEvent_t wlan_event;
+    SlNetAppEvent_t netapp_event;
+    uint64_t now = now_ms();
+
+    sched_yield();
+    memset(&wlan_event, 0, sizeof(wlan_event));
+    memset(&netapp_event, 0, sizeof(netapp_event));
+    if (wlan.leaving) {
+        wlan.leaving = 0;
+        wlan_event.Event = SL_WLAN_DISCONNECT_EVENT;
+        wlan_event.EventData.STAandP2PModeDisconnected.reason_code = SL_USER_INITIATED_DISCONNECTION;
+        if (SimpleLinkWlanEventHandler) {
+            SimpleLinkWlanEventHandler(&wlan_event);
+        }
+    }
+    if (wlan.joining && now >= wlan.connect_at) {
+        wlan.joining = 0;
+        wlan.connected = 1;
+        shim_net_stats.joins++;
+        wlan_event.Event = SL_WLAN_CONNECT_EVENT;
+        memcpy(wlan_event.EventData.STAandP2PModeWlanConnected.ssid_name, "shim", 4);
+        wlan_event.EventData.STAandP2PModeWlanConnected.ssid_len = 4;
+        if (SimpleLinkWlanEventHandler) {
+            SimpleLinkWlanEventHandler(&wlan_event);
+        }
+    }
+    if (wlan.connected && !wlan.has_ip && now >= wlan.ip_at) {
+        wlan.has_ip = 1;
+        netapp_event.Event = SL_NETAPP_IPV4_IPACQUIRED_EVENT;
+        netapp_event.EventData.ipAcquiredV4.ip = SHIM_AP_IP;
+        netapp_event.EventData.ipAcquiredV4.gateway = SHIM_AP_GATEWAY;
+        if (SimpleLinkNetAppEventHandler) {
+            SimpleLinkNetAppEventHandler(&netapp_event);
+        }
+    }
+    return 0;
+}
+
+// Start
+_i16 sl_Start(const void *if_hdl, _i8 *dev_name, const void *init_callback) {
+    (void)if_hdl;
+    (void)dev_name;
+    (void)init_callback;
+    configure();
+    shim_net_stats.starts++;
+    sleep_ms(config.start_ms);
+    // The device joins from a stored profile on its own
+    memset(&wlan, 0, sizeof(wlan));
+    if (profile_stored()) {
+        wlan_join();
+    }
+    return ROLE_STA;
+}
+
+// Stop
+_i16 sl_Stop(_u16 timeout) {
+    int sd;
+
+    (void)timeout;
+    for (sd = 0; sd < SHIM_MAX_SOCKETS; sd++) {
+        if (sockets[sd]) {
+            sl_Close(sd);
+        }
+    }
+    memset(&wlan, 0, sizeof(wlan));
+    return 0;
+}
+
+// Socket
+_i16 sl_Socket(_i16 domain, _i16 type, _i16 protocol) {
+    int sd;
+
+    configure();
+    if ((sd = socket(domain, type, (protocol == SL_SEC_SOCKET) ? 0 : protocol)) < 0) {
+        return sl_error();
+    }
+    if (sd >= SHIM_MAX_SOCKETS || !(sockets[sd] = calloc(1, sizeof(ShimSocket)))) {
+        // Still a working socket, just without the injected faults
+        return sd;
+    }
+    sockets[sd]->secure = (protocol == SL_SEC_SOCKET);
+    return sd;
+}
+
+// Close
+_i16 sl_Close(_i16 sd) {
+    if (lookup(sd)) {
+        free_socket(sd);
+    }
+    return close(sd);
+}
+
+// Set Socket Option
+_i16 sl_SetSockOpt(_i16 sd, _i16 level, _i16 optname, const void *optval, socklen_t optlen) {
+    ShimSocket *s = lookup(sd);
+    char *name = NULL;
+    int on;
+
+    if (level != SL_SOL_SOCKET) {
+        return setsockopt(sd, level, optname, optval, optlen) < 0 ? sl_error() : 0;
+    }
+    switch (optname) {
+    case SL_SO_NONBLOCKING:
+        on = fcntl(sd, F_GETFL, 0);
+        if (((const SlSockNonblocking_t *)optval)->NonblockingEnabled) {
+            on |= O_NONBLOCK;
+        } else {
+            on &= ~O_NONBLOCK;
+        }
+        return fcntl(sd, F_SETFL, on) < 0 ? sl_error() : 0;
+    case SL_SO_KEEPALIVE:
+        on = ((const SlSockKeepalive_t *)optval)->KeepaliveEnabled != 0;
+        return setsockopt(sd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on)) < 0 ? sl_error() : 0;
+    case SL_SO_RCVTIMEO: {
+        const SlTimeval_t *tv = (const SlTimeval_t *)optval;
+        struct timeval timeout;
+        timeout.tv_sec = tv->tv_sec;
+        timeout.tv_usec = tv->tv_usec;
+        if (setsockopt(sd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0) {
+            return sl_error();
+        }
+        if (s) {
+            s->rcvtimeo_ms = tv->tv_sec * 1000 + tv->tv_usec / 1000;
+        }
+        return 0;
+    }
+    case SL_SO_SECMETHOD:
+        if (!s || !s->secure) {
+            return -1;
+        }
+        s->tls12 = (*(const _u8 *)optval == SL_SO_SEC_METHOD_TLSV1_2);
+        return 0;
+    case SL_SO_SECURE_MASK:
+        return (s && s->secure) ? 0 : -1;
+    case SL_SO_SECURE_FILES_CA_FILE_NAME:
+        name = s ? s->ca : NULL;
+        break;
+    case SL_SO_SECURE_FILES_CERTIFICATE_FILE_NAME:
+        name = s ? s->cert : NULL;
+        break;
+    case SL_SO_SECURE_FILES_PRIVATE_KEY_FILE_NAME:
+        name = s ? s->key : NULL;
+        break;
+    default:
+        return setsockopt(sd, level, optname, optval, optlen) < 0 ? sl_error() : 0;
+    }
+    // The file names aren't terminated, optlen is their length
+    if (!name || !s->secure || optlen >= SHIM_NAME_SIZE) {
+        return -1;
+    }
+    memcpy(name, optval, optlen);
+    name[optlen] = '\0';
+    return 0;
+}
+
+// Connect
+_i16 sl_Connect(_i16 sd, const SlSockAddr_t *addr, _i16 addrlen) {
+    ShimSocket *s = lookup(sd);
+    struct pollfd pfd;
+    socklen_t len = sizeof(int);
+    int ret, err;
+
+    if (!s) {
+        if (connect(sd, addr, addrlen) == 0 || errno == EISCONN) {
+            return 0;
+        }
+        return (errno == EINPROGRESS || errno == EALREADY) ? SL_EALREADY : sl_error();
+    }
+    for (;;) {
+        switch (s->phase) {
+        case SHIM_NEW:
+            shim_net_stats.connects++;
+            if (connect(sd, addr, addrlen) < 0) {
+                if (errno != EINPROGRESS) {
+                    s->phase = SHIM_FAILED;
+                    return sl_error();
+                }
+                s->phase = SHIM_TCP;
+                break;
+            }
+            s->phase = SHIM_TCP_WAIT;
+            s->ready_at = now_ms() + latency();
+            break;
+        case SHIM_TCP:
+            pfd.fd = sd;
+            pfd.events = POLLOUT;
+            if (poll(&pfd, 1, nonblocking(sd) ? 0 : -1) == 0) {
+                return SL_EALREADY;
+            }
+            getsockopt(sd, SOL_SOCKET, SO_ERROR, &err, &len);
+            if (err) {
+                s->phase = SHIM_FAILED;
+                return -err;
+            }
+            s->phase = SHIM_TCP_WAIT;
+            s->ready_at = now_ms() + latency();
+            break;
+        case SHIM_TCP_WAIT:
+            if ((ret = wait_until(s, sd, SL_EALREADY, 0)) < 0) {
+                return ret;
+            }
+            if (!s->secure) {
+                s->phase = SHIM_OPEN;
+                return 0;
+            }
+            if (start_tls(s, sd) < 0) {
+                s->phase = SHIM_FAILED;
+                return SL_ESECHANDSHAKE;
+            }
+            s->phase = SHIM_TLS;
+            break;
+        case SHIM_TLS:
+            ret = SSL_connect(s->ssl);
+            if (ret != 1) {
+                err = SSL_get_error(s->ssl, ret);
+                if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+                    return SL_EALREADY;
+                }
+                ERR_clear_error();
+                s->phase = SHIM_FAILED;
+                return SL_ESECHANDSHAKE;
+            }
+            // A TLS 1.2 handshake takes two round trips
+            s->phase = SHIM_TLS_WAIT;
+            s->ready_at = now_ms() + latency() + latency();
+            break;
+        case SHIM_TLS_WAIT:
+            if ((ret = wait_until(s, sd, SL_EALREADY, 0)) < 0) {
+                return ret;
+            }
+            s->phase = SHIM_OPEN;
+            shim_net_stats.handshakes++;
+            if (!s->ca[0]) {
+                shim_net_stats.unverified++;
+                return SL_ESECSNOVERIFY;
+            }
+            return 0;
+        case SHIM_OPEN:
+            return 0;
+        default:
+            return -1;
+        }
+    }
+}
+
+// Send
+_i16 sl_Send(_i16 sd, const void *buf, _i16 len, _i16 flags) {
+    ShimSocket *s = lookup(sd);
+    int ret;
+
+    if (!s || s->phase != SHIM_OPEN) {
+        ret = send(sd, buf, len, flags | MSG_NOSIGNAL);
+        return (ret < 0) ? sl_error() : ret;
+    }
+    if (s->reset) {
+        return SL_ECONNRESET;
+    }
+    if (s->ssl) {
+        ret = SSL_write(s->ssl, buf, len);
+        if (ret <= 0) {
+            int err = SSL_get_error(s->ssl, ret);
+            ERR_clear_error();
+            return (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) ? SL_EAGAIN : SL_ECONNRESET;
+        }
+    } else if ((ret = send(sd, buf, len, flags | MSG_NOSIGNAL)) < 0) {
+        return sl_error();
+    }
+    shim_net_stats.bytes_sent += ret;
+    s->awaiting = 1;
+    return ret;
+}
+
+// Take in what has arrived and work out when it is due
+static int fill(ShimSocket *s, int sd) {
+    uint64_t ready = now_ms();
+    int ret;
+
+    if (s->ssl) {
+        ret = SSL_read(s->ssl, s->held, sizeof(s->held));
+        if (ret <= 0) {
+            int err = SSL_get_error(s->ssl, ret);
+            ERR_clear_error();
+            if (err == SSL_ERROR_ZERO_RETURN) {
+                return 0;
+            }
+            if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE ||
+                (err == SSL_ERROR_SYSCALL && (errno == EAGAIN || errno == EWOULDBLOCK))) {
+                return SL_EAGAIN;
+            }
+            return SL_ECONNRESET;
+        }
+    } else if ((ret = recv(sd, s->held, sizeof(s->held), 0)) <= 0) {
+        return (ret < 0) ? sl_error() : 0;
+    }
+    if (chance(config.reset_pct)) {
+        shim_net_stats.resets++;
+        s->reset = 1;
+        shutdown(sd, SHUT_RDWR);
+        return SL_ECONNRESET;
+    }
+    // The first data after a send is the reply, a round trip away
+    if (s->awaiting) {
+        ready += latency();
+        s->awaiting = 0;
+    }
+    if (chance(config.loss_pct)) {
+        shim_net_stats.held++;
+        ready += config.rto_ms;
+    }
+    s->held_pos = 0;
+    s->held_len = ret;
+    s->ready_at = ready;
+    return ret;
+}
+
+// Receive
+_i16 sl_Recv(_i16 sd, void *buf, _i16 len, _i16 flags) {
+    ShimSocket *s = lookup(sd);
+    int ret;
+
+    if (!s || s->phase != SHIM_OPEN) {
+        ret = recv(sd, buf, len, flags);
+        return (ret < 0) ? sl_error() : ret;
+    }
+    if (s->reset) {
+        return SL_ECONNRESET;
+    }
+    if (s->held_pos == s->held_len && (ret = fill(s, sd)) <= 0) {
+        return ret;
+    }
+    if ((ret = wait_until(s, sd, SL_EAGAIN, 1)) < 0) {
+        return ret;
+    }
+    ret = s->held_len - s->held_pos;
+    if (ret > len) {
+        ret = len;
+    }
+    memcpy(buf, s->held + s->held_pos, ret);
+    s->held_pos += ret;
+    shim_net_stats.bytes_received += ret;
+    return ret;
+}
+
+// DNS Get Host By Name
+_i16 sl_NetAppDnsGetHostByName(_i8 *name, _u16 len, _u32 *ip, _u8 family) {
+    struct addrinfo hints, *res;
+    char host[256];
+
+    configure();
+    shim_net_stats.lookups++;
+    sleep_ms(config.dns_ms);
+    if (len >= sizeof(host) || chance(config.dns_fail_pct)) {
+        shim_net_stats.lookup_failures++;
+        return SHIM_DNS_ERROR;
+    }
+    memcpy(host, name, len);
+    host[len] = '\0';
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = family;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, NULL, &hints, &res) != 0) {
+        shim_net_stats.lookup_failures++;
+        return SHIM_DNS_ERROR;
+    }
+    *ip = ntohl(((struct sockaddr_in *)res->ai_addr)->sin_addr.s_addr);
+    freeaddrinfo(res);
+    return 0;
+}
+
+// File Path
+void shim_fs_path(const _u8 *name, char *path, size_t size) {
+    char *p;
+
+    snprintf(path, size, "%s/sl_%s", SHIM_FS_DIR, (const char *)name);
+    for (p = path + strlen(SHIM_FS_DIR) + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '_';
+        }
+    }
+}
+
+// File Open
+_i32 sl_FsOpen(const _u8 *name, _u32 mode, _u32 *token, _i32 *handle) {
+    static const int flags[] = {O_RDONLY, O_WRONLY, O_WRONLY | O_CREAT | O_TRUNC};
+    char path[256];
+    int fd;
+
+    (void)token;
+    shim_fs_path(name, path, sizeof(path));
+    if ((fd = open(path, flags[mode], 0644)) < 0) {
+        return -1;
+    }
+    *handle = fd;
+    return 0;
+}
+
+// File Read
+_i32 sl_FsRead(_i32 handle, _u32 offset, _u8 *data, _u32 len) {
+    return pread(handle, data, len, offset);
+}
+
+// File Write
+_i32 sl_FsWrite(_i32 handle, _u32 offset, _u8 *data, _u32 len) {
+    return pwrite(handle, data, len, offset);
+}
+
+// File Close
+_i16 sl_FsClose(_i32 handle, _u8 *cert, _u8 *signature, _u32 signature_len) {
+    (void)cert;
+    (void)signature;
+    (void)signature_len;
+    return close(handle);
+}
+
+// File Delete
+_i16 sl_FsDel(const _u8 *name, _u32 token) {
+    char path[256];
+
+    (void)token;
+    shim_fs_path(name, path, sizeof(path));
+    return unlink(path);
+}
+
+// Wlan Set Mode
+_i16 sl_WlanSetMode(_u8 mode) {
+    return (mode == ROLE_STA) ? 0 : -1;
+}
+
+// Wlan Policy Set
+_i16 sl_WlanPolicySet(_u8 type, _u8 policy, _u8 *val, _u8 val_len) {
+    (void)type;
+    (void)policy;
+    (void)val;
+    (void)val_len;
+    return 0;
+}
+
+// Wlan Profile Add
+_i16 sl_WlanProfileAdd(const void *name, _i16 name_len, const _u8 *mac, const SlSecParams_t *sec,
+                       const void *sec_ext, _u32 priority, _u32 options) {
+    _i32 handle;
+    _u32 token = 0;
+
+    (void)name;
+    (void)name_len;
+    (void)mac;
+    (void)sec;
+    (void)sec_ext;
+    (void)priority;
+    (void)options;
+    if (sl_FsOpen((const _u8 *)SHIM_PROFILE_FILE, FS_MODE_OPEN_CREATE(0, 0), &token, &handle) < 0) {
+        return -1;
+    }
+    sl_FsClose(handle, 0, 0, 0);
+    return 0;
+}
+
+// Wlan Profile Delete, only "all of them" (0xFF) is used
+_i16 sl_WlanProfileDel(_i16 index) {
+    (void)index;
+    sl_FsDel((const _u8 *)SHIM_PROFILE_FILE, 0);
+    return 0;
+}
+
+// Wlan Connect
+_i16 sl_WlanConnect(const void *name, _i16 name_len, const _u8 *mac, const SlSecParams_t *sec, const void *sec_ext) {
+    (void)name;
+    (void)name_len;
+    (void)mac;
+    (void)sec;
+    (void)sec_ext;
+    wlan_join();
+    return 0;
+}
+
+// Wlan Disconnect, 0 if there was a connection to drop
+_i16 sl_WlanDisconnect(void) {
+    int was = wlan.connected;
+
+    memset(&wlan, 0, sizeof(wlan));
+    wlan.leaving = was;
+    return was ? 0 : -1;
+}
+
+// Wlan Set
+_i16 sl_WlanSet(_u16 config_id, _u16 config_opt, _u16 config_len, const _u8 *value) {
+    (void)config_id;
+    (void)config_opt;
+    (void)config_len;
+    (void)value;
+    return 0;
+}
+
+// Wlan Rx Filter Set
+_i16 sl_WlanRxFilterSet(_u8 op, const _u8 *buf, _u16 len) {
+    (void)op;
+    (void)buf;
+    (void)len;
+    return 0;
+}
+
+// NetCfg Set
+_i32 sl_NetCfgSet(_u8 config_id, _u8 config_opt, _u8 config_len, const _u8 *value) {
+    (void)config_id;
+    (void)config_opt;
+    (void)config_len;
+    (void)value;
+    return 0;
+}
+
+// mDNS Unregister
+_i16 sl_NetAppMDNSUnRegisterService(const void *name, _u8 name_len) {
+    (void)name;
+    (void)name_len;
+    return 0;
+}
+
+// Device Get, the version reads as all zeros
+_i32 sl_DevGet(_u8 config_id, _u8 *config_opt, _u8 *config_len, _u8 *value) {
+    (void)config_id;
+    (void)config_opt;
+    memset(value, 0, *config_len);
+    return 0;
+}
+
+// Device Set, the clock isn't used, OpenSSL checks certificates against the host's
+_i32 sl_DevSet(_u8 config_id, _u8 config_opt, _u8 config_len, const _u8 *value) {
+    (void)config_id;
+    (void)config_opt;
+    (void)config_len;
+    (void)value;
+    return 0;
+}
@@ -0,0 +1,316 @@
+/*
+ * simplelink.h
+ *
+ *  Linux stand-in for the parts of the SimpleLink host driver the network
+ *  code uses, so it can be built and run against local servers. Put this
+ *  directory on the include path ahead of the SDK (-Ishim from tools) and
+ *  link shim/simplelink.c with -lssl -lcrypto.
+ *
+ *  Sockets are POSIX sockets, and an SL_SEC_SOCKET does its TLS through
+ *  OpenSSL the way the network processor would: the CA, certificate and
+ *  key are sl_Fs file names set with sl_SetSockOpt(), the handshake is part
+ *  of sl_Connect(), and without a CA the connect succeeds with
+ *  SL_ESECSNOVERIFY. The BSD names SimpleLink maps onto sl_Socket() and
+ *  friends are mapped the same way here, and errors come back as
+ *  SimpleLink's: SL_EAGAIN for no data yet and SL_EALREADY while a connect
+ *  is under way.
+ *
+ *  Latency and loss can be added to sockets opened through the shim, set
+ *  with shim_net_config() or from the environment at the first call:
+ *      SHIM_LATENCY_MS     before a connect completes, before a handshake
+ *                          completes (twice) and before the reply to each
+ *                          send shows up
+ *      SHIM_JITTER_MS      up to this much more, at random
+ *      SHIM_LOSS_PCT       chance a received piece is held for a retransmit
+ *      SHIM_RTO_MS         how long that hold is (default 200)
+ *      SHIM_RESET_PCT      chance a received piece resets the connection
+ *      SHIM_DNS_MS         time a lookup takes
+ *      SHIM_DNS_FAIL_PCT   chance a lookup fails
+ *      SHIM_START_MS       time sl_Start() takes
+ *      SHIM_ASSOC_MS       time from asking to join the AP to the connect event
+ *      SHIM_DHCP_MS        time from the connect event to the IP event
+ *  A non-blocking socket returns SL_EAGAIN or SL_EALREADY until the delay
+ *  is over, a blocking one sleeps, up to its SL_SO_RCVTIMEO. Sockets the
+ *  shim didn't open, like a test server's, are passed through untouched.
+ *
+ *  sl_Fs files are plain files in SHIM_FS_DIR, named after the SimpleLink
+ *  path with '/' turned into '_'.
+ *
+ *  The Wlan, NetCfg and Dev calls network_utils.c makes are accepted and
+ *  mostly ignored, apart from a simulated AP: sl_WlanConnect(), or
+ *  sl_Start() while a profile is stored, joins it, and the connect and IP
+ *  events reach SimpleLinkWlanEventHandler() and
+ *  SimpleLinkNetAppEventHandler() from _SlNonOsMainLoopTask() once their
+ *  time is up. Stored profiles are kept in an sl_Fs file, so like the
+ *  device's NVMEM they outlast sl_Stop() and the process.
+ */
+
+#ifndef SHIM_SIMPLELINK_H_
+#define SHIM_SIMPLELINK_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+typedef uint8_t     _u8;
+typedef int8_t      _i8;
+typedef uint16_t    _u16;
+typedef int16_t     _i16;
+typedef uint32_t    _u32;
+typedef int32_t     _i32;
+
+#define ROLE_STA            0
+#define ROLE_AP             2
+#define SL_AF_INET          AF_INET
+#define SL_SOCK_STREAM      SOCK_STREAM
+#define SL_IPPROTO_TCP      IPPROTO_TCP
+#define SL_SEC_SOCKET       100
+#define SL_SOL_SOCKET       SOL_SOCKET
+
+// Options that aren't POSIX ones, handled by the shim
+#define SL_SO_NONBLOCKING                           0x7F01
+#define SL_SO_KEEPALIVE                             0x7F02
+#define SL_SO_RCVTIMEO                              0x7F03
+#define SL_SO_SECMETHOD                             0x7F04
+#define SL_SO_SECURE_MASK                           0x7F05
+#define SL_SO_SECURE_FILES_CA_FILE_NAME             0x7F06
+#define SL_SO_SECURE_FILES_CERTIFICATE_FILE_NAME    0x7F07
+#define SL_SO_SECURE_FILES_PRIVATE_KEY_FILE_NAME    0x7F08
+
+#define SL_SO_SEC_METHOD_TLSV1_2                            5
+#define SL_SEC_MASK_TLS_ECDHE_RSA_WITH_AES_128_CBC_SHA256   (1 << 16)   /* Recorded, OpenSSL picks the cipher */
+
+#define SL_EAGAIN           (-11)
+#define SL_ECONNRESET       (-104)
+#define SL_EALREADY         (-114)
+#define SL_ESECSNOVERIFY    (-453)      /* Connected without checking the server */
+#define SL_ESECHANDSHAKE    (-340)      /* Handshake or server check failed */
+
+#define sl_Htons            htons
+#define sl_Htonl            htonl
+
+typedef struct {
+    _u32 NonblockingEnabled;
+} SlSockNonblocking_t;
+
+typedef struct {
+    _u32 KeepaliveEnabled;
+} SlSockKeepalive_t;
+
+typedef struct {
+    _u32 tv_sec;
+    _u32 tv_usec;
+} SlTimeval_t;
+
+typedef struct sockaddr_in  SlSockAddrIn_t;
+typedef struct sockaddr     SlSockAddr_t;
+
+typedef struct {
+    uint32_t latency_ms;
+    uint32_t jitter_ms;
+    uint32_t loss_pct;
+    uint32_t rto_ms;
+    uint32_t reset_pct;
+    uint32_t dns_ms;
+    uint32_t dns_fail_pct;
+    uint32_t start_ms;
+    uint32_t assoc_ms;
+    uint32_t dhcp_ms;
+    uint32_t seed;              /* For the random choices, 0 for the default */
+} ShimNetConfig;
+
+typedef struct {
+    uint32_t connects;
+    uint32_t handshakes;
+    uint32_t unverified;        /* Handshakes without a CA */
+    uint32_t bytes_sent;
+    uint32_t bytes_received;
+    uint32_t held;              /* Pieces held for a retransmit */
+    uint32_t resets;
+    uint32_t lookups;
+    uint32_t lookup_failures;
+    uint32_t starts;
+    uint32_t joins;             /* AP connect events, asked for or from a stored profile */
+} ShimNetStats;
+
+extern ShimNetStats shim_net_stats;
+
+// Replace the injected latency and loss, the environment is then ignored
+void shim_net_config(const ShimNetConfig *config);
+
+// Events are handled by the kernel here, so this just lets other threads run
+_i16 _SlNonOsMainLoopTask(void);
+
+// Returns ROLE_STA; sl_Stop() closes the sockets the shim opened
+_i16 sl_Start(const void *if_hdl, _i8 *dev_name, const void *init_callback);
+_i16 sl_Stop(_u16 timeout);
+
+_i16 sl_Socket(_i16 domain, _i16 type, _i16 protocol);
+_i16 sl_Close(_i16 sd);
+_i16 sl_Connect(_i16 sd, const SlSockAddr_t *addr, _i16 addrlen);
+_i16 sl_Send(_i16 sd, const void *buf, _i16 len, _i16 flags);
+_i16 sl_Recv(_i16 sd, void *buf, _i16 len, _i16 flags);
+_i16 sl_SetSockOpt(_i16 sd, _i16 level, _i16 optname, const void *optval, socklen_t optlen);
+
+// Address in host byte order, as the SimpleLink call returns it
+_i16 sl_NetAppDnsGetHostByName(_i8 *name, _u16 len, _u32 *ip, _u8 family);
+
+#ifndef SHIM_IMPL
+#define socket      sl_Socket
+#define close       sl_Close
+#define connect     sl_Connect
+#define send        sl_Send
+#define recv        sl_Recv
+#endif
+
+#ifndef SHIM_FS_DIR
+#define SHIM_FS_DIR         "/tmp"
+#endif
+
+#define FS_MODE_OPEN_READ                   0
+#define FS_MODE_OPEN_WRITE                  1
+#define FS_MODE_OPEN_CREATE(size, flags)    2
+#define _FS_FILE_OPEN_FLAG_COMMIT           0
+#define _FS_FILE_PUBLIC_WRITE               0
+
+// Host path of an sl_Fs file
+void shim_fs_path(const _u8 *name, char *path, size_t size);
+
+_i32 sl_FsOpen(const _u8 *name, _u32 mode, _u32 *token, _i32 *handle);
+_i32 sl_FsRead(_i32 handle, _u32 offset, _u8 *data, _u32 len);
+_i32 sl_FsWrite(_i32 handle, _u32 offset, _u8 *data, _u32 len);
+_i16 sl_FsClose(_i32 handle, _u8 *cert, _u8 *signature, _u32 signature_len);
+_i16 sl_FsDel(const _u8 *name, _u32 token);
+
+//*****************************************************************************
+// Wlan, NetCfg and Dev
+//*****************************************************************************
+
+#define SL_DRIVER_VERSION                           "shim"
+#define SL_BSSID_LENGTH                             6
+#define SL_ECLOSE                                   (-57)
+
+#define SL_WLAN_CONNECT_EVENT                       1
+#define SL_WLAN_DISCONNECT_EVENT                    2
+#define SL_NETAPP_IPV4_IPACQUIRED_EVENT             3
+#define SL_SOCKET_TX_FAILED_EVENT                   1
+#define SL_USER_INITIATED_DISCONNECTION             200
+#define SL_IPV4_BYTE(val, index)                    (((val) >> ((index) * 8)) & 0xFF)
+
+#define SL_SEC_TYPE_OPEN                            0
+#define SL_SEC_TYPE_WEP                             1
+#define SL_SEC_TYPE_WPA_WPA2                        2
+
+#define SL_DEVICE_GENERAL_CONFIGURATION             1
+#define SL_DEVICE_GENERAL_CONFIGURATION_DATE_TIME   11
+#define SL_DEVICE_GENERAL_VERSION                   12
+#define SL_POLICY_CONNECTION                        0x10
+#define SL_POLICY_SCAN                              0x20
+#define SL_POLICY_PM                                0x30
+#define SL_NORMAL_POLICY                            0
+#define SL_CONNECTION_POLICY(Auto, Fast, Open, anyP2P, autoSmartConfig) \
+    (((Auto) << 0) | ((Fast) << 1) | ((Open) << 2) | ((anyP2P) << 3) | ((autoSmartConfig) << 4))
+#define SL_SCAN_POLICY(Enable)                      ((Enable) << 0)
+#define SL_IPV4_STA_P2P_CL_DHCP_ENABLE              4
+#define SL_WLAN_CFG_GENERAL_PARAM_ID                1
+#define WLAN_GENERAL_PARAM_OPT_STA_TX_POWER         10
+#define SL_REMOVE_RX_FILTER                         1
+
+typedef struct {
+    _u8 ssid_name[32];
+    _u8 ssid_len;
+    _u8 bssid[SL_BSSID_LENGTH];
+    _u8 reason_code;
+} slWlanConnectAsyncResponse_t;
+
+typedef struct {
+    _u32 Event;
+    union {
+        slWlanConnectAsyncResponse_t STAandP2PModeWlanConnected;
+        slWlanConnectAsyncResponse_t STAandP2PModeDisconnected;
+    } EventData;
+} SlWlanEvent_t;
+
+typedef struct {
+    _u32 ip;
+    _u32 gateway;
+    _u32 dns;
+} SlIpV4AcquiredAsync_t;
+
+typedef struct {
+    _u32 Event;
+    union {
+        SlIpV4AcquiredAsync_t ipAcquiredV4;
+    } EventData;
+} SlNetAppEvent_t;
+
+typedef struct {
+    _u32 Event;
+    union {
+        struct {
+            _i8 status;
+            _u32 sender;
+        } deviceEvent;
+    } EventData;
+} SlDeviceEvent_t;
+
+typedef struct {
+    _u32 Event;
+    struct {
+        struct {
+            _i16 status;
+            _u8 sd;
+        } SockTxFailData;
+    } socketAsyncEvent;
+} SlSockEvent_t;
+
+typedef struct {
+    _u32 Event;
+} SlHttpServerEvent_t;
+
+typedef struct {
+    _u32 Response;
+} SlHttpServerResponse_t;
+
+typedef struct {
+    _u32 ChipFwAndPhyVersion_ChipId;
+    struct {
+        _u8 FwVersion[4];
+        _u8 PhyVersion[4];
+    } ChipFwAndPhyVersion;
+    _u8 NwpVersion[4];
+    _u16 RomVersion;
+} SlVersionFull;
+
+typedef struct {
+    _u8 FilterIdMask[8];
+    _u8 Padding[4];
+} _WlanRxFilterOperationCommandBuff_t;
+
+typedef struct {
+    _u8 Type;
+    char *Key;
+    _u8 KeyLen;
+} SlSecParams_t;
+
+_i16 sl_WlanSetMode(_u8 mode);
+_i16 sl_WlanPolicySet(_u8 type, _u8 policy, _u8 *val, _u8 val_len);
+_i16 sl_WlanProfileAdd(const void *name, _i16 name_len, const _u8 *mac, const SlSecParams_t *sec,
+                       const void *sec_ext, _u32 priority, _u32 options);
+_i16 sl_WlanProfileDel(_i16 index);
+_i16 sl_WlanConnect(const void *name, _i16 name_len, const _u8 *mac, const SlSecParams_t *sec, const void *sec_ext);
+_i16 sl_WlanDisconnect(void);
+_i16 sl_WlanSet(_u16 config_id, _u16 config_opt, _u16 config_len, const _u8 *value);
+_i16 sl_WlanRxFilterSet(_u8 op, const _u8 *buf, _u16 len);
+_i32 sl_NetCfgSet(_u8 config_id, _u8 config_opt, _u8 config_len, const _u8 *value);
+_i16 sl_NetAppMDNSUnRegisterService(const void *name, _u8 name_len);
+_i32 sl_DevGet(_u8 config_id, _u8 *config_opt, _u8 *config_len, _u8 *value);
+_i32 sl_DevSet(_u8 config_id, _u8 config_opt, _u8 config_len, const _u8 *value);
+
+#endif /* SHIM_SIMPLELINK_H_ */
@@ -0,0 +1,11 @@
+/*
+ * uart.h
+ *
+ *  Empty host stand-in for the SDK header, so network_utils.c builds
+ *  against the shim. Nothing from it is used off the device.
+ */
+
+#ifndef SHIM_UART_H_
+#define SHIM_UART_H_
+
+#endif /* SHIM_UART_H_ */
@@ -0,0 +1,28 @@
+/*
+ * uart_if.h
+ *
+ *  Host stand-in for the SDK's UART console. Report() writes to stderr
+ *  when SHIM_UART is set in the environment and is silent otherwise, so
+ *  the network code's logging doesn't bury a tool's own output.
+ */
+
+#ifndef SHIM_UART_IF_H_
+#define SHIM_UART_IF_H_
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static inline int Report(const char *format, ...) {
+    va_list args;
+    int ret = 0;
+
+    if (getenv("SHIM_UART")) {
+        va_start(args, format);
+        ret = vfprintf(stderr, format, args);
+        va_end(args);
+    }
+    return ret;
+}
+
+#endif /* SHIM_UART_IF_H_ */
@@ -0,0 +1,408 @@
+/*
+ * tls_bench.c
+ *
+ *  Linux benchmark and check for the IoT TLS channel, run through the
+ *  SimpleLink shim against a local HTTPS stand-in. The device's own
+ *  network_utils.c is built in, so the sockets are opened and the
+ *  handshakes judged by the real tls_socket() and tls_connected(). A
+ *  throwaway RSA key and self-signed certificate are made at start and
+ *  written where the device keeps its own (/cert/rootCA.der, client.der
+ *  and private.der), and the stand-in asks for the client certificate as
+ *  AWS IoT does. Checked first, through wifi_connect_poll() and the shim's
+ *  simulated AP:
+ *      - a first connect takes the full reset and saves the config
+ *      - the next one takes the fast path from the saved config
+ *      - with the AP profile gone, the fast path falls back to the reset
+ *      - a config file of the old 8-byte format reads as missing
+ *  then the last connect's socket is handed to the channel and measured:
+ *      - full handshakes, as a reconnect pays them
+ *      - request and reply on the open channel
+ *  and checked:
+ *      - a server certificate the CA doesn't match fails the handshake
+ *      - so does a missing CA file
+ *      - the channel comes back after a drop, with the replies that went
+ *        missing counted
+ *  The slowest wifi_connect_poll(), tls_channel_poll() and
+ *  tls_channel_setup() calls are reported. SHIM_START_MS shows in the
+ *  first and the lookup time SHIM_DNS_MS in the first and last, never in
+ *  a channel poll.
+ *
+ *  Latency, loss and resets come from the shim's SHIM_* variables, e.g.
+ *      SHIM_LATENCY_MS=40 SHIM_RESET_PCT=2 SHIM_ASSOC_MS=300 ./tls_bench
+ *  The fallback check waits out WIFI_FAST_TIMEOUT_MS. SHIM_UART=1 shows
+ *  the device's log.
+ *
+ *  Host-only, not part of the CCS build. From the tools directory:
+ *      gcc -O2 -Ishim -I.. -DDNS_CACHE_PERSIST=0 -o tls_bench tls_bench.c shim/simplelink.c \
+ *          ../utils/network_utils.c ../utils/tls_channel.c ../utils/dns_cache.c ../utils/flash_record.c \
+ *          ../utils/fnv.c -lssl -lcrypto -lpthread
+ *      ./tls_bench [handshakes] [exchanges]
+ */
+
+#ifndef ccs
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include <openssl/evp.h>
+
+#include "simplelink.h"
+#include "utils/network_utils.h"
+#include "utils/tls_channel.h"
+#include "utils/dns_cache.h"
+
+// The stand-in's socket isn't the device's, so sl_Stop() mustn't close it
+#undef socket
+
+#define CA_FILE         SL_SSL_CA_CERT
+#define CLIENT_FILE     SL_SSL_CLIENT
+#define KEY_FILE        SL_SSL_PRIVATE
+#define HOST            "localhost"
+#define REPLY           "HTTP/1.1 200 OK\r\nContent-Length: 4\r\n\r\npong"
+#define WAIT_MS         20000
+
+static int listen_fd;
+static uint16_t server_port;
+static X509 *server_cert, *other_cert;
+static EVP_PKEY *server_key, *other_key;
+
+static uint32_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+//*****************************************************************************
+// Certificates
+//*****************************************************************************
+
+static X509 *make_cert(EVP_PKEY *key, const char *name) {
+    X509 *cert = X509_new();
+    X509_NAME *subject;
+
+    X509_set_version(cert, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), -60);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 24 * 3600);
+    X509_set_pubkey(cert, key);
+    subject = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(subject, "CN", MBSTRING_ASC, (const unsigned char *)name, -1, -1, 0);
+    X509_set_issuer_name(cert, subject);
+    X509_sign(cert, key, EVP_sha256());
+    return cert;
+}
+
+static void write_der(const char *name, X509 *cert, EVP_PKEY *key) {
+    char path[256];
+    FILE *f;
+
+    shim_fs_path((const _u8 *)name, path, sizeof(path));
+    if (!(f = fopen(path, "wb")) || !(cert ? i2d_X509_fp(f, cert) : i2d_PrivateKey_fp(f, key))) {
+        perror(path);
+        exit(1);
+    }
+    fclose(f);
+}
+
+// One key and certificate do for the server, the client and the CA, the
+// other one is a CA that doesn't match
+static void make_certs(void) {
+    other_key = EVP_RSA_gen(2048);
+    other_cert = make_cert(other_key, "other");
+    server_key = EVP_RSA_gen(2048);
+    server_cert = make_cert(server_key, HOST);
+    write_der(CA_FILE, server_cert, NULL);
+    write_der(CLIENT_FILE, server_cert, NULL);
+    write_der(KEY_FILE, NULL, server_key);
+}
+
+//*****************************************************************************
+// HTTPS stand-in
+//*****************************************************************************
+
+// Answer every request on the connection until the client goes
+static void serve(SSL *ssl) {
+    char req[1024];
+    int len = 0, got;
+
+    while ((got = SSL_read(ssl, req + len, sizeof(req) - 1 - len)) > 0) {
+        char *end;
+        len += got;
+        req[len] = '\0';
+        while ((end = strstr(req, "\r\n\r\n"))) {
+            if (SSL_write(ssl, REPLY, strlen(REPLY)) <= 0) {
+                return;
+            }
+            len -= end + 4 - req;
+            memmove(req, end + 4, len + 1);
+        }
+        if (len == sizeof(req) - 1) {
+            return;
+        }
+    }
+}
+
+static void *server(void *arg) {
+    SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+    int fd;
+
+    SSL_CTX_use_certificate(ctx, server_cert);
+    SSL_CTX_use_PrivateKey(ctx, server_key);
+    X509_STORE_add_cert(SSL_CTX_get_cert_store(ctx), server_cert);
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT, NULL);
+    while ((fd = accept(listen_fd, NULL, NULL)) >= 0) {
+        SSL *ssl = SSL_new(ctx);
+        SSL_set_fd(ssl, fd);
+        if (SSL_accept(ssl) == 1) {
+            serve(ssl);
+            SSL_shutdown(ssl);
+        }
+        SSL_free(ssl);
+        close(fd);
+    }
+    return NULL;
+}
+
+static void start_server(void) {
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    pthread_t thread;
+    int one = 1;
+
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_fd, 4) < 0) {
+        perror("server");
+        exit(1);
+    }
+    getsockname(listen_fd, (struct sockaddr *)&addr, &addr_len);
+    server_port = ntohs(addr.sin_port);
+    pthread_create(&thread, NULL, server, NULL);
+}
+
+//*****************************************************************************
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Longest single call of each, the game makes polls between ticks and the
+// setup from its menus, the Wi-Fi connect polls between frames of its screen
+static uint64_t poll_ns_max, setup_ns_max, wifi_ns_max;
+
+// Connect from scratch as main.c does, returns wifi_connect_poll()'s result
+static int wifi_connect(WifiConnect *wc) {
+    uint64_t begin, took;
+    int ret;
+
+    wifi_connect_start(wc, now_ms());
+    do {
+        begin = now_ns();
+        ret = wifi_connect_poll(wc, now_ms());
+        took = now_ns() - begin;
+        wifi_ns_max = (took > wifi_ns_max) ? took : wifi_ns_max;
+    } while (ret == WIFI_PENDING);
+    return ret;
+}
+
+static void step(TlsChannel *ch) {
+    uint64_t begin = now_ns(), took;
+
+    tls_channel_setup(ch, now_ms());
+    took = now_ns() - begin;
+    setup_ns_max = (took > setup_ns_max) ? took : setup_ns_max;
+    begin = now_ns();
+    tls_channel_poll(ch, now_ms());
+    took = now_ns() - begin;
+    poll_ns_max = (took > poll_ns_max) ? took : poll_ns_max;
+}
+
+// Poll until the channel opens, returns -1 if it doesn't in time
+static int wait_open(TlsChannel *ch, uint32_t limit_ms) {
+    uint32_t start = now_ms();
+
+    while (!tls_channel_open(ch)) {
+        step(ch);
+        if (now_ms() - start > limit_ms) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Reconnect and poll until the handshake ends, returns -1 if it failed
+static int handshake(TlsChannel *ch) {
+    uint32_t failures = ch->stats.failures;
+    uint32_t start = now_ms();
+
+    tls_channel_reconnect(ch, now_ms());
+    while (!tls_channel_open(ch) && ch->stats.failures == failures && now_ms() - start < WAIT_MS) {
+        step(ch);
+    }
+    return tls_channel_open(ch) ? 0 : -1;
+}
+
+// One request and its reply, returns -1 if the channel dropped
+static int exchange(TlsChannel *ch) {
+    static const char request[] = "GET /ping HTTP/1.1\r\nHost: " HOST "\r\n\r\n";
+    char reply[64];
+    int sent = 0, got = 0, ret;
+    uint32_t start = now_ms();
+
+    while (sent < (int)sizeof(request) - 1) {
+        if ((ret = tls_channel_send(ch, request + sent, sizeof(request) - 1 - sent, now_ms())) < 0) {
+            return -1;
+        }
+        sent += ret;
+    }
+    while (got < (int)strlen(REPLY)) {
+        if ((ret = tls_channel_recv(ch, reply + got, sizeof(reply) - got, now_ms())) < 0) {
+            return -1;
+        }
+        got += ret;
+        if (now_ms() - start > WAIT_MS) {
+            return -1;
+        }
+    }
+    return memcmp(reply, REPLY, strlen(REPLY)) == 0 ? 0 : -1;
+}
+
+int main(int argc, char **argv) {
+    static TlsChannel channel;
+    static const uint32_t old_config[2] = {WIFI_CONFIG_MAGIC, 0};
+    WifiConnect wc;
+    int handshakes = (argc > 1) ? atoi(argv[1]) : 20;
+    int exchanges = (argc > 2) ? atoi(argv[2]) : 200;
+    int i, failures = 0, lost = 0;
+    uint32_t start, took, drops, fallback_ms;
+    _i32 handle;
+    _u32 token = 0;
+
+    make_certs();
+    start_server();
+    g_app_config.host = (signed char *)HOST;
+    g_app_config.port = server_port;
+    dns_cache_init(NULL, now_ms);
+    channel.sock = -1;
+
+    // A device that has never connected
+    sl_FsDel((_u8 *)WIFI_CONFIG_FILE, 0);
+    sl_WlanProfileDel(0xFF);
+    if (wifi_connect(&wc) != 0 || wifi_stats.full != 1) {
+        printf("FAIL: first Wi-Fi connect (%s, error %ld)\n", wifi_state_name(wc.failed_state), wc.error);
+        failures++;
+    }
+    wifi_connect_cancel(&wc);
+
+    // The saved config and the profile the reset stored are still there
+    if (wifi_connect(&wc) != 0 || wifi_stats.fast != 1) {
+        printf("FAIL: Wi-Fi connect didn't take the fast path\n");
+        failures++;
+    }
+    wifi_connect_cancel(&wc);
+
+    // The profile is gone, so the device never joins on its own
+    sl_WlanProfileDel(0xFF);
+    start = now_ms();
+    if (wifi_connect(&wc) != 0 || wifi_stats.fallbacks != 1 || wifi_stats.full != 2) {
+        printf("FAIL: Wi-Fi connect didn't fall back to the full reset\n");
+        failures++;
+    }
+    fallback_ms = now_ms() - start;
+    wifi_connect_cancel(&wc);
+
+    // A config saved before the hashed record, it must not count as a match
+    if (sl_FsOpen((_u8 *)WIFI_CONFIG_FILE, FS_MODE_OPEN_CREATE(sizeof(old_config), 0), &token, &handle) == 0) {
+        sl_FsWrite(handle, 0, (_u8 *)old_config, sizeof(old_config));
+        sl_FsClose(handle, 0, 0, 0);
+    }
+    if (wifi_connect(&wc) != 0 || wifi_stats.full != 3 || wifi_stats.fast != 1) {
+        printf("FAIL: old config file wasn't ignored\n");
+        failures++;
+    }
+    printf("Wi-Fi connect: %u ms with the full reset, %u ms by the fast path, %u ms falling back; %u sl_Start calls\n",
+           wifi_stats.full_ms, wifi_stats.fast_ms, fallback_ms, shim_net_stats.starts);
+
+    // The channel carries on with the connect's socket
+    tls_channel_adopt(&channel, wc.sock, wc.tls_ms, now_ms());
+
+    // Full handshakes, verified with the CA
+    start = now_ms();
+    for (i = 0; i < handshakes; i++) {
+        if (handshake(&channel) < 0 && wait_open(&channel, WAIT_MS) < 0) {
+            printf("FAIL: handshake %d\n", i);
+            failures++;
+            break;
+        }
+    }
+    took = now_ms() - start;
+    printf("%u handshakes: %.1f ms each by the channel's count, %.1f ms by the clock, %u failed\n",
+           channel.stats.handshakes, channel.stats.handshakes ? (double)channel.stats.handshake_ms_total /
+           channel.stats.handshakes : 0.0, (double)took / (handshakes ? handshakes : 1), channel.stats.failures);
+
+    // Requests on the channel kept open, drops are reconnected
+    drops = channel.stats.drops;
+    start = now_ms();
+    for (i = 0; i < exchanges; i++) {
+        if (exchange(&channel) < 0) {
+            lost++;
+            if (wait_open(&channel, TLS_BACKOFF_MAX_MS + WAIT_MS) < 0) {
+                printf("FAIL: channel didn't come back after a drop\n");
+                failures++;
+                break;
+            }
+        }
+    }
+    took = now_ms() - start;
+    printf("%d exchanges on the open channel: %.2f ms each (%.1f ms to first reply byte), %d lost to %u drops\n",
+           exchanges, (double)took / (exchanges ? exchanges : 1), channel.stats.exchanges ?
+           (double)channel.stats.reply_ms_total / channel.stats.exchanges : 0.0, lost, channel.stats.drops - drops);
+    if (lost && !shim_net_stats.resets && !shim_net_stats.held) {
+        printf("FAIL: replies lost without injected faults\n");
+        failures++;
+    }
+
+    // The wrong CA fails the handshake
+    write_der(CA_FILE, other_cert, NULL);
+    if (handshake(&channel) == 0 || channel.state != TLS_BACKOFF) {
+        printf("FAIL: server accepted with the wrong CA\n");
+        failures++;
+    }
+
+    // So does a missing one, tls_socket() always asks for the server check
+    sl_FsDel((_u8 *)CA_FILE, 0);
+    if (handshake(&channel) == 0 || channel.state != TLS_BACKOFF) {
+        printf("FAIL: server accepted without a CA file\n");
+        failures++;
+    }
+
+    // And the right one connects again
+    write_der(CA_FILE, server_cert, NULL);
+    if (wait_open(&channel, TLS_BACKOFF_MAX_MS + WAIT_MS) < 0 || exchange(&channel) < 0) {
+        printf("FAIL: channel didn't come back with the CA restored\n");
+        failures++;
+    }
+    tls_channel_close(&channel);
+    wifi_connect_cancel(&wc);
+
+    printf("Slowest call: %.2f ms to poll the Wi-Fi connect, %.2f ms to poll the channel, "
+           "%.2f ms to set it up (lookup and socket options)\n",
+           wifi_ns_max / 1e6, poll_ns_max / 1e6, setup_ns_max / 1e6);
+    printf("Shim: %u connects, %u lookups, %u bytes out, %u in, %u pieces held, %u resets\n",
+           shim_net_stats.connects, shim_net_stats.lookups, shim_net_stats.bytes_sent,
+           shim_net_stats.bytes_received, shim_net_stats.held, shim_net_stats.resets);
+    printf("%d failure(s)\n", failures);
+    return failures ? 1 : 0;
+}
+
+#endif
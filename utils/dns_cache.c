@@ -0,0 +1,188 @@
+/*
+ * dns_cache.c
+ *
+ *  Host name lookup cache.
+ */
+
+#include "dns_cache.h"
+
+#include <string.h>
+
+#include "flash_record.h"
+
+// Simplelink includes
+#include "simplelink.h"
+
+#define FILE_MAGIC      0x53444E54      /* "TNDS" */
+
+typedef struct {
+    uint32_t magic;
+    DnsCacheEntry entries[DNS_CACHE_ENTRIES];   /* expires holds the ms left */
+    uint32_t hash;                              /* FNV-1a of everything above */
+} DnsCacheFile;
+
+DnsCacheStats dns_cache_stats;
+
+static DnsCacheEntry entries[DNS_CACHE_ENTRIES];
+static DnsResolver resolver;
+static DnsClock clock_ms;
+static uint8_t loaded = 0;
+
+static int32_t sl_resolve(const char *host, uint32_t *ip) {
+    _u32 addr;
+    int32_t ret = sl_NetAppDnsGetHostByName((_i8 *)host, strlen(host), &addr, SL_AF_INET);
+    // addr isn't filled in when the lookup fails
+    if (ret >= 0) {
+        *ip = addr;
+    }
+    return ret;
+}
+
+// Entry still good at now, wrap-safe
+static int live(const DnsCacheEntry *entry, uint32_t now) {
+    return (int32_t)(entry->expires - now) > 0;
+}
+
+#if DNS_CACHE_PERSIST
+
+// Store the resolved addresses with the time they have left. Time spent
+// switched off isn't counted, a stale address is caught by the connect.
+static void save(uint32_t now) {
+    static DnsCacheFile file;
+    int i;
+
+    memset(&file, 0, sizeof(file));
+    file.magic = FILE_MAGIC;
+    for (i = 0; i < DNS_CACHE_ENTRIES; i++) {
+        if (entries[i].host[0] && !entries[i].error && live(&entries[i], now)) {
+            file.entries[i] = entries[i];
+            file.entries[i].expires = entries[i].expires - now;
+        }
+    }
+    flash_record_save(DNS_CACHE_FILE, &file, sizeof(file));
+}
+
+static void load(uint32_t now) {
+    static DnsCacheFile file;
+    int i;
+
+    if (flash_record_load(DNS_CACHE_FILE, &file, sizeof(file)) < 0 || file.magic != FILE_MAGIC) {
+        return;
+    }
+    for (i = 0; i < DNS_CACHE_ENTRIES; i++) {
+        if (file.entries[i].host[0] && file.entries[i].expires <= DNS_CACHE_TTL) {
+            entries[i] = file.entries[i];
+            entries[i].host[DNS_CACHE_HOST_SIZE - 1] = '\0';
+            entries[i].expires += now;
+        }
+    }
+}
+
+#else
+
+static void save(uint32_t now) {
+    (void)now;
+}
+
+static void load(uint32_t now) {
+    (void)now;
+}
+
+#endif
+
+static int find_slot(const char *host) {
+    int i;
+    for (i = 0; i < DNS_CACHE_ENTRIES; i++) {
+        if (entries[i].host[0] && strcmp(entries[i].host, host) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Slot for a new entry: a free or expired one, else the one closest to expiring
+static int victim_slot(uint32_t now) {
+    int i, slot = 0;
+    for (i = 0; i < DNS_CACHE_ENTRIES; i++) {
+        if (!entries[i].host[0] || !live(&entries[i], now)) {
+            return i;
+        }
+        if ((int32_t)(entries[i].expires - entries[slot].expires) < 0) {
+            slot = i;
+        }
+    }
+    dns_cache_stats.evictions++;
+    return slot;
+}
+
+// DNS Cache Init
+void dns_cache_init(DnsResolver resolve, DnsClock now) {
+    resolver = resolve ? resolve : sl_resolve;
+    clock_ms = now;
+    memset(entries, 0, sizeof(entries));
+    loaded = 0;
+}
+
+// DNS Cache Resolve
+int32_t dns_cache_resolve(const char *host, uint32_t *ip) {
+    uint32_t now;
+    int32_t ret;
+    int slot;
+
+    if (!clock_ms) {
+        return sl_resolve(host, ip);
+    }
+    now = clock_ms();
+    if (!loaded) {
+        load(now);
+        loaded = 1;
+    }
+
+    slot = find_slot(host);
+    if (slot >= 0 && live(&entries[slot], now)) {
+        if (entries[slot].error) {
+            dns_cache_stats.negative_hits++;
+            return entries[slot].error;
+        }
+        dns_cache_stats.hits++;
+        *ip = entries[slot].ip;
+        return 0;
+    }
+    if (slot >= 0) {
+        dns_cache_stats.expired++;
+    }
+
+    dns_cache_stats.misses++;
+    ret = resolver(host, ip);
+    if (strlen(host) >= DNS_CACHE_HOST_SIZE) {
+        return ret;
+    }
+    if (slot < 0) {
+        slot = victim_slot(now);
+    }
+    strcpy(entries[slot].host, host);
+    if (ret < 0) {
+        dns_cache_stats.failures++;
+        entries[slot].ip = 0;
+        entries[slot].error = ret;
+        entries[slot].expires = now + DNS_CACHE_NEG_TTL;
+        return ret;
+    }
+    entries[slot].ip = *ip;
+    entries[slot].error = 0;
+    entries[slot].expires = now + DNS_CACHE_TTL;
+    save(now);
+    return 0;
+}
+
+// DNS Cache Invalidate
+void dns_cache_invalidate(const char *host) {
+    int slot = find_slot(host);
+    if (slot >= 0) {
+        memset(&entries[slot], 0, sizeof(DnsCacheEntry));
+        dns_cache_stats.invalidated++;
+        if (clock_ms) {
+            save(clock_ms());
+        }
+    }
+}
@@ -0,0 +1,65 @@
+/*
+ * dns_cache.h
+ *
+ *  Cache of host name lookups, so the map host and the IoT host are each
+ *  resolved once instead of on every connection. SimpleLink doesn't report
+ *  a record's TTL, so an address is trusted for DNS_CACHE_TTL and dropped
+ *  early if connecting to it fails. Failed lookups are remembered for
+ *  DNS_CACHE_NEG_TTL so a dead name doesn't cost a round trip per retry.
+ *  With DNS_CACHE_PERSIST the addresses are kept in serial flash and
+ *  reused after a reboot for what was left of their TTL.
+ */
+
+#ifndef UTILS_DNS_CACHE_H_
+#define UTILS_DNS_CACHE_H_
+
+#include <stdint.h>
+
+#define DNS_CACHE_ENTRIES       4
+#define DNS_CACHE_HOST_SIZE     48
+#define DNS_CACHE_TTL           600000      /* ms an address is trusted */
+#define DNS_CACHE_NEG_TTL       30000       /* ms a failed lookup is remembered */
+
+#ifndef DNS_CACHE_PERSIST
+#define DNS_CACHE_PERSIST       1
+#endif
+#define DNS_CACHE_FILE          "ttcache/dns"
+
+typedef struct {
+    char host[DNS_CACHE_HOST_SIZE];     /* Empty when the slot is free */
+    uint32_t ip;                        /* Host byte order */
+    uint32_t expires;                   /* Clock time the entry runs out */
+    int32_t error;                      /* Resolver error of a failed lookup, 0 if it resolved */
+} DnsCacheEntry;
+
+typedef struct {
+    uint32_t hits;
+    uint32_t negative_hits;     /* Failures answered from the cache */
+    uint32_t misses;            /* Lookups passed on to the resolver */
+    uint32_t failures;          /* Of those, the ones that failed */
+    uint32_t expired;
+    uint32_t invalidated;       /* Dropped after a connect failure */
+    uint32_t evictions;
+} DnsCacheStats;
+
+extern DnsCacheStats dns_cache_stats;
+
+// Resolves a host to an address in host byte order, returns < 0 on failure
+typedef int32_t (*DnsResolver)(const char *host, uint32_t *ip);
+
+// Milliseconds from any fixed point, allowed to wrap
+typedef uint32_t (*DnsClock)(void);
+
+// Set where lookups and time come from. A NULL resolver uses SimpleLink.
+// Persisted entries are read on the first lookup, once the network
+// processor is running.
+void dns_cache_init(DnsResolver resolver, DnsClock clock);
+
+// Address of a host from the cache or the resolver, returns 0 or the
+// resolver's error. Before dns_cache_init every lookup goes to SimpleLink.
+int32_t dns_cache_resolve(const char *host, uint32_t *ip);
+
+// Forget a host, for when its address didn't work
+void dns_cache_invalidate(const char *host);
+
+#endif /* UTILS_DNS_CACHE_H_ */
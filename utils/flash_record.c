@@ -0,0 +1,55 @@
+/*
+ * flash_record.c
+ *
+ *  Hashed records in serial flash.
+ */
+
+#include "flash_record.h"
+
+#include <string.h>
+
+#include "fnv.h"
+
+// Simplelink includes
+#include "simplelink.h"
+
+// Record Save
+int flash_record_save(const char *name, void *record, uint32_t size) {
+    uint32_t hash = fnv1a(FNV_INIT, (const uint8_t *)record, size - sizeof(hash));
+    _i32 handle, written = -1;
+    _u32 token = 0;
+
+    memcpy((uint8_t *)record + size - sizeof(hash), &hash, sizeof(hash));
+    if (sl_FsOpen((_u8 *)name, FS_MODE_OPEN_WRITE, &token, &handle) >= 0) {
+        written = sl_FsWrite(handle, 0, (_u8 *)record, size);
+        sl_FsClose(handle, 0, 0, 0);
+    }
+    // Missing, or made for a smaller record before a format change
+    if (written != (_i32)size) {
+        sl_FsDel((_u8 *)name, 0);
+        if (sl_FsOpen((_u8 *)name, FS_MODE_OPEN_CREATE(size, _FS_FILE_OPEN_FLAG_COMMIT | _FS_FILE_PUBLIC_WRITE),
+                      &token, &handle) < 0) {
+            return -1;
+        }
+        written = sl_FsWrite(handle, 0, (_u8 *)record, size);
+        sl_FsClose(handle, 0, 0, 0);
+    }
+    return (written == (_i32)size) ? 0 : -1;
+}
+
+// Record Load
+int flash_record_load(const char *name, void *record, uint32_t size) {
+    uint32_t hash;
+    _i32 handle, got = -1;
+    _u32 token = 0;
+
+    if (sl_FsOpen((_u8 *)name, FS_MODE_OPEN_READ, &token, &handle) >= 0) {
+        got = sl_FsRead(handle, 0, (_u8 *)record, size);
+        sl_FsClose(handle, 0, 0, 0);
+    }
+    if (got != (_i32)size) {
+        return -1;
+    }
+    memcpy(&hash, (const uint8_t *)record + size - sizeof(hash), sizeof(hash));
+    return (hash == fnv1a(FNV_INIT, (const uint8_t *)record, size - sizeof(hash))) ? 0 : -1;
+}
@@ -0,0 +1,26 @@
+/*
+ * flash_record.h
+ *
+ *  Small fixed-size records kept in the serial-flash file system, like the
+ *  map cache index, the DNS cache and the leaderboard queue. A record ends
+ *  in a uint32_t FNV-1a of the bytes before it, so a torn or damaged file
+ *  reads as missing instead of as garbage. Files are created fail-safe, a
+ *  reset part way through a write leaves the copy before it. The device
+ *  must be started to reach the file system.
+ */
+
+#ifndef UTILS_FLASH_RECORD_H_
+#define UTILS_FLASH_RECORD_H_
+
+#include <stdint.h>
+
+// Fill in the trailing hash of a record of size bytes and write it, creating
+// the file if it is missing or too small for it. Returns 0 or -1.
+int flash_record_save(const char *name, void *record, uint32_t size);
+
+// Read a record of size bytes, returns 0 if the file held a whole one with
+// the right hash, else -1 and the record's contents are undefined. Magic
+// numbers and versions are left to the caller.
+int flash_record_load(const char *name, void *record, uint32_t size);
+
+#endif /* UTILS_FLASH_RECORD_H_ */
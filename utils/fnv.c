@@ -0,0 +1,16 @@
+/*
+ * fnv.c
+ *
+ *  FNV-1a hash.
+ */
+
+#include "fnv.h"
+
+// FNV-1a
+uint32_t fnv1a(uint32_t hash, const uint8_t *data, uint32_t len) {
+    uint32_t i;
+    for (i = 0; i < len; i++) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
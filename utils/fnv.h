@@ -0,0 +1,19 @@
+/*
+ * fnv.h
+ *
+ *  FNV-1a, the one hash used across the game: replay logs, the manifest's
+ *  file hashes, cached map files and the records kept in serial flash. It
+ *  catches damage and tells files apart, it isn't meant to resist anyone.
+ */
+
+#ifndef UTILS_FNV_H_
+#define UTILS_FNV_H_
+
+#include <stdint.h>
+
+#define FNV_INIT        2166136261u     /* FNV-1a offset basis */
+
+// Hash a piece of data, pass FNV_INIT to start and the result to go on
+uint32_t fnv1a(uint32_t hash, const uint8_t *data, uint32_t len);
+
+#endif /* UTILS_FNV_H_ */
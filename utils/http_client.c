@@ -0,0 +1,268 @@
+/*
+ * http_client.c
+ *
+ *  Keep-alive HTTP/1.1 client.
+ */
+
+#include "http_client.h"
+#include "dns_cache.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Simplelink includes
+#include "simplelink.h"
+
+static int set_blocking(HttpClient *client, uint8_t blocking) {
+    SlSockNonblocking_t nonblocking;
+
+    nonblocking.NonblockingEnabled = !blocking;
+    if (sl_SetSockOpt(client->sock, SL_SOL_SOCKET, SL_SO_NONBLOCKING, &nonblocking, sizeof(nonblocking)) < 0) {
+        return -1;
+    }
+    client->sock_blocking = blocking;
+    return 0;
+}
+
+// The connect is always stepped without blocking, the timeout only holds
+// for a blocking receive
+static int open_socket(HttpClient *client) {
+    SlTimeval_t timeout;
+
+    if (dns_cache_resolve(client->host, &client->ip) < 0) {
+        return HTTP_E_DNS;
+    }
+    if ((client->sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+        client->sock = -1;
+        return HTTP_E_CONNECT;
+    }
+    timeout.tv_sec = HTTP_RECV_TIMEOUT_MS / 1000;
+    timeout.tv_usec = (HTTP_RECV_TIMEOUT_MS % 1000) * 1000;
+    if (set_blocking(client, 0) < 0 ||
+        sl_SetSockOpt(client->sock, SL_SOL_SOCKET, SL_SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0) {
+        http_client_close(client);
+        return HTTP_E_CONNECT;
+    }
+    client->rx_pos = client->rx_len = 0;
+    return 0;
+}
+
+// Step a non-blocking connect, SL_EALREADY while it is under way
+static int connect_step(HttpClient *client) {
+    struct sockaddr_in server_addr;
+
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(client->port);
+    server_addr.sin_addr.s_addr = htonl(client->ip);
+    return connect(client->sock, (struct sockaddr *)&server_addr, sizeof(server_addr));
+}
+
+// Only a 200 or 206 response's body is passed on, others are read and dropped
+static void body_filter(const char *data, int len, void *ctx) {
+    HttpClient *client = (HttpClient *)ctx;
+    if (client->parser.status == 200 || client->parser.status == 206) {
+        client->sink(data, len, client->ctx);
+    }
+}
+
+// Start sending the request, on the open connection if there is one
+static int begin_attempt(HttpClient *client) {
+    int ret;
+
+    client->reused = (client->sock >= 0);
+    client->received = 0;
+    client->sent = 0;
+    http_parser_init(&client->parser, body_filter, client);
+    if (client->reused) {
+        client->stats.reused++;
+        client->phase = HC_SENDING;
+        return 0;
+    }
+    if ((ret = open_socket(client)) < 0) {
+        return ret;
+    }
+    client->phase = HC_CONNECTING;
+    return 0;
+}
+
+// Do what can be done without waiting, returns HTTP_PENDING, 0 once the
+// response is complete or HTTP_E_*
+static int step(HttpClient *client) {
+    int ret;
+
+    for (;;) {
+        if (client->phase == HC_CONNECTING) {
+            ret = connect_step(client);
+            if (ret == SL_EALREADY) {
+                return HTTP_PENDING;
+            }
+            if (ret < 0) {
+                // The address may be stale, look it up again next time
+                dns_cache_invalidate(client->host);
+                return HTTP_E_CONNECT;
+            }
+            client->stats.connects++;
+            client->phase = HC_SENDING;
+        } else if (client->sock_blocking != client->blocking && set_blocking(client, client->blocking) < 0) {
+            return HTTP_E_SEND;
+        } else if (client->phase == HC_SENDING) {
+            ret = send(client->sock, client->request + client->sent, client->request_len - client->sent, 0);
+            if (ret == SL_EAGAIN) {
+                return HTTP_PENDING;
+            }
+            if (ret <= 0) {
+                return HTTP_E_SEND;
+            }
+            client->sent += ret;
+            if (client->sent == client->request_len) {
+                client->phase = HC_RECEIVING;
+            }
+        } else if (client->phase == HC_RECEIVING) {
+            if (client->rx_pos == client->rx_len) {
+                int got = recv(client->sock, client->rx, sizeof(client->rx), 0);
+                if (got == SL_EAGAIN && client->sock_blocking) {
+                    client->stats.timeouts++;
+                    return HTTP_E_TIMEOUT;
+                }
+                if (got == SL_EAGAIN) {
+                    return HTTP_PENDING;
+                }
+                if (got <= 0) {
+                    return http_parser_finish(&client->parser);
+                }
+                client->rx_pos = 0;
+                client->rx_len = got;
+                client->received += got;
+            }
+            ret = http_parser_feed(&client->parser, client->rx + client->rx_pos, client->rx_len - client->rx_pos);
+            if (ret < 0) {
+                return ret;
+            }
+            client->rx_pos += ret;
+            if (http_parser_done(&client->parser)) {
+                return 0;
+            }
+        } else {
+            return HTTP_E_SEND;
+        }
+    }
+}
+
+// Client Init
+void http_client_init(HttpClient *client, const char *host, uint16_t port) {
+    memset(client, 0, sizeof(*client));
+    client->host = host;
+    client->port = port;
+    client->sock = -1;
+}
+
+// HTTP Start
+int http_start(HttpClient *client, const char *path, const char *etag, HttpBodySink sink, void *ctx) {
+    return http_start_range(client, path, etag, 0, sink, ctx);
+}
+
+// HTTP Start Range
+int http_start_range(HttpClient *client, const char *path, const char *etag, uint32_t offset, HttpBodySink sink,
+                     void *ctx) {
+    char range[64] = "";
+    int ret;
+
+    http_cancel(client);
+    if (offset) {
+        // If the file changed since, If-Range gets the whole new one
+        snprintf(range, sizeof(range), "Range: bytes=%u-\r\n", (unsigned int)offset);
+        client->stats.ranges++;
+    }
+    // With an ETag the server answers 304 and no body if the file is unchanged
+    client->request_len = snprintf(client->request, sizeof(client->request),
+                                   "GET %s HTTP/1.1\r\n"
+                                   "Host: %s\r\n"
+                                   "%s%s%s%s"
+                                   "\r\n",
+                                   path, client->host, range, (etag && etag[0]) ? (offset ? "If-Range: " :
+                                   "If-None-Match: ") : "", (etag && etag[0]) ? etag : "",
+                                   (etag && etag[0]) ? "\r\n" : "");
+    if (client->request_len >= (int)sizeof(client->request)) {
+        return HTTP_E_SEND;
+    }
+    client->sink = sink;
+    client->ctx = ctx;
+    client->attempt = 0;
+    client->stats.requests++;
+    if ((ret = begin_attempt(client)) < 0) {
+        client->phase = HC_IDLE;
+    }
+    return ret;
+}
+
+// HTTP Poll
+int http_poll(HttpClient *client) {
+    int ret;
+
+    if (client->phase == HC_IDLE) {
+        return HTTP_E_SEND;
+    }
+    for (;;) {
+        ret = step(client);
+        if (ret == HTTP_PENDING) {
+            return ret;
+        }
+        if (ret < 0 || !client->parser.keep_alive) {
+            http_client_close(client);
+        }
+        // An idle connection the server has since closed fails before any
+        // of the response arrives, that one is worth a second try
+        if (ret < 0 && ret != HTTP_E_PROTOCOL && client->reused && client->received == 0 && client->attempt == 0) {
+            client->attempt++;
+            client->stats.retries++;
+            if ((ret = begin_attempt(client)) == 0) {
+                continue;
+            }
+        }
+        client->phase = HC_IDLE;
+        return ret;
+    }
+}
+
+// HTTP Wait
+int http_wait(HttpClient *client) {
+    int ret;
+
+    client->blocking = 1;
+    while ((ret = http_poll(client)) == HTTP_PENDING) {
+        _SlNonOsMainLoopTask();
+    }
+    client->blocking = 0;
+    return ret;
+}
+
+// HTTP Get
+int http_get(HttpClient *client, const char *path, const char *etag, HttpBodySink sink, void *ctx) {
+    return http_get_range(client, path, etag, 0, sink, ctx);
+}
+
+// HTTP Get Range
+int http_get_range(HttpClient *client, const char *path, const char *etag, uint32_t offset, HttpBodySink sink,
+                   void *ctx) {
+    int ret = http_start_range(client, path, etag, offset, sink, ctx);
+    return (ret < 0) ? ret : http_wait(client);
+}
+
+// HTTP Cancel
+void http_cancel(HttpClient *client) {
+    // Part of the response may still be on its way, so the connection can't be reused
+    if (client->phase != HC_IDLE) {
+        http_client_close(client);
+        client->phase = HC_IDLE;
+    }
+}
+
+// Client Close
+void http_client_close(HttpClient *client) {
+    if (client->sock >= 0) {
+        close(client->sock);
+    }
+    client->sock = -1;
+    client->rx_pos = client->rx_len = 0;
+}
@@ -0,0 +1,119 @@
+/*
+ * http_client.h
+ *
+ *  Small HTTP/1.1 client that keeps one connection to a host open across
+ *  requests, so fetching the map list and then a map costs one DNS lookup
+ *  and one TCP handshake instead of one each. GETs are sent one after the
+ *  other on the open connection and responses are read with http_parser.
+ *  If the server has closed an idle connection, the request is sent again
+ *  on a new one without the caller noticing. Host names are looked up
+ *  through the DNS cache.
+ *
+ *  http_start() and http_poll() work on a non-blocking socket and let the
+ *  caller do other work meanwhile, such as running a menu while a download
+ *  goes on in the background. http_get() and http_wait() switch the socket
+ *  to blocking with SL_SO_RCVTIMEO set, so a connection that goes quiet
+ *  fails with HTTP_E_TIMEOUT instead of being waited on for ever.
+ *
+ *  A download that was cut short can be resumed with a Range request from
+ *  the bytes already received; with the ETag as If-Range the server sends
+ *  the whole file (200) instead if it has changed since.
+ */
+
+#ifndef UTILS_HTTP_CLIENT_H_
+#define UTILS_HTTP_CLIENT_H_
+
+#include <stdint.h>
+
+#include "http_parser.h"
+
+#define HTTP_RX_SIZE        1024    /* Bytes read from the socket at a time */
+#define HTTP_REQUEST_SIZE   256
+#ifndef HTTP_RECV_TIMEOUT_MS
+#define HTTP_RECV_TIMEOUT_MS 5000   /* Longest quiet spell while waiting on a response */
+#endif
+
+#define HTTP_PENDING        1       /* Request still under way */
+
+#define HTTP_E_DNS          -1      /* Host didn't resolve */
+#define HTTP_E_CONNECT      -2
+#define HTTP_E_SEND         -3
+#define HTTP_E_TIMEOUT      -6      /* Nothing arrived for HTTP_RECV_TIMEOUT_MS */
+
+typedef enum {
+    HC_IDLE,
+    HC_CONNECTING,
+    HC_SENDING,
+    HC_RECEIVING
+} HttpPhase;
+
+typedef struct {
+    uint32_t connects;              /* TCP connections opened */
+    uint32_t requests;
+    uint32_t reused;                /* Requests sent on an already open connection */
+    uint32_t retries;               /* Requests resent after the server closed the connection */
+    uint32_t timeouts;              /* Responses that stopped arriving */
+    uint32_t ranges;                /* Range requests, to resume a download */
+} HttpStats;
+
+typedef struct {
+    const char *host;
+    uint16_t port;
+    uint32_t ip;                    /* Address of the last connection */
+    int sock;                       /* -1 when not connected */
+    uint8_t blocking;               /* Waiting in http_wait(), the socket blocks up to the timeout */
+    uint8_t sock_blocking;          /* Mode the socket is in */
+
+    // Request under way
+    HttpPhase phase;
+    char request[HTTP_REQUEST_SIZE];
+    int request_len, sent;
+    uint8_t reused;                 /* Sent on a connection kept from an earlier request */
+    uint8_t attempt;                /* 1 once resent on a new connection */
+    HttpParser parser;              /* Response being read */
+    uint32_t received;              /* Response bytes so far, headers included */
+    HttpBodySink sink;              /* Where the body of a 200 or 206 response goes */
+    void *ctx;
+
+    char rx[HTTP_RX_SIZE];
+    int rx_pos, rx_len;             /* Unread bytes of rx */
+
+    HttpStats stats;
+} HttpClient;
+
+// Set up a client for a host, nothing is sent until the first request
+void http_client_init(HttpClient *client, const char *host, uint16_t port);
+
+// GET path, with If-None-Match if etag is given. The body of a 200
+// response goes to sink, other bodies are read and dropped. Returns 0 once
+// the whole response has arrived, client->parser.status and .etag then
+// describe it; returns HTTP_E_* on failure.
+int http_get(HttpClient *client, const char *path, const char *etag, HttpBodySink sink, void *ctx);
+
+// GET path from byte offset on, with etag (if given) as If-Range. A 206
+// response's body starts at client->parser.range_start; a 200 is the
+// whole file. offset 0 is the same as http_get().
+int http_get_range(HttpClient *client, const char *path, const char *etag, uint32_t offset, HttpBodySink sink,
+                   void *ctx);
+
+// Start either request without waiting, cancelling any under way.
+// Returns 0 or HTTP_E_*.
+int http_start(HttpClient *client, const char *path, const char *etag, HttpBodySink sink, void *ctx);
+int http_start_range(HttpClient *client, const char *path, const char *etag, uint32_t offset, HttpBodySink sink,
+                     void *ctx);
+
+// Move the started request on as far as it goes without waiting, returns
+// HTTP_PENDING until it finishes, then what http_get() would have
+int http_poll(HttpClient *client);
+
+// Wait for the started request to finish, with the receive timeout.
+// Returns what http_get() would have.
+int http_wait(HttpClient *client);
+
+// Drop the request under way, and with it the connection
+void http_cancel(HttpClient *client);
+
+// Close the connection, the next request opens a new one
+void http_client_close(HttpClient *client);
+
+#endif /* UTILS_HTTP_CLIENT_H_ */
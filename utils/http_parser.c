@@ -0,0 +1,236 @@
+/*
+ * http_parser.c
+ *
+ *  Incremental HTTP/1.1 response parser.
+ */
+
+#include "http_parser.h"
+
+#include <string.h>
+#include <ctype.h>
+
+// Case-insensitive check for a header name at the start of a line
+static int header_is(const char *line, const char *name) {
+    while (*name) {
+        if (tolower((unsigned char)*line++) != *name++) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Case-insensitive search for a token in a header value
+static int value_has(const char *value, const char *token) {
+    for (; *value; value++) {
+        if (header_is(value, token)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static const char *header_value(const char *line) {
+    line = strchr(line, ':') + 1;
+    while (*line == ' ' || *line == '\t') line++;
+    return line;
+}
+
+// Read a number up to the end of the line or a ';', returns -1 if there is
+// none, it has other characters or it doesn't fit 32 bits
+static int parse_number(const char *p, int base, uint32_t *value) {
+    uint32_t v = 0;
+    int digits = 0, d;
+
+    for (;; p++, digits++) {
+        char c = tolower((unsigned char)*p);
+        if (c >= '0' && c <= '9') {
+            d = c - '0';
+        } else if (base == 16 && c >= 'a' && c <= 'f') {
+            d = c - 'a' + 10;
+        } else {
+            break;
+        }
+        if (v > (0xFFFFFFFFu - d) / base) {
+            return -1;
+        }
+        v = v * base + d;
+    }
+    while (*p == ' ' || *p == '\t') p++;
+    if (digits == 0 || (*p && *p != ';')) {
+        return -1;
+    }
+    *value = v;
+    return 0;
+}
+
+// Read decimal digits at *p, returns how many or -1 if they don't fit 32 bits
+static int read_digits(const char **p, uint32_t *value) {
+    int digits = 0;
+
+    for (*value = 0; **p >= '0' && **p <= '9'; (*p)++, digits++) {
+        if (*value > (0xFFFFFFFFu - (**p - '0')) / 10) {
+            return -1;
+        }
+        *value = *value * 10 + (**p - '0');
+    }
+    return digits;
+}
+
+// "bytes first-last/total", total may be '*'. A range that doesn't parse
+// is left out, the client then can't place the body.
+static void parse_range(HttpParser *parser, const char *value) {
+    uint32_t first, last, total = 0;
+    const char *p = value + 6;
+
+    if (!header_is(value, "bytes ") || read_digits(&p, &first) <= 0 || *p++ != '-' ||
+        read_digits(&p, &last) <= 0 || last < first || *p++ != '/') {
+        return;
+    }
+    if (*p != '*' && (read_digits(&p, &total) <= 0 || last >= total)) {
+        return;
+    }
+    parser->range_start = first;
+    parser->range_total = total;
+    parser->has_range = 1;
+}
+
+// A complete status or header line (without CRLF) is in parser->line
+static int header_line(HttpParser *parser) {
+    const char *line = parser->line;
+
+    if (parser->state == HS_STATUS) {
+        // "HTTP/1.x NNN reason"
+        if (strncmp(line, "HTTP/1.", 7) != 0 || line[8] != ' ' || !isdigit((unsigned char)line[9]) ||
+            !isdigit((unsigned char)line[10]) || !isdigit((unsigned char)line[11])) {
+            return HTTP_E_PROTOCOL;
+        }
+        parser->status = (line[9] - '0') * 100 + (line[10] - '0') * 10 + (line[11] - '0');
+        if (parser->status < 100) {
+            return HTTP_E_PROTOCOL;
+        }
+        // HTTP/1.0 servers close after each response
+        parser->keep_alive = (line[7] != '0');
+        parser->state = HS_HEADER;
+        return 0;
+    }
+
+    if (parser->line_len > 0) {
+        if (header_is(line, "content-length:")) {
+            if (parse_number(header_value(line), 10, &parser->body_left) < 0) {
+                return HTTP_E_PROTOCOL;
+            }
+            parser->has_length = 1;
+        } else if (header_is(line, "transfer-encoding:")) {
+            parser->chunked = value_has(header_value(line), "chunked");
+        } else if (header_is(line, "connection:")) {
+            if (value_has(header_value(line), "close")) {
+                parser->keep_alive = 0;
+            }
+        } else if (header_is(line, "etag:")) {
+            strncpy(parser->etag, header_value(line), sizeof(parser->etag) - 1);
+            parser->etag[sizeof(parser->etag) - 1] = '\0';
+        } else if (header_is(line, "content-range:")) {
+            parse_range(parser, header_value(line));
+        }
+        return 0;
+    }
+
+    // Blank line, the headers are over. An interim 1xx response is followed
+    // by the real one. Chunked framing wins over a Content-Length.
+    if (parser->status < 200) {
+        parser->state = HS_STATUS;
+        parser->chunked = parser->has_length = parser->has_range = 0;
+        parser->etag[0] = '\0';
+    } else if (parser->status == 204 || parser->status == 304) {
+        parser->state = HS_DONE;
+    } else if (parser->chunked) {
+        parser->state = HS_CHUNK_SIZE;
+    } else if (parser->has_length) {
+        parser->state = parser->body_left ? HS_BODY_LENGTH : HS_DONE;
+    } else {
+        parser->state = HS_BODY_CLOSE;
+        parser->keep_alive = 0;
+    }
+    return 0;
+}
+
+// A complete line of chunk framing is in parser->line
+static int chunk_line(HttpParser *parser) {
+    if (parser->state == HS_TRAILER) {
+        if (parser->line_len == 0) {
+            parser->state = HS_DONE;
+        }
+        return 0;
+    }
+    if (parser->state == HS_CHUNK_END) {
+        parser->state = HS_CHUNK_SIZE;
+        return (parser->line_len == 0) ? 0 : HTTP_E_PROTOCOL;
+    }
+    // Chunk size in hex, extensions after ';' are ignored
+    if (parse_number(parser->line, 16, &parser->body_left) < 0) {
+        return HTTP_E_PROTOCOL;
+    }
+    parser->state = parser->body_left ? HS_CHUNK_DATA : HS_TRAILER;
+    return 0;
+}
+
+// Parser Init
+void http_parser_init(HttpParser *parser, HttpBodySink sink, void *ctx) {
+    memset(parser, 0, sizeof(*parser));
+    parser->state = HS_STATUS;
+    parser->sink = sink;
+    parser->ctx = ctx;
+}
+
+// Parser Feed
+int http_parser_feed(HttpParser *parser, const char *data, int len) {
+    int i = 0, ret;
+
+    while (i < len && parser->state != HS_DONE) {
+        if (parser->state == HS_BODY_LENGTH || parser->state == HS_BODY_CLOSE || parser->state == HS_CHUNK_DATA) {
+            int n = len - i;
+            if (parser->state != HS_BODY_CLOSE && (uint32_t)n > parser->body_left) {
+                n = parser->body_left;
+            }
+            parser->sink(data + i, n, parser->ctx);
+            parser->body_len += n;
+            i += n;
+            if (parser->state == HS_BODY_CLOSE) {
+                continue;
+            }
+            parser->body_left -= n;
+            if (parser->body_left == 0) {
+                parser->state = (parser->state == HS_BODY_LENGTH) ? HS_DONE : HS_CHUNK_END;
+            }
+            continue;
+        }
+
+        // Everything else is read a line at a time, a line can straddle two reads
+        char c = data[i++];
+        if (c != '\n') {
+            if (c != '\r' && parser->line_len < HTTP_LINE_SIZE - 1) {
+                parser->line[parser->line_len++] = c;
+            }
+            continue;
+        }
+        parser->line[parser->line_len] = '\0';
+        if (parser->state == HS_STATUS || parser->state == HS_HEADER) {
+            ret = header_line(parser);
+        } else {
+            ret = chunk_line(parser);
+        }
+        if (ret < 0) {
+            return ret;
+        }
+        parser->line_len = 0;
+    }
+    return i;
+}
+
+// Parser Finish
+int http_parser_finish(HttpParser *parser) {
+    if (parser->state == HS_BODY_CLOSE) {
+        parser->state = HS_DONE;
+    }
+    return (parser->state == HS_DONE) ? 0 : HTTP_E_CLOSED;
+}
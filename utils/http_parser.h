@@ -0,0 +1,71 @@
+/*
+ * http_parser.h
+ *
+ *  Incremental HTTP/1.1 response parser. Bytes are fed in whatever pieces
+ *  recv() hands back, and body bytes go to a callback as soon as they
+ *  arrive, so a response of any size is handled in the parser's fixed
+ *  state. It reads the status line and the headers the client acts on
+ *  (Content-Length, Transfer-Encoding, Connection, ETag, Content-Range)
+ *  and finds the end
+ *  of the body from the length, the chunked framing, or the connection
+ *  closing. Header lines longer than HTTP_LINE_SIZE are cut; only their
+ *  start is looked at.
+ */
+
+#ifndef UTILS_HTTP_PARSER_H_
+#define UTILS_HTTP_PARSER_H_
+
+#include <stdint.h>
+
+#define HTTP_LINE_SIZE      96
+#define HTTP_ETAG_SIZE      40
+
+#define HTTP_E_CLOSED       -4      /* Connection ended before the response did */
+#define HTTP_E_PROTOCOL     -5      /* Response didn't parse */
+
+// Receives a response body piece by piece
+typedef void (*HttpBodySink)(const char *data, int len, void *ctx);
+
+typedef enum {
+    HS_STATUS,
+    HS_HEADER,
+    HS_BODY_LENGTH,
+    HS_BODY_CLOSE,                  /* No length given, the body ends when the connection does */
+    HS_CHUNK_SIZE,
+    HS_CHUNK_DATA,
+    HS_CHUNK_END,                   /* CRLF after a chunk */
+    HS_TRAILER,
+    HS_DONE
+} HttpState;
+
+typedef struct {
+    HttpState state;
+    int status;
+    char etag[HTTP_ETAG_SIZE];      /* ETag header, empty if none */
+    uint8_t keep_alive;             /* Connection may be reused after this response */
+    uint8_t chunked, has_length;
+    uint8_t has_range;              /* Content-Range parsed, for a 206 */
+    uint32_t range_start;           /* Offset of the body in the file */
+    uint32_t range_total;           /* Size of the whole file, 0 if not given */
+    uint32_t body_left;             /* Body or chunk bytes still to come */
+    uint32_t body_len;              /* Body bytes so far */
+    char line[HTTP_LINE_SIZE];
+    int line_len;
+    HttpBodySink sink;
+    void *ctx;
+} HttpParser;
+
+// Start on a new response
+void http_parser_init(HttpParser *parser, HttpBodySink sink, void *ctx);
+
+// Parse received bytes, returns how many were used (all of them unless the
+// response ended part way) or HTTP_E_PROTOCOL
+int http_parser_feed(HttpParser *parser, const char *data, int len);
+
+// The connection closed, returns 0 if that completed the response or
+// HTTP_E_CLOSED if it was cut short
+int http_parser_finish(HttpParser *parser);
+
+#define http_parser_done(parser)    ((parser)->state == HS_DONE)
+
+#endif /* UTILS_HTTP_PARSER_H_ */
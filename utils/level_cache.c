@@ -0,0 +1,324 @@
+/*
+ * level_cache.c
+ *
+ *  Serial-flash map file cache.
+ */
+
+#include "level_cache.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "fnv.h"
+#include "flash_record.h"
+
+// Simplelink includes
+#include "simplelink.h"
+
+#define INDEX_MAGIC     0x434C5454      /* "TTLC" */
+#define INDEX_VERSION   1
+#define READ_CHUNK      256
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t clock;                     /* Bumped on every store and hit, for LRU */
+    LevelCacheEntry entries[LEVEL_CACHE_ENTRIES];
+    uint32_t hash;                      /* FNV-1a of everything above */
+} LevelCacheIndex;
+
+LevelCacheStats level_cache_stats;
+
+static LevelCacheIndex cache_index;
+static uint8_t cache_ready = 0;
+static uint8_t chunk[READ_CHUNK];
+
+// File being stored
+static int write_slot = -1;
+static _i32 write_handle;
+static LevelCacheEntry write_entry;
+
+static void data_file(int slot, char *name) {
+    sprintf(name, LEVEL_CACHE_DATA_FILE, (unsigned int)slot);
+}
+
+// Write the index back, fail-safe so a reset mid-write keeps the old one
+static int index_save(void) {
+    return flash_record_save(LEVEL_CACHE_INDEX_FILE, &cache_index, sizeof(cache_index));
+}
+
+static int find_slot(const char *name) {
+    int i;
+    for (i = 0; i < LEVEL_CACHE_ENTRIES; i++) {
+        if (cache_index.entries[i].name[0] && strcmp(cache_index.entries[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Delete a slot's file and free it, the caller saves the index
+static void free_slot(int slot) {
+    char name[sizeof(LEVEL_CACHE_DATA_FILE) + 8];
+    data_file(slot, name);
+    sl_FsDel((_u8 *)name, 0);
+    memset(&cache_index.entries[slot], 0, sizeof(LevelCacheEntry));
+}
+
+// Least recently used slot other than keep and keep2, -1 if none is in use
+static int lru_slot(int keep, int keep2) {
+    int i, lru = -1;
+    for (i = 0; i < LEVEL_CACHE_ENTRIES; i++) {
+        if (i != keep && i != keep2 && cache_index.entries[i].name[0] &&
+            (lru < 0 || cache_index.entries[i].last_used < cache_index.entries[lru].last_used)) {
+            lru = i;
+        }
+    }
+    return lru;
+}
+
+// Cache Init
+int level_cache_init(void) {
+    if (cache_ready) {
+        return 0;
+    }
+    if (flash_record_load(LEVEL_CACHE_INDEX_FILE, &cache_index, sizeof(cache_index)) < 0 ||
+        cache_index.magic != INDEX_MAGIC || cache_index.version != INDEX_VERSION) {
+        // Fresh start: the data files are recreated as slots get used
+        memset(&cache_index, 0, sizeof(cache_index));
+        cache_index.magic = INDEX_MAGIC;
+        cache_index.version = INDEX_VERSION;
+    }
+    cache_ready = 1;
+    return 0;
+}
+
+// Cache Find
+const LevelCacheEntry *level_cache_find(const char *name) {
+    int slot = find_slot(name);
+    return (slot >= 0) ? &cache_index.entries[slot] : NULL;
+}
+
+// Cache Read
+int level_cache_read(const char *name, LevelCacheSink sink, void *ctx) {
+    int slot = find_slot(name), pass;
+    LevelCacheEntry *entry;
+    char file[sizeof(LEVEL_CACHE_DATA_FILE) + 8];
+    _i32 handle, got;
+    _u32 token = 0, offset;
+    uint32_t hash = FNV_INIT;
+
+    if (slot < 0) {
+        level_cache_stats.misses++;
+        return -1;
+    }
+    entry = &cache_index.entries[slot];
+    data_file(slot, file);
+    if (sl_FsOpen((_u8 *)file, FS_MODE_OPEN_READ, &token, &handle) < 0) {
+        goto corrupt;
+    }
+
+    // Check the whole file first so sink never sees damaged data
+    for (pass = 0; pass < 2; pass++) {
+        for (offset = 0; offset < entry->size; offset += got) {
+            uint32_t len = entry->size - offset;
+            got = sl_FsRead(handle, offset, chunk, (len < READ_CHUNK) ? len : READ_CHUNK);
+            if (got <= 0) {
+                sl_FsClose(handle, 0, 0, 0);
+                goto corrupt;
+            }
+            if (pass == 0) {
+                hash = fnv1a(hash, chunk, got);
+            } else {
+                sink((const char *)chunk, got, ctx);
+            }
+        }
+        if (pass == 0 && hash != entry->hash) {
+            sl_FsClose(handle, 0, 0, 0);
+            goto corrupt;
+        }
+    }
+    sl_FsClose(handle, 0, 0, 0);
+
+    // Recency is kept in RAM only, it reaches flash with the next store
+    entry->last_used = ++cache_index.clock;
+    level_cache_stats.hits++;
+    return 0;
+
+corrupt:
+    level_cache_stats.corrupt++;
+    free_slot(slot);
+    index_save();
+    return -1;
+}
+
+// Cache Begin
+int level_cache_begin(const char *name, const char *etag, uint32_t size_hint) {
+    char file[sizeof(LEVEL_CACHE_DATA_FILE) + 8];
+    uint32_t alloc = size_hint ? size_hint : LEVEL_CACHE_FILE_MAX;
+    uint32_t used;
+    _u32 token = 0;
+    int slot = -1, old, i;
+
+    level_cache_abort();
+    if (!cache_ready || strlen(name) >= LEVEL_CACHE_NAME_SIZE || alloc > LEVEL_CACHE_BUDGET) {
+        return -1;
+    }
+
+    // An older copy stays readable until the new one is committed, so the
+    // new one takes a free slot, else the least recently used of the others
+    old = find_slot(name);
+    for (i = 0; slot < 0 && i < LEVEL_CACHE_ENTRIES; i++) {
+        if (!cache_index.entries[i].name[0]) {
+            slot = i;
+        }
+    }
+    if (slot < 0) {
+        slot = lru_slot(old, -1);
+        if (slot < 0) {
+            return -1;
+        }
+        level_cache_stats.evictions++;
+    }
+    free_slot(slot);
+
+    // Evict until the new file fits in the budget, not counting the copy it replaces
+    for (;;) {
+        for (used = 0, i = 0; i < LEVEL_CACHE_ENTRIES; i++) {
+            used += (i != old) ? cache_index.entries[i].alloc : 0;
+        }
+        if (used + alloc <= LEVEL_CACHE_BUDGET) {
+            break;
+        }
+        i = lru_slot(slot, old);
+        if (i < 0) {
+            return -1;
+        }
+        free_slot(i);
+        level_cache_stats.evictions++;
+    }
+    if (index_save() < 0) {
+        return -1;
+    }
+
+    // Data files skip the fail-safe copy, the hash catches a torn write
+    data_file(slot, file);
+    if (sl_FsOpen((_u8 *)file, FS_MODE_OPEN_CREATE(alloc, _FS_FILE_PUBLIC_WRITE), &token, &write_handle) < 0) {
+        return -1;
+    }
+    memset(&write_entry, 0, sizeof(write_entry));
+    strcpy(write_entry.name, name);
+    if (etag) {
+        strncpy(write_entry.etag, etag, LEVEL_CACHE_ETAG_SIZE - 1);
+    }
+    write_entry.alloc = alloc;
+    write_entry.hash = FNV_INIT;
+    write_slot = slot;
+    return 0;
+}
+
+// Cache Append
+int level_cache_append(const char *data, int len) {
+    if (write_slot < 0) {
+        return -1;
+    }
+    if (write_entry.size + len > write_entry.alloc ||
+        sl_FsWrite(write_handle, write_entry.size, (_u8 *)data, len) != len) {
+        level_cache_abort();
+        return -1;
+    }
+    write_entry.size += len;
+    write_entry.hash = fnv1a(write_entry.hash, (const uint8_t *)data, len);
+    return 0;
+}
+
+// Cache Commit
+int level_cache_commit(void) {
+    char file[sizeof(LEVEL_CACHE_DATA_FILE) + 8];
+    int old, ret;
+
+    if (write_slot < 0) {
+        return -1;
+    }
+    sl_FsClose(write_handle, 0, 0, 0);
+
+    // Switch the index over before the older copy's file goes
+    old = find_slot(write_entry.name);
+    write_entry.last_used = ++cache_index.clock;
+    cache_index.entries[write_slot] = write_entry;
+    if (old >= 0) {
+        memset(&cache_index.entries[old], 0, sizeof(LevelCacheEntry));
+    }
+    write_slot = -1;
+    level_cache_stats.stores++;
+    ret = index_save();
+    if (old >= 0) {
+        data_file(old, file);
+        sl_FsDel((_u8 *)file, 0);
+    }
+    return ret;
+}
+
+// Cache Abort
+void level_cache_abort(void) {
+    if (write_slot >= 0) {
+        sl_FsClose(write_handle, 0, 0, 0);
+        free_slot(write_slot);
+        write_slot = -1;
+    }
+}
+
+// Cache Drop
+void level_cache_drop(const char *name) {
+    int slot = find_slot(name);
+    if (slot >= 0) {
+        free_slot(slot);
+        index_save();
+    }
+}
+
+// Cache Tee Init
+void level_cache_tee_init(LevelCacheTee *tee, const char *path, uint32_t size_hint, const HttpParser *parser,
+                          LevelCacheSink on_body, void *ctx) {
+    memset(tee, 0, sizeof(*tee));
+    tee->path = path;
+    tee->parser = parser;
+    tee->on_body = on_body;
+    tee->ctx = ctx;
+    tee->size_hint = tee->total = size_hint;
+    tee->hash = FNV_INIT;
+}
+
+// Cache Tee Body
+void level_cache_tee_body(const char *data, int len, void *ctx) {
+    LevelCacheTee *tee = (LevelCacheTee *)ctx;
+    const HttpParser *parser = tee->parser;
+
+    if (!tee->started) {
+        tee->started = 1;
+        if (tee->delivered == 0 && parser->status == 200) {
+            // Headers are in by the first body byte, so the ETag is known
+            tee->caching = (level_cache_begin(tee->path, parser->etag, tee->size_hint) == 0);
+            strcpy(tee->etag, parser->etag);
+            if (!tee->total && parser->has_length) {
+                tee->total = parser->body_left;
+            }
+        } else if (tee->resumed &&
+                   (parser->status != 206 || !parser->has_range || parser->range_start != tee->delivered)) {
+            // The whole file again, so it changed, or not the piece asked for
+            tee->mismatch = 1;
+        }
+    }
+    // An error page isn't level data, its status is reported when the request ends
+    if (tee->mismatch || (!tee->resumed && parser->status != 200)) {
+        return;
+    }
+    if (tee->caching && level_cache_append(data, len) < 0) {
+        tee->caching = 0;   // Too big for the cache, still deliver it
+    }
+    tee->hash = fnv1a(tee->hash, (const uint8_t *)data, len);
+    tee->delivered += len;
+    if (tee->on_body) {
+        tee->on_body(data, len, tee->ctx);
+    }
+}
@@ -0,0 +1,100 @@
+/*
+ * level_cache.h
+ *
+ *  Cache of downloaded map files in the serial-flash file system. Each
+ *  file is stored under its server path together with the server's ETag and
+ *  a hash of the contents, so a later download can be revalidated with a
+ *  conditional GET and served from flash on 304 Not Modified, or when the
+ *  server can't be reached at all. Files are evicted least recently used
+ *  once their flash allocations would exceed LEVEL_CACHE_BUDGET.
+ */
+
+#ifndef UTILS_LEVEL_CACHE_H_
+#define UTILS_LEVEL_CACHE_H_
+
+#include <stdint.h>
+
+#include "http_parser.h"
+
+#define LEVEL_CACHE_ENTRIES     8
+#define LEVEL_CACHE_NAME_SIZE   24
+#define LEVEL_CACHE_ETAG_SIZE   40
+#define LEVEL_CACHE_FILE_MAX    8192            /* Flash reserved for a file of unknown size */
+#define LEVEL_CACHE_BUDGET      (32 * 1024)     /* Flash reserved for all cached files */
+
+#define LEVEL_CACHE_INDEX_FILE  "ttcache/index"
+#define LEVEL_CACHE_DATA_FILE   "ttcache/file%u"
+
+typedef struct {
+    char name[LEVEL_CACHE_NAME_SIZE];   /* Server path, empty when the slot is free */
+    char etag[LEVEL_CACHE_ETAG_SIZE];   /* Validator from the server, may be empty */
+    uint32_t size;                      /* Bytes stored */
+    uint32_t alloc;                     /* Flash reserved for the file */
+    uint32_t hash;                      /* FNV-1a of the contents */
+    uint32_t last_used;                 /* Cache clock at the last store or hit */
+} LevelCacheEntry;
+
+typedef struct {
+    uint32_t hits;          /* Files served from flash */
+    uint32_t misses;
+    uint32_t stores;
+    uint32_t evictions;
+    uint32_t corrupt;       /* Entries dropped for a bad hash or read error */
+} LevelCacheStats;
+
+extern LevelCacheStats level_cache_stats;
+
+// Receives cached contents piece by piece
+typedef void (*LevelCacheSink)(const char *data, int len, void *ctx);
+
+// Passes a download on to its consumer while storing it in the cache, and
+// keeps what is needed to resume it. Give level_cache_tee_body to the
+// request as its sink with the tee as the context.
+typedef struct {
+    const char *path;
+    const HttpParser *parser;   /* Of the client making the request */
+    LevelCacheSink on_body;     /* Consumer of the body, or NULL to only store it */
+    void *ctx;
+    uint32_t size_hint;         /* File size from the manifest, 0 if unknown */
+    uint32_t delivered;         /* Body bytes passed on */
+    uint32_t total;             /* Expected file size, 0 while unknown */
+    uint32_t hash;              /* FNV-1a of the body so far */
+    char etag[HTTP_ETAG_SIZE];  /* Of the first response, sent as If-Range */
+    uint8_t caching;
+    uint8_t started;            /* The current response has delivered body bytes */
+    uint8_t resumed;            /* Part of the body came from a Range request */
+    uint8_t mismatch;           /* A response didn't continue the body, the rest was dropped */
+} LevelCacheTee;
+
+// Load the index from flash, starts empty if it is missing or damaged
+int level_cache_init(void);
+
+// Cached entry for a path, or NULL
+const LevelCacheEntry *level_cache_find(const char *name);
+
+// Play a cached file into sink after checking its hash, returns -1 if it
+// isn't cached or was damaged (the entry is then dropped)
+int level_cache_read(const char *name, LevelCacheSink sink, void *ctx);
+
+// Store a file as it downloads. size_hint is the final size if known, else
+// 0 to reserve LEVEL_CACHE_FILE_MAX. Nothing is visible until commit, and a
+// cached copy of the same path is kept and readable until then.
+int level_cache_begin(const char *name, const char *etag, uint32_t size_hint);
+int level_cache_append(const char *data, int len);
+int level_cache_commit(void);
+void level_cache_abort(void);
+
+// Forget a cached file
+void level_cache_drop(const char *name);
+
+// Set up a tee for a download of path. Before each Range request that
+// resumes it, clear started and set resumed. The caller commits or aborts
+// the stored copy once the download ends.
+void level_cache_tee_init(LevelCacheTee *tee, const char *path, uint32_t size_hint, const HttpParser *parser,
+                          LevelCacheSink on_body, void *ctx);
+
+// Body sink for a tee: the first 200 response starts a stored copy, a
+// resumed one must be the 206 that continues it. Error pages aren't passed on.
+void level_cache_tee_body(const char *data, int len, void *ctx);
+
+#endif /* UTILS_LEVEL_CACHE_H_ */
@@ -5,6 +5,9 @@
  *      Author: rtsang
  */
 #include "network_utils.h"
+#include "dns_cache.h"
+#include "fnv.h"
+#include "flash_record.h"
 
 // stdlib includes
 #include <stdio.h>
@@ -421,60 +424,6 @@ static long ConfigureSimpleLinkToDefaultState() {
 }
 
 
-//****************************************************************************
-//
-//! \brief Connecting to a WLAN Accesspoint
-//!
-//!  This function connects to the required AP (SSID_NAME) with Security
-//!  parameters specified in te form of macros at the top of this file
-//!
-//! \param  None
-//!
-//! \return  0 on success else error code
-//!
-//! \warning    If the WLAN connection fails or we don't aquire an IP
-//!            address, It will be stuck in this function forever.
-//
-//****************************************************************************
-static long WlanConnect() {
-    SlSecParams_t secParams = {0};
-    long lRetVal = 0;
-
-    secParams.Key = SECURITY_KEY;
-    secParams.KeyLen = strlen(SECURITY_KEY);
-    secParams.Type = SECURITY_TYPE;
-
-    UART_PRINT("Attempting connection to access point: ");
-    UART_PRINT(SSID_NAME);
-    UART_PRINT("... ...");
-    lRetVal = sl_WlanConnect(SSID_NAME, strlen(SSID_NAME), 0, &secParams, 0);
-    ASSERT_ON_ERROR(lRetVal);
-
-    UART_PRINT(" Connected!!!\n\r");
-
-    int timeout = 0;
-    // Wait for WLAN Event
-    while((!IS_CONNECTED(g_ulStatus)) || (!IS_IP_ACQUIRED(g_ulStatus))) {
-        // Toggle LEDs to Indicate Connection Progress
-        _SlNonOsMainLoopTask();
-        GPIO_IF_LedOff(MCU_IP_ALLOC_IND);
-        MAP_UtilsDelay(800000);
-        _SlNonOsMainLoopTask();
-        GPIO_IF_LedOn(MCU_IP_ALLOC_IND);
-        MAP_UtilsDelay(800000);
-        timeout++;
-        if (timeout >= 100) {
-            return -1;
-        }
-    }
-
-    return SUCCESS;
-
-}
-
-
-
-
 long printErrConvenience(char * msg, long retVal) {
     UART_PRINT(msg);
     GPIO_IF_LedOn(MCU_RED_LED_GPIO);
@@ -483,23 +432,17 @@ long printErrConvenience(char * msg, long retVal) {
 
 //*****************************************************************************
 //
-//! This function demonstrates how certificate can be used with SSL.
-//! The procedure includes the following steps:
-//! 1) connect to an open AP
-//! 2) get the server name via a DNS request
-//! 3) define all socket options and point to the CA certificate
-//! 4) connect to the server via TCP
+//! Opens the secure socket to the IoT host. The procedure includes the
+//! following steps:
+//! 1) get the server name via a DNS request
+//! 2) define all socket options and point to the CA certificate
 //!
-//! \param None
+//! \param Addr - filled with the server's address
 //!
-//! \return  0 on success else error code
-//! \return  LED1 is turned solid in case of success
-//!    LED2 is turned solid in case of failure
+//! \return  socket on success else error code
 //!
 //*****************************************************************************
-int tls_connect() {
-    SlSockAddrIn_t    Addr;
-    int    iAddrSize;
+int tls_socket(SlSockAddrIn_t *pAddr) {
     unsigned char    ucMethod = SL_SO_SEC_METHOD_TLSV1_2;
     unsigned int uiIP;
 //    unsigned int uiCipher = SL_SEC_MASK_TLS_ECDHE_RSA_WITH_AES_256_CBC_SHA;
@@ -517,17 +460,15 @@ int tls_connect() {
     long lRetVal = -1;
     int iSockID;
 
-    lRetVal = sl_NetAppDnsGetHostByName(g_Host, strlen((const char *)g_Host),
-                                    (unsigned long*)&uiIP, SL_AF_INET);
+    lRetVal = dns_cache_resolve((const char *)g_Host, (uint32_t *)&uiIP);
 
     if(lRetVal < 0) {
         return printErrConvenience("Device couldn't retrieve the host name \n\r", lRetVal);
     }
 
-    Addr.sin_family = SL_AF_INET;
-    Addr.sin_port = sl_Htons(g_port);
-    Addr.sin_addr.s_addr = sl_Htonl(uiIP);
-    iAddrSize = sizeof(SlSockAddrIn_t);
+    pAddr->sin_family = SL_AF_INET;
+    pAddr->sin_port = sl_Htons(g_port);
+    pAddr->sin_addr.s_addr = sl_Htonl(uiIP);
     //
     // opens a secure socket
     //
@@ -542,6 +483,7 @@ int tls_connect() {
     lRetVal = sl_SetSockOpt(iSockID, SL_SOL_SOCKET, SL_SO_SECMETHOD, &ucMethod,\
                                sizeof(ucMethod));
     if(lRetVal < 0) {
+        sl_Close(iSockID);
         return printErrConvenience("Device couldn't set socket options \n\r", lRetVal);
     }
     //
@@ -550,6 +492,7 @@ int tls_connect() {
     lRetVal = sl_SetSockOpt(iSockID, SL_SOL_SOCKET, SL_SO_SECURE_MASK, &uiCipher,\
                            sizeof(uiCipher));
     if(lRetVal < 0) {
+        sl_Close(iSockID);
         return printErrConvenience("Device couldn't set socket options \n\r", lRetVal);
     }
 
@@ -566,6 +509,7 @@ int tls_connect() {
                            strlen(SL_SSL_CA_CERT));
 
     if(lRetVal < 0) {
+        sl_Close(iSockID);
         return printErrConvenience("Device couldn't set socket options \n\r", lRetVal);
     }
 // END: COMMENT THIS OUT IF DISABLING SERVER VERIFICATION
@@ -580,6 +524,7 @@ int tls_connect() {
                            strlen(SL_SSL_CLIENT));
 
     if(lRetVal < 0) {
+        sl_Close(iSockID);
         return printErrConvenience("Device couldn't set socket options \n\r", lRetVal);
     }
 
@@ -591,13 +536,24 @@ int tls_connect() {
                            strlen(SL_SSL_PRIVATE));
 
     if(lRetVal < 0) {
+        sl_Close(iSockID);
         return printErrConvenience("Device couldn't set socket options \n\r", lRetVal);
     }
 
 
-    /* connect to the peer device - Google server */
-    lRetVal = sl_Connect(iSockID, ( SlSockAddr_t *)&Addr, iAddrSize);
+    return iSockID;
+}
 
+//*****************************************************************************
+//
+//! Reports how the connect on a secure socket ended, closes it on failure
+//!
+//! \return  socket on success else error code
+//! \return  LED1 is turned solid in case of success
+//!    LED2 is turned solid in case of failure
+//!
+//*****************************************************************************
+int tls_connected(int iSockID, long lRetVal) {
     if(lRetVal >= 0) {
         UART_PRINT("Device has connected to the website:");
         UART_PRINT("%s", g_Host);
@@ -612,6 +568,8 @@ int tls_connect() {
         UART_PRINT("Device couldn't connect to server:");
         UART_PRINT("%s", g_Host);
         UART_PRINT("\n\r");
+        dns_cache_invalidate((const char *)g_Host);
+        sl_Close(iSockID);
         return printErrConvenience("Device couldn't connect to server \n\r", lRetVal);
     }
 
@@ -622,61 +580,287 @@ int tls_connect() {
 
 
 
-int connectToAccessPoint() {
-    long lRetVal = -1;
-    GPIO_IF_LedConfigure(LED1|LED3);
+//*****************************************************************************
+//
+//! Connects to the IoT host over TLS, waiting for the handshake
+//!
+//! \param None
+//!
+//! \return  socket on success else error code
+//!
+//*****************************************************************************
+int tls_connect() {
+    SlSockAddrIn_t Addr;
+    int iSockID = tls_socket(&Addr);
+
+    if(iSockID < 0) {
+        return iSockID;
+    }
+    /* connect to the peer device - Google server */
+    return tls_connected(iSockID, sl_Connect(iSockID, (SlSockAddr_t *)&Addr, sizeof(SlSockAddrIn_t)));
+}
+
+
+
+//*****************************************************************************
+// Wi-Fi connect state machine
+//*****************************************************************************
 
+// Longest each state may take, 0 for states that finish in one poll
+static const uint32_t wifi_timeout_ms[WIFI_DONE] = {
+    0,                          /* WIFI_IDLE */
+    0,                          /* WIFI_CONFIGURE */
+    0,                          /* WIFI_START */
+    WIFI_ASSOCIATE_TIMEOUT_MS,  /* WIFI_ASSOCIATE */
+    WIFI_DHCP_TIMEOUT_MS,       /* WIFI_DHCP */
+    0,                          /* WIFI_TIME */
+    WIFI_TLS_TIMEOUT_MS         /* WIFI_TLS */
+};
+
+static const char *wifi_state_names[] = {
+    "Idle", "Resetting radio", "Starting radio", "Joining AP", "Getting IP",
+    "Setting time", "Secure connect", "Connected", "Failed", "Cancelled"
+};
+
+WifiStats wifi_stats;
+
+// Saved after a successful full reset
+typedef struct {
+    uint32_t magic;
+    uint32_t config;                    /* wifi_config_hash() of the settings */
+    uint32_t hash;                      /* FNV-1a of everything above */
+} WifiConfigFile;
+
+// Hash of everything the full reset and profile set up
+static uint32_t wifi_config_hash(void) {
+    uint32_t hash = FNV_INIT, value;
+
+    hash = fnv1a(hash, (const uint8_t *)SSID_NAME, strlen(SSID_NAME));
+    hash = fnv1a(hash, (const uint8_t *)SECURITY_KEY, strlen(SECURITY_KEY));
+    value = SECURITY_TYPE;
+    hash = fnv1a(hash, (const uint8_t *)&value, sizeof(value));
+    value = WIFI_CONFIG_VERSION;
+    return fnv1a(hash, (const uint8_t *)&value, sizeof(value));
+}
+
+// The device must be started to reach the file system
+static int wifi_config_saved(void) {
+    WifiConfigFile file;
+    return flash_record_load(WIFI_CONFIG_FILE, &file, sizeof(file)) == 0 && file.magic == WIFI_CONFIG_MAGIC &&
+           file.config == wifi_config_hash();
+}
+
+static void wifi_config_save(void) {
+    WifiConfigFile file = {WIFI_CONFIG_MAGIC, 0, 0};
+    file.config = wifi_config_hash();
+    flash_record_save(WIFI_CONFIG_FILE, &file, sizeof(file));
+}
+
+static void wifi_enter(WifiConnect *wc, WifiState state, uint32_t now_ms) {
+    UART_PRINT("[WIFI] %s: %u ms\n\r", wifi_state_names[wc->state], now_ms - wc->state_start);
+    wc->state = state;
+    wc->state_start = now_ms;
+}
+
+// Leave the radio stopped so the next attempt starts from scratch
+static int wifi_fail(WifiConnect *wc, long error, uint32_t now_ms) {
+    UART_PRINT("[WIFI] %s failed (%d) after %u ms\n\r", wifi_state_names[wc->state], error,
+               now_ms - wc->state_start);
+    // A fast start that doesn't get an IP falls back to the full reset,
+    // and the saved config is forgotten until that succeeds
+    if (wc->fast && wc->state <= WIFI_DHCP) {
+        sl_FsDel((_u8 *)WIFI_CONFIG_FILE, 0);
+        sl_Stop(SL_STOP_TIMEOUT);
+        wc->started = 0;
+        wc->fast = 0;
+        wifi_stats.fallbacks++;
+        wc->state = WIFI_CONFIGURE;
+        wc->state_start = now_ms;
+        return WIFI_PENDING;
+    }
+    if (wc->sock >= 0) {
+        sl_Close(wc->sock);
+        wc->sock = -1;
+    }
+    if (wc->started) {
+        sl_Stop(SL_STOP_TIMEOUT);
+        wc->started = 0;
+    }
+    GPIO_IF_LedOn(MCU_RED_LED_GPIO);
+    wc->failed_state = wc->state;
+    wc->error = error;
+    wc->state = WIFI_FAILED;
+    return error;
+}
+
+// Wi-Fi Connect Start
+void wifi_connect_start(WifiConnect *wc, uint32_t now_ms) {
+    memset(wc, 0, sizeof(*wc));
+    wc->sock = -1;
+    wc->state = WIFI_CONFIGURE;
+    wc->start = wc->state_start = now_ms;
+
+    GPIO_IF_LedConfigure(LED1|LED3);
     GPIO_IF_LedOff(MCU_RED_LED_GPIO);
     GPIO_IF_LedOff(MCU_GREEN_LED_GPIO);
+}
 
-    lRetVal = InitializeAppVariables();
+// Wi-Fi Connect Poll
+int wifi_connect_poll(WifiConnect *wc, uint32_t now_ms) {
+    SlSecParams_t secParams = {0};
+    SlSockNonblocking_t nonblocking;
+    uint32_t timeout;
+    long lRetVal;
+
+    _SlNonOsMainLoopTask();
+    switch (wc->state) {
+        case WIFI_CONFIGURE:
+            InitializeAppVariables();
+            // If the last full reset was for the same settings, they and
+            // the AP profile are still in NVMEM, so start as is and let the
+            // device join the AP on its own
+            if (!wc->tried_fast) {
+                wc->tried_fast = 1;
+                lRetVal = sl_Start(0, 0, 0);
+                if (lRetVal >= 0 && ROLE_STA == lRetVal && wifi_config_saved()) {
+                    UART_PRINT("[WIFI] Saved config matches, waiting for auto-connect\n\r");
+                    wc->started = 1;
+                    wc->fast = 1;
+                    wifi_enter(wc, WIFI_ASSOCIATE, now_ms);
+                    break;
+                }
+                if (lRetVal >= 0) {
+                    sl_Stop(SL_STOP_TIMEOUT);
+                }
+                break;
+            }
+            // Clears the persistent settings stored in NVMEM (connection
+            // profiles, policies, power policy) and stops the device again
+            lRetVal = ConfigureSimpleLinkToDefaultState();
+            if (lRetVal < 0) {
+                return wifi_fail(wc, lRetVal, now_ms);
+            }
+            CLR_STATUS_BIT_ALL(g_ulStatus);
+            wifi_enter(wc, WIFI_START, now_ms);
+            break;
 
-    //
-    // Following function configure the device to default state by cleaning
-    // the persistent settings stored in NVMEM (viz. connection profiles &
-    // policies, power policy etc)
-    //
-    // Applications may choose to skip this step if the developer is sure
-    // that the device is in its default state at start of applicaton
-    //
-    // Note that all profiles and persistent settings that were done on the
-    // device will be lost
-    //
-    lRetVal = ConfigureSimpleLinkToDefaultState();
-    if(lRetVal < 0) {
-      if (DEVICE_NOT_IN_STATION_MODE == lRetVal)
-          UART_PRINT("Failed to configure the device in its default state \n\r");
+        case WIFI_START:
+            lRetVal = sl_Start(0, 0, 0);
+            wc->started = (lRetVal >= 0);
+            if (lRetVal < 0 || ROLE_STA != lRetVal) {
+                return wifi_fail(wc, (lRetVal < 0) ? lRetVal : DEVICE_NOT_IN_STATION_MODE, now_ms);
+            }
+            // Only queues the request, the connect and IP events come later.
+            // The profile lets the next start join without being asked.
+            secParams.Key = SECURITY_KEY;
+            secParams.KeyLen = strlen(SECURITY_KEY);
+            secParams.Type = SECURITY_TYPE;
+            sl_WlanProfileAdd(SSID_NAME, strlen(SSID_NAME), 0, &secParams, 0, 7, 0);
+            lRetVal = sl_WlanConnect(SSID_NAME, strlen(SSID_NAME), 0, &secParams, 0);
+            if (lRetVal < 0) {
+                return wifi_fail(wc, lRetVal, now_ms);
+            }
+            UART_PRINT("Attempting connection to access point: %s\n\r", SSID_NAME);
+            wifi_enter(wc, WIFI_ASSOCIATE, now_ms);
+            break;
 
-      return lRetVal;
-    }
+        case WIFI_ASSOCIATE:
+            if (IS_CONNECTED(g_ulStatus)) {
+                wifi_enter(wc, WIFI_DHCP, now_ms);
+            }
+            break;
 
-    UART_PRINT("Device is configured in default state \n\r");
+        case WIFI_DHCP:
+            if (!IS_CONNECTED(g_ulStatus)) {
+                return wifi_fail(wc, LAN_CONNECTION_FAILED, now_ms);
+            }
+            if (IS_IP_ACQUIRED(g_ulStatus)) {
+                wifi_enter(wc, WIFI_TIME, now_ms);
+            }
+            break;
 
-    CLR_STATUS_BIT_ALL(g_ulStatus);
+        case WIFI_TIME:
+            // Certificates are checked against the device clock
+            lRetVal = sl_DevSet(SL_DEVICE_GENERAL_CONFIGURATION, SL_DEVICE_GENERAL_CONFIGURATION_DATE_TIME,
+                                sizeof(SlDateTime), (unsigned char *)&g_time);
+            if (lRetVal < 0) {
+                return wifi_fail(wc, lRetVal, now_ms);
+            }
+            if ((wc->sock = tls_socket(&wc->addr)) < 0) {
+                lRetVal = wc->sock;
+                wc->sock = -1;
+                return wifi_fail(wc, lRetVal, now_ms);
+            }
+            // Non-blocking, so the handshake is stepped by the polls below
+            nonblocking.NonblockingEnabled = 1;
+            sl_SetSockOpt(wc->sock, SL_SOL_SOCKET, SL_SO_NONBLOCKING, &nonblocking, sizeof(nonblocking));
+            wifi_enter(wc, WIFI_TLS, now_ms);
+            break;
 
-    ///
-    // Assumption is that the device is configured in station mode already
-    // and it is in its default state
-    //
-    UART_PRINT("Opening sl_start\n\r");
-    lRetVal = sl_Start(0, 0, 0);
-    if (lRetVal < 0 || ROLE_STA != lRetVal) {
-        UART_PRINT("Failed to start the device \n\r");
-        return lRetVal;
+        case WIFI_TLS:
+            lRetVal = sl_Connect(wc->sock, (SlSockAddr_t *)&wc->addr, sizeof(SlSockAddrIn_t));
+            if (lRetVal == SL_EALREADY) {
+                break;
+            }
+            lRetVal = tls_connected(wc->sock, lRetVal);
+            if (lRetVal < 0) {
+                wc->sock = -1;
+                return wifi_fail(wc, lRetVal, now_ms);
+            }
+            nonblocking.NonblockingEnabled = 0;
+            sl_SetSockOpt(wc->sock, SL_SOL_SOCKET, SL_SO_NONBLOCKING, &nonblocking, sizeof(nonblocking));
+            wc->tls_ms = now_ms - wc->state_start;
+            wifi_enter(wc, WIFI_DONE, now_ms);
+            if (wc->fast) {
+                wifi_stats.fast++;
+                wifi_stats.fast_ms = now_ms - wc->start;
+            } else {
+                wifi_config_save();
+                wifi_stats.full++;
+                wifi_stats.full_ms = now_ms - wc->start;
+            }
+            UART_PRINT("[WIFI] Connected in %u ms (%s)\n\r", now_ms - wc->start, wc->fast ? "fast path" : "full reset");
+            UART_PRINT("[WIFI] Fast path %u, last %u ms; full reset %u, last %u ms; %u fell back\n\r",
+                       wifi_stats.fast, wifi_stats.fast_ms, wifi_stats.full, wifi_stats.full_ms, wifi_stats.fallbacks);
+            return 0;
+
+        case WIFI_DONE:
+            return 0;
+
+        default:
+            return wc->error;
     }
 
-    UART_PRINT("Device started as STATION \n\r");
+    timeout = (wc->fast && wc->state == WIFI_ASSOCIATE) ? WIFI_FAST_TIMEOUT_MS : wifi_timeout_ms[wc->state];
+    if (timeout && now_ms - wc->state_start > timeout) {
+        return wifi_fail(wc, CONNECT_TIMED_OUT, now_ms);
+    }
+    return WIFI_PENDING;
+}
 
-    //
-    //Connecting to WLAN AP
-    //
-    lRetVal = WlanConnect();
-    if(lRetVal < 0) {
-        UART_PRINT("Failed to establish connection w/ an AP \n\r");
-        GPIO_IF_LedOn(MCU_RED_LED_GPIO);
-        return lRetVal;
+// Wi-Fi Connect Cancel
+void wifi_connect_cancel(WifiConnect *wc) {
+    if (wc->sock >= 0) {
+        sl_Close(wc->sock);
+        wc->sock = -1;
+    }
+    if (wc->started) {
+        sl_Stop(SL_STOP_TIMEOUT);
+        wc->started = 0;
     }
+    UART_PRINT("[WIFI] Cancelled during %s\n\r", wifi_state_names[wc->state]);
+    // Progress stays where it stopped, the same as a failure
+    wc->failed_state = wc->state;
+    wc->state = WIFI_CANCELLED;
+}
+
+// Wi-Fi State Name
+const char *wifi_state_name(WifiState state) {
+    return wifi_state_names[state];
+}
 
-    UART_PRINT("Connection established w/ AP and IP is aquired \n\r");
-    return 0;
+// Wi-Fi Progress
+int wifi_connect_progress(const WifiConnect *wc) {
+    WifiState state = (wc->state >= WIFI_FAILED) ? wc->failed_state : wc->state;
+    return (state - WIFI_CONFIGURE) * 100 / (WIFI_DONE - WIFI_CONFIGURE);
 }
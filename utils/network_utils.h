@@ -8,11 +8,14 @@
 #ifndef UTILS_NETWORK_UTILS_H_
 #define UTILS_NETWORK_UTILS_H_
 
+#include <stdint.h>
+
 // Simplelink includes
 #include "simplelink.h"
 
 #include "utils.h"
 #include "common.h"
+#include "tls_channel.h"
 
 #define MAX_URI_SIZE 128
 #define URI_SIZE MAX_URI_SIZE + 1
@@ -61,6 +64,7 @@ typedef enum {
     LAN_CONNECTION_FAILED = -0x7D0,
     INTERNET_CONNECTION_FAILED = LAN_CONNECTION_FAILED - 1,
     DEVICE_NOT_IN_STATION_MODE = INTERNET_CONNECTION_FAILED - 1,
+    CONNECT_TIMED_OUT = DEVICE_NOT_IN_STATION_MODE - 1,
 
     STATUS_CODE_MAX = -0xBB8
 } e_AppStatusCodes;
@@ -78,9 +82,78 @@ void SimpleLinkSockEventHandler(SlSockEvent_t *pSock);
 
 static long ConfigureSimpleLinkToDefaultState();
 
+// Polled Wi-Fi connect. Each poll does one step of bringing up the radio,
+// joining the AP, getting an IP, setting the clock and the TLS handshake
+// with g_Host, so the caller can keep the screen moving and cancel. States
+// that wait on the network time out after their WIFI_*_TIMEOUT_MS.
+#define WIFI_ASSOCIATE_TIMEOUT_MS   10000
+#define WIFI_DHCP_TIMEOUT_MS        10000
+#define WIFI_TLS_TIMEOUT_MS         10000
+
+// After a successful full reset the settings' hash is saved, and while it
+// matches later connects skip the reset and let the device join the AP
+// from its stored profile, going back to the full reset if that doesn't
+// give an IP. Bump WIFI_CONFIG_VERSION when the reset sequence changes.
+#define WIFI_FAST_TIMEOUT_MS        5000    /* To join the AP from the stored profile */
+#define WIFI_CONFIG_FILE            "ttcache/wifi"
+#define WIFI_CONFIG_MAGIC           0x49464957      /* "WIFI" */
+#define WIFI_CONFIG_VERSION         1
+
+#define WIFI_PENDING                1       /* Still connecting */
+
+typedef enum {
+    WIFI_IDLE,
+    WIFI_CONFIGURE,                 /* Reset the device to station defaults */
+    WIFI_START,                     /* Start as a station and ask to join the AP */
+    WIFI_ASSOCIATE,                 /* Waiting for the AP */
+    WIFI_DHCP,                      /* Waiting for an IP */
+    WIFI_TIME,                      /* Set the clock from g_time and open the TLS socket */
+    WIFI_TLS,                       /* Handshake with g_Host */
+    WIFI_DONE,
+    WIFI_FAILED,
+    WIFI_CANCELLED
+} WifiState;
+
+typedef struct {
+    WifiState state;
+    WifiState failed_state;         /* State that failed or timed out */
+    long error;
+    uint32_t start;                 /* ms the connect began */
+    uint32_t state_start;           /* ms the current state began */
+    uint8_t started;                /* sl_Start() succeeded, sl_Stop() on failure */
+    uint8_t tried_fast;             /* Saved config checked */
+    uint8_t fast;                   /* Connecting without the full reset */
+    int sock;                       /* TLS socket, -1 until opened */
+    uint32_t tls_ms;                /* Time the handshake took */
+    SlSockAddrIn_t addr;
+} WifiConnect;
+
+typedef struct {
+    uint32_t fast;                  /* Connects that skipped the full reset */
+    uint32_t full;                  /* Connects after a full reset */
+    uint32_t fallbacks;             /* Fast starts that needed the full reset */
+    uint32_t fast_ms, full_ms;      /* Time the last connect of each kind took */
+} WifiStats;
+
+extern WifiStats wifi_stats;
+
 int tls_connect();
 
-int connectToAccessPoint();
+// Begin connecting, nothing is done until the first poll
+void wifi_connect_start(WifiConnect *wc, uint32_t now_ms);
+
+// Do the next step, returns WIFI_PENDING, 0 once connected (wc->sock is the
+// TLS socket) or an error code
+int wifi_connect_poll(WifiConnect *wc, uint32_t now_ms);
+
+// Give up on a connect under way and stop the device
+void wifi_connect_cancel(WifiConnect *wc);
+
+// Name of a state for the progress screen
+const char *wifi_state_name(WifiState state);
+
+// How far the connect has got, 0-100
+int wifi_connect_progress(const WifiConnect *wc);
 
 static long printErrConvenience(char * msg, long retVal);
 
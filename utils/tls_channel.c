@@ -0,0 +1,177 @@
+/*
+ * tls_channel.c
+ *
+ *  Long-lived TLS connection to the IoT host.
+ */
+
+#include "tls_channel.h"
+
+#include <string.h>
+
+// Simplelink includes
+#include "simplelink.h"
+
+static void set_options(int sock) {
+    SlSockNonblocking_t nonblocking;
+    SlSockKeepalive_t keepalive;
+
+    nonblocking.NonblockingEnabled = 1;
+    sl_SetSockOpt(sock, SL_SOL_SOCKET, SL_SO_NONBLOCKING, &nonblocking, sizeof(nonblocking));
+    keepalive.KeepaliveEnabled = 1;
+    sl_SetSockOpt(sock, SL_SOL_SOCKET, SL_SO_KEEPALIVE, &keepalive, sizeof(keepalive));
+}
+
+static void enter(TlsChannel *ch, TlsState state, uint32_t now_ms) {
+    ch->state = state;
+    ch->state_start = now_ms;
+}
+
+// Close the socket and wait before trying again, twice as long each time
+static void back_off(TlsChannel *ch, uint32_t now_ms) {
+    if (ch->sock >= 0) {
+        sl_Close(ch->sock);
+        ch->sock = -1;
+    }
+    ch->sent_at = 0;
+    enter(ch, TLS_BACKOFF, now_ms);
+    ch->backoff_ms = ch->backoff_ms ? ch->backoff_ms * 2 : TLS_BACKOFF_MIN_MS;
+    if (ch->backoff_ms > TLS_BACKOFF_MAX_MS) {
+        ch->backoff_ms = TLS_BACKOFF_MAX_MS;
+    }
+}
+
+static void opened(TlsChannel *ch, uint32_t handshake_ms, uint32_t now_ms) {
+    ch->stats.handshakes++;
+    ch->stats.handshake_ms_total += handshake_ms;
+    ch->stats.handshake_ms_last = handshake_ms;
+    ch->backoff_ms = 0;
+    ch->sent_at = 0;
+    enter(ch, TLS_OPEN, now_ms);
+}
+
+// A channel that was working is lost, so start the backoff over
+static int dropped(TlsChannel *ch, uint32_t now_ms) {
+    ch->stats.drops++;
+    ch->backoff_ms = 0;
+    back_off(ch, now_ms);
+    return TLS_E_IO;
+}
+
+// Channel Adopt
+void tls_channel_adopt(TlsChannel *ch, int sock, uint32_t handshake_ms, uint32_t now_ms) {
+    memset(ch, 0, sizeof(*ch));
+    ch->sock = sock;
+    set_options(sock);
+    opened(ch, handshake_ms, now_ms);
+}
+
+// Channel Poll
+void tls_channel_poll(TlsChannel *ch, uint32_t now_ms) {
+    long ret;
+
+    if (ch->state == TLS_BACKOFF && now_ms - ch->state_start >= ch->backoff_ms) {
+        enter(ch, TLS_SETUP, now_ms);
+    }
+    if (ch->state == TLS_CONNECTING) {
+        ret = sl_Connect(ch->sock, (SlSockAddr_t *)&ch->addr, sizeof(SlSockAddrIn_t));
+        if (ret == SL_EALREADY) {
+            if (now_ms - ch->state_start > TLS_HANDSHAKE_TIMEOUT_MS) {
+                ch->stats.failures++;
+                back_off(ch, now_ms);
+            }
+            return;
+        }
+        if (tls_connected(ch->sock, ret) < 0) {
+            // tls_connected() closed it
+            ch->sock = -1;
+            ch->stats.failures++;
+            back_off(ch, now_ms);
+            return;
+        }
+        opened(ch, now_ms - ch->state_start, now_ms);
+    }
+}
+
+// Channel Setup
+void tls_channel_setup(TlsChannel *ch, uint32_t now_ms) {
+    if (ch->state == TLS_BACKOFF && now_ms - ch->state_start >= ch->backoff_ms) {
+        enter(ch, TLS_SETUP, now_ms);
+    }
+    if (ch->state != TLS_SETUP) {
+        return;
+    }
+    // The address is looked up again through the DNS cache
+    if ((ch->sock = tls_socket(&ch->addr)) < 0) {
+        ch->sock = -1;
+        ch->stats.failures++;
+        back_off(ch, now_ms);
+        return;
+    }
+    set_options(ch->sock);
+    enter(ch, TLS_CONNECTING, now_ms);
+}
+
+// Channel Send
+int tls_channel_send(TlsChannel *ch, const void *data, int len, uint32_t now_ms) {
+    int ret;
+
+    if (ch->state != TLS_OPEN) {
+        return TLS_E_CLOSED;
+    }
+    ret = sl_Send(ch->sock, data, len, 0);
+    if (ret == SL_EAGAIN) {
+        return 0;
+    }
+    if (ret <= 0) {
+        return dropped(ch, now_ms);
+    }
+    ch->stats.bytes_sent += ret;
+    if (!ch->sent_at) {
+        ch->sent_at = now_ms ? now_ms : 1;
+    }
+    return ret;
+}
+
+// Channel Receive
+int tls_channel_recv(TlsChannel *ch, void *buf, int len, uint32_t now_ms) {
+    int ret;
+
+    if (ch->state != TLS_OPEN) {
+        return TLS_E_CLOSED;
+    }
+    ret = sl_Recv(ch->sock, buf, len, 0);
+    if (ret == SL_EAGAIN) {
+        return 0;
+    }
+    if (ret <= 0) {
+        return dropped(ch, now_ms);
+    }
+    ch->stats.bytes_received += ret;
+    if (ch->sent_at) {
+        ch->stats.exchanges++;
+        ch->stats.reply_ms_last = now_ms - ch->sent_at;
+        ch->stats.reply_ms_total += ch->stats.reply_ms_last;
+        ch->sent_at = 0;
+    }
+    return ret;
+}
+
+// Channel Reconnect
+void tls_channel_reconnect(TlsChannel *ch, uint32_t now_ms) {
+    if (ch->sock >= 0) {
+        sl_Close(ch->sock);
+        ch->sock = -1;
+    }
+    ch->sent_at = 0;
+    ch->backoff_ms = 0;
+    enter(ch, TLS_BACKOFF, now_ms);
+}
+
+// Channel Close
+void tls_channel_close(TlsChannel *ch) {
+    if (ch->sock >= 0) {
+        sl_Close(ch->sock);
+        ch->sock = -1;
+    }
+    ch->state = TLS_CLOSED;
+}
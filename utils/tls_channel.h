@@ -0,0 +1,104 @@
+/*
+ * tls_channel.h
+ *
+ *  Long-lived TLS connection to the IoT host. The socket from the Wi-Fi
+ *  connect is kept open for game traffic instead of being dropped, so the
+ *  ECDHE-RSA handshake is paid once rather than per message. The socket is
+ *  non-blocking with TCP keepalive on; when it fails, the channel
+ *  reconnects in the background with exponential backoff, stepping the
+ *  handshake from tls_channel_poll() so a game tick never waits on it. The
+ *  DNS lookup and socket setup before the handshake do block (a lookup
+ *  after a failed connect always misses the cache), so they wait for
+ *  tls_channel_setup(), which the caller makes outside play.
+ *
+ *  The CC3200 network processor does the TLS itself and exposes no session
+ *  IDs or tickets to the host, so a reconnect is always a full handshake.
+ *  Keeping the channel open is the only way to skip it; the stats compare
+ *  the two costs.
+ */
+
+#ifndef UTILS_TLS_CHANNEL_H_
+#define UTILS_TLS_CHANNEL_H_
+
+#include <stdint.h>
+
+// Simplelink includes
+#include "simplelink.h"
+
+#ifndef TLS_BACKOFF_MIN_MS
+#define TLS_BACKOFF_MIN_MS      1000
+#endif
+#define TLS_BACKOFF_MAX_MS      60000
+#define TLS_HANDSHAKE_TIMEOUT_MS 10000
+
+#define TLS_E_CLOSED            -1      /* Not open, a reconnect may be under way */
+#define TLS_E_IO                -2      /* Send or receive failed, the channel reconnects */
+
+typedef enum {
+    TLS_CLOSED,                 /* Not wanted */
+    TLS_CONNECTING,             /* Handshake under way */
+    TLS_OPEN,
+    TLS_BACKOFF,                /* Waiting to reconnect */
+    TLS_SETUP                   /* Backoff over, waiting for tls_channel_setup() */
+} TlsState;
+
+typedef struct {
+    uint32_t handshakes;
+    uint32_t handshake_ms_total;
+    uint32_t handshake_ms_last;
+    uint32_t failures;          /* Handshakes that failed or timed out */
+    uint32_t drops;             /* Open channels lost to an error or the server closing */
+    uint32_t exchanges;         /* Replies on an open channel */
+    uint32_t reply_ms_total;    /* Send to first reply byte, on an open channel */
+    uint32_t reply_ms_last;
+    uint32_t bytes_sent;
+    uint32_t bytes_received;
+} TlsStats;
+
+typedef struct {
+    TlsState state;
+    int sock;                   /* -1 unless connecting or open */
+    SlSockAddrIn_t addr;
+    uint32_t state_start;       /* ms the current state began */
+    uint32_t backoff_ms;        /* Wait before the next reconnect */
+    uint32_t sent_at;           /* ms of a send still waiting for its reply, 0 if none */
+    TlsStats stats;
+} TlsChannel;
+
+// Open and set up the secure socket to g_Host without connecting it, pAddr
+// is filled with the address. Returns the socket or an error code. In
+// network_utils.c.
+int tls_socket(SlSockAddrIn_t *pAddr);
+
+// Report the result of sl_Connect() on a secure socket, closing it on
+// failure. Returns the socket or the error code.
+int tls_connected(int iSockID, long lRetVal);
+
+// Take over a connected socket, handshake_ms is what connecting it took
+void tls_channel_adopt(TlsChannel *ch, int sock, uint32_t handshake_ms, uint32_t now_ms);
+
+// Step a reconnect, call often, it never waits
+void tls_channel_poll(TlsChannel *ch, uint32_t now_ms);
+
+// Look the host up and open the socket of a reconnect whose backoff is
+// over, which can take as long as a DNS query. Call where a pause doesn't
+// show, like a menu or a download, never between game ticks.
+void tls_channel_setup(TlsChannel *ch, uint32_t now_ms);
+
+// Send what fits without waiting, returns the bytes sent (0 if none fit
+// now) or TLS_E_*
+int tls_channel_send(TlsChannel *ch, const void *data, int len, uint32_t now_ms);
+
+// Receive what has arrived, returns the bytes read (0 if none yet) or TLS_E_*
+int tls_channel_recv(TlsChannel *ch, void *buf, int len, uint32_t now_ms);
+
+// Drop the connection and open a new one at the next poll, for when the
+// server ends the connection after a response or a response is cut short
+void tls_channel_reconnect(TlsChannel *ch, uint32_t now_ms);
+
+// Drop the connection and stop reconnecting
+void tls_channel_close(TlsChannel *ch);
+
+#define tls_channel_open(ch)    ((ch)->state == TLS_OPEN)
+
+#endif /* UTILS_TLS_CHANNEL_H_ */